@@ -41,6 +41,7 @@
 #include "Standalone/standalone.h"
 #include "util.h"
 #include "ticks.h"
+#include "rledelta.h"
 
 #ifdef WITH_LCD
 #include "LCD.h"
@@ -384,6 +385,31 @@ void SendStatus(void) {
     reply_ng(CMD_STATUS, PM3_SUCCESS, NULL, 0);
 }
 
+// flash downloads read this much at once when compressed
+#define FLASH_DOWNLOAD_BLOCK_COMPRESSED 4096
+
+// Sends numofbytes of mem to the client, arg0 of the replies is the offset (from base),
+// arg1 the length. Compressed replies carry rledelta blocks, with DOWNLOAD_COMPRESSED in arg1
+static void SendDownload(uint16_t cmd, uint32_t base, uint8_t *mem, uint32_t numofbytes, uint64_t arg2, bool compressed) {
+    for (size_t i = 0; i < numofbytes;) {
+        int result;
+        size_t len;
+        if (compressed) {
+            uint8_t block[PM3_CMD_DATA_SIZE - 3 * sizeof(uint64_t)];
+            uint32_t consumed = 0;
+            uint32_t blocklen = rledelta_encode(mem + i, numofbytes - i, block, sizeof(block), &consumed);
+            len = consumed;
+            result = reply_mix(cmd, base + i, len | DOWNLOAD_COMPRESSED, arg2, block, blocklen);
+        } else {
+            len = MIN((numofbytes - i), PM3_CMD_DATA_SIZE);
+            result = reply_old(cmd, base + i, len, arg2, mem + i, len);
+        }
+        if (result != PM3_SUCCESS)
+            Dbprintf("transfer to client failed ::  | bytes between %d - %d (%d) | result: %d", base + i, base + i + len, len, result);
+        i += len;
+    }
+}
+
 void SendCapabilities(void) {
     capabilities_t capabilities;
     capabilities.version = CAPABILITIES_VERSION;
@@ -442,8 +468,10 @@ void SendCapabilities(void) {
 #endif
 #ifdef WITH_ISO14443a
     capabilities.compiled_with_iso14443a = true;
+    capabilities.mifare_chkkeys_stream = true;
 #else
     capabilities.compiled_with_iso14443a = false;
+    capabilities.mifare_chkkeys_stream = false;
 #endif
 #ifdef WITH_ISO14443b
     capabilities.compiled_with_iso14443b = true;
@@ -480,6 +508,8 @@ void SendCapabilities(void) {
 #else
     capabilities.compiled_with_lcd = false;
 #endif
+    capabilities.sequenced_frames = true;
+    capabilities.compressed_download = true;
     reply_ng(CMD_CAPABILITIES, PM3_SUCCESS, (uint8_t *)&capabilities, sizeof(capabilities));
 }
 
@@ -1143,6 +1173,10 @@ static void PacketReceived(PacketCommandNG *packet) {
             MifareChkKeys_fast(packet->oldarg[0], packet->oldarg[1], packet->oldarg[2], packet->data.asBytes);
             break;
         }
+        case CMD_HF_MIFARE_CHKKEYS_STREAM: {
+            MifareChkKeys_stream(packet->data.asBytes);
+            break;
+        }
         case CMD_HF_MIFARE_SIMULATE: {
             struct p {
                 uint16_t flags;
@@ -1549,15 +1583,10 @@ static void PacketReceived(PacketCommandNG *packet) {
 
             // arg0 = startindex
             // arg1 = length bytes to transfer
-            // arg2 = BigBuf tracelen
+            // arg2 = BigBuf tracelen, DOWNLOAD_COMPRESSED from the client
             //Dbprintf("transfer to client parameters: %" PRIu32 " | %" PRIu32 " | %" PRIu32, startidx, numofbytes, packet->oldarg[2]);
 
-            for (size_t i = 0; i < numofbytes; i += PM3_CMD_DATA_SIZE) {
-                size_t len = MIN((numofbytes - i), PM3_CMD_DATA_SIZE);
-                int result = reply_old(CMD_DOWNLOADED_BIGBUF, i, len, BigBuf_get_traceLen(), mem + startidx + i, len);
-                if (result != PM3_SUCCESS)
-                    Dbprintf("transfer to client failed ::  | bytes between %d - %d (%d) | result: %d", i, i + len, len, result);
-            }
+            SendDownload(CMD_DOWNLOADED_BIGBUF, 0, mem + startidx, numofbytes, BigBuf_get_traceLen(), packet->oldarg[2] & DOWNLOAD_COMPRESSED);
             // Trigger a finish downloading signal with an ACK frame
             // iceman,  when did sending samplingconfig array got attached here?!?
             // arg0 = status of download transfer
@@ -1609,14 +1638,9 @@ static void PacketReceived(PacketCommandNG *packet) {
 
             // arg0 = startindex
             // arg1 = length bytes to transfer
-            // arg2 = RFU
+            // arg2 = DOWNLOAD_COMPRESSED
 
-            for (size_t i = 0; i < numofbytes; i += PM3_CMD_DATA_SIZE) {
-                size_t len = MIN((numofbytes - i), PM3_CMD_DATA_SIZE);
-                int result = reply_old(CMD_DOWNLOADED_EML_BIGBUF, i, len, 0, mem + startidx + i, len);
-                if (result != PM3_SUCCESS)
-                    Dbprintf("transfer to client failed ::  | bytes between %d - %d (%d) | result: %d", i, i + len, len, result);
-            }
+            SendDownload(CMD_DOWNLOADED_EML_BIGBUF, 0, mem + startidx, numofbytes, 0, packet->oldarg[2] & DOWNLOAD_COMPRESSED);
             // Trigger a finish downloading signal with an ACK frame
             reply_old(CMD_ACK, 1, 0, 0, 0, 0);
             LED_B_OFF();
@@ -1670,14 +1694,9 @@ static void PacketReceived(PacketCommandNG *packet) {
 
             // arg0 = filename
             // arg1 = size
-            // arg2 = RFU
+            // arg2 = DOWNLOAD_COMPRESSED
 
-            for (size_t i = 0; i < size; i += PM3_CMD_DATA_SIZE) {
-                size_t len = MIN((size - i), PM3_CMD_DATA_SIZE);
-                int result = reply_old(CMD_SPIFFS_DOWNLOADED, i, len, 0, buff + i, len);
-                if (result != PM3_SUCCESS)
-                    Dbprintf("transfer to client failed ::  | bytes between %d - %d (%d) | result: %d", i, i + len, len, result);
-            }
+            SendDownload(CMD_SPIFFS_DOWNLOADED, 0, buff, size, 0, packet->oldarg[2] & DOWNLOAD_COMPRESSED);
             // Trigger a finish downloading signal with an ACK frame
             reply_old(CMD_ACK, 1, 0, 0, 0, 0);
             LED_B_OFF();
@@ -1803,7 +1822,7 @@ static void PacketReceived(PacketCommandNG *packet) {
             res = Flash_Write(startidx, data, len);
             isok = (res == len) ? 1 : 0;
 
-            reply_old(CMD_ACK, isok, 0, 0, 0, 0);
+            reply_mix(CMD_ACK, isok, 0, 0, 0, 0);
             LED_B_OFF();
             break;
         }
@@ -1828,27 +1847,29 @@ static void PacketReceived(PacketCommandNG *packet) {
         case CMD_FLASHMEM_DOWNLOAD: {
 
             LED_B_ON();
-            uint8_t *mem = BigBuf_malloc(PM3_CMD_DATA_SIZE);
             uint32_t startidx = packet->oldarg[0];
             uint32_t numofbytes = packet->oldarg[1];
+            bool compressed = packet->oldarg[2] & DOWNLOAD_COMPRESSED;
             // arg0 = startindex
             // arg1 = length bytes to transfer
-            // arg2 = RFU
+            // arg2 = DOWNLOAD_COMPRESSED
+
+            // compressed, read bigger blocks so that runs span several frames
+            size_t blocksize = compressed ? FLASH_DOWNLOAD_BLOCK_COMPRESSED : PM3_CMD_DATA_SIZE;
+            uint8_t *mem = BigBuf_malloc(blocksize);
 
             if (!FlashInit()) {
                 break;
             }
 
-            for (size_t i = 0; i < numofbytes; i += PM3_CMD_DATA_SIZE) {
-                size_t len = MIN((numofbytes - i), PM3_CMD_DATA_SIZE);
+            for (size_t i = 0; i < numofbytes; i += blocksize) {
+                size_t len = MIN((numofbytes - i), blocksize);
                 Flash_CheckBusy(BUSY_TIMEOUT);
                 bool isok = Flash_ReadDataCont(startidx + i, mem, len);
                 if (!isok)
                     Dbprintf("reading flash memory failed ::  | bytes between %d - %d", i, len);
 
-                isok = reply_old(CMD_FLASHMEM_DOWNLOADED, i, len, 0, mem, len);
-                if (isok != 0)
-                    Dbprintf("transfer to client failed ::  | bytes between %d - %d", i, len);
+                SendDownload(CMD_FLASHMEM_DOWNLOADED, i, mem, len, 0, compressed);
             }
             FlashStop();
 
@@ -41,6 +41,9 @@ bool reply_with_crc_on_fpc = true;
 // "Session" flag, to tell via which interface next msgs should be sent: USB or FPC USART
 bool reply_via_fpc = false;
 bool reply_via_usb = false;
+// "Session" sequence number, replies to a sequenced frame are sequenced frames with its number
+bool reply_with_seq = false;
+uint16_t reply_seq = 0;
 
 int reply_old(uint64_t cmd, uint64_t arg0, uint64_t arg1, uint64_t arg2, void *data, size_t len) {
     PacketResponseOLD txcmd;
@@ -84,11 +87,19 @@ int reply_old(uint64_t cmd, uint64_t arg0, uint64_t arg1, uint64_t arg2, void *d
 }
 
 static int reply_ng_internal(uint16_t cmd, int16_t status, uint8_t *data, size_t len, bool ng) {
-    PacketResponseNGRaw txBufferNG;
+    PacketResponseNGSeqRaw txBufferNG;
     size_t txBufferNGLen;
+    size_t header_len = sizeof(PacketResponseNGPreamble);
+    uint8_t *payload = (uint8_t *)&txBufferNG.seq;
 
     // Compose the outgoing command frame
     txBufferNG.pre.magic = RESPONSENG_PREAMBLE_MAGIC;
+    if (reply_with_seq) {
+        txBufferNG.pre.magic = RESPONSENG_SEQ_PREAMBLE_MAGIC;
+        txBufferNG.seq = reply_seq;
+        header_len += sizeof(txBufferNG.seq);
+        payload = txBufferNG.data;
+    }
     txBufferNG.pre.cmd = cmd;
     txBufferNG.pre.status = status;
     txBufferNG.pre.ng = ng;
@@ -102,20 +113,20 @@ static int reply_ng_internal(uint16_t cmd, int16_t status, uint8_t *data, size_t
     // Add the (optional) content to the frame, with a maximum size of PM3_CMD_DATA_SIZE
     if (data && len) {
         for (size_t i = 0; i < len; i++) {
-            txBufferNG.data[i] = data[i];
+            payload[i] = data[i];
         }
     }
 
-    PacketResponseNGPostamble *tx_post = (PacketResponseNGPostamble *)((uint8_t *)&txBufferNG + sizeof(PacketResponseNGPreamble) + len);
+    PacketResponseNGPostamble *tx_post = (PacketResponseNGPostamble *)((uint8_t *)&txBufferNG + header_len + len);
     // Note: if we send to both FPC & USB, we'll set CRC for both if any of them require CRC
     if ((reply_via_fpc && reply_with_crc_on_fpc) || ((reply_via_usb) && reply_with_crc_on_usb)) {
         uint8_t first, second;
-        compute_crc(CRC_14443_A, (uint8_t *)&txBufferNG, sizeof(PacketResponseNGPreamble) + len, &first, &second);
+        compute_crc(CRC_14443_A, (uint8_t *)&txBufferNG, header_len + len, &first, &second);
         tx_post->crc = (first << 8) + second;
     } else {
         tx_post->crc = RESPONSENG_POSTAMBLE_MAGIC;
     }
-    txBufferNGLen = sizeof(PacketResponseNGPreamble) + len + sizeof(PacketResponseNGPostamble);
+    txBufferNGLen = header_len + len + sizeof(PacketResponseNGPostamble);
 
     int resultfpc = PM3_EUNDEF;
     int resultusb = PM3_EUNDEF;
@@ -157,7 +168,7 @@ int reply_mix(uint64_t cmd, uint64_t arg0, uint64_t arg1, uint64_t arg2, void *d
 }
 
 static int receive_ng_internal(PacketCommandNG *rx, uint32_t read_ng(uint8_t *data, size_t len), bool usb, bool fpc) {
-    PacketCommandNGRaw rx_raw;
+    PacketCommandNGSeqRaw rx_raw;
     size_t bytes = read_ng((uint8_t *)&rx_raw.pre, sizeof(PacketCommandNGPreamble));
 
     if (bytes == 0)
@@ -170,46 +181,63 @@ static int receive_ng_internal(PacketCommandNG *rx, uint32_t read_ng(uint8_t *da
     rx->ng = rx_raw.pre.ng;
     uint16_t length = rx_raw.pre.length;
     rx->cmd = rx_raw.pre.cmd;
+    rx->has_seq = false;
+    rx->seq = 0;
 
-    if (rx->magic == COMMANDNG_PREAMBLE_MAGIC) { // New style NG command
+    if (rx->magic == COMMANDNG_PREAMBLE_MAGIC || rx->magic == COMMANDNG_SEQ_PREAMBLE_MAGIC) { // New style NG command
         if (length > PM3_CMD_DATA_SIZE)
             return PM3_EOVFLOW;
 
+        size_t header_len = sizeof(PacketCommandNGPreamble);
+        uint8_t *payload = (uint8_t *)&rx_raw.seq;
+        if (rx->magic == COMMANDNG_SEQ_PREAMBLE_MAGIC) {
+            bytes = read_ng((uint8_t *)&rx_raw.seq, sizeof(rx_raw.seq));
+            if (bytes != sizeof(rx_raw.seq))
+                return PM3_EIO;
+            rx->has_seq = true;
+            rx->seq = rx_raw.seq;
+            header_len += sizeof(rx_raw.seq);
+            payload = rx_raw.data;
+        }
+
         // Get the core and variable length payload
-        bytes = read_ng((uint8_t *)&rx_raw.data, length);
+        bytes = read_ng(payload, length);
         if (bytes != length)
             return PM3_EIO;
 
         if (rx->ng) {
-            memcpy(rx->data.asBytes, rx_raw.data, length);
+            memcpy(rx->data.asBytes, payload, length);
             rx->length = length;
         } else {
             uint64_t arg[3];
             if (length < sizeof(arg))
                 return PM3_EIO;
 
-            memcpy(arg, rx_raw.data, sizeof(arg));
+            memcpy(arg, payload, sizeof(arg));
             rx->oldarg[0] = arg[0];
             rx->oldarg[1] = arg[1];
             rx->oldarg[2] = arg[2];
-            memcpy(rx->data.asBytes, rx_raw.data + sizeof(arg), length - sizeof(arg));
+            memcpy(rx->data.asBytes, payload + sizeof(arg), length - sizeof(arg));
             rx->length = length - sizeof(arg);
         }
         // Get the postamble
-        bytes = read_ng((uint8_t *)&rx_raw.foopost, sizeof(PacketCommandNGPostamble));
+        PacketCommandNGPostamble foopost;
+        bytes = read_ng((uint8_t *)&foopost, sizeof(PacketCommandNGPostamble));
         if (bytes != sizeof(PacketCommandNGPostamble))
             return PM3_EIO;
 
         // Check CRC, accept MAGIC as placeholder
-        rx->crc = rx_raw.foopost.crc;
+        rx->crc = foopost.crc;
         if (rx->crc != COMMANDNG_POSTAMBLE_MAGIC) {
             uint8_t first, second;
-            compute_crc(CRC_14443_A, (uint8_t *)&rx_raw, sizeof(PacketCommandNGPreamble) + length, &first, &second);
+            compute_crc(CRC_14443_A, (uint8_t *)&rx_raw, header_len + length, &first, &second);
             if ((first << 8) + second != rx->crc)
                 return PM3_EIO;
         }
         reply_via_usb = usb;
         reply_via_fpc = fpc;
+        reply_with_seq = rx->has_seq;
+        reply_seq = rx->seq;
     } else {                               // Old style command
         PacketCommandOLD rx_old;
         memcpy(&rx_old, &rx_raw.pre, sizeof(PacketCommandNGPreamble));
@@ -219,6 +247,7 @@ static int receive_ng_internal(PacketCommandNG *rx, uint32_t read_ng(uint8_t *da
 
         reply_via_usb = usb;
         reply_via_fpc = fpc;
+        reply_with_seq = false;
         rx->ng = false;
         rx->magic = 0;
         rx->crc = 0;
@@ -234,8 +263,8 @@ static int receive_ng_internal(PacketCommandNG *rx, uint32_t read_ng(uint8_t *da
 
 int receive_ng(PacketCommandNG *rx) {
 
-    // Check if there is a packet available
-    if (usb_poll_validate_length())
+    // Check if there is a packet available, in the endpoint or left over from the last USB packet
+    if (usb_read_ng_has_buffered_data() || usb_poll_validate_length())
         return receive_ng_internal(rx, usb_read_ng, true, false);
 
 #ifdef WITH_FPC_USART_HOST
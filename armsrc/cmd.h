@@ -42,6 +42,9 @@ extern bool reply_with_crc_on_fpc;
 // "Session" flag, to tell via which interface next msgs should be sent: USB and/or FPC USART
 extern bool reply_via_fpc;
 extern bool reply_via_usb;
+// "Session" sequence number of the command being answered
+extern bool reply_with_seq;
+extern uint16_t reply_seq;
 
 int reply_old(uint64_t cmd, uint64_t arg0, uint64_t arg1, uint64_t arg2, void *data, size_t len);
 int reply_ng(uint16_t cmd, int16_t status, uint8_t *data, size_t len);
@@ -1236,6 +1236,30 @@ void chkKey_loopBonly(struct chk_t *c, struct sector_t *k_sector, uint8_t *found
 
 
 
+// found keys and the found bitmap, 480 + 10 bytes
+// arg1 tells the client the session was ended by the button
+static void chkkeys_fast_reply(uint8_t foundkeys, sector_t *k_sector, uint8_t *found, uint8_t sectorcnt, bool aborted) {
+
+    uint64_t foo = 0;
+    for (uint8_t m = 0; m < 64; m++) {
+        foo |= ((uint64_t)(found[m] & 1) << m);
+    }
+
+    uint16_t bar = 0;
+    uint8_t j = 0;
+    for (uint8_t m = 64; m < 80; m++) {
+        bar |= ((uint16_t)(found[m] & 1) << j++);
+    }
+
+    uint8_t tmp[480 + 10] = {0};
+    memcpy(tmp, k_sector, sectorcnt * sizeof(sector_t));
+    num_to_bytes(foo, 8, tmp + 480);
+    tmp[488] = bar & 0xFF;
+    tmp[489] = bar >> 8 & 0xFF;
+
+    reply_old(CMD_ACK, foundkeys, aborted, 0, tmp, sizeof(tmp));
+}
+
 // get Chunks of keys, to test authentication against card.
 // arg0 = antal sectorer
 // arg0 = first time
@@ -1266,6 +1290,15 @@ void MifareChkKeys_fast(uint32_t arg0, uint32_t arg1, uint32_t arg2, uint8_t *da
     static sector_t k_sector[80];
     static uint8_t found[80];
     static uint8_t *uid;
+    static bool active = false;
+    static bool aborted = false;
+
+    // the client queues the next chunk before it sees the reply which found
+    // the last key or the button abort. Answer it with the result, the field is off already.
+    if (!firstchunk && !active) {
+        chkkeys_fast_reply(foundkeys, k_sector, found, sectorcnt, aborted);
+        return;
+    }
 
 #ifdef WITH_FLASH
     if (use_flashmem) {
@@ -1310,6 +1343,8 @@ void MifareChkKeys_fast(uint32_t arg0, uint32_t arg1, uint32_t arg2, uint8_t *da
         memset(k_sector, 0x00, 480 + 10);
         memset(found, 0x00, sizeof(found));
         foundkeys = 0;
+        active = true;
+        aborted = false;
 
         iso14a_card_select_t card_info;
         if (!iso14443a_select_card(uid, &card_info, &cuid, true, 0, true)) {
@@ -1357,8 +1392,9 @@ void MifareChkKeys_fast(uint32_t arg0, uint32_t arg1, uint32_t arg2, uint8_t *da
 
             for (uint16_t i = s_point; i < keyCount; ++i) {
 
-                // Allow button press / usb cmd to interrupt device
-                if (BUTTON_PRESS() && !data_available()) {
+                // Allow button press to end the session, the queued chunks can't
+                if (BUTTON_PRESS()) {
+                    aborted = true;
                     goto OUT;
                 }
 
@@ -1449,8 +1485,11 @@ void MifareChkKeys_fast(uint32_t arg0, uint32_t arg1, uint32_t arg2, uint8_t *da
         // Keychunk loop
         for (uint16_t i = 0; i < keyCount; i++) {
 
-            // Allow button press / usb cmd to interrupt device
-            if (BUTTON_PRESS() && !data_available()) break;
+            // Allow button press to end the session, the queued chunks can't
+            if (BUTTON_PRESS()) {
+                aborted = true;
+                goto OUT;
+            }
 
             // found all keys?
             if (foundkeys == allkeys)
@@ -1512,27 +1551,14 @@ OUT:
 
     crypto1_deinit(pcs);
 
-    // All keys found, send to client, or last keychunk from client
-    if (foundkeys == allkeys || lastchunk) {
-
-        uint64_t foo = 0;
-        for (uint8_t m = 0; m < 64; m++) {
-            foo |= ((uint64_t)(found[m] & 1) << m);
-        }
-
-        uint16_t bar = 0;
-        uint8_t j = 0;
-        for (uint8_t m = 64; m < ARRAYLEN(found); m++) {
-            bar |= ((uint16_t)(found[m] & 1) << j++);
-        }
+    // keys found so far, after every keychunk. The client has the next chunk
+    // queued already, we pick it up as soon as this reply is out.
+    chkkeys_fast_reply(foundkeys, k_sector, found, sectorcnt, aborted);
 
-        uint8_t *tmp =  BigBuf_malloc(480 + 10);
-        memcpy(tmp, k_sector, sectorcnt * sizeof(sector_t));
-        num_to_bytes(foo, 8, tmp + 480);
-        tmp[488] = bar & 0xFF;
-        tmp[489] = bar >> 8 & 0xFF;
+    // All keys found, last keychunk from client, or button
+    if (foundkeys == allkeys || lastchunk || aborted) {
 
-        reply_old(CMD_ACK, foundkeys, 0, 0, tmp, 480 + 10);
+        active = false;
 
         set_tracing(false);
         FpgaWriteConfWord(FPGA_MAJOR_MODE_OFF);
@@ -1565,9 +1591,6 @@ OUT:
             MifareECardLoad(sectorcnt, 1);
             DBGLEVEL = oldbg;
         }
-    } else {
-        // partial/none keys found
-        reply_mix(CMD_ACK, foundkeys, 0, 0, 0, 0);
     }
 }
 
@@ -1663,6 +1686,108 @@ void MifareChkKeys(uint8_t *datain) {
     crypto1_deinit(pcs);
 }
 
+// Key check spread over several packets, the client sends the next packet while
+// this one is being checked. The field and the card's UID are kept between packets.
+static struct {
+    bool active;
+    bool have_uid;
+    uint8_t uid[10];
+    uint32_t cuid;
+    uint8_t cascade_levels;
+} chkkeys_stream;
+
+void MifareChkKeys_stream(uint8_t *datain) {
+    mf_chkkeys_stream_t *payload = (mf_chkkeys_stream_t *)datain;
+    mf_chkkeys_stream_result_t keyresult;
+    memset(&keyresult, 0, sizeof(keyresult));
+
+    struct Crypto1State mpcs = {0, 0};
+    struct Crypto1State *pcs;
+    pcs = &mpcs;
+
+    if (payload->flags & MF_CHKKEYS_STREAM_FIRST) {
+        FpgaWriteConfWord(FPGA_MAJOR_MODE_OFF);
+        LEDsoff();
+        LED_A_ON();
+
+        iso14443a_setup(FPGA_HF_ISO14443A_READER_LISTEN);
+
+        if (payload->flags & MF_CHKKEYS_STREAM_CLEARTRACE)
+            clear_trace();
+
+        set_tracing(true);
+        chkkeys_stream.active = true;
+        chkkeys_stream.have_uid = false;
+    }
+
+    // the key was found or the check aborted, the packets still in flight are skipped
+    if (!chkkeys_stream.active) {
+        reply_ng(CMD_HF_MIFARE_CHKKEYS_STREAM, PM3_EOPABORTED, (uint8_t *)&keyresult, sizeof(keyresult));
+        return;
+    }
+
+    int status = PM3_SUCCESS;
+    for (int i = 0; i < payload->keycnt; i++) {
+
+        if (BUTTON_PRESS()) {
+            status = PM3_EOPABORTED;
+            break;
+        }
+
+        if (!chkkeys_stream.have_uid) { // need a full select cycle to get the uid first
+            iso14a_card_select_t card_info;
+            if (!iso14443a_select_card(chkkeys_stream.uid, &card_info, &chkkeys_stream.cuid, true, 0, true)) {
+                if (DBGLEVEL >= 1) Dbprintf("ChkKeys: Can't select card (ALL)");
+                --i; // try same key once again
+                continue;
+            }
+            switch (card_info.uidlen) {
+                case 4 :
+                    chkkeys_stream.cascade_levels = 1;
+                    break;
+                case 7 :
+                    chkkeys_stream.cascade_levels = 2;
+                    break;
+                case 10:
+                    chkkeys_stream.cascade_levels = 3;
+                    break;
+                default:
+                    break;
+            }
+            chkkeys_stream.have_uid = true;
+        } else { // no need for anticollision. We can directly select the card
+            if (!iso14443a_select_card(chkkeys_stream.uid, NULL, NULL, false, chkkeys_stream.cascade_levels, true)) {
+                if (DBGLEVEL >= 1) Dbprintf("ChkKeys: Can't select card (UID)");
+                --i; // try same key once again
+                continue;
+            }
+        }
+
+        uint64_t key = bytes_to_num(payload->keys + i * 6, 6);
+        int res = mifare_classic_auth(pcs, chkkeys_stream.cuid, payload->blockno, payload->keytype, key, AUTH_FIRST);
+        keyresult.checked++;
+
+        CHK_TIMEOUT();
+
+        if (res)
+            continue;
+        memcpy(keyresult.key, payload->keys + i * 6, 6);
+        keyresult.found = true;
+        break;
+    }
+
+    reply_ng(CMD_HF_MIFARE_CHKKEYS_STREAM, status, (uint8_t *)&keyresult, sizeof(keyresult));
+    crypto1_deinit(pcs);
+
+    if (keyresult.found || status != PM3_SUCCESS || (payload->flags & MF_CHKKEYS_STREAM_LAST)) {
+        LED_B_ON();
+        FpgaWriteConfWord(FPGA_MAJOR_MODE_OFF);
+        LEDsoff();
+        set_tracing(false);
+        chkkeys_stream.active = false;
+    }
+}
+
 //-----------------------------------------------------------------------------
 // Work with emulator memory
 //
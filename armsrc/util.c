@@ -325,8 +325,8 @@ void FormatVersionInformation(char *dst, int len, const char *prefix, void *vers
 
 bool data_available(void) {
 #ifdef WITH_FPC_USART_HOST
-    return usb_poll_validate_length() || (usart_rxdata_available() > 0);
+    return usb_read_ng_has_buffered_data() || usb_poll_validate_length() || (usart_rxdata_available() > 0);
 #else
-    return usb_poll_validate_length();
+    return usb_read_ng_has_buffered_data() || usb_poll_validate_length();
 #endif
 }
@@ -12,7 +12,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <limits.h>   // for CmdNorm INT_MIN && INT_MAX
-#include <math.h>     // pow
+#include <math.h>     // cos, sin, fabs
 #include <ctype.h>    // tolower
 
 #include "commonutil.h"  // ARRAYLEN
@@ -24,6 +24,7 @@
 #include "loclass/cipherutils.h" // for decimating samples in getsamples
 #include "cmdlfem4x.h" // askem410xdecode
 #include "fileutils.h" // searchFile
+#include "util_posix.h" // msclock
 
 uint8_t DemodBuffer[MAX_DEMOD_BUF_LEN];
 size_t DemodBufferLen = 0;
@@ -211,11 +212,14 @@ static int usage_data_rawdemod_p2(void) {
 }
 static int usage_data_autocorr(void) {
     PrintAndLogEx(NORMAL, "Autocorrelate is used to detect repeating sequences. We use it as detection of length in bits a message inside the signal is");
-    PrintAndLogEx(NORMAL, "Usage: data autocorr w <window> [g]");
+    PrintAndLogEx(NORMAL, "Usage: data autocorr w <window> [d <factor>] [g]");
+    PrintAndLogEx(NORMAL, "       data autocorr b");
     PrintAndLogEx(NORMAL, "Options:");
     PrintAndLogEx(NORMAL, "       h              This help");
-    PrintAndLogEx(NORMAL, "       w <window>     window length for correlation - default = 4000");
+    PrintAndLogEx(NORMAL, "       w <window>     window length for correlation, the samples a lag overlaps at least - default = 4000");
+    PrintAndLogEx(NORMAL, "       d <factor>     decimate the samples by <factor> first, the period is refined at full resolution. ASK / NRZ only");
     PrintAndLogEx(NORMAL, "       g              save back to GraphBuffer (overwrite)");
+    PrintAndLogEx(NORMAL, "       b              benchmark on 40k, 160k and 320k sample traces");
     return PM3_SUCCESS;
 }
 static int usage_data_undecimate(void) {
@@ -333,18 +337,6 @@ static double compute_mean(const int *data, size_t n) {
     return mean;
 }
 
-//  function to compute variance for a series
-static double compute_variance(const int *data, size_t n) {
-    double variance = 0.0;
-    double mean = compute_mean(data, n);
-
-    for (size_t i = 0; i < n; i++)
-        variance += pow((data[i] - mean), 2.0);
-
-    variance /= n;
-    return variance;
-}
-
 // Function to compute autocorrelation for a series
 //  Author: Kenneth J. Christensen
 //  - Corrected divide by n to divide (n - lag) from Tobias Mueller
@@ -519,59 +511,65 @@ static int CmdConvertBitStream(const char *Cmd) {
     return PM3_SUCCESS;
 }
 
-//by marshmellow
-//Cmd Args: Clock, invert, maxErr, maxLen as integers and amplify as char == 'a'
-//   (amp may not be needed anymore)
-//verbose will print results and demoding messages
-//emSearch will auto search for EM410x format in bitstream
-//askType switches decode: ask/raw = 0, ask/manchester = 1
-int ASKDemod_ext(const char *Cmd, bool verbose, bool emSearch, uint8_t askType, bool *stCheck) {
-    int invert = 0;
-    int clk = 0;
-    int maxErr = 100;
-    size_t maxLen = 0;
-    uint8_t askamp = 0;
-    char amp = tolower(param_getchar(Cmd, 0));
-
-    sscanf(Cmd, "%i %i %i %zu %c", &clk, &invert, &maxErr, &maxLen, &amp);
-
-    if (!maxLen) maxLen = BIGBUF_SIZE;
-
-    if (invert != 0 && invert != 1) {
-        PrintAndLogEx(WARNING, "Invalid argument: %s", Cmd);
-        return PM3_EINVARG;
+// runs a demod on the graph samples and makes what it found the DemodBuffer.
+// *out is only set on success, the caller frees it. If the protocol checks
+// failed after the modulation demod, that one is left in DemodBuffer.
+int demodGraph(lf_find_t find, const char *Cmd, lf_demod_t **out) {
+    uint8_t *samples = calloc(MAX_GRAPH_TRACE_LEN, sizeof(uint8_t));
+    lf_demod_t *d = calloc(1, sizeof(lf_demod_t));
+    if (samples == NULL || d == NULL) {
+        free(samples);
+        free(d);
+        return PM3_EMALLOC;
     }
 
-    if (clk == 1) {
-        invert = 1;
-        clk = 0;
+    size_t len = getFromGraphBuf(samples);
+    int res = find(samples, len, Cmd, d);
+    free(samples);
+    if (res != PM3_SUCCESS) {
+        if (d->size) {
+            d->idx = 0;
+            setDemodBuffFrom(d);
+        }
+        free(d);
+        return res;
     }
-    uint8_t *bits = calloc(MAX_GRAPH_TRACE_LEN, sizeof(uint8_t));
-    if (bits == NULL) {
-        return PM3_EMALLOC;
+
+    setDemodBuffFrom(d);
+    *out = d;
+    return PM3_SUCCESS;
+}
+
+void setDemodBuffFrom(const lf_demod_t *d) {
+    setDemodBuff((uint8_t *)d->bits, d->size, d->idx);
+    setClockGrid(d->clock, d->start_idx + (d->idx * d->clock));
+    if (d->st) {
+        CursorCPos = d->ststart;
+        CursorDPos = d->stend;
     }
+}
 
-    size_t BitLen = getFromGraphBuf(bits);
+// ASK demod of a sample snapshot, askType: ask/raw = 0, ask/manchester = 1
+int ASKDemod_buf(const uint8_t *samples, size_t len, int clk, int invert, int maxErr, size_t maxLen, bool amp, uint8_t askType, lf_demod_t *d) {
 
-    PrintAndLogEx(DEBUG, "DEBUG: (ASKDemod_ext) #samples from graphbuff: %zu", BitLen);
+    PrintAndLogEx(DEBUG, "DEBUG: (ASKDemod_ext) #samples from graphbuff: %zu", len);
 
-    if (BitLen < 255) {
-        free(bits);
+    if (len < 255)
         return PM3_ESOFT;
-    }
 
-    if (maxLen < BitLen && maxLen != 0) BitLen = maxLen;
+    if (maxLen == 0) maxLen = BIGBUF_SIZE;
+    size_t BitLen = (maxLen < len) ? maxLen : len;
+    memcpy(d->bits, samples, BitLen);
 
     int foundclk = 0;
 
     //amplify signal before ST check
-    if (amp == 'a') {
-        askAmp(bits, BitLen);
+    if (amp) {
+        askAmp(d->bits, BitLen);
     }
 
     size_t ststart = 0, stend = 0;
-//    if (*stCheck)
-    bool st = DetectST(bits, &BitLen, &foundclk, &ststart, &stend);
+    bool st = DetectST(d->bits, &BitLen, &foundclk, &ststart, &stend);
 
     if (clk == 0) {
         if (foundclk == 32 || foundclk == 64) {
@@ -579,42 +577,114 @@ int ASKDemod_ext(const char *Cmd, bool verbose, bool emSearch, uint8_t askType,
         }
     }
 
-    if (st) {
-        *stCheck = st;
-        CursorCPos = ststart;
-        CursorDPos = stend;
-        if (verbose)
-            PrintAndLogEx(DEBUG, "Found Sequence Terminator - First one is shown by orange / blue graph markers");
-    }
-
     int startIdx = 0;
-    int errCnt = askdemod_ext(bits, &BitLen, &clk, &invert, maxErr, askamp, askType, &startIdx);
+    int errCnt = askdemod_ext(d->bits, &BitLen, &clk, &invert, maxErr, 0, askType, &startIdx);
 
     if (errCnt < 0 || BitLen < 16) { //if fatal error (or -1)
         PrintAndLogEx(DEBUG, "DEBUG: (ASKDemod_ext) No data found errors:%d, invert:%c, bitlen:%zu, clock:%d", errCnt, (invert) ? 'Y' : 'N', BitLen, clk);
-        free(bits);
         return PM3_ESOFT;
     }
 
     if (errCnt > maxErr) {
         PrintAndLogEx(DEBUG, "DEBUG: (ASKDemod_ext) Too many errors found, errors:%d, bits:%zu, clock:%d", errCnt, BitLen, clk);
-        free(bits);
         return PM3_ESOFT;
     }
 
-    if (verbose) PrintAndLogEx(DEBUG, "DEBUG: (ASKDemod_ext) Using clock:%d, invert:%d, bits found:%zu, start index %d", clk, invert, BitLen, startIdx);
+    d->len = d->size = BitLen;
+    d->idx = 0;
+    d->clock = clk;
+    d->start_idx = startIdx;
+    d->invert = invert;
+    d->errors = errCnt;
+    d->st = st;
+    d->ststart = ststart;
+    d->stend = stend;
+    return PM3_SUCCESS;
+}
+
+// <clock> <invert> <maxErr> <maxLen> <amplify>, clock 1 is invert with auto clock
+int getASKDemodArgs(const char *Cmd, int *clk, int *invert, int *maxErr, size_t *maxLen, bool *amp) {
+    *invert = 0;
+    *clk = 0;
+    *maxErr = 100;
+    *maxLen = 0;
+    char a = tolower(param_getchar(Cmd, 0));
+
+    sscanf(Cmd, "%i %i %i %zu %c", clk, invert, maxErr, maxLen, &a);
+    *amp = (a == 'a');
+
+    if (*invert != 0 && *invert != 1)
+        return PM3_EINVARG;
+
+    if (*clk == 1) {
+        *invert = 1;
+        *clk = 0;
+    }
+    return PM3_SUCCESS;
+}
+
+// <clock> <invert> <maxErr> for PSK and NRZ, clock 1 is invert with auto clock
+int getDemodArgs(const char *Cmd, int *clk, int *invert, int *maxErr) {
+    *invert = 0;
+    *clk = 0;
+    *maxErr = 100;
+    sscanf(Cmd, "%i %i %i", clk, invert, maxErr);
+    if (*clk == 1) {
+        *invert = 1;
+        *clk = 0;
+    }
+    return (*invert != 0 && *invert != 1) ? PM3_EINVARG : PM3_SUCCESS;
+}
+
+//by marshmellow
+//Cmd Args: Clock, invert, maxErr, maxLen as integers and amplify as char == 'a'
+//   (amp may not be needed anymore)
+//verbose will print results and demoding messages
+//emSearch will auto search for EM410x format in bitstream
+//askType switches decode: ask/raw = 0, ask/manchester = 1
+int ASKDemod_ext(const char *Cmd, bool verbose, bool emSearch, uint8_t askType, bool *stCheck) {
+    int invert, clk, maxErr;
+    size_t maxLen;
+    bool amp;
+    if (getASKDemodArgs(Cmd, &clk, &invert, &maxErr, &maxLen, &amp) != PM3_SUCCESS) {
+        PrintAndLogEx(WARNING, "Invalid argument: %s", Cmd);
+        return PM3_EINVARG;
+    }
+
+    uint8_t *samples = calloc(MAX_GRAPH_TRACE_LEN, sizeof(uint8_t));
+    lf_demod_t *d = calloc(1, sizeof(lf_demod_t));
+    if (samples == NULL || d == NULL) {
+        free(samples);
+        free(d);
+        return PM3_EMALLOC;
+    }
+
+    size_t len = getFromGraphBuf(samples);
+    int res = ASKDemod_buf(samples, len, clk, invert, maxErr, maxLen, amp, askType, d);
+    free(samples);
+    if (res != PM3_SUCCESS) {
+        free(d);
+        return res;
+    }
+
+    if (d->st) {
+        *stCheck = true;
+        if (verbose)
+            PrintAndLogEx(DEBUG, "Found Sequence Terminator - First one is shown by orange / blue graph markers");
+    }
+
+    if (verbose) PrintAndLogEx(DEBUG, "DEBUG: (ASKDemod_ext) Using clock:%d, invert:%d, bits found:%zu, start index %d", d->clock, d->invert, d->size, d->start_idx);
 
     //output
-    setDemodBuff(bits, BitLen, 0);
-    setClockGrid(clk, startIdx);
+    setDemodBuffFrom(d);
 
     if (verbose) {
-        if (errCnt > 0)
-            PrintAndLogEx(DEBUG, "# Errors during Demoding (shown as 7 in bit stream): %d", errCnt);
+        if (d->errors > 0)
+            PrintAndLogEx(DEBUG, "# Errors during Demoding (shown as 7 in bit stream): %d", d->errors);
         if (askType)
-            PrintAndLogEx(DEBUG, "ASK/Manchester - Clock: %d - Decoded bitstream:", clk);
+            PrintAndLogEx(DEBUG, "ASK/Manchester - Clock: %d - Decoded bitstream:", d->clock);
         else
-            PrintAndLogEx(DEBUG, "ASK/Raw - Clock: %d - Decoded bitstream:", clk);
+            PrintAndLogEx(DEBUG, "ASK/Raw - Clock: %d - Decoded bitstream:", d->clock);
 
         printDemodBuff();
     }
@@ -623,7 +693,7 @@ int ASKDemod_ext(const char *Cmd, bool verbose, bool emSearch, uint8_t askType,
     if (emSearch)
         AskEm410xDecode(true, &hi, &lo);
 
-    free(bits);
+    free(d);
     return PM3_SUCCESS;
 }
 int ASKDemod(const char *Cmd, bool verbose, bool emSearch, uint8_t askType) {
@@ -751,45 +821,73 @@ static int CmdBiphaseDecodeRaw(const char *Cmd) {
     return PM3_SUCCESS;
 }
 
-//by marshmellow
-// - ASK Demod then Biphase decode GraphBuffer samples
-int ASKbiphaseDemod(const char *Cmd, bool verbose) {
-    //ask raw demod GraphBuffer first
-    int offset = 0, clk = 0, invert = 0, maxErr = 50;
-    sscanf(Cmd, "%i %i %i %i", &offset, &clk, &invert, &maxErr);
-
-    uint8_t BitStream[MAX_DEMOD_BUF_LEN];
-    size_t size = getFromGraphBuf(BitStream);
-    if (size == 0) {
+// ASK demod then Biphase decode of a sample snapshot
+int ASKbiphaseDemod_buf(const uint8_t *samples, size_t len, int offset, int clk, int invert, int maxErr, lf_demod_t *d) {
+    if (len == 0) {
         PrintAndLogEx(DEBUG, "DEBUG: no data in graphbuf");
         return PM3_ESOFT;
     }
+    size_t size = len;
+    memcpy(d->bits, samples, size);
+
     int startIdx = 0;
     //invert here inverts the ask raw demoded bits which has no effect on the demod, but we need the pointer
-    int errCnt = askdemod_ext(BitStream, &size, &clk, &invert, maxErr, 0, 0, &startIdx);
+    int errCnt = askdemod_ext(d->bits, &size, &clk, &invert, maxErr, 0, 0, &startIdx);
     if (errCnt < 0 || errCnt > maxErr) {
         PrintAndLogEx(DEBUG, "DEBUG: no data or error found %d, clock: %d", errCnt, clk);
         return PM3_ESOFT;
     }
 
     //attempt to Biphase decode BitStream
-    errCnt = BiphaseRawDecode(BitStream, &size, &offset, invert);
+    errCnt = BiphaseRawDecode(d->bits, &size, &offset, invert);
     if (errCnt < 0) {
-        if (g_debugMode || verbose) PrintAndLogEx(DEBUG, "DEBUG: Error BiphaseRawDecode: %d", errCnt);
+        PrintAndLogEx(DEBUG, "DEBUG: Error BiphaseRawDecode: %d", errCnt);
         return PM3_ESOFT;
     }
     if (errCnt > maxErr) {
-        if (g_debugMode || verbose) PrintAndLogEx(DEBUG, "DEBUG: Error BiphaseRawDecode too many errors: %d", errCnt);
+        PrintAndLogEx(DEBUG, "DEBUG: Error BiphaseRawDecode too many errors: %d", errCnt);
         return PM3_ESOFT;
     }
 
+    d->len = d->size = size;
+    d->idx = 0;
+    d->clock = clk;
+    d->start_idx = startIdx + clk * offset / 2;
+    d->invert = invert;
+    d->errors = errCnt;
+    return PM3_SUCCESS;
+}
+
+//by marshmellow
+// - ASK Demod then Biphase decode GraphBuffer samples
+int ASKbiphaseDemod(const char *Cmd, bool verbose) {
+    //ask raw demod GraphBuffer first
+    int offset = 0, clk = 0, invert = 0, maxErr = 50;
+    sscanf(Cmd, "%i %i %i %i", &offset, &clk, &invert, &maxErr);
+
+    uint8_t *samples = calloc(MAX_GRAPH_TRACE_LEN, sizeof(uint8_t));
+    lf_demod_t *d = calloc(1, sizeof(lf_demod_t));
+    if (samples == NULL || d == NULL) {
+        free(samples);
+        free(d);
+        return PM3_EMALLOC;
+    }
+
+    size_t len = getFromGraphBuf(samples);
+    int res = ASKbiphaseDemod_buf(samples, len, offset, clk, invert, maxErr, d);
+    free(samples);
+    if (res != PM3_SUCCESS) {
+        free(d);
+        return res;
+    }
+
     //success set DemodBuffer and return
-    setDemodBuff(BitStream, size, 0);
-    setClockGrid(clk, startIdx + clk * offset / 2);
+    setDemodBuffFrom(d);
     if (g_debugMode || verbose) {
-        PrintAndLogEx(DEBUG, "Biphase Decoded using offset %d | clock %d | #errors %d | start index %d\ndata\n", offset, clk, errCnt, (startIdx + clk * offset / 2));
+        PrintAndLogEx(DEBUG, "Biphase Decoded using clock %d | #errors %d | start index %d\ndata\n", d->clock, d->errors, d->start_idx);
         printDemodBuff();
     }
+    free(d);
     return PM3_SUCCESS;
 }
 //by marshmellow - see ASKbiphaseDemod
@@ -808,95 +906,298 @@ static int Cmdaskrawdemod(const char *Cmd) {
     return ASKDemod(Cmd, true, false, 0);
 }
 
-int AutoCorrelate(const int *in, int *out, size_t len, size_t window, bool SaveGrph, bool verbose) {
-    // sanity check
-    if (window > len) window = len;
-
-    if (verbose) PrintAndLogEx(INFO, "performing " _YELLOW_("%zu")" correlations", GraphTraceLen - window);
-
-    //test
-    double autocv = 0.0;    // Autocovariance value
-    size_t correlation = 0;
-    int lastmax = 0;
-
-    // in, len, 4000
-    double mean = compute_mean(in, len);
-    // Computed variance
-    double variance = compute_variance(in, len);
-
-    int *correl_buf = calloc(MAX_GRAPH_TRACE_LEN, sizeof(int));
+// in place radix-2 FFT of n = 2^k complex values, the inverse is not scaled by 1/n
+static int fft(double *re, double *im, size_t n, bool inverse) {
+    double *twiddle = malloc(n * sizeof(double));
+    if (twiddle == NULL)
+        return PM3_EMALLOC;
 
-    for (size_t i = 0; i < len - window; ++i) {
+    // cos and sin of the n / 2 roots of unity
+    for (size_t k = 0; k < n / 2; k++) {
+        twiddle[k] = cos(2 * M_PI * k / n);
+        twiddle[n / 2 + k] = (inverse ? 1 : -1) * sin(2 * M_PI * k / n);
+    }
+
+    // bit reversed order
+    for (size_t i = 1, j = 0; i < n; i++) {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+        if (i < j) {
+            double t = re[i];
+            re[i] = re[j];
+            re[j] = t;
+            t = im[i];
+            im[i] = im[j];
+            im[j] = t;
+        }
+    }
 
-        for (size_t j = 0; j < (len - i); j++) {
-            autocv += (in[j] - mean) * (in[j + i] - mean);
+    for (size_t len = 2; len <= n; len <<= 1) {
+        size_t half = len / 2, stride = n / len;
+        for (size_t i = 0; i < n; i += len) {
+            for (size_t k = 0; k < half; k++) {
+                double wr = twiddle[k * stride], wi = twiddle[n / 2 + k * stride];
+                size_t a = i + k, b = i + k + half;
+                double xr = re[b] * wr - im[b] * wi;
+                double xi = re[b] * wi + im[b] * wr;
+                re[b] = re[a] - xr;
+                im[b] = im[a] - xi;
+                re[a] += xr;
+                im[a] += xi;
+            }
         }
-        autocv = (1.0 / (len - i)) * autocv;
+    }
+    free(twiddle);
+    return PM3_SUCCESS;
+}
 
-        correl_buf[i] = autocv;
+// autocovariance of a single lag, O(len)
+static double autocovariance_lag(const int *in, size_t len, double mean, size_t lag) {
+    double autocv = 0.0;
+    for (size_t j = 0; j < len - lag; j++)
+        autocv += (in[j] - mean) * (in[j + lag] - mean);
+    return autocv / (len - lag);
+}
 
-        // Computed autocorrelation value to be returned
-        // Autocorrelation is autocovariance divided by variance
-        double ac_value = autocv / variance;
+// Autocovariance of the lags 0 .. lags - 1 in O(n log n) (Wiener-Khinchin): the inverse FFT of
+// the power spectrum of the signal, zero padded to len + lags so no lag wraps around.
+static int autocovariance(const int *in, size_t len, size_t lags, double *out) {
+    size_t n = 1;
+    while (n < len + lags)
+        n <<= 1;
 
-        // keep track of which distance is repeating.
-        if (ac_value > 1) {
-            correlation = i - lastmax;
-            lastmax = i;
-        }
+    double *re = calloc(n, sizeof(double));
+    double *im = calloc(n, sizeof(double));
+    if (re == NULL || im == NULL) {
+        free(re);
+        free(im);
+        return PM3_EMALLOC;
     }
 
-    //
-    int hi = 0, idx = 0;
-    int distance = 0, hi_1 = 0, idx_1 = 0;
-    for (size_t i = 0; i <= len; ++i) {
-        if (correl_buf[i] > hi) {
-            hi = correl_buf[i];
-            idx = i;
+    double mean = compute_mean(in, len);
+    for (size_t i = 0; i < len; i++)
+        re[i] = in[i] - mean;
+
+    int res = fft(re, im, n, false);
+    if (res == PM3_SUCCESS) {
+        for (size_t i = 0; i < n; i++) {
+            re[i] = re[i] * re[i] + im[i] * im[i];
+            im[i] = 0;
         }
+        res = fft(re, im, n, true);
+    }
+    if (res == PM3_SUCCESS) {
+        for (size_t k = 0; k < lags; k++)
+            out[k] = re[k] / n / (len - k);
     }
+    free(re);
+    free(im);
+    return res;
+}
+
+// Lag where the signal repeats. Once the central peak at lag 0 has fallen off, the first
+// peak reaching 90% of the highest one, its multiples are about as high. 0 if none.
+static size_t autocorrelation_period(const double *autocv, size_t lags) {
+    size_t start = 1;
+    while (start < lags && autocv[start] > 0)
+        start++;
 
-    for (size_t i = idx + 1; i <= window; ++i) {
-        if (correl_buf[i] > hi_1) {
-            hi_1 = correl_buf[i];
-            idx_1 = i;
+    double hi = 0;
+    for (size_t i = start; i < lags; i++)
+        hi = MAX(hi, autocv[i]);
+    if (hi <= 0)
+        return 0;
+
+    size_t i = start;
+    while (autocv[i] < 0.9 * hi)
+        i++;
+    // top of that peak
+    while (i + 1 < lags && autocv[i + 1] > autocv[i])
+        i++;
+    return i;
+}
+
+// Autocorrelation by FFT, the lags with at least window samples overlapping. Decimated, the
+// samples are summed in groups of decimation first and the period is refined at full resolution.
+// That suits ASK and NRZ, the carrier of FSK and PSK is averaged away.
+// Returns the period in samples, 0 if the signal doesn't repeat.
+int AutoCorrelate_ext(const int *in, int *out, size_t len, size_t window, size_t decimation, bool SaveGrph, bool verbose) {
+    // sanity check
+    if (window > len) window = len;
+    if (decimation == 0) decimation = 1;
+
+    size_t lags = len - window;
+    size_t dlen = len / decimation;
+    size_t dlags = lags / decimation;
+    if (dlags < 2) {
+        if (verbose) PrintAndLogEx(FAILED, "no repeating pattern found, try decreasing window size");
+        return 0;
+    }
+
+    if (verbose) PrintAndLogEx(INFO, "performing " _YELLOW_("%zu")" correlations%s", lags, (decimation > 1) ? ", decimated" : "");
+
+    const int *samples = in;
+    int *decimated = NULL;
+    if (decimation > 1) {
+        decimated = calloc(dlen, sizeof(int));
+        if (decimated == NULL)
+            return 0;
+        for (size_t i = 0; i < dlen; i++)
+            for (size_t j = 0; j < decimation; j++)
+                decimated[i] += in[i * decimation + j];
+        samples = decimated;
+    }
+
+    double *autocv = calloc(dlags, sizeof(double));
+    if (autocv == NULL || autocovariance(samples, dlen, dlags, autocv) != PM3_SUCCESS) {
+        PrintAndLogEx(ERR, "Fail, cannot allocate memory");
+        free(autocv);
+        free(decimated);
+        return 0;
+    }
+    free(decimated);
+
+    size_t period = autocorrelation_period(autocv, dlags);
+    double variance = autocv[0];
+    double peak = autocv[period];
+
+    // the best lag around the decimated one, against the variance of all samples
+    if (decimation > 1) {
+        double mean = compute_mean(in, len);
+        variance = autocovariance_lag(in, len, mean, 0);
+        if (period) {
+            size_t lo = (period - 1) * decimation, hi = MIN((period + 1) * decimation, lags - 1);
+            period = 0;
+            peak = 0;
+            for (size_t lag = lo; lag <= hi; lag++) {
+                double autocv_lag = autocovariance_lag(in, len, mean, lag);
+                if (autocv_lag > peak) {
+                    peak = autocv_lag;
+                    period = lag;
+                }
+            }
         }
     }
 
-    int foo = ABS(hi - hi_1);
-    int bar = (int)((int)((hi + hi_1) / 2) * 0.04);
-
-    if (verbose && foo < bar) {
-        distance = idx_1 - idx;
-        PrintAndLogEx(SUCCESS, "possible visible correlation %4d samples", distance);
-    } else if (verbose && (correlation > 1)) {
-        PrintAndLogEx(SUCCESS, "possible correlation %4zu samples", correlation);
+    // Autocorrelation is autocovariance divided by variance
+    double ac_value = (variance > 0) ? peak / variance : 0;
+
+    int retval = 0;
+    if (period && ac_value >= 0.5) {
+        retval = period;
+        if (verbose) PrintAndLogEx(SUCCESS, "possible visible correlation %4zu samples", period);
+    } else if (period && ac_value >= 0.2) {
+        retval = period;
+        if (verbose) PrintAndLogEx(SUCCESS, "possible correlation %4zu samples", period);
     } else {
-        PrintAndLogEx(FAILED, "no repeating pattern found, try increasing window size");
+        if (verbose) PrintAndLogEx(FAILED, "no repeating pattern found, try increasing window size");
     }
+    if (verbose && retval) PrintAndLogEx(INFO, "autocorrelation at that lag " _YELLOW_("%.2f"), ac_value);
 
-    int retval = correlation;
     if (SaveGrph) {
-        //GraphTraceLen = GraphTraceLen - window;
-        memcpy(out, correl_buf, len * sizeof(int));
-        if (distance > 0) {
-            setClockGrid(distance, idx);
-            retval = distance;
-        } else
-            setClockGrid(correlation, idx);
-
-        CursorCPos = idx_1;
-        CursorDPos = idx_1 + retval;
+        for (size_t i = 0; i < len; i++)
+            out[i] = (i < dlags * decimation) ? autocv[i / decimation] / (decimation * decimation) : 0;
+        setClockGrid(retval, 0);
+        CursorCPos = retval;
+        CursorDPos = retval * 2;
         DemodBufferLen = 0;
         RepaintGraphWindow();
     }
-    free(correl_buf);
+    free(autocv);
     return retval;
 }
 
+int AutoCorrelate(const int *in, int *out, size_t len, size_t window, bool SaveGrph, bool verbose) {
+    return AutoCorrelate_ext(in, out, len, window, 1, SaveGrph, verbose);
+}
+
+// O(n^2) autocorrelation the FFT replaced, extrapolated from the lags done in about a second
+static double autocorr_direct_ms(const int *in, size_t len, size_t lags, bool *estimated) {
+    double mean = compute_mean(in, len);
+    size_t lag = 0;
+    volatile double sink = 0;
+    uint64_t t1 = msclock();
+    for (; lag < lags && msclock() - t1 < 1000; lag++)
+        sink += autocovariance_lag(in, len, mean, lag);
+    uint64_t ms = msclock() - t1;
+    (void)sink;
+    *estimated = (lag < lags);
+
+    // the lags are the shorter the longer, per lag the work is len - lag
+    double done = (double)lag * len - (double)lag * lag / 2;
+    double all = (double)lags * len - (double)lags * lags / 2;
+    return ms * all / done;
+}
+
+static int autocorr_benchmark(void) {
+    const size_t sizes[] = {40000, 160000, 320000};
+    const size_t window = 8000, period = 2048, decimation = 8;
+
+    int *trace = calloc(MAX_GRAPH_TRACE_LEN, sizeof(int));
+    if (trace == NULL) {
+        PrintAndLogEx(ERR, "Fail, cannot allocate memory");
+        return PM3_EMALLOC;
+    }
+
+    // an ASK tag at RF/32, 64 bits repeating, with noise
+    srand(0x1337);
+    uint64_t bits = ((uint64_t)rand() << 32) ^ rand();
+    for (size_t i = 0; i < MAX_GRAPH_TRACE_LEN; i++) {
+        int bit = (bits >> ((i % period) / 32)) & 1;
+        trace[i] = (bit ? 90 : -90) + rand() % 61 - 30;
+    }
+
+    PrintAndLogEx(INFO, "Autocorrelation of a signal repeating every %zu samples, window %zu", period, window);
+    PrintAndLogEx(NORMAL, "");
+    PrintAndLogEx(NORMAL, "   samples      O(n^2) ms      FFT ms   FFT / %zu ms   period", decimation);
+    PrintAndLogEx(NORMAL, "  ---------+--------------+-----------+-------------+--------");
+
+    int res = PM3_SUCCESS;
+    for (size_t s = 0; s < ARRAYLEN(sizes); s++) {
+        size_t len = sizes[s];
+
+        uint64_t t1 = msclock();
+        int found = AutoCorrelate_ext(trace, NULL, len, window, 1, false, false);
+        uint64_t ms_fft = msclock() - t1;
+
+        t1 = msclock();
+        int found_dec = AutoCorrelate_ext(trace, NULL, len, window, decimation, false, false);
+        uint64_t ms_dec = msclock() - t1;
+
+        bool estimated;
+        double ms_direct = autocorr_direct_ms(trace, len, len - window, &estimated);
+
+        PrintAndLogEx(NORMAL, "  %8zu | %s%11.0f | %9" PRIu64 " | %11" PRIu64 " | %3d %3d",
+                      len, (estimated ? "~" : " "), ms_direct, ms_fft, ms_dec, found, found_dec);
+        if (found != period || found_dec != period)
+            res = PM3_ESOFT;
+    }
+    PrintAndLogEx(NORMAL, "");
+    PrintAndLogEx(INFO, "~ extrapolated from the lags done in a second");
+
+    // the FFT against the direct sums, a few lags
+    double mean = compute_mean(trace, sizes[0]);
+    double *autocv = calloc(sizes[0], sizeof(double));
+    if (autocv && autocovariance(trace, sizes[0], sizes[0] - window, autocv) == PM3_SUCCESS) {
+        double err = 0;
+        for (size_t lag = 0; lag < sizes[0] - window; lag += 997)
+            err = MAX(err, fabs(autocv[lag] - autocovariance_lag(trace, sizes[0], mean, lag)) / autocv[0]);
+        PrintAndLogEx(INFO, "largest difference to the direct sums %.1e of the variance", err);
+    }
+    free(autocv);
+    free(trace);
+
+    if (res != PM3_SUCCESS)
+        PrintAndLogEx(FAILED, "period not found");
+    return res;
+}
+
 static int CmdAutoCorr(const char *Cmd) {
 
     uint32_t window = 4000;
+    uint32_t decimation = 1;
     uint8_t cmdp = 0;
     bool updateGrph = false;
     bool errors = false;
@@ -905,10 +1206,20 @@ static int CmdAutoCorr(const char *Cmd) {
         switch (tolower(param_getchar(Cmd, cmdp))) {
             case 'h':
                 return usage_data_autocorr();
+            case 'b':
+                return autocorr_benchmark();
             case 'g':
                 updateGrph = true;
                 cmdp++;
                 break;
+            case 'd':
+                decimation = param_get32ex(Cmd, cmdp + 1, 1, 10);
+                if (decimation == 0) {
+                    PrintAndLogEx(WARNING, "decimation factor must be at least 1");
+                    errors = true;
+                }
+                cmdp += 2;
+                break;
             case 'w':
                 window = param_get32ex(Cmd, cmdp + 1, 4000, 10);
                 if (window >= GraphTraceLen) {
@@ -926,7 +1237,7 @@ static int CmdAutoCorr(const char *Cmd) {
     //Validations
     if (errors || cmdp == 0) return usage_data_autocorr();
 
-    AutoCorrelate(GraphBuffer, GraphBuffer, GraphTraceLen, window, updateGrph, true);
+    AutoCorrelate_ext(GraphBuffer, GraphBuffer, GraphTraceLen, window, decimation, updateGrph, true);
 
     return PM3_SUCCESS;
 }
@@ -1190,107 +1501,124 @@ static int CmdFSKrawdemod(const char *Cmd) {
     return FSKrawDemod(Cmd, true);
 }
 
-//by marshmellow
-//attempt to psk1 demod graph buffer
-int PSKDemod(const char *Cmd, bool verbose) {
-    int invert = 0, clk = 0, maxErr = 100;
-
-    sscanf(Cmd, "%i %i %i", &clk, &invert, &maxErr);
-
-    if (clk == 1) {
-        invert = 1;
-        clk = 0;
-    }
-    if (invert != 0 && invert != 1) {
-        if (g_debugMode || verbose) PrintAndLogEx(WARNING, "Invalid argument: %s", Cmd);
-        return PM3_EINVARG;
-    }
+// psk1 demod of a sample snapshot
+int PSKDemod_buf(const uint8_t *samples, size_t len, int clk, int invert, int maxErr, lf_demod_t *d) {
 
     if (getSignalProperties()->isnoise)
         return PM3_ESOFT;
 
-    uint8_t *bits = calloc(MAX_GRAPH_TRACE_LEN, sizeof(uint8_t));
-    if (bits == NULL) {
-        return PM3_EMALLOC;
-    }
-    size_t bitlen = getFromGraphBuf(bits);
-    if (bitlen == 0) {
-        free(bits);
+    if (len == 0)
         return PM3_ESOFT;
-    }
+
+    size_t bitlen = len;
+    memcpy(d->bits, samples, bitlen);
 
     int startIdx = 0;
-    int errCnt = pskRawDemod_ext(bits, &bitlen, &clk, &invert, &startIdx);
+    int errCnt = pskRawDemod_ext(d->bits, &bitlen, &clk, &invert, &startIdx);
     if (errCnt > maxErr) {
-        if (g_debugMode || verbose) PrintAndLogEx(DEBUG, "DEBUG: (PSKdemod) Too many errors found, clk: %d, invert: %d, numbits: %zu, errCnt: %d", clk, invert, bitlen, errCnt);
-        free(bits);
+        PrintAndLogEx(DEBUG, "DEBUG: (PSKdemod) Too many errors found, clk: %d, invert: %d, numbits: %zu, errCnt: %d", clk, invert, bitlen, errCnt);
         return PM3_ESOFT;
     }
     if (errCnt < 0 || bitlen < 16) { //throw away static - allow 1 and -1 (in case of threshold command first)
-        if (g_debugMode || verbose) PrintAndLogEx(DEBUG, "DEBUG: (PSKdemod) no data found, clk: %d, invert: %d, numbits: %zu, errCnt: %d", clk, invert, bitlen, errCnt);
-        free(bits);
+        PrintAndLogEx(DEBUG, "DEBUG: (PSKdemod) no data found, clk: %d, invert: %d, numbits: %zu, errCnt: %d", clk, invert, bitlen, errCnt);
         return PM3_ESOFT;
     }
+
+    d->len = d->size = bitlen;
+    d->idx = 0;
+    d->clock = clk;
+    d->start_idx = startIdx;
+    d->invert = invert;
+    d->errors = errCnt;
+    return PM3_SUCCESS;
+}
+
+//by marshmellow
+//attempt to psk1 demod graph buffer
+int PSKDemod(const char *Cmd, bool verbose) {
+    int invert, clk, maxErr;
+    if (getDemodArgs(Cmd, &clk, &invert, &maxErr) != PM3_SUCCESS) {
+        if (g_debugMode || verbose) PrintAndLogEx(WARNING, "Invalid argument: %s", Cmd);
+        return PM3_EINVARG;
+    }
+
+    uint8_t *samples = calloc(MAX_GRAPH_TRACE_LEN, sizeof(uint8_t));
+    lf_demod_t *d = calloc(1, sizeof(lf_demod_t));
+    if (samples == NULL || d == NULL) {
+        free(samples);
+        free(d);
+        return PM3_EMALLOC;
+    }
+
+    size_t len = getFromGraphBuf(samples);
+    int res = PSKDemod_buf(samples, len, clk, invert, maxErr, d);
+    free(samples);
+    if (res != PM3_SUCCESS) {
+        free(d);
+        return res;
+    }
+
     if (verbose || g_debugMode) {
-        PrintAndLogEx(DEBUG, "DEBUG: (PSKdemod) Using Clock:%d, invert:%d, Bits Found:%zu", clk, invert, bitlen);
-        if (errCnt > 0) {
-            PrintAndLogEx(DEBUG, "DEBUG: (PSKdemod) errors during Demoding (shown as 7 in bit stream): %d", errCnt);
+        PrintAndLogEx(DEBUG, "DEBUG: (PSKdemod) Using Clock:%d, invert:%d, Bits Found:%zu", d->clock, d->invert, d->size);
+        if (d->errors > 0) {
+            PrintAndLogEx(DEBUG, "DEBUG: (PSKdemod) errors during Demoding (shown as 7 in bit stream): %d", d->errors);
         }
     }
     //prime demod buffer for output
-    setDemodBuff(bits, bitlen, 0);
-    setClockGrid(clk, startIdx);
-    free(bits);
+    setDemodBuffFrom(d);
+    free(d);
     return PM3_SUCCESS;
 }
 
-static int CmdIdteckDemod(const char *Cmd) {
+static void printIdteckError(int idx, size_t size) {
+    if (idx == -1)
+        PrintAndLogEx(DEBUG, "DEBUG: Error - Idteck: not enough samples");
+    else if (idx == -2)
+        PrintAndLogEx(DEBUG, "DEBUG: Error - Idteck: just noise");
+    else if (idx == -3)
+        PrintAndLogEx(DEBUG, "DEBUG: Error - Idteck: preamble not found");
+    else if (idx == -4)
+        PrintAndLogEx(DEBUG, "DEBUG: Error - Idteck: size not correct: %zu", size);
+    else
+        PrintAndLogEx(DEBUG, "DEBUG: Error - Idteck: idx: %d", idx);
+}
+
+int demodIdteck_buf(const uint8_t *samples, size_t len, const char *Cmd, lf_demod_t *d) {
     (void)Cmd; // Cmd is not used so far
 
-    if (PSKDemod("", false) != PM3_SUCCESS) {
+    if (PSKDemod_buf(samples, len, 0, 0, 100, d) != PM3_SUCCESS) {
         PrintAndLogEx(DEBUG, "DEBUG: Error - Idteck PSKDemod failed");
         return PM3_ESOFT;
     }
-    size_t size = DemodBufferLen;
+    size_t size = d->size;
 
     //get binary from PSK1 wave
-    int idx = detectIdteck(DemodBuffer, &size);
+    int idx = detectIdteck(d->bits, &size);
     if (idx < 0) {
-
-        if (idx == -1)
-            PrintAndLogEx(DEBUG, "DEBUG: Error - Idteck: not enough samples");
-        else if (idx == -2)
-            PrintAndLogEx(DEBUG, "DEBUG: Error - Idteck: just noise");
-        else if (idx == -3)
-            PrintAndLogEx(DEBUG, "DEBUG: Error - Idteck: preamble not found");
-        else if (idx == -4)
-            PrintAndLogEx(DEBUG, "DEBUG: Error - Idteck: size not correct: %zu", size);
-        else
-            PrintAndLogEx(DEBUG, "DEBUG: Error - Idteck: idx: %d", idx);
+        printIdteckError(idx, size);
 
         // if didn't find preamble try again inverting
-        if (PSKDemod("1", false) != PM3_SUCCESS) {
+        if (PSKDemod_buf(samples, len, 0, 1, 100, d) != PM3_SUCCESS) {
             PrintAndLogEx(DEBUG, "DEBUG: Error - Idteck PSKDemod failed");
             return PM3_ESOFT;
         }
-        idx = detectIdteck(DemodBuffer, &size);
+        idx = detectIdteck(d->bits, &size);
         if (idx < 0) {
-
-            if (idx == -1)
-                PrintAndLogEx(DEBUG, "DEBUG: Error - Idteck: not enough samples");
-            else if (idx == -2)
-                PrintAndLogEx(DEBUG, "DEBUG: Error - Idteck: just noise");
-            else if (idx == -3)
-                PrintAndLogEx(DEBUG, "DEBUG: Error - Idteck: preamble not found");
-            else if (idx == -4)
-                PrintAndLogEx(DEBUG, "DEBUG: Error - Idteck: size not correct: %zu", size);
-            else
-                PrintAndLogEx(DEBUG, "DEBUG: Error - Idteck: idx: %d", idx);
-
+            printIdteckError(idx, size);
             return PM3_ESOFT;
         }
     }
-    setDemodBuff(DemodBuffer, 64, idx);
+    d->idx = idx;
+    d->size = 64;
+    return PM3_SUCCESS;
+}
+
+static int CmdIdteckDemod(const char *Cmd) {
+
+    lf_demod_t *d = NULL;
+    if (demodGraph(demodIdteck_buf, Cmd, &d) != PM3_SUCCESS)
+        return PM3_ESOFT;
+    free(d);
 
     //got a good demod
     uint32_t id = 0;
@@ -1310,66 +1638,78 @@ int demodIdteck(void) {
 }
 
 
-// by marshmellow
-// takes 3 arguments - clock, invert, maxErr as integers
-// attempts to demodulate nrz only
-// prints binary found and saves in demodbuffer for further commands
-int NRZrawDemod(const char *Cmd, bool verbose) {
-
-    int errCnt = 0, clkStartIdx = 0;
-    int invert = 0, clk = 0, maxErr = 100;
-    sscanf(Cmd, "%i %i %i", &clk, &invert, &maxErr);
-    if (clk == 1) {
-        invert = 1;
-        clk = 0;
-    }
-
-    if (invert != 0 && invert != 1) {
-        PrintAndLogEx(WARNING, "(NRZrawDemod) Invalid argument: %s", Cmd);
-        return PM3_EINVARG;
-    }
+// nrz demod of a sample snapshot
+int NRZrawDemod_buf(const uint8_t *samples, size_t len, int clk, int invert, int maxErr, lf_demod_t *d) {
 
     if (getSignalProperties()->isnoise)
         return PM3_ESOFT;
 
-    uint8_t *bits = calloc(MAX_GRAPH_TRACE_LEN, sizeof(uint8_t));
-    if (bits == NULL) {
-        return PM3_EMALLOC;
-    }
-
-    size_t BitLen = getFromGraphBuf(bits);
-
-    if (BitLen == 0) {
-        free(bits);
+    if (len == 0)
         return PM3_ESOFT;
-    }
 
-    errCnt = nrzRawDemod(bits, &BitLen, &clk, &invert, &clkStartIdx);
+    size_t BitLen = len;
+    memcpy(d->bits, samples, BitLen);
+
+    int clkStartIdx = 0;
+    int errCnt = nrzRawDemod(d->bits, &BitLen, &clk, &invert, &clkStartIdx);
     if (errCnt > maxErr) {
         PrintAndLogEx(DEBUG, "DEBUG: (NRZrawDemod) Too many errors found, clk: %d, invert: %d, numbits: %zu, errCnt: %d", clk, invert, BitLen, errCnt);
-        free(bits);
         return PM3_ESOFT;
     }
     if (errCnt < 0 || BitLen < 16) { //throw away static - allow 1 and -1 (in case of threshold command first)
         PrintAndLogEx(DEBUG, "DEBUG: (NRZrawDemod) no data found, clk: %d, invert: %d, numbits: %zu, errCnt: %d", clk, invert, BitLen, errCnt);
-        free(bits);
         return PM3_ESOFT;
     }
 
-    if (verbose || g_debugMode) PrintAndLogEx(DEBUG, "DEBUG: (NRZrawDemod) Tried NRZ Demod using Clock: %d - invert: %d - Bits Found: %zu", clk, invert, BitLen);
-    //prime demod buffer for output
-    setDemodBuff(bits, BitLen, 0);
-    setClockGrid(clk, clkStartIdx);
+    d->len = d->size = BitLen;
+    d->idx = 0;
+    d->clock = clk;
+    d->start_idx = clkStartIdx;
+    d->invert = invert;
+    d->errors = errCnt;
+    return PM3_SUCCESS;
+}
 
+// by marshmellow
+// takes 3 arguments - clock, invert, maxErr as integers
+// attempts to demodulate nrz only
+// prints binary found and saves in demodbuffer for further commands
+int NRZrawDemod(const char *Cmd, bool verbose) {
+
+    int invert, clk, maxErr;
+    if (getDemodArgs(Cmd, &clk, &invert, &maxErr) != PM3_SUCCESS) {
+        PrintAndLogEx(WARNING, "(NRZrawDemod) Invalid argument: %s", Cmd);
+        return PM3_EINVARG;
+    }
 
-    if (errCnt > 0 && (verbose || g_debugMode)) PrintAndLogEx(DEBUG, "DEBUG: (NRZrawDemod) Errors during Demoding (shown as 7 in bit stream): %d", errCnt);
+    uint8_t *samples = calloc(MAX_GRAPH_TRACE_LEN, sizeof(uint8_t));
+    lf_demod_t *d = calloc(1, sizeof(lf_demod_t));
+    if (samples == NULL || d == NULL) {
+        free(samples);
+        free(d);
+        return PM3_EMALLOC;
+    }
+
+    size_t len = getFromGraphBuf(samples);
+    int res = NRZrawDemod_buf(samples, len, clk, invert, maxErr, d);
+    free(samples);
+    if (res != PM3_SUCCESS) {
+        free(d);
+        return res;
+    }
+
+    if (verbose || g_debugMode) PrintAndLogEx(DEBUG, "DEBUG: (NRZrawDemod) Tried NRZ Demod using Clock: %d - invert: %d - Bits Found: %zu", d->clock, d->invert, d->size);
+    //prime demod buffer for output
+    setDemodBuffFrom(d);
+
+    if (d->errors > 0 && (verbose || g_debugMode)) PrintAndLogEx(DEBUG, "DEBUG: (NRZrawDemod) Errors during Demoding (shown as 7 in bit stream): %d", d->errors);
     if (verbose || g_debugMode) {
         PrintAndLogEx(NORMAL, "NRZ demoded bitstream:");
         // Now output the bitstream to the scrollback by line of 16 bits
         printDemodBuff();
     }
 
-    free(bits);
+    free(d);
     return PM3_SUCCESS;
 }
 
@@ -2244,7 +2584,7 @@ static int CmdDataIIR(const char *Cmd) {
 static command_t CommandTable[] = {
     {"help",            CmdHelp,                 AlwaysAvailable, "This help"},
     {"askedgedetect",   CmdAskEdgeDetect,        AlwaysAvailable, "[threshold] Adjust Graph for manual ASK demod using the length of sample differences to detect the edge of a wave (use 20-45, def:25)"},
-    {"autocorr",        CmdAutoCorr,             AlwaysAvailable, "[window length] [g] -- Autocorrelation over window - g to save back to GraphBuffer (overwrite)"},
+    {"autocorr",        CmdAutoCorr,             AlwaysAvailable, "[window length] [d <factor>] [g] -- Autocorrelation over window - g to save back to GraphBuffer (overwrite)"},
     {"biphaserawdecode", CmdBiphaseDecodeRaw,    AlwaysAvailable, "[offset] [invert<0|1>] [maxErr] -- Biphase decode bin stream in DemodBuffer (offset = 0|1 bits to shift the decode start)"},
     {"bin2hex",         Cmdbin2hex,              AlwaysAvailable, "<digits> -- Converts binary to hexadecimal"},
     {"bitsamples",      CmdBitsamples,           IfPm3Present,    "Get raw samples as bitstring"},
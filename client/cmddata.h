@@ -12,9 +12,32 @@
 #define CMDDATA_H__
 
 #include "common.h"
+#include "graph.h"  // MAX_GRAPH_TRACE_LEN
 
 //#include <stdlib.h>  //size_t
 
+// A demodulation of a copy of the graph samples. The *_buf demods fill one
+// without touching DemodBuffer, the clock grid or the samples, so several can
+// run side by side on one snapshot (lf search). setDemodBuffFrom() makes the
+// frame bits[idx..idx+size] the DemodBuffer, like the GraphBuffer demods do.
+typedef struct {
+    uint8_t bits[MAX_GRAPH_TRACE_LEN];
+    size_t len;             // bits[] filled, the FSK demods leave samples past their bits
+    size_t idx;             // frame found in bits
+    size_t size;
+    int clock;
+    int start_idx;          // sample of bits[0], for the clock grid
+    int invert;
+    int errors;
+    bool st;                // ASK sequence terminator, at samples ststart..stend
+    size_t ststart;
+    size_t stend;
+    uint32_t raw[4];        // decoded words a protocol demod keeps for its output
+} lf_demod_t;
+
+// a protocol demod on a sample snapshot, Cmd as for its demod command
+typedef int (*lf_find_t)(const uint8_t *samples, size_t len, const char *Cmd, lf_demod_t *d);
+
 int CmdData(const char *Cmd);
 
 // Still quite work to do here to provide proper functions for internal usage...
@@ -62,17 +85,28 @@ int FSKrawDemod(const char *Cmd, bool verbose);
 int PSKDemod(const char *Cmd, bool verbose);                                                    // used by cmd lf em4x, lf indala, lf keri, lf nexwatch, lf t55xx
 int NRZrawDemod(const char *Cmd, bool verbose);                                                 // used by cmd lf pac, lf t55xx
 
+int getASKDemodArgs(const char *Cmd, int *clk, int *invert, int *maxErr, size_t *maxLen, bool *amp);
+int getDemodArgs(const char *Cmd, int *clk, int *invert, int *maxErr);
+int ASKDemod_buf(const uint8_t *samples, size_t len, int clk, int invert, int maxErr, size_t maxLen, bool amp, uint8_t askType, lf_demod_t *d);
+int ASKbiphaseDemod_buf(const uint8_t *samples, size_t len, int offset, int clk, int invert, int maxErr, lf_demod_t *d);
+int PSKDemod_buf(const uint8_t *samples, size_t len, int clk, int invert, int maxErr, lf_demod_t *d);
+int NRZrawDemod_buf(const uint8_t *samples, size_t len, int clk, int invert, int maxErr, lf_demod_t *d);
+int demodGraph(lf_find_t find, const char *Cmd, lf_demod_t **out);
+void setDemodBuffFrom(const lf_demod_t *d);
+
 
 void printDemodBuff(void);
 void setDemodBuff(uint8_t *buff, size_t size, size_t start_idx);
 bool getDemodBuff(uint8_t *buff, size_t *size);
 void save_restoreDB(uint8_t saveOpt);// option '1' to save DemodBuffer any other to restore
 int AutoCorrelate(const int *in, int *out, size_t len, size_t window, bool SaveGrph, bool verbose);
+int AutoCorrelate_ext(const int *in, int *out, size_t len, size_t window, size_t decimation, bool SaveGrph, bool verbose);
 int getSamples(uint32_t n, bool silent);
 void setClockGrid(uint32_t clk, int offset);
 int directionalThreshold(const int *in, int *out, size_t len, int8_t up, int8_t down);
 int AskEdgeDetect(const int *in, int *out, int len, int threshold);
 int demodIdteck(void);
+int demodIdteck_buf(const uint8_t *samples, size_t len, const char *Cmd, lf_demod_t *d);
 
 #define MAX_DEMOD_BUF_LEN (1024*128)
 #define BIGBUF_SIZE 40000
@@ -121,6 +121,29 @@ static int CmdFlashmemSpiBaudrate(const char *Cmd) {
     return PM3_SUCCESS;
 }
 
+typedef struct {
+    uint8_t *data;
+    size_t datalen;
+    uint32_t start_index;
+} flashmem_load_t;
+
+static uint16_t flashmem_load_send(uint32_t index, void *ctx) {
+    flashmem_load_t *load = ctx;
+    uint32_t offset = index * FLASH_MEM_BLOCK_SIZE;
+    uint32_t bytes_in_packet = MIN(FLASH_MEM_BLOCK_SIZE, load->datalen - offset);
+    return SendCommandMIXSeq(CMD_FLASHMEM_WRITE, load->start_index + offset, bytes_in_packet, 0, load->data + offset, bytes_in_packet);
+}
+
+static int flashmem_load_reply(uint32_t index, PacketResponseNG *response, void *ctx) {
+    (void)ctx;
+    uint8_t isok  = response->oldarg[0] & 0xFF;
+    if (!isok) {
+        PrintAndLogEx(FAILED, "Flash write fail [offset %u]", index * FLASH_MEM_BLOCK_SIZE);
+        return PM3_EFLASH;
+    }
+    return PM3_SUCCESS;
+}
+
 static int CmdFlashMemLoad(const char *Cmd) {
 
     uint32_t start_index = 0;
@@ -231,41 +254,18 @@ static int CmdFlashMemLoad(const char *Cmd) {
         data = newdata;
     }
 
-    //Send to device
-    uint32_t bytes_sent = 0;
-    uint32_t bytes_remaining = datalen;
-
-    // fast push mode
-    conn.block_after_ACK = true;
-
-    while (bytes_remaining > 0) {
-        uint32_t bytes_in_packet = MIN(FLASH_MEM_BLOCK_SIZE, bytes_remaining);
-
-        clearCommandBuffer();
-
-        SendCommandOLD(CMD_FLASHMEM_WRITE, start_index + bytes_sent, bytes_in_packet, 0, data + bytes_sent, bytes_in_packet);
-
-        bytes_remaining -= bytes_in_packet;
-        bytes_sent += bytes_in_packet;
-
-        PacketResponseNG resp;
-        if (!WaitForResponseTimeout(CMD_ACK, &resp, 2000)) {
-            PrintAndLogEx(WARNING, "timeout while waiting for reply.");
-            conn.block_after_ACK = false;
-            free(data);
-            return PM3_ETIMEOUT;
-        }
-
-        uint8_t isok  = resp.oldarg[0] & 0xFF;
-        if (!isok) {
-            conn.block_after_ACK = false;
-            PrintAndLogEx(FAILED, "Flash write fail [offset %u]", bytes_sent);
-            return PM3_EFLASH;
-        }
+    //Send to device, several chunks in flight
+    flashmem_load_t load = {data, datalen, start_index};
+    uint32_t chunks = (datalen + FLASH_MEM_BLOCK_SIZE - 1) / FLASH_MEM_BLOCK_SIZE;
+    res = SendCommandsPipelined(chunks, CMD_ACK, 2000, flashmem_load_send, flashmem_load_reply, &load);
+    free(data);
+    if (res == PM3_ETIMEOUT) {
+        PrintAndLogEx(WARNING, "timeout while waiting for reply.");
+        return PM3_ETIMEOUT;
     }
+    if (res != PM3_SUCCESS)
+        return res;
 
-    conn.block_after_ACK = false;
-    free(data);
     PrintAndLogEx(SUCCESS, "Wrote "_GREEN_("%zu")"bytes to offset "_GREEN_("%u"), datalen, start_index);
     return PM3_SUCCESS;
 }
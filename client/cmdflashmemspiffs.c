@@ -370,9 +370,6 @@ static int CmdFlashMemSpiFFSLoad(const char *Cmd) {
     uint32_t bytes_sent = 0;
     uint32_t bytes_remaining = datalen;
 
-    // fast push mode
-    conn.block_after_ACK = true;
-
     // SendCommandMIX(CMD_SPIFFS_COPY, 0, 0, 0, (uint8_t *)data, 65);
 
     while (bytes_remaining > 0) {
@@ -397,21 +394,18 @@ static int CmdFlashMemSpiFFSLoad(const char *Cmd) {
         PacketResponseNG resp;
         if (!WaitForResponseTimeout(CMD_ACK, &resp, 2000)) {
             PrintAndLogEx(WARNING, "timeout while waiting for reply.");
-            conn.block_after_ACK = false;
             free(data);
             return PM3_ETIMEOUT;
         }
 
         uint8_t isok = resp.oldarg[0] & 0xFF;
         if (!isok) {
-            conn.block_after_ACK = false;
             PrintAndLogEx(FAILED, "Flash write fail [offset %u]", bytes_sent);
             free(data);
             return PM3_EFLASH;
         }
     }
 
-    conn.block_after_ACK = false;
     free(data);
     PrintAndLogEx(SUCCESS, "Wrote "_GREEN_("%zu") "bytes to file "_GREEN_("%s"), datalen, destfilename);
 
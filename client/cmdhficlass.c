@@ -14,6 +14,7 @@
 #include "cmdhficlass.h"
 
 #include <ctype.h>
+#include <pthread.h>
 
 #include "cmdparser.h"    // command_t
 #include "commonutil.h"  // ARRAYLEN
@@ -28,6 +29,7 @@
 #include "loclass/elite_crack.h"
 #include "fileutils.h"
 #include "protocols.h"
+#include "crc32.h"
 
 
 #define NUM_CSNS 9
@@ -229,11 +231,12 @@ static int usage_hf_iclass_sniff(void) {
     return PM3_SUCCESS;
 }
 static int usage_hf_iclass_loclass(void) {
-    PrintAndLogEx(NORMAL, "Usage: hf iclass loclass [h] [t [l]] [f <filename>]");
+    PrintAndLogEx(NORMAL, "Usage: hf iclass loclass [h] [t [l]] [b] [f <filename> [s]]");
     PrintAndLogEx(NORMAL, "Options:");
     PrintAndLogEx(NORMAL, "      h             Show this help");
     PrintAndLogEx(NORMAL, "      t             Perform self-test");
     PrintAndLogEx(NORMAL, "      t l           Perform self-test, including long ones");
+    PrintAndLogEx(NORMAL, "      b             Benchmark, MACs/s of the cipher engines and keys/s of the bruteforce");
     PrintAndLogEx(NORMAL, "      f <filename>  Bruteforce iclass dumpfile");
     PrintAndLogEx(NORMAL, "                    An iclass dumpfile is assumed to consist of an arbitrary number of");
     PrintAndLogEx(NORMAL, "                    malicious CSNs, and their protocol responses");
@@ -242,6 +245,8 @@ static int usage_hf_iclass_loclass(void) {
     PrintAndLogEx(NORMAL, "                    <8 byte CSN><8 byte CC><4 byte NR><4 byte MAC>");
     PrintAndLogEx(NORMAL, "                    <8 byte CSN><8 byte CC><4 byte NR><4 byte MAC>");
     PrintAndLogEx(NORMAL, "                   ... totalling N*24 bytes");
+    PrintAndLogEx(NORMAL, "      f <filename> s  Bruteforce the CSNs one by one in file order. By default the CSNs with");
+    PrintAndLogEx(NORMAL, "                    the fewest unknown key bytes go first, those without common bytes concurrently");
     return PM3_SUCCESS;
 }
 static int usage_hf_iclass_chk(void) {
@@ -260,7 +265,7 @@ static int usage_hf_iclass_chk(void) {
 }
 static int usage_hf_iclass_lookup(void) {
     PrintAndLogEx(NORMAL, "Lookup keys takes some sniffed trace data and tries to verify what key was used against a dictionary file");
-    PrintAndLogEx(NORMAL, "Usage: hf iclass lookup [h|e|r] [f  (*.dic)] [u <csn>] [p <epurse>] [m <macs>]");
+    PrintAndLogEx(NORMAL, "Usage: hf iclass lookup [h|e|r|i] [f  (*.dic)] [u <csn>] [p <epurse>] [m <macs>]");
     PrintAndLogEx(NORMAL, "Options:");
     PrintAndLogEx(NORMAL, "      h             Show this help");
     PrintAndLogEx(NORMAL, "      f <filename>  Dictionary file with default iclass keys");
@@ -269,9 +274,12 @@ static int usage_hf_iclass_lookup(void) {
     PrintAndLogEx(NORMAL, "      m             macs");
     PrintAndLogEx(NORMAL, "      r             raw");
     PrintAndLogEx(NORMAL, "      e             elite");
+    PrintAndLogEx(NORMAL, "      i             keep the sorted MACs in the user directory, repeated lookups of the");
+    PrintAndLogEx(NORMAL, "                    same CSN / CCNR and dictionary skip the precalculation");
     PrintAndLogEx(NORMAL, "Examples:");
     PrintAndLogEx(NORMAL, "        hf iclass lookup u 9655a400f8ff12e0 p f0ffffffffffffff m 0000000089cb984b f dictionaries/iclass_default_keys.dic");
     PrintAndLogEx(NORMAL, "        hf iclass lookup u 9655a400f8ff12e0 p f0ffffffffffffff m 0000000089cb984b f dictionaries/iclass_default_keys.dic e");
+    PrintAndLogEx(NORMAL, "        hf iclass lookup u 9655a400f8ff12e0 p f0ffffffffffffff m 0000000089cb984b f dictionaries/iclass_default_keys.dic e i");
     return PM3_SUCCESS;
 }
 static int usage_hf_iclass_permutekey(void) {
@@ -776,19 +784,12 @@ static int CmdHFiClassELoad(const char *Cmd) {
 
     printIclassDumpInfo(dump);
 
-    // fast push mode
-    conn.block_after_ACK = true;
-
     //Send to device
     uint32_t bytes_sent = 0;
     uint32_t bytes_remaining  = bytes_read;
 
     while (bytes_remaining > 0) {
         uint32_t bytes_in_packet = MIN(PM3_CMD_DATA_SIZE, bytes_remaining);
-        if (bytes_in_packet == bytes_remaining) {
-            // Disable fast mode on last packet
-            conn.block_after_ACK = false;
-        }
         clearCommandBuffer();
         SendCommandOLD(CMD_HF_ICLASS_EML_MEMSET, bytes_sent, bytes_in_packet, 0, dump + bytes_sent, bytes_in_packet);
         bytes_remaining -= bytes_in_packet;
@@ -1829,11 +1830,14 @@ static int CmdHFiClass_loclass(const char *Cmd) {
     if (opt == 'f') {
         char fileName[FILE_PATH_SIZE] = {0};
         if (param_getstr(Cmd, 1, fileName, sizeof(fileName)) > 0) {
-            return bruteforceFileNoKeys(fileName);
+            bool sequential = tolower(param_getchar(Cmd, 2)) == 's';
+            return bruteforceFileNoKeys(fileName, sequential);
         } else {
             PrintAndLogEx(WARNING, "You must specify a filename");
             return PM3_EFILE;
         }
+    } else if (opt == 'b') {
+        return benchElite();
     } else if (opt == 't') {
         char opt2 = tolower(param_getchar(Cmd, 1));
         int errors = testCipherUtils();
@@ -1932,20 +1936,25 @@ static int CmdHFiClassReadTagFile(const char *Cmd) {
     return PM3_SUCCESS;
 }
 
+// elite diversification, with hash1 of the CSN already done
+static void calc_div_key_elite(uint8_t *CSN, const uint8_t key_index[8], uint8_t *KEY, uint8_t *div_key) {
+    uint8_t keytable[128] = {0};
+    uint8_t key_sel[8] = { 0 };
+    uint8_t key_sel_p[8] = { 0 };
+    hash2(KEY, keytable);
+    for (uint8_t i = 0; i < 8 ; i++)
+        key_sel[i] = keytable[key_index[i]] & 0xFF;
+
+    //Permute from iclass format to standard format
+    permutekey_rev(key_sel, key_sel_p);
+    diversifyKey(CSN, key_sel_p, div_key);
+}
+
 void HFiClassCalcDivKey(uint8_t *CSN, uint8_t *KEY, uint8_t *div_key, bool elite) {
     if (elite) {
-        uint8_t keytable[128] = {0};
         uint8_t key_index[8] = {0};
-        uint8_t key_sel[8] = { 0 };
-        uint8_t key_sel_p[8] = { 0 };
-        hash2(KEY, keytable);
         hash1(CSN, key_index);
-        for (uint8_t i = 0; i < 8 ; i++)
-            key_sel[i] = keytable[key_index[i]] & 0xFF;
-
-        //Permute from iclass format to standard format
-        permutekey_rev(key_sel, key_sel_p);
-        diversifyKey(CSN, key_sel_p, div_key);
+        calc_div_key_elite(CSN, key_index, KEY, div_key);
     } else {
         diversifyKey(CSN, KEY, div_key);
     }
@@ -2215,6 +2224,157 @@ static int CmdHFiClassManageKeys(const char *Cmd) {
     return PM3_SUCCESS;
 }
 
+// Precalculation of diversified keys and their MACs.
+// The keys are handed out MAC_SLICE at a time to all CPUs, the MACs of a slice are calculated bitsliced.
+#define MAX_PREMAC_THREADS 64
+
+typedef struct {
+    uint8_t *CSN;
+    uint8_t *CCNR;
+    bool use_raw;
+    bool use_elite;
+    uint8_t key_index[8];       // hash1 of the CSN, the same for all keys
+    uint8_t *keys;
+    uint32_t next;              // atomic, first key of the next slice
+    uint32_t last;
+    iclass_premac_t *macs;      // where to store the results, one of both
+    iclass_prekey_t *prekeys;
+} premac_t;
+
+static void premac_init(premac_t *p, uint8_t *CSN, uint8_t *CCNR, bool use_raw, bool use_elite, uint8_t *keys) {
+    memset(p, 0, sizeof(premac_t));
+    p->CSN = CSN;
+    p->CCNR = CCNR;
+    p->use_raw = use_raw;
+    p->use_elite = use_elite;
+    p->keys = keys;
+    if (use_elite)
+        hash1(CSN, p->key_index);
+}
+
+static void *premac_thread(void *arg) {
+    premac_t *p = arg;
+    uint8_t div_keys[MAC_SLICE][8];
+    uint8_t macs[MAC_SLICE][4];
+    uint32_t first;
+
+    while ((first = __atomic_fetch_add(&p->next, MAC_SLICE, __ATOMIC_RELAXED)) < p->last) {
+        uint32_t n = MIN(MAC_SLICE, p->last - first);
+        for (uint32_t i = 0; i < n; i++) {
+            uint8_t *key = p->keys + 8 * (first + i);
+            if (p->use_raw)
+                memcpy(div_keys[i], key, 8);
+            else if (p->use_elite)
+                calc_div_key_elite(p->CSN, p->key_index, key, div_keys[i]);
+            else
+                diversifyKey(p->CSN, key, div_keys[i]);
+        }
+
+        doMAC_many(p->CCNR, (const uint8_t (*)[8])div_keys, n, macs);
+
+        for (uint32_t i = 0; i < n; i++) {
+            if (p->macs) {
+                memcpy(p->macs[first + i].mac, macs[i], 4);
+            } else {
+                memcpy(p->prekeys[first + i].key, p->keys + 8 * (first + i), 8);
+                memcpy(p->prekeys[first + i].mac, macs[i], 4);
+            }
+        }
+    }
+    return NULL;
+}
+
+// keys [first, last), the calling thread works along
+static void premac_run(premac_t *p, uint32_t first, uint32_t last) {
+    p->next = first;
+    p->last = last;
+
+    int num_threads = MIN(num_CPUs(), MAX_PREMAC_THREADS);
+    num_threads = MIN(num_threads, (int)((last - first + MAC_SLICE - 1) / MAC_SLICE));
+
+    pthread_t threads[MAX_PREMAC_THREADS];
+    int started = 0;
+    for (; started < num_threads - 1; started++)
+        if (pthread_create(&threads[started], NULL, premac_thread, p) != 0)
+            break;
+    premac_thread(p);
+    for (int i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+}
+
+// Streaming precalculation for hf iclass chk. The MACs are calculated in growing windows
+// while the device checks the chunks already done, the first chunk is sent right away.
+typedef struct {
+    premac_t premac;
+    uint32_t keycount;
+    uint32_t chunksize;
+    uint32_t ready;             // number of keys with their MAC done
+    bool stop;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t thread;
+} premac_stream_t;
+
+static void *premac_stream_thread(void *arg) {
+    premac_stream_t *s = arg;
+    uint32_t window = s->chunksize;
+
+    for (uint32_t first = 0; first < s->keycount;) {
+        pthread_mutex_lock(&s->lock);
+        bool stop = s->stop;
+        pthread_mutex_unlock(&s->lock);
+        if (stop)
+            break;
+
+        uint32_t last = MIN(s->keycount, first + window);
+        premac_run(&s->premac, first, last);
+
+        pthread_mutex_lock(&s->lock);
+        s->ready = last;
+        pthread_cond_broadcast(&s->cond);
+        pthread_mutex_unlock(&s->lock);
+
+        first = last;
+        window = MIN(window * 2, 64 * s->chunksize);
+    }
+    return NULL;
+}
+
+static void premac_stream_start(premac_stream_t *s, uint8_t *CSN, uint8_t *CCNR, bool use_raw, bool use_elite, uint8_t *keys, uint32_t keycount, uint32_t chunksize, iclass_premac_t *list) {
+    memset(s, 0, sizeof(premac_stream_t));
+    premac_init(&s->premac, CSN, CCNR, use_raw, use_elite, keys);
+    s->premac.macs = list;
+    s->keycount = keycount;
+    s->chunksize = chunksize;
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->cond, NULL);
+    if (pthread_create(&s->thread, NULL, premac_stream_thread, s) != 0) {
+        // no thread, no overlap
+        premac_run(&s->premac, 0, keycount);
+        s->ready = keycount;
+        s->stop = true;
+    }
+}
+
+// blocks until the MACs of the first <count> keys are done
+static void premac_stream_wait(premac_stream_t *s, uint32_t count) {
+    pthread_mutex_lock(&s->lock);
+    while (s->ready < count)
+        pthread_cond_wait(&s->cond, &s->lock);
+    pthread_mutex_unlock(&s->lock);
+}
+
+static void premac_stream_stop(premac_stream_t *s) {
+    pthread_mutex_lock(&s->lock);
+    bool started = !s->stop;
+    s->stop = true;
+    pthread_mutex_unlock(&s->lock);
+    if (started)
+        pthread_join(s->thread, NULL);
+    pthread_cond_destroy(&s->cond);
+    pthread_mutex_destroy(&s->lock);
+}
+
 static int CmdHFiClassCheckKeys(const char *Cmd) {
 
     // empty string
@@ -2236,6 +2396,7 @@ static int CmdHFiClassCheckKeys(const char *Cmd) {
     char filename[FILE_PATH_SIZE] = {0};
     uint8_t fileNameLen = 0;
     iclass_premac_t *pre = NULL;
+    premac_stream_t stream;
 
     // time
     uint64_t t1 = msclock();
@@ -2273,15 +2434,21 @@ static int CmdHFiClassCheckKeys(const char *Cmd) {
     if (errors) return usage_hf_iclass_chk();
 
 
-    uint8_t *keyBlock = NULL;
-    uint16_t keycount = 0;
-
-    // load keys
-    int res = loadFileDICTIONARY_safe(filename, (void **)&keyBlock, 8, &keycount);
-    if (res != PM3_SUCCESS || keycount == 0) {
-        free(keyBlock);
+    // load keys, compiled dictionaries are mapped
+    dictionary_t dict;
+    int res = openFileDICTIONARY(filename, 8, &dict);
+    if (res != PM3_SUCCESS)
+        return res;
+    if (dict.keycount == 0 || dict.keycount > INT32_MAX) {
+        if (dict.keycount) {
+            PrintAndLogEx(ERR, "dictionary too large, %" PRIu64 " keys", dict.keycount);
+            res = PM3_EOVFLOW;
+        }
+        closeFileDICTIONARY(&dict);
         return res;
     }
+    uint8_t *keyBlock = dict.keys;
+    uint32_t keycount = dict.keycount;
 
     // Get CSN / UID and CCNR
     PrintAndLogEx(SUCCESS, "Reading tag CSN");
@@ -2294,13 +2461,14 @@ static int CmdHFiClassCheckKeys(const char *Cmd) {
     if (got_csn == false) {
         PrintAndLogEx(WARNING, "Tried 10 times. Can't select card, aborting...");
         DropField();
+        closeFileDICTIONARY(&dict);
         return PM3_ESOFT;
     }
 
     pre = calloc(keycount, sizeof(iclass_premac_t));
     if (!pre) {
         DropField();
-        free(keyBlock);
+        closeFileDICTIONARY(&dict);
         return PM3_EMALLOC;
     }
 
@@ -2315,16 +2483,14 @@ static int CmdHFiClassCheckKeys(const char *Cmd) {
     PrintAndLogEx(SUCCESS, "CSN     | %s", sprint_hex(CSN, sizeof(CSN)));
     PrintAndLogEx(SUCCESS, "CCNR    | %s", sprint_hex(CCNR, sizeof(CCNR)));
 
-    GenerateMacFrom(CSN, CCNR, use_raw, use_elite, keyBlock, keycount, pre);
-
-    //PrintPreCalcMac(keyBlock, keycnt, pre);
-
     // max 42 keys inside USB_COMMAND.  512/4 = 103 mac
     uint32_t chunksize = keycount > (PM3_CMD_DATA_SIZE / 4) ? (PM3_CMD_DATA_SIZE / 4) : keycount;
     bool lastChunk = false;
 
-    // fast push mode
-    conn.block_after_ACK = true;
+    // the MACs are calculated while the device checks the chunks
+    premac_stream_start(&stream, CSN, CCNR, use_raw, use_elite, keyBlock, keycount, chunksize, pre);
+
+    //PrintPreCalcMac(keyBlock, keycnt, pre);
 
     // keep track of position of found key
     uint8_t found_offset = 0;
@@ -2345,8 +2511,6 @@ static int CmdHFiClassCheckKeys(const char *Cmd) {
         // last chunk?
         if (keys == keycount - key_offset) {
             lastChunk = true;
-            // Disable fast mode on last command
-            conn.block_after_ACK = false;
         }
         uint32_t flags = lastChunk << 8;
         // bit 16
@@ -2354,6 +2518,8 @@ static int CmdHFiClassCheckKeys(const char *Cmd) {
         //   - 0 indicates debit key (default)
         flags |= (use_credit_key << 16);
 
+        premac_stream_wait(&stream, key_offset + keys);
+
         clearCommandBuffer();
         SendCommandOLD(CMD_HF_ICLASS_CHKKEYS, flags, keys, 0, pre + key_offset, 4 * keys);
         PacketResponseNG resp;
@@ -2410,6 +2576,7 @@ static int CmdHFiClassCheckKeys(const char *Cmd) {
     } // end chunks of keys
 
 out:
+    premac_stream_stop(&stream);
     t1 = msclock() - t1;
 
     PrintAndLogEx(SUCCESS, "\nTime in iclass checkkeys: %.0f seconds\n", (float)t1 / 1000.0);
@@ -2430,22 +2597,115 @@ out:
     }
 
     free(pre);
-    free(keyBlock);
+    closeFileDICTIONARY(&dict);
     return PM3_SUCCESS;
 }
 
+// MACs compared big endian, same order as bytes_to_num
 static int cmp_uint32(const void *a, const void *b) {
 
     const iclass_prekey_t *x = (const iclass_prekey_t *)a;
     const iclass_prekey_t *y = (const iclass_prekey_t *)b;
 
-    uint32_t mx = bytes_to_num((uint8_t *)x->mac, 4);
-    uint32_t my = bytes_to_num((uint8_t *)y->mac, 4);
+    return memcmp(x->mac, y->mac, 4);
+}
+
+// Precalculated MAC index of hf iclass lookup, the MAC sorted keys of a dictionary for one CSN / CCNR.
+// Stored in the user directory, named after CSN, CCNR and mode.
+#define MAC_INDEX_MAGIC     "PM3MACIX"
+#define MAC_INDEX_VERSION   1
 
-    if (mx < my)
-        return -1;
-    else
-        return mx > my;
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint8_t csn[8];
+    uint8_t ccnr[12];
+    uint8_t elite;
+    uint8_t raw;
+    uint8_t reserved[2];
+    uint32_t keycount;
+    uint32_t dict_crc;          // crc32 of the dictionary keys
+    uint32_t data_crc;          // crc32 of the iclass_prekey_t entries
+} PACKED mac_index_header_t;
+
+static void mac_index_header(mac_index_header_t *header, uint8_t *CSN, uint8_t *CCNR, bool use_raw, bool use_elite, uint8_t *keys, uint32_t keycount) {
+    memset(header, 0, sizeof(mac_index_header_t));
+    memcpy(header->magic, MAC_INDEX_MAGIC, sizeof(header->magic));
+    header->version = MAC_INDEX_VERSION;
+    memcpy(header->csn, CSN, sizeof(header->csn));
+    memcpy(header->ccnr, CCNR, sizeof(header->ccnr));
+    header->elite = use_elite;
+    header->raw = use_raw;
+    header->keycount = keycount;
+    crc32_ex(keys, 8 * keycount, (uint8_t *)&header->dict_crc);
+}
+
+static int mac_index_path(char **path, uint8_t *CSN, uint8_t *CCNR, bool use_raw, bool use_elite, bool create_home) {
+    char filename[80];
+    snprintf(filename, sizeof(filename), "iclass_macs_%s", sprint_hex_inrow(CSN, 8));
+    snprintf(filename + strlen(filename), sizeof(filename) - strlen(filename), "_%s%s.bin", sprint_hex_inrow(CCNR, 12), use_raw ? "_raw" : use_elite ? "_elite" : "");
+    return searchHomeFilePath(path, filename, create_home);
+}
+
+// the sorted MACs of a previous lookup with the same dictionary, NULL if there are none
+static iclass_prekey_t *mac_index_load(mac_index_header_t *expected) {
+    char *path = NULL;
+    if (mac_index_path(&path, expected->csn, expected->ccnr, expected->raw, expected->elite, false) != PM3_SUCCESS)
+        return NULL;
+
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        free(path);
+        return NULL;
+    }
+
+    mac_index_header_t header;
+    iclass_prekey_t *prekey = NULL;
+    if (fread(&header, sizeof(header), 1, f) == 1
+            && memcmp(&header, expected, offsetof(mac_index_header_t, data_crc)) == 0
+            && (prekey = calloc(header.keycount, sizeof(iclass_prekey_t))) != NULL) {
+        uint32_t crc = 0;
+        if (fread(prekey, sizeof(iclass_prekey_t), header.keycount, f) == header.keycount)
+            crc32_ex((uint8_t *)prekey, header.keycount * sizeof(iclass_prekey_t), (uint8_t *)&crc);
+        if (crc != header.data_crc) {
+            PrintAndLogEx(WARNING, "Ignoring corrupt MAC index %s", path);
+            free(prekey);
+            prekey = NULL;
+        }
+    }
+    fclose(f);
+    if (prekey != NULL)
+        PrintAndLogEx(SUCCESS, "Loaded %u precalculated MACs from " _YELLOW_("%s"), header.keycount, path);
+    free(path);
+    return prekey;
+}
+
+static int mac_index_save(mac_index_header_t *header, iclass_prekey_t *prekey) {
+    char *path = NULL;
+    int res = mac_index_path(&path, header->csn, header->ccnr, header->raw, header->elite, true);
+    if (res != PM3_SUCCESS)
+        return res;
+
+    crc32_ex((uint8_t *)prekey, header->keycount * sizeof(iclass_prekey_t), (uint8_t *)&header->data_crc);
+
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        PrintAndLogEx(WARNING, "Could not create file %s", path);
+        free(path);
+        return PM3_EFILE;
+    }
+    bool ok = (fwrite(header, sizeof(mac_index_header_t), 1, f) == 1);
+    ok = ok && (fwrite(prekey, sizeof(iclass_prekey_t), header->keycount, f) == header->keycount);
+    ok = (fclose(f) == 0) && ok;
+    if (!ok) {
+        PrintAndLogEx(WARNING, "Error writing MAC index %s", path);
+        remove(path);
+        free(path);
+        return PM3_EFILE;
+    }
+    PrintAndLogEx(SUCCESS, "Saved %u precalculated MACs to " _YELLOW_("%s"), header->keycount, path);
+    free(path);
+    return PM3_SUCCESS;
 }
 
 // this method tries to identify in which configuration mode a iClass / iClass SE reader is in.
@@ -2461,6 +2721,7 @@ static int CmdHFiClassLookUp(const char *Cmd) {
     // elite key,  raw key, standard key
     bool use_elite = false;
     bool use_raw = false;
+    bool use_index = false;
     bool errors = false;
     uint8_t cmdp = 0x00;
 
@@ -2518,6 +2779,10 @@ static int CmdHFiClassLookUp(const char *Cmd) {
                 use_raw = true;
                 cmdp++;
                 break;
+            case 'i':
+                use_index = true;
+                cmdp++;
+                break;
             default:
                 PrintAndLogEx(WARNING, "unknown parameter '%c'\n", param_getchar(Cmd, cmdp));
                 errors = true;
@@ -2537,30 +2802,50 @@ static int CmdHFiClassLookUp(const char *Cmd) {
     PrintAndLogEx(SUCCESS, "CCNR    | %s", sprint_hex(CCNR, sizeof(CCNR)));
     PrintAndLogEx(SUCCESS, "MAC_TAG | %s", sprint_hex(MAC_TAG, sizeof(MAC_TAG)));
 
-    uint8_t *keyBlock = NULL;
-    uint16_t keycount = 0;
-
-    // load keys
-    int res = loadFileDICTIONARY_safe(filename, (void **)&keyBlock, 8, &keycount);
-    if (res != PM3_SUCCESS || keycount == 0) {
-        free(keyBlock);
+    // load keys, compiled dictionaries are mapped
+    dictionary_t dict;
+    int res = openFileDICTIONARY(filename, 8, &dict);
+    if (res != PM3_SUCCESS)
+        return res;
+    if (dict.keycount == 0 || dict.keycount > INT32_MAX) {
+        if (dict.keycount) {
+            PrintAndLogEx(ERR, "dictionary too large, %" PRIu64 " keys", dict.keycount);
+            res = PM3_EOVFLOW;
+        }
+        closeFileDICTIONARY(&dict);
         return res;
     }
+    uint8_t *keyBlock = dict.keys;
+    uint32_t keycount = dict.keycount;
 
-    //iclass_prekey_t
-    prekey = calloc(keycount, sizeof(iclass_prekey_t));
-    if (!prekey) {
-        free(keyBlock);
-        return PM3_EMALLOC;
+    mac_index_header_t index_header;
+    if (use_index) {
+        mac_index_header(&index_header, CSN, CCNR, use_raw, use_elite, keyBlock, keycount);
+        prekey = mac_index_load(&index_header);
     }
 
-    PrintAndLogEx(INFO, "Generating diversified keys");
-    GenerateMacKeyFrom(CSN, CCNR, use_raw, use_elite, keyBlock, keycount, prekey);
+    if (prekey == NULL) {
+        //iclass_prekey_t
+        prekey = calloc(keycount, sizeof(iclass_prekey_t));
+        if (!prekey) {
+            closeFileDICTIONARY(&dict);
+            return PM3_EMALLOC;
+        }
+
+        uint64_t t2 = msclock();
+        PrintAndLogEx(INFO, "Generating diversified keys");
+        GenerateMacKeyFrom(CSN, CCNR, use_raw, use_elite, keyBlock, keycount, prekey);
+        t2 = msclock() - t2;
+        PrintAndLogEx(INFO, "%u MACs in %.1fs, %.0f keys/s on %d threads", keycount, (float)t2 / 1000.0, t2 ? keycount * 1000.0 / t2 : 0.0, num_CPUs());
+
+        PrintAndLogEx(INFO, "Sorting");
 
-    PrintAndLogEx(INFO, "Sorting");
+        // sort mac list.
+        qsort(prekey, keycount, sizeof(iclass_prekey_t), cmp_uint32);
 
-    // sort mac list.
-    qsort(prekey, keycount, sizeof(iclass_prekey_t), cmp_uint32);
+        if (use_index)
+            mac_index_save(&index_header, prekey);
+    }
 
     //PrintPreCalc(prekey, keycnt);
 
@@ -2591,46 +2876,24 @@ static int CmdHFiClassLookUp(const char *Cmd) {
     }
 
     free(prekey);
-    free(keyBlock);
+    closeFileDICTIONARY(&dict);
     PrintAndLogEx(NORMAL, "");
     return PM3_SUCCESS;
 }
 
 // precalc diversified keys and their MAC
 void GenerateMacFrom(uint8_t *CSN, uint8_t *CCNR, bool use_raw, bool use_elite, uint8_t *keys, int keycnt, iclass_premac_t *list) {
-    uint8_t key[8] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
-    uint8_t div_key[8] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
-
-    for (int i = 0; i < keycnt; i++) {
-
-        memcpy(key, keys + 8 * i, 8);
-
-        if (use_raw)
-            memcpy(div_key, key, 8);
-        else
-            HFiClassCalcDivKey(CSN, key, div_key, use_elite);
-
-        doMAC(CCNR, div_key, list[i].mac);
-    }
+    premac_t p;
+    premac_init(&p, CSN, CCNR, use_raw, use_elite, keys);
+    p.macs = list;
+    premac_run(&p, 0, keycnt);
 }
 
 void GenerateMacKeyFrom(uint8_t *CSN, uint8_t *CCNR, bool use_raw, bool use_elite, uint8_t *keys, int keycnt, iclass_prekey_t *list) {
-
-    uint8_t div_key[8] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
-
-    for (int i = 0; i < keycnt; i++) {
-
-        memcpy(list[i].key, keys + 8 * i, 8);
-
-        // generate diversifed key
-        if (use_raw)
-            memcpy(div_key, list[i].key, 8);
-        else
-            HFiClassCalcDivKey(CSN, list[i].key, div_key, use_elite);
-
-        // generate MAC
-        doMAC(CCNR, div_key, list[i].mac);
-    }
+    premac_t p;
+    premac_init(&p, CSN, CCNR, use_raw, use_elite, keys);
+    p.prekeys = list;
+    premac_run(&p, 0, keycnt);
 }
 
 // print diversified keys
@@ -842,15 +842,9 @@ void legic_chk_iv(uint32_t *iv) {
     }
 }
 void legic_seteml(uint8_t *src, uint32_t offset, uint32_t numofbytes) {
-    // fast push mode
-    conn.block_after_ACK = true;
     for (size_t i = offset; i < numofbytes; i += PM3_CMD_DATA_SIZE) {
 
         size_t len = MIN((numofbytes - i), PM3_CMD_DATA_SIZE);
-        if (len == numofbytes - i) {
-            // Disable fast mode on last packet
-            conn.block_after_ACK = false;
-        }
         clearCommandBuffer();
         SendCommandOLD(CMD_HF_LEGIC_ESET, i, len, 0, src + i, len);
     }
@@ -1054,18 +1048,11 @@ static int CmdLegicRestore(const char *Cmd) {
 
     PrintAndLogEx(SUCCESS, "Restoring to card");
 
-    // fast push mode
-    conn.block_after_ACK = true;
-
     // transfer to device
     PacketResponseNG resp;
     for (size_t i = 7; i < numofbytes; i += PM3_CMD_DATA_SIZE) {
 
         size_t len = MIN((numofbytes - i), PM3_CMD_DATA_SIZE);
-        if (len == numofbytes - i) {
-            // Disable fast mode on last packet
-            conn.block_after_ACK = false;
-        }
         clearCommandBuffer();
         SendCommandOLD(CMD_HF_LEGIC_WRITER, i, len, 0x55, data + i, len);
 
@@ -1249,9 +1236,6 @@ static int CmdLegicWipe(const char *Cmd) {
     legic_print_type(card.cardsize, 0);
 
     PrintAndLogEx(SUCCESS, "Erasing");
-    // fast push mode
-    conn.block_after_ACK = true;
-
     // transfer to device
     PacketResponseNG resp;
     for (size_t i = 7; i < card.cardsize; i += PM3_CMD_DATA_SIZE) {
@@ -1259,10 +1243,6 @@ static int CmdLegicWipe(const char *Cmd) {
         printf(".");
         fflush(stdout);
         size_t len = MIN((card.cardsize - i), PM3_CMD_DATA_SIZE);
-        if (len == card.cardsize - i) {
-            // Disable fast mode on last packet
-            conn.block_after_ACK = false;
-        }
         clearCommandBuffer();
         SendCommandOLD(CMD_HF_LEGIC_WRITER, i, len, 0x55, data + i, len);
 
@@ -11,6 +11,7 @@
 #include "cmdhfmf.h"
 
 #include <ctype.h>
+#include <pthread.h>
 
 #include "cmdparser.h"    // command_t
 #include "commonutil.h"  // ARRAYLEN
@@ -21,7 +22,9 @@
 #include "mifare/mifaredefault.h"          // mifare default key array
 #include "cliparser/cliparser.h"           // argtable
 #include "hardnested/hardnested_bf_core.h" // SetSIMDInstr
+#include "cmdhfmfhard.h"                    // hardnested_create_bitflip_cache
 #include "mifare/mad.h"
+#include "mifare/mfkeyhits.h"
 #include "mifare/ndef.h"
 #include "protocols.h"
 #include "util_posix.h"  // msclock
@@ -120,8 +123,10 @@ static int usage_hf14_nested(void) {
     PrintAndLogEx(NORMAL, " all sectors:  hf mf nested  <card memory> <block number> <key A/B> <key (12 hex symbols)> [t,d]");
     PrintAndLogEx(NORMAL, " one sector:   hf mf nested  o <block number> <key A/B> <key (12 hex symbols)>");
     PrintAndLogEx(NORMAL, "               <target block number> <target key A/B> [t]");
+    PrintAndLogEx(NORMAL, " benchmark:    hf mf nested  b [<number of keys>]");
     PrintAndLogEx(NORMAL, "Options:");
     PrintAndLogEx(NORMAL, "      h    this help");
+    PrintAndLogEx(NORMAL, "      b    benchmark the key recovery on the host with simulated nonces, no tag needed");
     PrintAndLogEx(NORMAL, "      card memory - 0 - MINI(320 bytes), 1 - 1K, 2 - 2K, 4 - 4K, <other> - 1K");
     PrintAndLogEx(NORMAL, "      t    transfer keys into emulator memory");
     PrintAndLogEx(NORMAL, "      d    write keys to binary file `hf-mf-<UID>-key.bin`");
@@ -131,13 +136,16 @@ static int usage_hf14_nested(void) {
     PrintAndLogEx(NORMAL, "      hf mf nested 1 0 A FFFFFFFFFFFF t   -- and transfer keys into emulator memory");
     PrintAndLogEx(NORMAL, "      hf mf nested 1 0 A FFFFFFFFFFFF d   -- or write keys to binary file ");
     PrintAndLogEx(NORMAL, "      hf mf nested o 0 A FFFFFFFFFFFF 4 A");
+    PrintAndLogEx(NORMAL, "      hf mf nested b 20                   -- compare the host key recovery on 20 random keys");
     return 0;
 }
 static int usage_hf14_hardnested(void) {
     PrintAndLogEx(NORMAL, "Usage:");
     PrintAndLogEx(NORMAL, "      hf mf hardnested <block number> <key A|B> <key (12 hex symbols)>");
     PrintAndLogEx(NORMAL, "                       <target block number> <target key A|B> [known target key (12 hex symbols)] [w] [s]");
-    PrintAndLogEx(NORMAL, "  or  hf mf hardnested r [known target key]");
+    PrintAndLogEx(NORMAL, "  or  hf mf hardnested r [known target key] [--resume]");
+    PrintAndLogEx(NORMAL, "  or  hf mf hardnested c [cache file]");
+    PrintAndLogEx(NORMAL, "  or  hf mf hardnested b");
     PrintAndLogEx(NORMAL, "");
     PrintAndLogEx(NORMAL, "Options:");
     PrintAndLogEx(NORMAL, "      h         this help");
@@ -146,7 +154,12 @@ static int usage_hf14_hardnested(void) {
     PrintAndLogEx(NORMAL, "      r         read hf-mf-<UID>-nonces.bin if tag present, otherwise read nonces.bin, then start attack");
     PrintAndLogEx(NORMAL, "      u <UID>   read/write hf-mf-<UID>-nonces.bin instead of default name");
     PrintAndLogEx(NORMAL, "      f <name>  read/write <name> instead of default name");
+    PrintAndLogEx(NORMAL, "      --resume  continue an interrupted brute force from <name>.checkpoint (requires the same nonces)");
+    PrintAndLogEx(NORMAL, "      x <file>  don't brute force, export nonces and candidate states to work <file> for hardnested_worker");
     PrintAndLogEx(NORMAL, "      t         tests?");
+    PrintAndLogEx(NORMAL, "      c         create uncompressed bitflip table cache (default ~/.proxmark3/bitflip_states.cache)");
+    PrintAndLogEx(NORMAL, "                later runs map it instead of inflating the tables, which makes startup much faster");
+    PrintAndLogEx(NORMAL, "      b         benchmark the brute force rate of all SIMD instruction sets supported by this CPU");
     PrintAndLogEx(NORMAL, "      i <X>     set type of SIMD instructions. Without this flag programs autodetect it.");
     PrintAndLogEx(NORMAL, "        i 5   = AVX512");
     PrintAndLogEx(NORMAL, "        i 2   = AVX2");
@@ -161,6 +174,10 @@ static int usage_hf14_hardnested(void) {
     PrintAndLogEx(NORMAL, "      hf mf hardnested 0 A FFFFFFFFFFFF 4 A f nonces.bin w s");
     PrintAndLogEx(NORMAL, "      hf mf hardnested r");
     PrintAndLogEx(NORMAL, "      hf mf hardnested r a0a1a2a3a4a5");
+    PrintAndLogEx(NORMAL, "      hf mf hardnested r f nonces.bin --resume");
+    PrintAndLogEx(NORMAL, "      hf mf hardnested r f nonces.bin x nonces.work");
+    PrintAndLogEx(NORMAL, "      hf mf hardnested c");
+    PrintAndLogEx(NORMAL, "      hf mf hardnested b");
     PrintAndLogEx(NORMAL, "");
     PrintAndLogEx(NORMAL, "Add the known target key to check if it is present in the remaining key space:");
     PrintAndLogEx(NORMAL, "      hf mf hardnested 0 A A0A1A2A3A4A5 4 A FFFFFFFFFFFF");
@@ -203,7 +220,7 @@ static int usage_hf14_autopwn(void) {
     return 0;
 }
 static int usage_hf14_chk(void) {
-    PrintAndLogEx(NORMAL, "Usage:  hf mf chk [h] <block number>|<*card memory> <key type (A/B/?)> [t|d] [<key (12 hex symbols)>] [<dic (*.dic)>]");
+    PrintAndLogEx(NORMAL, "Usage:  hf mf chk [h] <block number>|<*card memory> <key type (A/B/?)> [t|d|n] [<key (12 hex symbols)>] [<dic (*.dic)>]");
     PrintAndLogEx(NORMAL, "Options:");
     PrintAndLogEx(NORMAL, "      h    this help");
     PrintAndLogEx(NORMAL, "      *    all sectors based on card memory, other values then below defaults to 1k");
@@ -212,7 +229,8 @@ static int usage_hf14_chk(void) {
     PrintAndLogEx(NORMAL, "                2 - 2K");
     PrintAndLogEx(NORMAL, "                4 - 4K");
     PrintAndLogEx(NORMAL, "      d    write keys to binary file");
-    PrintAndLogEx(NORMAL, "      t    write keys to emulator memory\n");
+    PrintAndLogEx(NORMAL, "      t    write keys to emulator memory");
+    PrintAndLogEx(NORMAL, "      n    keep the key order, don't use or update the key statistics in " MF_KEYHITS_FILE "\n");
     PrintAndLogEx(NORMAL, "");
     PrintAndLogEx(NORMAL, "Examples:");
     PrintAndLogEx(NORMAL, "      hf mf chk 0 A 1234567890ab         -- target block 0, Key A using key 1234567890ab");
@@ -223,7 +241,7 @@ static int usage_hf14_chk(void) {
 }
 static int usage_hf14_chk_fast(void) {
     PrintAndLogEx(NORMAL, "This is a improved checkkeys method speedwise. It checks Mifare Classic tags sector keys against a dictionary file with keys");
-    PrintAndLogEx(NORMAL, "Usage:  hf mf fchk [h] <card memory> [t|d|f] [<key (12 hex symbols)>] [<dic (*.dic)>]");
+    PrintAndLogEx(NORMAL, "Usage:  hf mf fchk [h] <card memory> [t|d|m|n] [<key (12 hex symbols)>] [<dic (*.dic)>]");
     PrintAndLogEx(NORMAL, "Options:");
     PrintAndLogEx(NORMAL, "      h    this help");
     PrintAndLogEx(NORMAL, "      <cardmem> all sectors based on card memory, other values than below defaults to 1k");
@@ -233,7 +251,8 @@ static int usage_hf14_chk_fast(void) {
     PrintAndLogEx(NORMAL, "                 4 - 4K");
     PrintAndLogEx(NORMAL, "      d    write keys to binary file");
     PrintAndLogEx(NORMAL, "      t    write keys to emulator memory");
-    PrintAndLogEx(NORMAL, "      m    use dictionary from flashmemory\n");
+    PrintAndLogEx(NORMAL, "      m    use dictionary from flashmemory");
+    PrintAndLogEx(NORMAL, "      n    keep the key order, don't use or update the key statistics in " MF_KEYHITS_FILE "\n");
     PrintAndLogEx(NORMAL, "");
     PrintAndLogEx(NORMAL, "Examples:");
     PrintAndLogEx(NORMAL, "      hf mf fchk 1 1234567890ab         -- target 1K using key 1234567890ab");
@@ -466,6 +485,21 @@ static int GetHFMF14AUID(uint8_t *uid, int *uidlen) {
     return 1;
 }
 
+// ATQA, SAK and first UID byte of the card in the field for the key statistics, 0 without a card
+static uint32_t GetHFMF14AFingerprint(void) {
+    clearCommandBuffer();
+    SendCommandMIX(CMD_HF_ISO14443A_READER, ISO14A_CONNECT, 0, 0, NULL, 0);
+    PacketResponseNG resp;
+    if (!WaitForResponseTimeout(CMD_ACK, &resp, 2500) || resp.oldarg[0] == 0) {
+        DropField();
+        return 0;
+    }
+
+    iso14a_card_select_t card;
+    memcpy(&card, (iso14a_card_select_t *)resp.data.asBytes, sizeof(iso14a_card_select_t));
+    return mfKeyHitsFingerprint(card.atqa, card.sak, card.uid);
+}
+
 static char *GenerateFilename(const char *prefix, const char *suffix) {
     uint8_t uid[10] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
     int uidlen = 0;
@@ -803,6 +837,39 @@ static int FastDumpWithEcFill(uint8_t numsectors) {
     return PM3_SUCCESS;
 }
 
+// C1C2C3 of the data areas and the sector trailer from the access bytes of a sector trailer
+static void mf_dump_rights(uint8_t *data, uint8_t *rights) {
+    rights[0] = ((data[7] & 0x10) >> 2) | ((data[8] & 0x1) << 1) | ((data[8] & 0x10) >> 4); // C1C2C3 for data area 0
+    rights[1] = ((data[7] & 0x20) >> 3) | ((data[8] & 0x2) << 0) | ((data[8] & 0x20) >> 5); // C1C2C3 for data area 1
+    rights[2] = ((data[7] & 0x40) >> 4) | ((data[8] & 0x4) >> 1) | ((data[8] & 0x40) >> 6); // C1C2C3 for data area 2
+    rights[3] = ((data[7] & 0x80) >> 5) | ((data[8] & 0x8) >> 2) | ((data[8] & 0x80) >> 7); // C1C2C3 for sector trailer
+}
+
+typedef struct {
+    uint8_t (*keyA)[6];
+    uint8_t (*rights)[4];
+    bool *have_rights;
+} mf_dump_rights_t;
+
+static uint16_t mf_dump_rights_send(uint32_t sectorNo, void *ctx) {
+    mf_dump_rights_t *d = ctx;
+    mf_readblock_t payload;
+    payload.blockno = FirstBlockOfSector(sectorNo) + NumBlocksPerSector(sectorNo) - 1;
+    payload.keytype = 0;
+    memcpy(payload.key, d->keyA[sectorNo], sizeof(payload.key));
+    return SendCommandNGSeq(CMD_HF_MIFARE_READBL, (uint8_t *)&payload, sizeof(mf_readblock_t));
+}
+
+static int mf_dump_rights_reply(uint32_t sectorNo, PacketResponseNG *resp, void *ctx) {
+    mf_dump_rights_t *d = ctx;
+    // failed sectors are retried one by one
+    if (resp->status == PM3_SUCCESS) {
+        mf_dump_rights(resp->data.asBytes, d->rights[sectorNo]);
+        d->have_rights[sectorNo] = true;
+    }
+    return PM3_SUCCESS;
+}
+
 static int CmdHF14AMfDump(const char *Cmd) {
 
     uint64_t t1 = msclock();
@@ -811,6 +878,7 @@ static int CmdHF14AMfDump(const char *Cmd) {
     uint8_t keyA[40][6];
     uint8_t keyB[40][6];
     uint8_t rights[40][4];
+    bool have_rights[40] = {false};
     uint8_t carddata[256][16];
     uint8_t numSectors = 16;
     uint8_t cmdp = 0;
@@ -887,9 +955,16 @@ static int CmdHF14AMfDump(const char *Cmd) {
 
     PrintAndLogEx(INFO, "Reading sector access bits...");
 
+    // all sector trailers in one go, several reads in flight
+    mf_dump_rights_t rights_ctx = {keyA, rights, have_rights};
+    SendCommandsPipelined(numSectors, CMD_HF_MIFARE_READBL, 1500, mf_dump_rights_send, mf_dump_rights_reply, &rights_ctx);
+
     uint8_t tries;
     mf_readblock_t payload;
     for (sectorNo = 0; sectorNo < numSectors; sectorNo++) {
+        if (have_rights[sectorNo])
+            continue;
+
         for (tries = 0; tries < MIFARE_SECTOR_RETRY; tries++) {
             printf(".");
             fflush(NULL);
@@ -905,10 +980,7 @@ static int CmdHF14AMfDump(const char *Cmd) {
 
                 uint8_t *data = resp.data.asBytes;
                 if (resp.status == PM3_SUCCESS) {
-                    rights[sectorNo][0] = ((data[7] & 0x10) >> 2) | ((data[8] & 0x1) << 1) | ((data[8] & 0x10) >> 4); // C1C2C3 for data area 0
-                    rights[sectorNo][1] = ((data[7] & 0x20) >> 3) | ((data[8] & 0x2) << 0) | ((data[8] & 0x20) >> 5); // C1C2C3 for data area 1
-                    rights[sectorNo][2] = ((data[7] & 0x40) >> 4) | ((data[8] & 0x4) >> 1) | ((data[8] & 0x40) >> 6); // C1C2C3 for data area 2
-                    rights[sectorNo][3] = ((data[7] & 0x80) >> 5) | ((data[8] & 0x8) >> 2) | ((data[8] & 0x80) >> 7); // C1C2C3 for sector trailer
+                    mf_dump_rights(data, rights[sectorNo]);
                     break;
                 } else if (tries == 2) { // on last try set defaults
                     PrintAndLogEx(FAILED, "could not get access rights for sector %2d. Trying with defaults...", sectorNo);
@@ -1178,10 +1250,20 @@ static int CmdHF14AMfNested(const char *Cmd) {
     bool transferToEml = false;
     bool createDumpFile = false;
 
-    if (strlen(Cmd) < 3) return usage_hf14_nested();
-
     char cmdp, ctmp;
     cmdp = tolower(param_getchar(Cmd, 0));
+    if (cmdp == 'b') {
+        uint32_t iterations = param_get32ex(Cmd, 1, 10, 10);
+        return mfnested_benchmark(iterations);
+    }
+
+    if (strlen(Cmd) < 3) return usage_hf14_nested();
+
+    if (!IfPm3Iso14443a()) {
+        PrintAndLogEx(WARNING, "This command is not available in this mode, only the benchmark " _YELLOW_("hf mf nested b") " is");
+        return PM3_ENOTIMPL;
+    }
+
     uint8_t blockNo = param_get8(Cmd, 1);
     ctmp = tolower(param_getchar(Cmd, 2));
 
@@ -1229,8 +1311,11 @@ static int CmdHF14AMfNested(const char *Cmd) {
         return 3;
     }
 
+    mfnested_reset_stats();
+
     if (cmdp == 'o') {
         int16_t isOK = mfnested(blockNo, keyType, key, trgBlockNo, trgKeyType, keyBlock, true);
+        mfnested_print_stats();
         switch (isOK) {
             case -1 :
                 PrintAndLogEx(ERR, "Error: No response from Proxmark3.\n");
@@ -1343,7 +1428,9 @@ static int CmdHF14AMfNested(const char *Cmd) {
         }
 
         t1 = msclock() - t1;
-        PrintAndLogEx(SUCCESS, "time in nested: %.0f seconds\n", (float)t1 / 1000.0);
+        PrintAndLogEx(SUCCESS, "time in nested: %.0f seconds", (float)t1 / 1000.0);
+        mfnested_print_stats();
+        PrintAndLogEx(NORMAL, "");
 
 
         // 20160116 If Sector A is found, but not Sector B,  try just reading it of the tag?
@@ -1387,8 +1474,6 @@ jumptoend:
 
         // transfer them to the emulator
         if (transferToEml) {
-            // fast push mode
-            conn.block_after_ACK = true;
             for (int i = 0; i < SectorsCnt; i++) {
                 mfEmlGetMem(keyBlock, FirstBlockOfSector(i) + NumBlocksPerSector(i) - 1, 1);
 
@@ -1398,10 +1483,6 @@ jumptoend:
                 if (e_sector[i].foundKey[1])
                     num_to_bytes(e_sector[i].Key[1], 6, &keyBlock[10]);
 
-                if (i == SectorsCnt - 1) {
-                    // Disable fast mode on last packet
-                    conn.block_after_ACK = false;
-                }
                 mfEmlSetMem(keyBlock, FirstBlockOfSector(i) + NumBlocksPerSector(i) - 1, 1);
             }
             PrintAndLogEx(SUCCESS, "keys transferred to emulator memory.");
@@ -1458,12 +1539,14 @@ static int CmdHF14AMfNestedHard(const char *Cmd) {
     uint8_t cmdp = 0;
     char filename[FILE_PATH_SIZE] = {0}, *fptr;
     char szTemp[FILE_PATH_SIZE - 20];
+    char work_filename[FILE_PATH_SIZE] = {0};
     char ctmp;
 
     bool know_target_key = false;
     bool nonce_file_read = false;
     bool nonce_file_write = false;
     bool slow = false;
+    bool resume = false;
     int tests = 0;
 
     switch (tolower(param_getchar(Cmd, cmdp))) {
@@ -1489,6 +1572,11 @@ static int CmdHF14AMfNestedHard(const char *Cmd) {
             }
             cmdp += 2;
             break;
+        case 'c':
+            param_getstr(Cmd, cmdp + 1, filename, FILE_PATH_SIZE);
+            return hardnested_create_bitflip_cache(filename);
+        case 'b':
+            return hardnested_benchmark();
         default:
             if (param_getchar(Cmd, cmdp) == 0x00) {
                 PrintAndLogEx(WARNING, "Block number is missing");
@@ -1555,6 +1643,13 @@ static int CmdHF14AMfNestedHard(const char *Cmd) {
                 strncpy(filename, szTemp, FILE_PATH_SIZE - 20);
                 cmdp++;
                 break;
+            case 'x':
+                if (param_getstr(Cmd, cmdp + 1, work_filename, FILE_PATH_SIZE) == 0) {
+                    PrintAndLogEx(WARNING, "Work file name is missing");
+                    return 1;
+                }
+                cmdp++;
+                break;
             case 'i':
                 SetSIMDInstr(SIMD_AUTO);
                 ctmp = tolower(param_getchar(Cmd, cmdp + 1));
@@ -1583,6 +1678,15 @@ static int CmdHF14AMfNestedHard(const char *Cmd) {
                 }
                 cmdp += 2;
                 break;
+            case '-':
+                param_getstr(Cmd, cmdp, szTemp, sizeof(szTemp));
+                if (strcmp(szTemp, "--resume") != 0) {
+                    PrintAndLogEx(WARNING, "Unknown parameter '%s'\n", szTemp);
+                    usage_hf14_hardnested();
+                    return 1;
+                }
+                resume = true;
+                break;
             default:
                 PrintAndLogEx(WARNING, "Unknown parameter '%c'\n", ctmp);
                 usage_hf14_hardnested();
@@ -1591,6 +1695,11 @@ static int CmdHF14AMfNestedHard(const char *Cmd) {
         cmdp++;
     }
 
+    if (resume && !nonce_file_read) {
+        PrintAndLogEx(WARNING, "Option --resume requires reading the nonces from file (option r)");
+        return 1;
+    }
+
     if (!know_target_key && nonce_file_read == false) {
         uint64_t key64 = 0;
         // check if we can authenticate to sector
@@ -1610,7 +1719,7 @@ static int CmdHF14AMfNestedHard(const char *Cmd) {
                   tests);
 
     uint64_t foundkey = 0;
-    int16_t isOK = mfnestedhard(blockNo, keyType, key, trgBlockNo, trgKeyType, know_target_key ? trgkey : NULL, nonce_file_read, nonce_file_write, slow, tests, &foundkey, filename);
+    int16_t isOK = mfnestedhard(blockNo, keyType, key, trgBlockNo, trgKeyType, know_target_key ? trgkey : NULL, nonce_file_read, nonce_file_write, slow, resume, strlen(work_filename) ? work_filename : NULL, tests, &foundkey, filename);
 
     DropField();
     if (isOK) {
@@ -1629,6 +1738,336 @@ static int CmdHF14AMfNestedHard(const char *Cmd) {
     return 0;
 }
 
+// time spent by autopwn in each phase. The nested attack collects nonces and checks
+// candidates on the device while the host recovers the keys of other targets, so its
+// phases overlap and nested_wall is what they took together.
+typedef struct {
+    uint64_t dictionary;
+    uint64_t darkside;
+    uint64_t reuse;             // found keys tried on the other sectors, B keys read
+    uint64_t nested_nonces;
+    uint64_t nested_recover;    // host time summed over the targets
+    uint64_t nested_check;
+    uint64_t nested_wall;
+    uint64_t hardnested;
+    uint64_t dump;
+} autopwn_timing_t;
+
+static void autopwn_print_timing(autopwn_timing_t *timing, uint64_t total) {
+    PrintAndLogEx(NORMAL, "");
+    PrintAndLogEx(INFO, "  phase                     seconds");
+    PrintAndLogEx(INFO, "  ------------------------+--------");
+    PrintAndLogEx(INFO, "  dictionary              | %7.1f", timing->dictionary / 1000.0);
+    PrintAndLogEx(INFO, "  darkside                | %7.1f", timing->darkside / 1000.0);
+    PrintAndLogEx(INFO, "  key reuse / read key B  | %7.1f", timing->reuse / 1000.0);
+    PrintAndLogEx(INFO, "  nested nonces  (device) | %7.1f", timing->nested_nonces / 1000.0);
+    PrintAndLogEx(INFO, "  nested recover   (host) | %7.1f", timing->nested_recover / 1000.0);
+    PrintAndLogEx(INFO, "  nested check   (device) | %7.1f", timing->nested_check / 1000.0);
+    PrintAndLogEx(INFO, "  nested, overlapped      | %7.1f", timing->nested_wall / 1000.0);
+    PrintAndLogEx(INFO, "  hardnested              | %7.1f", timing->hardnested / 1000.0);
+    PrintAndLogEx(INFO, "  dump                    | %7.1f", timing->dump / 1000.0);
+    PrintAndLogEx(INFO, "  ------------------------+--------");
+    PrintAndLogEx(INFO, "  total                   | %7.1f", total / 1000.0);
+}
+
+// tries a found key on all sectors still missing keys
+static void autopwn_reuse_key(sector_t *e_sector, uint8_t sectors_cnt, uint8_t *key) {
+    uint64_t key64 = 0;
+    for (int i = 0; i < sectors_cnt; i++) {
+        for (int j = 0; j < 2; j++) {
+            // Check if the sector key is already broken
+            if (e_sector[i].foundKey[j])
+                continue;
+
+            // Check if the key works
+            if (mfCheckKeys(FirstBlockOfSector(i), j, true, 1, key, &key64) == PM3_SUCCESS) {
+                e_sector[i].Key[j] = bytes_to_num(key, 6);
+                e_sector[i].foundKey[j] = 'R';
+                PrintAndLogEx(SUCCESS, "target sector:%3u key type: %c -- found valid key [  " _YELLOW_("%s") "]",
+                              i,
+                              j ? 'B' : 'A',
+                              sprint_hex(key, 6)
+                             );
+            }
+        }
+    }
+}
+
+// reads key B from the sector trailer with key A, if the access bits allow it
+static bool autopwn_read_keyB(sector_t *e_sector, uint8_t sector, bool verbose) {
+    if (e_sector[sector].foundKey[0] == 0 || e_sector[sector].foundKey[1])
+        return false;
+
+    if (verbose) {
+        PrintAndLogEx(INFO, _YELLOW_("======================= START READ B KEY ATTACK ======================="));
+        PrintAndLogEx(INFO, "reading  B  key: sector: %3d key type: %c", sector, 'B');
+    }
+    uint8_t sectrail = (FirstBlockOfSector(sector) + NumBlocksPerSector(sector) - 1);
+
+    mf_readblock_t payload;
+    payload.blockno = sectrail;
+    payload.keytype = 0;
+
+    num_to_bytes(e_sector[sector].Key[0], 6, payload.key); // KEY A
+
+    clearCommandBuffer();
+    SendCommandNG(CMD_HF_MIFARE_READBL, (uint8_t *)&payload, sizeof(mf_readblock_t));
+
+    PacketResponseNG resp;
+    if (!WaitForResponseTimeout(CMD_HF_MIFARE_READBL, &resp, 1500) || resp.status != PM3_SUCCESS)
+        return false;
+
+    uint8_t *data = resp.data.asBytes;
+    uint64_t key64 = bytes_to_num(data + 10, 6);
+    if (key64) {
+        e_sector[sector].foundKey[1] = 'A';
+        e_sector[sector].Key[1] = key64;
+        PrintAndLogEx(SUCCESS, "target sector:%3u key type: %c -- found valid key [  " _YELLOW_("%s") "]",
+                      sector,
+                      'B',
+                      sprint_hex(data + 10, 6)
+                     );
+    } else {
+        if (verbose) PrintAndLogEx(WARNING, "unknown  B  key: sector: %3d key type: %c (reading the B key was not possible, maybe due to insufficient access rights) ",
+                                       sector,
+                                       'B'
+                                      );
+    }
+    if (verbose) PrintAndLogEx(INFO, _YELLOW_("======================= STOP  READ B KEY ATTACK ======================="));
+    return key64 != 0;
+}
+
+typedef enum {
+    NESTED_WAITING,             // for its nonces
+    NESTED_RECOVERING,
+    NESTED_RECOVERED,
+    NESTED_DONE,
+} nested_state_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t recovered;
+    int recover_threads;    // threads of each recovery
+} nested_pipe_t;
+
+// a target key of the nested pipeline
+typedef struct {
+    uint8_t sector;
+    uint8_t keytype;
+    uint8_t retries;
+    nested_state_t state;
+    StateList_t statelists[2];
+    int32_t keycnt;
+    uint64_t ms;
+    pthread_t thread;
+    bool threaded;
+    nested_pipe_t *pipe;
+} nested_job_t;
+
+static void *nested_recover_thread(void *arg) {
+    nested_job_t *job = arg;
+    uint64_t t1 = msclock();
+    int32_t keycnt = mfnested_recover(job->statelists, job->pipe->recover_threads);
+
+    pthread_mutex_lock(&job->pipe->lock);
+    job->keycnt = keycnt;
+    job->ms = msclock() - t1;
+    job->state = NESTED_RECOVERED;
+    pthread_cond_signal(&job->pipe->recovered);
+    pthread_mutex_unlock(&job->pipe->lock);
+    return NULL;
+}
+
+static nested_job_t *nested_next(nested_job_t *jobs, uint16_t njobs, nested_state_t state) {
+    for (uint16_t i = 0; i < njobs; i++)
+        if (jobs[i].state == state)
+            return &jobs[i];
+    return NULL;
+}
+
+// Nested attack on all keys still missing. The device collects the nonces of the next
+// targets while the host recovers the keys of the previous ones, a few targets at a time
+// sharing the CPUs. Recovered candidates are checked first, a key found is tried on the other sectors
+// right away and spares their nonces. Keys left over need hardnested, *nested_failed
+// says so.
+static int autopwn_nested(sector_t *e_sector, uint8_t sectors_cnt, uint8_t blockNo, uint8_t keyType, uint8_t *key,
+                          bool *calibrate, bool *nested_failed, bool verbose, autopwn_timing_t *timing) {
+
+    nested_job_t *jobs = calloc(sectors_cnt * 2, sizeof(nested_job_t));
+    if (jobs == NULL)
+        return PM3_EMALLOC;
+
+    nested_pipe_t pipe;
+    pthread_mutex_init(&pipe.lock, NULL);
+    pthread_cond_init(&pipe.recovered, NULL);
+
+    // A keys first, once one is found key B can often be read from the sector trailer
+    uint16_t njobs = 0;
+    for (uint8_t j = 0; j < 2; j++) {
+        for (uint8_t i = 0; i < sectors_cnt; i++) {
+            if (e_sector[i].foundKey[j])
+                continue;
+            jobs[njobs].sector = i;
+            jobs[njobs].keytype = j;
+            jobs[njobs].state = NESTED_WAITING;
+            jobs[njobs].pipe = &pipe;
+            njobs++;
+        }
+    }
+
+    // each recovery is threaded itself, the CPUs are split between the concurrent ones.
+    // Two at least, so the nonces of the next target are collected meanwhile
+    int max_recovering = MAX(2, MIN(4, num_CPUs()));
+    pipe.recover_threads = MAX(1, num_CPUs() / max_recovering);
+    int recovering = 0;
+    int res = PM3_SUCCESS;
+    bool stop = false;
+    uint64_t t_wall = msclock();
+
+    while (true) {
+
+        // candidates first, a key found may spare the nonces of other targets
+        pthread_mutex_lock(&pipe.lock);
+        nested_job_t *job = nested_next(jobs, njobs, NESTED_RECOVERED);
+        pthread_mutex_unlock(&pipe.lock);
+
+        if (job) {
+            if (job->threaded)
+                pthread_join(job->thread, NULL);
+            recovering--;
+            pthread_mutex_lock(&pipe.lock);
+            job->state = NESTED_DONE;
+            pthread_mutex_unlock(&pipe.lock);
+            timing->nested_recover += job->ms;
+
+            if (job->keycnt < 0) {
+                PrintAndLogEx(ERR, "Out of memory");
+                res = PM3_EMALLOC;
+                stop = true;
+            } else if (res == PM3_SUCCESS && e_sector[job->sector].foundKey[job->keytype] == 0) {
+                uint8_t found_key[6];
+                uint64_t t1 = msclock();
+                int isOK = mfnested_check(job->statelists, job->keycnt, found_key);
+                timing->nested_check += msclock() - t1;
+
+                if (isOK == -5) {
+                    e_sector[job->sector].Key[job->keytype] = bytes_to_num(found_key, 6);
+                    e_sector[job->sector].foundKey[job->keytype] = 'N';
+                    PrintAndLogEx(SUCCESS, "target sector:%3u key type: %c -- found valid key [  " _YELLOW_("%s") "]",
+                                  job->sector,
+                                  job->keytype ? 'B' : 'A',
+                                  sprint_hex(found_key, sizeof(found_key))
+                                 );
+                    // key B of the sectors whose key A is new
+                    t1 = msclock();
+                    bool had_keyA[MIFARE_4K_MAXSECTOR] = {false};
+                    for (uint8_t i = 0; i < sectors_cnt; i++)
+                        had_keyA[i] = (e_sector[i].foundKey[0] && i != job->sector);
+                    autopwn_reuse_key(e_sector, sectors_cnt, found_key);
+                    for (uint8_t i = 0; i < sectors_cnt; i++)
+                        if (had_keyA[i] == false)
+                            autopwn_read_keyB(e_sector, i, verbose);
+                    timing->reuse += msclock() - t1;
+                } else if (job->retries++ < MIFARE_SECTOR_RETRY) {
+                    // this can happen on some old cards, it's worth trying some more before switching to slower hardnested
+                    PrintAndLogEx(FAILED, "Nested attack failed, trying again (%i/%i)", job->retries, MIFARE_SECTOR_RETRY);
+                    job->state = NESTED_WAITING;
+                } else {
+                    PrintAndLogEx(FAILED, "Nested attack failed, moving to hardnested");
+                    *nested_failed = true;
+                    stop = true;
+                }
+            }
+            mfnested_free(job->statelists);
+            continue;
+        }
+
+        // nonces of the next target while the host is busy
+        pthread_mutex_lock(&pipe.lock);
+        job = nested_next(jobs, njobs, NESTED_WAITING);
+        while (job && e_sector[job->sector].foundKey[job->keytype]) {
+            job->state = NESTED_DONE;
+            job = nested_next(jobs, njobs, NESTED_WAITING);
+        }
+        pthread_mutex_unlock(&pipe.lock);
+
+        if (job && !stop && recovering < max_recovering) {
+
+            if (kbd_enter_pressed()) {
+                PrintAndLogEx(WARNING, "\naborted via keyboard!\n");
+                res = PM3_EOPABORTED;
+                stop = true;
+                continue;
+            }
+
+            if (verbose) {
+                PrintAndLogEx(INFO, _YELLOW_("======================= START   NESTED   ATTACK ======================="));
+                PrintAndLogEx(INFO, "sector no: %3d, target key type: %c", job->sector, job->keytype ? 'B' : 'A');
+            }
+
+            uint64_t t1 = msclock();
+            int isOK = mfnested_acquire(FirstBlockOfSector(blockNo), keyType, key, FirstBlockOfSector(job->sector), job->keytype, *calibrate, job->statelists);
+            timing->nested_nonces += msclock() - t1;
+
+            switch (isOK) {
+                case PM3_SUCCESS:
+                    *calibrate = false;
+                    pthread_mutex_lock(&pipe.lock);
+                    job->state = NESTED_RECOVERING;
+                    pthread_mutex_unlock(&pipe.lock);
+                    recovering++;
+                    job->threaded = (pthread_create(&job->thread, NULL, nested_recover_thread, job) == 0);
+                    // no thread, recover it here
+                    if (job->threaded == false)
+                        nested_recover_thread(job);
+                    break;
+                case -1 :
+                    PrintAndLogEx(ERR, "\nError: No response from Proxmark3.");
+                    res = PM3_ESOFT;
+                    stop = true;
+                    break;
+                case -2 :
+                    PrintAndLogEx(WARNING, "\nButton pressed. Aborted.");
+                    res = PM3_EOPABORTED;
+                    stop = true;
+                    break;
+                case -3 :
+                    PrintAndLogEx(FAILED, "Tag isn't vulnerable to Nested Attack (PRNG is probably not predictable).");
+                    PrintAndLogEx(FAILED, "Nested attack failed --> try hardnested");
+                    *nested_failed = true;
+                    stop = true;
+                    break;
+                default :
+                    *calibrate = false;
+                    if (job->retries++ < MIFARE_SECTOR_RETRY) {
+                        PrintAndLogEx(FAILED, "Nested attack failed, trying again (%i/%i)", job->retries, MIFARE_SECTOR_RETRY);
+                    } else {
+                        PrintAndLogEx(FAILED, "Nested attack failed, moving to hardnested");
+                        *nested_failed = true;
+                        stop = true;
+                    }
+                    break;
+            }
+            continue;
+        }
+
+        if (recovering == 0)
+            break;
+
+        // the device is idle, wait for the host
+        pthread_mutex_lock(&pipe.lock);
+        while (nested_next(jobs, njobs, NESTED_RECOVERED) == NULL)
+            pthread_cond_wait(&pipe.recovered, &pipe.lock);
+        pthread_mutex_unlock(&pipe.lock);
+    }
+
+    timing->nested_wall += msclock() - t_wall;
+    pthread_cond_destroy(&pipe.recovered);
+    pthread_mutex_destroy(&pipe.lock);
+    free(jobs);
+    return res;
+}
+
 static int CmdHF14AMfAutoPWN(const char *Cmd) {
     // Nested and Hardnested parameter
     uint8_t blockNo = 0;
@@ -1638,14 +2077,15 @@ static int CmdHF14AMfAutoPWN(const char *Cmd) {
     bool calibrate = true;
     // Attack key storage variables
     uint8_t *keyBlock = NULL;
-    uint16_t key_cnt = 0;
+    uint32_t key_cnt = 0;
     sector_t *e_sector;
     uint8_t sectors_cnt = MIFARE_1K_MAXSECTOR;
     int block_cnt = MIFARE_1K_MAXBLOCK;
     uint8_t tmp_key[6] = {0};
     bool know_target_key = false;
     // For the timer
-    uint64_t t1;
+    uint64_t t1, t2;
+    autopwn_timing_t timing = {0};
     // Parameters and dictionary file
     char filename[FILE_PATH_SIZE] = {0};
     uint8_t cmdp = 0;
@@ -1898,6 +2338,7 @@ static int CmdHF14AMfAutoPWN(const char *Cmd) {
 
     // Use the dictionary to find sector keys on the card
     if (verbose) PrintAndLogEx(INFO, _YELLOW_("======================= START DICTIONARY ATTACK ======================="));
+    t2 = msclock();
 
     if (legacy_mfchk) {
         // Check all the sectors
@@ -1923,38 +2364,38 @@ static int CmdHF14AMfAutoPWN(const char *Cmd) {
     } else {
 
         int chunksize = key_cnt > (PM3_CMD_DATA_SIZE / 6) ? (PM3_CMD_DATA_SIZE / 6) : key_cnt;
-        bool firstChunk = true, lastChunk = false;
 
         for (uint8_t strategy = 1; strategy < 3; strategy++) {
             PrintAndLogEx(INFO, "running strategy %u", strategy);
+
+            chkkeys_fast_stream_t stream;
+            mfCheckKeys_fast_stream_start(&stream, sectors_cnt, strategy, e_sector);
+
             // main keychunk loop
+            bool aborted = false;
             for (int i = 0; i < key_cnt; i += chunksize) {
 
                 if (kbd_enter_pressed()) {
                     PrintAndLogEx(WARNING, "\naborted via keyboard!\n");
-                    i = key_cnt;
-                    strategy = 3;
+                    mfCheckKeys_fast_stream_abort(&stream);
+                    aborted = true;
                     break; // Exit the loop
                 }
                 uint32_t size = ((key_cnt - i)  > chunksize) ? chunksize : key_cnt - i;
                 // last chunk?
-                if (size == key_cnt - i)
-                    lastChunk = true;
-
-                int res = mfCheckKeys_fast(sectors_cnt, firstChunk, lastChunk, strategy, size, keyBlock + (i * 6), e_sector, false);
-                if (firstChunk)
-                    firstChunk = false;
-                // all keys,  aborted
-                if (res == PM3_SUCCESS) {
-                    i = key_cnt;
-                    strategy = 3;
-                    break; // Exit the loop
-                }
+                bool lastChunk = (size == key_cnt - i);
+
+                if (mfCheckKeys_fast_stream_add(&stream, lastChunk, size, keyBlock + (i * 6)) != PM3_ESOFT)
+                    break;
             } // end chunks of keys
-            firstChunk = true;
-            lastChunk = false;
+
+            // all keys,  aborted
+            int res = mfCheckKeys_fast_stream_end(&stream);
+            if (res == PM3_SUCCESS || res == PM3_EOPABORTED || aborted)
+                break;
         } // end strategy
     }
+    timing.dictionary = msclock() - t2;
     if (verbose) PrintAndLogEx(INFO, _YELLOW_("======================= STOP  DICTIONARY ATTACK ======================="));
 
 
@@ -1992,7 +2433,9 @@ static int CmdHF14AMfAutoPWN(const char *Cmd) {
         // Check if the darkside attack can be used
         if (prng_type) {
             if (verbose) PrintAndLogEx(INFO, _YELLOW_("======================= START  DARKSIDE  ATTACK ======================="));
+            t2 = msclock();
             int isOK = mfDarkside(FirstBlockOfSector(blockNo), keyType, &key64);
+            timing.darkside = msclock() - t2;
             if (verbose) PrintAndLogEx(INFO, _YELLOW_("======================= STOP   DARKSIDE  ATTACK ======================="));
             switch (isOK) {
                 case -1 :
@@ -2038,181 +2481,87 @@ noValidKeyFound:
     num_to_bytes(0, 6, tmp_key);
     bool nested_failed = false;
 
-    // Iterate over each sector and key(A/B)
+    // the key all the attacks below authenticate with
+    num_to_bytes(e_sector[blockNo].Key[keyType], 6, key);
+
+    if (prng_type) {
+        int res = autopwn_nested(e_sector, sectors_cnt, blockNo, keyType, key, &calibrate, &nested_failed, verbose, &timing);
+        if (verbose) PrintAndLogEx(INFO, _YELLOW_("======================= STOP    NESTED   ATTACK ======================="));
+        if (res != PM3_SUCCESS) {
+            free(e_sector);
+            return res;
+        }
+    }
+
+    // Iterate over each sector and key(A/B) left
     for (current_sector_i = 0; current_sector_i < sectors_cnt; current_sector_i++) {
         for (current_key_type_i = 0; current_key_type_i < 2; current_key_type_i++) {
 
             // If the key is already known, just skip it
             if (e_sector[current_sector_i].foundKey[current_key_type_i] == 0) {
 
+                t2 = msclock();
                 // Try the found keys are reused
                 if (bytes_to_num(tmp_key, 6) != 0) {
                     // <!> The fast check --> mfCheckKeys_fast(sectors_cnt, true, true, 2, 1, tmp_key, e_sector, false);
                     // <!> Returns false keys, so we just stick to the slower mfchk.
-                    for (int i = 0; i < sectors_cnt; i++) {
-                        for (int j = 0; j < 2; j++) {
-                            // Check if the sector key is already broken
-                            if (e_sector[i].foundKey[j])
-                                continue;
-
-                            // Check if the key works
-                            if (mfCheckKeys(FirstBlockOfSector(i), j, true, 1, tmp_key, &key64) == PM3_SUCCESS) {
-                                e_sector[i].Key[j] = bytes_to_num(tmp_key, 6);
-                                e_sector[i].foundKey[j] = 'R';
-                                PrintAndLogEx(SUCCESS, "target sector:%3u key type: %c -- found valid key [  " _YELLOW_("%s") "]",
-                                              i,
-                                              j ? 'B' : 'A',
-                                              sprint_hex(tmp_key, sizeof(tmp_key))
-                                             );
-                            }
-                        }
-                    }
+                    autopwn_reuse_key(e_sector, sectors_cnt, tmp_key);
                 }
                 // Clear the last found key
                 num_to_bytes(0, 6, tmp_key);
 
-                if (current_key_type_i == 1) {
-                    if (e_sector[current_sector_i].foundKey[0] && !e_sector[current_sector_i].foundKey[1]) {
-                        if (verbose) {
-                            PrintAndLogEx(INFO, _YELLOW_("======================= START READ B KEY ATTACK ======================="));
-                            PrintAndLogEx(INFO, "reading  B  key: sector: %3d key type: %c",
-                                          current_sector_i,
-                                          current_key_type_i ? 'B' : 'A');
-                        }
-                        uint8_t sectrail = (FirstBlockOfSector(current_sector_i) + NumBlocksPerSector(current_sector_i) - 1);
-
-                        mf_readblock_t payload;
-                        payload.blockno = sectrail;
-                        payload.keytype = 0;
-
-                        num_to_bytes(e_sector[current_sector_i].Key[0], 6, payload.key); // KEY A
-
-                        clearCommandBuffer();
-                        SendCommandNG(CMD_HF_MIFARE_READBL, (uint8_t *)&payload, sizeof(mf_readblock_t));
-
-                        PacketResponseNG resp;
-                        if (!WaitForResponseTimeout(CMD_HF_MIFARE_READBL, &resp, 1500)) goto skipReadBKey;
-
-                        if (resp.status != PM3_SUCCESS) goto skipReadBKey;
+                if (current_key_type_i == 1 && autopwn_read_keyB(e_sector, current_sector_i, verbose))
+                    num_to_bytes(e_sector[current_sector_i].Key[1], 6, tmp_key);
+                timing.reuse += msclock() - t2;
 
-                        uint8_t *data = resp.data.asBytes;
-                        key64 = bytes_to_num(data + 10, 6);
-                        if (key64) {
-                            e_sector[current_sector_i].foundKey[current_key_type_i] = 'A';
-                            e_sector[current_sector_i].Key[current_key_type_i] = key64;
-                            num_to_bytes(key64, 6, tmp_key);
-                            PrintAndLogEx(SUCCESS, "target sector:%3u key type: %c -- found valid key [  " _YELLOW_("%s") "]",
-                                          current_sector_i,
-                                          current_key_type_i ? 'B' : 'A',
-                                          sprint_hex(tmp_key, sizeof(tmp_key))
-                                         );
-                        } else {
-                            if (verbose) PrintAndLogEx(WARNING, "unknown  B  key: sector: %3d key type: %c (reading the B key was not possible, maybe due to insufficient access rights) ",
-                                                           current_sector_i,
-                                                           current_key_type_i ? 'B' : 'A'
-                                                          );
-                        }
-                        if (verbose) PrintAndLogEx(INFO, _YELLOW_("======================= STOP  READ B KEY ATTACK ======================="));
+                // Use the hardnested attack
+                if (e_sector[current_sector_i].foundKey[current_key_type_i] == 0) {
+                    if (verbose) {
+                        PrintAndLogEx(INFO, _YELLOW_("======================= START HARDNESTED ATTACK ======================="));
+                        PrintAndLogEx(INFO, "sector no: %3d, target key type: %c, Slow: %s",
+                                      current_sector_i,
+                                      current_key_type_i ? 'B' : 'A',
+                                      slow ? "Yes" : "No");
                     }
-                }
 
-                // Use the nested / hardnested attack
-skipReadBKey:
-                if (e_sector[current_sector_i].foundKey[current_key_type_i] == 0) {
-                    if (prng_type && (! nested_failed)) {
-                        uint8_t retries = 0;
-                        if (verbose) {
-                            PrintAndLogEx(INFO, _YELLOW_("======================= START   NESTED   ATTACK ======================="));
-                            PrintAndLogEx(INFO, "sector no: %3d, target key type: %c",
-                                          current_sector_i,
-                                          current_key_type_i ? 'B' : 'A');
-                        }
-tryNested:
-                        isOK = mfnested(FirstBlockOfSector(blockNo), keyType, key, FirstBlockOfSector(current_sector_i), current_key_type_i, tmp_key, calibrate);
+                    t2 = msclock();
+                    isOK = mfnestedhard(FirstBlockOfSector(blockNo), keyType, key, FirstBlockOfSector(current_sector_i), current_key_type_i, NULL, false, false, slow, false, NULL, 0, &foundkey, NULL);
+                    DropField();
+                    timing.hardnested += msclock() - t2;
+                    if (isOK) {
                         switch (isOK) {
-                            case -1 :
+                            case 1 :
                                 PrintAndLogEx(ERR, "\nError: No response from Proxmark3.");
-                                free(e_sector);
-                                return PM3_ESOFT;
-                            case -2 :
-                                PrintAndLogEx(WARNING, "\nButton pressed. Aborted.");
-                                free(e_sector);
-                                return PM3_ESOFT;
-                            case -3 :
-                                PrintAndLogEx(FAILED, "Tag isn't vulnerable to Nested Attack (PRNG is probably not predictable).");
-                                PrintAndLogEx(FAILED, "Nested attack failed --> try hardnested");
-                                goto tryHardnested;
-                            case -4 : //key not found
-                                calibrate = false;
-                                // this can happen on some old cards, it's worth trying some more before switching to slower hardnested
-                                if (retries++ < MIFARE_SECTOR_RETRY) {
-                                    PrintAndLogEx(FAILED, "Nested attack failed, trying again (%i/%i)", retries, MIFARE_SECTOR_RETRY);
-                                    goto tryNested;
-                                } else {
-                                    PrintAndLogEx(FAILED, "Nested attack failed, moving to hardnested");
-                                    nested_failed = true;
-                                    goto tryHardnested;
-                                }
                                 break;
-                            case -5 :
-                                calibrate = false;
-                                e_sector[current_sector_i].Key[current_key_type_i] = bytes_to_num(tmp_key, 6);
-                                e_sector[current_sector_i].foundKey[current_key_type_i] = 'N';
+                            case 2 :
+                                PrintAndLogEx(NORMAL, "\nButton pressed. Aborted.");
                                 break;
                             default :
-                                PrintAndLogEx(ERR, "unknown Error.\n");
-                                free(e_sector);
-                                return PM3_ESOFT;
-                        }
-                        if (verbose) PrintAndLogEx(INFO, _YELLOW_("======================= STOP    NESTED   ATTACK ======================="));
-                    } else {
-tryHardnested: // If the nested attack fails then we try the hardnested attack
-                        if (verbose) {
-                            PrintAndLogEx(INFO, _YELLOW_("======================= START HARDNESTED ATTACK ======================="));
-                            PrintAndLogEx(INFO, "sector no: %3d, target key type: %c, Slow: %s",
-                                          current_sector_i,
-                                          current_key_type_i ? 'B' : 'A',
-                                          slow ? "Yes" : "No");
+                                break;
                         }
+                        free(e_sector);
+                        return PM3_ESOFT;
+                    }
 
-                        isOK = mfnestedhard(FirstBlockOfSector(blockNo), keyType, key, FirstBlockOfSector(current_sector_i), current_key_type_i, NULL, false, false, slow, 0, &foundkey, NULL);
-                        DropField();
-                        if (isOK) {
-                            switch (isOK) {
-                                case 1 :
-                                    PrintAndLogEx(ERR, "\nError: No response from Proxmark3.");
-                                    break;
-                                case 2 :
-                                    PrintAndLogEx(NORMAL, "\nButton pressed. Aborted.");
-                                    break;
-                                default :
-                                    break;
-                            }
-                            free(e_sector);
-                            return PM3_ESOFT;
-                        }
+                    // Copy the found key to the tmp_key variale (for the following print statement, and the key reuse above)
+                    num_to_bytes(foundkey, 6, tmp_key);
+                    e_sector[current_sector_i].Key[current_key_type_i] = foundkey;
+                    e_sector[current_sector_i].foundKey[current_key_type_i] = 'H';
 
-                        // Copy the found key to the tmp_key variale (for the following print statement, and the mfCheckKeys above)
-                        num_to_bytes(foundkey, 6, tmp_key);
-                        e_sector[current_sector_i].Key[current_key_type_i] = foundkey;
-                        e_sector[current_sector_i].foundKey[current_key_type_i] = 'H';
+                    if (verbose) PrintAndLogEx(INFO, _YELLOW_("======================= STOP  HARDNESTED ATTACK ======================="));
 
-                        if (verbose) PrintAndLogEx(INFO, _YELLOW_("======================= STOP  HARDNESTED ATTACK ======================="));
-                    }
-                    // Check if the key was found
-                    if (e_sector[current_sector_i].foundKey[current_key_type_i]) {
-                        PrintAndLogEx(SUCCESS, "target sector:%3u key type: %c -- found valid key [  " _YELLOW_("%s") "]",
-                                      current_sector_i,
-                                      current_key_type_i ? 'B' : 'A',
-                                      sprint_hex(tmp_key, sizeof(tmp_key))
-                                     );
-                    }
+                    PrintAndLogEx(SUCCESS, "target sector:%3u key type: %c -- found valid key [  " _YELLOW_("%s") "]",
+                                  current_sector_i,
+                                  current_key_type_i ? 'B' : 'A',
+                                  sprint_hex(tmp_key, sizeof(tmp_key))
+                                 );
                 }
             }
         }
     }
 
 all_found:
+    t2 = msclock();
 
     // Show the results to the user
     PrintAndLogEx(NORMAL, "");
@@ -2303,7 +2652,9 @@ all_found:
     saveFileJSON(filename, jsfCardMemory, dump, bytes);
 
     // Generate and show statistics
+    timing.dump = msclock() - t2;
     t1 = msclock() - t1;
+    autopwn_print_timing(&timing, t1);
     PrintAndLogEx(INFO, "autopwn execution time: " _YELLOW_("%.0f") " seconds", (float)t1 / 1000.0);
 
     free(dump);
@@ -2334,23 +2685,70 @@ static void shuffle(uint8_t *array, uint16_t len) {
 }
 */
 
+// Keys of hf mf chk / fchk: command line and text dictionary keys in keyBlock, then a mapped
+// compiled dictionary. Chunks straddling both are copied to buf.
+static uint8_t *get_key_chunk(uint8_t *keyBlock, uint32_t keycnt, dictionary_t *dict, uint64_t first, uint32_t count, uint8_t *buf) {
+    if (first + count <= keycnt)
+        return keyBlock + first * 6;
+    if (first >= keycnt)
+        return dict->keys + (first - keycnt) * 6;
+    uint32_t n = keycnt - first;
+    memcpy(buf, keyBlock + first * 6, n * 6);
+    memcpy(buf + n * 6, dict->keys, (count - n) * 6);
+    return buf;
+}
+
+// Adds a dictionary file to the keys. Text dictionaries are appended to keyBlock, a compiled one is kept mapped.
+static int add_dictionary(const char *filename, uint8_t **keyBlock, int *keycnt, uint32_t *keyitems, dictionary_t *dict) {
+    dictionary_t d;
+    int res = openFileDICTIONARY(filename, 6, &d);
+    if (res != PM3_SUCCESS)
+        return res;
+
+    if (d.map != NULL) {
+        if (dict->map != NULL) {
+            PrintAndLogEx(WARNING, "Only one compiled dictionary at a time, skipping " _YELLOW_("%s"), filename);
+            closeFileDICTIONARY(&d);
+        } else {
+            *dict = d;
+        }
+        return PM3_SUCCESS;
+    }
+
+    if (*keycnt + d.keycount + 2 > *keyitems) {
+        uint8_t *p = realloc(*keyBlock, 6 * (*keycnt + d.keycount + 64));
+        if (!p) {
+            PrintAndLogEx(FAILED, "Cannot allocate memory for default keys");
+            closeFileDICTIONARY(&d);
+            return PM3_EMALLOC;
+        }
+        *keyBlock = p;
+        *keyitems = *keycnt + d.keycount + 64;
+    }
+    memcpy(*keyBlock + 6 * *keycnt, d.keys, 6 * d.keycount);
+    *keycnt += d.keycount;
+    closeFileDICTIONARY(&d);
+    return PM3_SUCCESS;
+}
+
 static int CmdHF14AMfChk_fast(const char *Cmd) {
 
     char ctmp = 0x00;
     ctmp = tolower(param_getchar(Cmd, 0));
     if (strlen(Cmd) < 1 || ctmp == 'h') return usage_hf14_chk_fast();
 
-    FILE *f;
     char filename[FILE_PATH_SIZE] = {0};
-    char buf[13];
     char *fptr;
     uint8_t *keyBlock, *p;
     uint8_t sectorsCnt = 1;
     int i, keycnt = 0;
+    dictionary_t dict = {0};
     int clen = 0;
     int transferToEml = 0, createDumpFile = 0;
     uint32_t keyitems = ARRAYLEN(g_mifare_default_keys);
     bool use_flashmemory = false;
+    bool use_keyhits = true;
+    uint32_t fingerprint = 0;
 
     sector_t *e_sector = NULL;
 
@@ -2405,6 +2803,7 @@ static int CmdHF14AMfChk_fast(const char *Cmd) {
             if (ctmp == 't') { transferToEml = 1; continue; }
             if (ctmp == 'd') { createDumpFile = 1; continue; }
             if ((ctmp == 'm') && (IfPm3Flash())) { use_flashmemory = true; continue; }
+            if (ctmp == 'n') { use_keyhits = false; continue; }
         } else {
             // May be a dic file
             if (param_getstr(Cmd, i, filename, FILE_PATH_SIZE) >= FILE_PATH_SIZE) {
@@ -2413,58 +2812,16 @@ static int CmdHF14AMfChk_fast(const char *Cmd) {
                 return PM3_EINVARG;
             }
 
-            char *dict_path;
-            int res = searchFile(&dict_path, DICTIONARIES_SUBDIR, filename, ".dic", false);
+            int res = add_dictionary(filename, &keyBlock, &keycnt, &keyitems, &dict);
             if (res != PM3_SUCCESS) {
                 free(keyBlock);
+                closeFileDICTIONARY(&dict);
                 return res;
             }
-            f = fopen(dict_path, "r");
-            if (!f) {
-                PrintAndLogEx(FAILED, "File: " _YELLOW_("%s") ": not found or locked.", dict_path);
-                free(dict_path);
-                free(keyBlock);
-                return PM3_EFILE;
-            }
-            free(dict_path);
-
-            // read file
-            while (fgets(buf, sizeof(buf), f)) {
-                if (strlen(buf) < 12 || buf[11] == '\n')
-                    continue;
-
-                while (fgetc(f) != '\n' && !feof(f)) ;  //goto next line
-
-                if (buf[0] == '#') continue; //The line start with # is comment, skip
-
-                if (!isxdigit(buf[0])) {
-                    PrintAndLogEx(FAILED, "File content error. '" _YELLOW_("%s")"' must include 12 HEX symbols", buf);
-                    continue;
-                }
-
-                buf[12] = 0;
-                if (keyitems - keycnt < 2) {
-                    p = realloc(keyBlock, 6 * (keyitems += 64));
-                    if (!p) {
-                        PrintAndLogEx(FAILED, "Cannot allocate memory for default keys");
-                        free(keyBlock);
-                        fclose(f);
-                        return PM3_EMALLOC;
-                    }
-                    keyBlock = p;
-                }
-                int pos = 6 * keycnt;
-                memset(keyBlock + pos, 0, 6);
-                num_to_bytes(strtoll(buf, NULL, 16), 6, keyBlock + pos);
-                keycnt++;
-                memset(buf, 0, sizeof(buf));
-            }
-            fclose(f);
-            PrintAndLogEx(SUCCESS, "Loaded %2d keys from " _YELLOW_("%s"), keycnt, filename);
         }
     }
 
-    if (keycnt == 0 && !use_flashmemory) {
+    if (keycnt == 0 && dict.keycount == 0 && !use_flashmemory) {
         PrintAndLogEx(SUCCESS, "No key specified, trying default keys");
         for (; keycnt < ARRAYLEN(g_mifare_default_keys); keycnt++)
             PrintAndLogEx(NORMAL, "[%2d] %02x%02x%02x%02x%02x%02x", keycnt,
@@ -2472,15 +2829,24 @@ static int CmdHF14AMfChk_fast(const char *Cmd) {
                           (keyBlock + 6 * keycnt)[3], (keyBlock + 6 * keycnt)[4], (keyBlock + 6 * keycnt)[5]);
     }
 
+    // keys that opened cards like this one first
+    if (use_keyhits) {
+        fingerprint = GetHFMF14AFingerprint();
+        if (fingerprint && !use_flashmemory)
+            mfKeyHitsReorder(fingerprint, &keyBlock, &keycnt, &keyitems, &dict);
+    }
+
     // // initialize storage for found keys
     e_sector = calloc(sectorsCnt, sizeof(sector_t));
     if (e_sector == NULL) {
         free(keyBlock);
+        closeFileDICTIONARY(&dict);
         return PM3_EMALLOC;
     }
 
-    uint32_t chunksize = keycnt > (PM3_CMD_DATA_SIZE / 6) ? (PM3_CMD_DATA_SIZE / 6) : keycnt;
-    bool firstChunk = true, lastChunk = false;
+    uint64_t total = keycnt + dict.keycount;
+    uint8_t chunk_buf[PM3_CMD_DATA_SIZE];
+    uint32_t chunksize = total > (PM3_CMD_DATA_SIZE / 6) ? (PM3_CMD_DATA_SIZE / 6) : total;
 
     // time
     uint64_t t1 = msclock();
@@ -2494,37 +2860,40 @@ static int CmdHF14AMfChk_fast(const char *Cmd) {
         for (uint8_t strategy = 1; strategy < 3; strategy++) {
             PrintAndLogEx(SUCCESS, "Running strategy %u", strategy);
 
-            // main keychunk loop
-            for (i = 0; i < keycnt; i += chunksize) {
+            chkkeys_fast_stream_t stream;
+            mfCheckKeys_fast_stream_start(&stream, sectorsCnt, strategy, e_sector);
+
+            // main keychunk loop, the next chunk is queued while the device works on the current one
+            for (uint64_t k = 0; k < total; k += chunksize) {
 
                 if (kbd_enter_pressed()) {
                     PrintAndLogEx(WARNING, "\naborted via keyboard!\n");
+                    mfCheckKeys_fast_stream_abort(&stream);
                     goto out;
                 }
 
-                uint32_t size = ((keycnt - i)  > chunksize) ? chunksize : keycnt - i;
+                uint32_t size = ((total - k)  > chunksize) ? chunksize : total - k;
 
                 // last chunk?
-                if (size == keycnt - i)
-                    lastChunk = true;
+                bool lastChunk = (size == total - k);
 
-                int res = mfCheckKeys_fast(sectorsCnt, firstChunk, lastChunk, strategy, size, keyBlock + (i * 6), e_sector, false);
-
-                if (firstChunk)
-                    firstChunk = false;
-
-                // all keys,  aborted
-                if (res == PM3_SUCCESS || res == 2)
-                    goto out;
+                uint8_t *keys = get_key_chunk(keyBlock, keycnt, &dict, k, size, chunk_buf);
+                if (mfCheckKeys_fast_stream_add(&stream, lastChunk, size, keys) != PM3_ESOFT)
+                    break;
             } // end chunks of keys
-            firstChunk = true;
-            lastChunk = false;
+
+            // all keys,  aborted
+            if (mfCheckKeys_fast_stream_end(&stream) != PM3_ESOFT)
+                goto out;
         } // end strategy
     }
 out:
     t1 = msclock() - t1;
     PrintAndLogEx(SUCCESS, "Time in checkkeys (fast):  %.1fs\n", (float)(t1 / 1000.0));
 
+    if (fingerprint)
+        mfKeyHitsRecord(fingerprint, e_sector, sectorsCnt);
+
     // check..
     uint8_t found_keys = 0;
     for (i = 0; i < sectorsCnt; ++i) {
@@ -2550,8 +2919,6 @@ out:
         }
 
         if (transferToEml) {
-            // fast push mode
-            conn.block_after_ACK = true;
             uint8_t block[16] = {0x00};
             for (i = 0; i < sectorsCnt; ++i) {
                 uint8_t blockno = FirstBlockOfSector(i) + NumBlocksPerSector(i) - 1;
@@ -2560,10 +2927,6 @@ out:
                     num_to_bytes(e_sector[i].Key[0], 6, block);
                 if (e_sector[i].foundKey[1])
                     num_to_bytes(e_sector[i].Key[1], 6, block + 10);
-                if (i == sectorsCnt - 1) {
-                    // Disable fast mode on last packet
-                    conn.block_after_ACK = false;
-                }
                 mfEmlSetMem(block, blockno, 1);
             }
             PrintAndLogEx(SUCCESS, "Found keys have been transferred to the emulator memory");
@@ -2580,6 +2943,7 @@ out:
     }
 
     free(keyBlock);
+    closeFileDICTIONARY(&dict);
     free(e_sector);
     PrintAndLogEx(NORMAL, "");
     return PM3_SUCCESS;
@@ -2590,10 +2954,9 @@ static int CmdHF14AMfChk(const char *Cmd) {
     char ctmp = tolower(param_getchar(Cmd, 0));
     if (strlen(Cmd) < 3 || ctmp == 'h') return usage_hf14_chk();
 
-    FILE *f;
     char filename[FILE_PATH_SIZE] = {0};
-    char buf[13];
     uint8_t *keyBlock, *p;
+    dictionary_t dict = {0};
     sector_t *e_sector = NULL;
 
     uint8_t blockNo = 0;
@@ -2606,6 +2969,8 @@ static int CmdHF14AMfChk(const char *Cmd) {
     int transferToEml = 0;
     int createDumpFile = 0;
     int i, keycnt = 0;
+    bool use_keyhits = true;
+    uint32_t fingerprint = 0;
 
     keyBlock = calloc(ARRAYLEN(g_mifare_default_keys), 6);
     if (keyBlock == NULL) return PM3_EMALLOC;
@@ -2670,6 +3035,7 @@ static int CmdHF14AMfChk(const char *Cmd) {
         } else if (clen == 1) {
             if (ctmp == 't') { transferToEml = 1; continue; }
             if (ctmp == 'd') { createDumpFile = 1; continue; }
+            if (ctmp == 'n') { use_keyhits = false; continue; }
         } else {
             // May be a dic file
             if (param_getstr(Cmd, i, filename, sizeof(filename)) >= FILE_PATH_SIZE) {
@@ -2678,60 +3044,16 @@ static int CmdHF14AMfChk(const char *Cmd) {
                 return PM3_EINVARG;
             }
 
-            char *dict_path;
-            int res = searchFile(&dict_path, DICTIONARIES_SUBDIR, filename, ".dic", false);
+            int res = add_dictionary(filename, &keyBlock, &keycnt, &keyitems, &dict);
             if (res != PM3_SUCCESS) {
                 free(keyBlock);
+                closeFileDICTIONARY(&dict);
                 return PM3_EFILE;
             }
-            f = fopen(dict_path, "r");
-            if (!f) {
-                PrintAndLogEx(FAILED, "File: " _YELLOW_("%s") ": not found or locked.", dict_path);
-                free(dict_path);
-                free(keyBlock);
-                return PM3_EFILE;
-            }
-            free(dict_path);
-
-            // load keys from dictionary file
-            while (fgets(buf, sizeof(buf), f)) {
-                if (strlen(buf) < 12 || buf[11] == '\n')
-                    continue;
-
-                while (fgetc(f) != '\n' && !feof(f)) ;  //goto next line
-
-                if (buf[0] == '#') continue; //The line start with # is comment, skip
-
-                // codesmell, only checks first char?
-                if (!isxdigit(buf[0])) {
-                    PrintAndLogEx(FAILED, "File content error. '" _YELLOW_("%s")"' must include 12 HEX symbols", buf);
-                    continue;
-                }
-
-                buf[12] = 0;
-
-                if (keyitems - keycnt < 2) {
-                    p = realloc(keyBlock, 6 * (keyitems += 64));
-                    if (!p) {
-                        PrintAndLogEx(FAILED, "Cannot allocate memory for defKeys");
-                        free(keyBlock);
-                        fclose(f);
-                        return PM3_EMALLOC;
-                    }
-                    keyBlock = p;
-                }
-                memset(keyBlock + 6 * keycnt, 0, 6);
-                num_to_bytes(strtoll(buf, NULL, 16), 6, keyBlock + 6 * keycnt);
-                //PrintAndLogEx(NORMAL, "check key[%2d] %012" PRIx64, keycnt, bytes_to_num(keyBlock + 6*keycnt, 6));
-                keycnt++;
-                memset(buf, 0, sizeof(buf));
-            }
-            fclose(f);
-            PrintAndLogEx(SUCCESS, "Loaded %2d keys from " _YELLOW_("%s"), keycnt, filename);
         }
     }
 
-    if (keycnt == 0) {
+    if (keycnt == 0 && dict.keycount == 0) {
         PrintAndLogEx(INFO, "No key specified, trying default keys");
         for (; keycnt < ARRAYLEN(g_mifare_default_keys); keycnt++)
             PrintAndLogEx(NORMAL, "[%2d] %02x%02x%02x%02x%02x%02x", keycnt,
@@ -2744,10 +3066,18 @@ static int CmdHF14AMfChk(const char *Cmd) {
                          );
     }
 
+    // keys that opened cards like this one first
+    if (use_keyhits) {
+        fingerprint = GetHFMF14AFingerprint();
+        if (fingerprint)
+            mfKeyHitsReorder(fingerprint, &keyBlock, &keycnt, &keyitems, &dict);
+    }
+
     // initialize storage for found keys
     e_sector = calloc(SectorsCnt, sizeof(sector_t));
     if (e_sector == NULL) {
         free(keyBlock);
+        closeFileDICTIONARY(&dict);
         return PM3_EMALLOC;
     }
 
@@ -2761,14 +3091,13 @@ static int CmdHF14AMfChk(const char *Cmd) {
 
 
     uint8_t trgKeyType = 0;
-    uint16_t max_keys = keycnt > KEYS_IN_BLOCK ? KEYS_IN_BLOCK : keycnt;
+    uint64_t total = keycnt + dict.keycount;
+    uint8_t chunk_buf[KEYBLOCK_SIZE];
+    uint16_t max_keys = total > KEYS_IN_BLOCK ? KEYS_IN_BLOCK : total;
 
     // time
     uint64_t t1 = msclock();
 
-    // fast push mode
-    conn.block_after_ACK = true;
-
     // clear trace log by first check keys call only
     bool clearLog = true;
     // check keys.
@@ -2780,7 +3109,7 @@ static int CmdHF14AMfChk(const char *Cmd) {
             // skip already found keys.
             if (e_sector[i].foundKey[trgKeyType]) continue;
 
-            for (uint16_t c = 0; c < keycnt; c += max_keys) {
+            for (uint64_t c = 0; c < total; c += max_keys) {
 
                 printf(".");
                 fflush(stdout);
@@ -2789,9 +3118,10 @@ static int CmdHF14AMfChk(const char *Cmd) {
                     goto out;
                 }
 
-                uint16_t size = keycnt - c > max_keys ? max_keys : keycnt - c;
+                uint16_t size = total - c > max_keys ? max_keys : total - c;
 
-                if (mfCheckKeys(b, trgKeyType, clearLog, size, &keyBlock[6 * c], &key64) == PM3_SUCCESS) {
+                uint8_t *keys = get_key_chunk(keyBlock, keycnt, &dict, c, size, chunk_buf);
+                if (mfCheckKeys(b, trgKeyType, clearLog, size, keys, &key64) == PM3_SUCCESS) {
                     e_sector[i].Key[trgKeyType] = key64;
                     e_sector[i].foundKey[trgKeyType] = true;
                     clearLog = false;
@@ -2846,9 +3176,10 @@ out:
     //print keys
     printKeyTable(SectorsCnt, e_sector);
 
+    if (fingerprint)
+        mfKeyHitsRecord(fingerprint, e_sector, SectorsCnt);
+
     if (transferToEml) {
-        // fast push mode
-        conn.block_after_ACK = true;
         uint8_t block[16] = {0x00};
         for (i = 0; i < SectorsCnt; ++i) {
             uint8_t blockno = FirstBlockOfSector(i) + NumBlocksPerSector(i) - 1;
@@ -2857,10 +3188,6 @@ out:
                 num_to_bytes(e_sector[i].Key[0], 6, block);
             if (e_sector[i].foundKey[1])
                 num_to_bytes(e_sector[i].Key[1], 6, block + 10);
-            if (i == SectorsCnt - 1) {
-                // Disable fast mode on last packet
-                conn.block_after_ACK = false;
-            }
             mfEmlSetMem(block, blockno, 1);
         }
         PrintAndLogEx(SUCCESS, "Found keys have been transferred to the emulator memory");
@@ -2871,16 +3198,9 @@ out:
         createMfcKeyDump(SectorsCnt, e_sector, fptr);
     }
     free(keyBlock);
+    closeFileDICTIONARY(&dict);
     free(e_sector);
 
-    // Disable fast mode and send a dummy command to make it effective
-    conn.block_after_ACK = false;
-    SendCommandNG(CMD_PING, NULL, 0);
-    if (!WaitForResponseTimeout(CMD_PING, NULL, 1000)) {
-        PrintAndLogEx(WARNING, "command execution time out");
-        return PM3_ETIMEOUT;
-    }
-
     PrintAndLogEx(NORMAL, "");
     return PM3_SUCCESS;
 }
@@ -3446,15 +3766,8 @@ int CmdHF14AMfELoad(const char *Cmd) {
 
     PrintAndLogEx(INFO, "Copying to emulator memory");
 
-    // fast push mode
-    conn.block_after_ACK = true;
     blockNum = 0;
     while (datalen) {
-        if (datalen == blockWidth) {
-            // Disable fast mode on last packet
-            conn.block_after_ACK = false;
-        }
-
         if (mfEmlSetMem_xt(data + counter, blockNum, 1, blockWidth) != PM3_SUCCESS) {
             PrintAndLogEx(FAILED, "Cant set emul block: %3d", blockNum);
             free(data);
@@ -3963,13 +4276,7 @@ static int CmdHF14AMfCSave(const char *Cmd) {
 
     if (fillEmulator) {
         PrintAndLogEx(INFO, "uploading to emulator memory");
-        // fast push mode
-        conn.block_after_ACK = true;
         for (i = 0; i < numblocks; i += 5) {
-            if (i == numblocks - 1) {
-                // Disable fast mode on last packet
-                conn.block_after_ACK = false;
-            }
             if (mfEmlSetMem(dump + (i * MFBLOCK_SIZE), i, 5) != PM3_SUCCESS) {
                 PrintAndLogEx(WARNING, "Cant set emul block: %d", i);
             }
@@ -4418,7 +4725,7 @@ static command_t CommandTable[] = {
     {"help",        CmdHelp,                AlwaysAvailable, "This help"},
     {"list",        CmdHF14AMfList,         AlwaysAvailable,  "List MIFARE history"},
     {"darkside",    CmdHF14AMfDarkside,     IfPm3Iso14443a,  "Darkside attack"},
-    {"nested",      CmdHF14AMfNested,       IfPm3Iso14443a,  "Nested attack"},
+    {"nested",      CmdHF14AMfNested,       AlwaysAvailable, "Nested attack"},
     {"hardnested",  CmdHF14AMfNestedHard,   AlwaysAvailable, "Nested attack for hardened MIFARE Classic cards"},
     {"autopwn",     CmdHF14AMfAutoPWN,      IfPm3Iso14443a,  "Automatic key recovery tool for MIFARE Classic"},
 //    {"keybrute",    CmdHF14AMfKeyBrute,     IfPm3Iso14443a,  "J_Run's 2nd phase of multiple sector nested authentication key recovery"},
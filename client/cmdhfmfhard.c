@@ -24,6 +24,11 @@
 #include <locale.h>
 #include <math.h>
 #include <time.h> // MingW
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
 
 #include "commonutil.h"  // ARRAYLEN
 #include "comms.h"
@@ -33,8 +38,10 @@
 #include "util_posix.h"
 #include "crapto1/crapto1.h"
 #include "parity.h"
+#include "crc32.h"
 #include "hardnested/hardnested_bf_core.h"
 #include "hardnested/hardnested_bitarray_core.h"
+#include "hardnested/hardnested_work.h"
 #include "zlib.h"
 #include "fileutils.h"
 
@@ -45,6 +52,7 @@
 
 #define STATE_FILES_DIRECTORY           "hardnested_tables/"
 #define STATE_FILE_TEMPLATE             "bitflip_%d_%03" PRIx16 "_states.bin.z"
+#define STATE_CACHE_FILE                "bitflip_states.cache"
 
 #define DEBUG_KEY_ELIMINATION
 // #define DEBUG_REDUCTION
@@ -112,7 +120,7 @@ static void print_progress_header(void) {
 
 void hardnested_print_progress(uint32_t nonces, const char *activity, float brute_force, uint64_t min_diff_print_time) {
     static uint64_t last_print_time = 0;
-    if (msclock() - last_print_time > min_diff_print_time) {
+    if (msclock() - last_print_time >= min_diff_print_time) {
         last_print_time = msclock();
         uint64_t total_time = msclock() - start_time;
         float brute_force_time = brute_force / brute_force_per_second;
@@ -232,7 +240,7 @@ static void init_inflate(z_streamp compressed_stream, uint8_t *input_buffer, uin
 }
 
 
-static void init_bitflip_bitarrays(void) {
+static void load_bitflip_bitarrays(void) {
 #if defined (DEBUG_REDUCTION)
     uint8_t line = 0;
 #endif
@@ -321,6 +329,167 @@ static void init_bitflip_bitarrays(void) {
         effective_bitflip[odd_even][num_effective_bitflips[odd_even]] = 0x400; // EndOfList marker
     }
 
+}
+
+
+//----------------------------------------------------------------------------
+// Bitflip state cache.
+// A single file holding all effective bitflip bitarrays uncompressed, so that
+// it can be mmap'ed read-only instead of inflating ~350 tables on each run.
+// Several concurrent clients mapping the same file share the physical pages.
+// Layout: header | index (one entry per bitarray) | padding to page size |
+//         bitarrays (2MiB each, in index order)
+//----------------------------------------------------------------------------
+#define BITFLIP_CACHE_MAGIC             "PM3HNBF"
+#define BITFLIP_CACHE_VERSION           1
+#define BITFLIP_CACHE_ALIGN             4096
+#define BITFLIP_BITARRAY_SIZE           (sizeof(uint32_t) * (1 << 19))
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_entries;
+    uint32_t data_offset;               // page aligned offset of the first bitarray
+    uint32_t bitarray_size;
+    uint64_t file_size;
+    uint32_t index_crc;                 // crc32 over the index entries
+    uint32_t header_crc;                // crc32 over this header with header_crc = 0
+} PACKED bitflip_cache_header_t;
+
+typedef struct {
+    uint8_t odd_even;
+    uint8_t reserved;
+    uint16_t bitflip;
+    uint32_t count;
+} PACKED bitflip_cache_entry_t;
+
+#ifndef _WIN32
+static void *bitflip_cache_map = NULL;
+static size_t bitflip_cache_map_size = 0;
+#endif
+
+static uint32_t bitflip_cache_data_offset(uint32_t num_entries) {
+    uint32_t offset = sizeof(bitflip_cache_header_t) + num_entries * sizeof(bitflip_cache_entry_t);
+    return (offset + BITFLIP_CACHE_ALIGN - 1) & ~(BITFLIP_CACHE_ALIGN - 1);
+}
+
+static uint32_t bitflip_cache_crc(const void *data, size_t len) {
+    uint32_t crc;
+    crc32_ex(data, len, (uint8_t *)&crc);
+    return crc;
+}
+
+static uint32_t bitflip_cache_header_crc(bitflip_cache_header_t *header) {
+    bitflip_cache_header_t tmp = *header;
+    tmp.header_crc = 0;
+    return bitflip_cache_crc(&tmp, sizeof(tmp));
+}
+
+// try to map a previously created cache file. Returns false if there is none (or it is unusable).
+static bool map_bitflip_cache(void) {
+#ifdef _WIN32
+    return false;
+#else
+    char *path;
+    if (searchHomeFilePath(&path, STATE_CACHE_FILE, false) != PM3_SUCCESS)
+        return false;
+
+    if (!fileExists(path)) {
+        free(path);
+        if (searchFile(&path, RESOURCES_SUBDIR, STATE_FILES_DIRECTORY STATE_CACHE_FILE, "", true) != PM3_SUCCESS)
+            return false;
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        free(path);
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(bitflip_cache_header_t)) {
+        PrintAndLogEx(WARNING, "Ignoring invalid bitflip cache %s", path);
+        close(fd);
+        free(path);
+        return false;
+    }
+
+    uint8_t *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        PrintAndLogEx(WARNING, "Could not map bitflip cache %s", path);
+        free(path);
+        return false;
+    }
+
+    bitflip_cache_header_t *header = (bitflip_cache_header_t *)map;
+    bitflip_cache_entry_t *index = (bitflip_cache_entry_t *)(map + sizeof(bitflip_cache_header_t));
+    if (memcmp(header->magic, BITFLIP_CACHE_MAGIC, sizeof(header->magic)) != 0
+            || header->version != BITFLIP_CACHE_VERSION
+            || header->bitarray_size != BITFLIP_BITARRAY_SIZE
+            || header->num_entries > 2 * 0x400
+            || header->data_offset != bitflip_cache_data_offset(header->num_entries)
+            || header->file_size != (uint64_t)st.st_size
+            || header->file_size != header->data_offset + (uint64_t)header->num_entries * BITFLIP_BITARRAY_SIZE
+            || header->header_crc != bitflip_cache_header_crc(header)
+            || header->index_crc != bitflip_cache_crc(index, header->num_entries * sizeof(bitflip_cache_entry_t))) {
+        PrintAndLogEx(WARNING, "Ignoring outdated or corrupt bitflip cache %s", path);
+        munmap(map, st.st_size);
+        free(path);
+        return false;
+    }
+
+    // the CRCs only catch accidents, the entries index the tables: in range and strictly
+    // increasing by odd_even, bitflip, which also leaves room for the EndOfList markers
+    uint32_t prev = 0;
+    for (uint32_t i = 0; i < header->num_entries; i++) {
+        uint32_t key = (index[i].odd_even << 16) | index[i].bitflip;
+        if (index[i].odd_even > ODD_STATE || index[i].bitflip == 0 || index[i].bitflip >= 0x400 || key <= prev) {
+            PrintAndLogEx(WARNING, "Ignoring corrupt bitflip cache %s", path);
+            munmap(map, st.st_size);
+            free(path);
+            return false;
+        }
+        prev = key;
+    }
+
+    for (odd_even_t odd_even = EVEN_STATE; odd_even <= ODD_STATE; odd_even++) {
+        num_effective_bitflips[odd_even] = 0;
+        for (uint16_t bitflip = 0x001; bitflip < 0x400; bitflip++) {
+            bitflip_bitarrays[odd_even][bitflip] = NULL;
+            count_bitflip_bitarrays[odd_even][bitflip] = 1 << 24;
+        }
+    }
+
+    // entries are stored sorted by odd_even, bitflip - the same order the tables are loaded in
+    for (uint32_t i = 0; i < header->num_entries; i++) {
+        odd_even_t odd_even = index[i].odd_even;
+        uint16_t bitflip = index[i].bitflip;
+        effective_bitflip[odd_even][num_effective_bitflips[odd_even]++] = bitflip;
+        bitflip_bitarrays[odd_even][bitflip] = (uint32_t *)(map + header->data_offset + (size_t)i * BITFLIP_BITARRAY_SIZE);
+        count_bitflip_bitarrays[odd_even][bitflip] = index[i].count;
+    }
+    effective_bitflip[EVEN_STATE][num_effective_bitflips[EVEN_STATE]] = 0x400; // EndOfList marker
+    effective_bitflip[ODD_STATE][num_effective_bitflips[ODD_STATE]] = 0x400;
+
+    if (g_debugMode == 2) {
+        PrintAndLogEx(INFO, "Mapped bitflip cache %s", path);
+    }
+    free(path);
+    bitflip_cache_map = map;
+    bitflip_cache_map_size = st.st_size;
+    return true;
+#endif
+}
+
+
+static void init_bitflip_bitarrays(void) {
+
+    bool mapped = map_bitflip_cache();
+    if (!mapped) {
+        load_bitflip_bitarrays();
+    }
+
     uint16_t i = 0;
     uint16_t j = 0;
     num_all_effective_bitflips = 0;
@@ -356,12 +525,20 @@ static void init_bitflip_bitarrays(void) {
     }
 #endif
     char progress_text[80];
-    sprintf(progress_text, "Using %d precalculated bitflip state tables", num_all_effective_bitflips);
+    sprintf(progress_text, "Using %d precalculated bitflip state tables%s", num_all_effective_bitflips, mapped ? " (cached)" : "");
     hardnested_print_progress(0, progress_text, (float)(1LL << 47), 0);
 }
 
 
 static void free_bitflip_bitarrays(void) {
+#ifndef _WIN32
+    if (bitflip_cache_map != NULL) {
+        munmap(bitflip_cache_map, bitflip_cache_map_size);
+        bitflip_cache_map = NULL;
+        memset(bitflip_bitarrays, 0, sizeof(bitflip_bitarrays));
+        return;
+    }
+#endif
     for (int16_t bitflip = 0x3ff; bitflip > 0x000; bitflip--) {
         free_bitarray(bitflip_bitarrays[ODD_STATE][bitflip]);
     }
@@ -371,6 +548,101 @@ static void free_bitflip_bitarrays(void) {
 }
 
 
+int hardnested_create_bitflip_cache(const char *filename) {
+    char *path = NULL;
+    if (filename == NULL || strlen(filename) == 0) {
+        if (searchHomeFilePath(&path, STATE_CACHE_FILE, true) != PM3_SUCCESS)
+            return PM3_EFILE;
+    } else {
+        path = calloc(strlen(filename) + 1, sizeof(char));
+        if (path == NULL)
+            return PM3_EMALLOC;
+        strcpy(path, filename);
+    }
+
+    start_time = msclock();
+    load_bitflip_bitarrays();
+
+    uint32_t num_entries = num_effective_bitflips[EVEN_STATE] + num_effective_bitflips[ODD_STATE];
+    if (num_entries == 0) {
+        PrintAndLogEx(ERR, "No bitflip state tables found, can't create cache");
+        free(path);
+        return PM3_EFILE;
+    }
+
+    bitflip_cache_entry_t *index = calloc(num_entries, sizeof(bitflip_cache_entry_t));
+    if (index == NULL) {
+        free_bitflip_bitarrays();
+        free(path);
+        return PM3_EMALLOC;
+    }
+    uint32_t n = 0;
+    for (odd_even_t odd_even = EVEN_STATE; odd_even <= ODD_STATE; odd_even++) {
+        for (uint16_t i = 0; i < num_effective_bitflips[odd_even]; i++) {
+            uint16_t bitflip = effective_bitflip[odd_even][i];
+            index[n].odd_even = odd_even;
+            index[n].bitflip = bitflip;
+            index[n].count = count_bitflip_bitarrays[odd_even][bitflip];
+            n++;
+        }
+    }
+
+    bitflip_cache_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BITFLIP_CACHE_MAGIC, sizeof(header.magic));
+    header.version = BITFLIP_CACHE_VERSION;
+    header.num_entries = num_entries;
+    header.data_offset = bitflip_cache_data_offset(num_entries);
+    header.bitarray_size = BITFLIP_BITARRAY_SIZE;
+    header.file_size = header.data_offset + (uint64_t)num_entries * BITFLIP_BITARRAY_SIZE;
+    header.index_crc = bitflip_cache_crc(index, num_entries * sizeof(bitflip_cache_entry_t));
+    header.header_crc = bitflip_cache_header_crc(&header);
+
+    // write to a temporary file first. Running clients may still have the old cache mapped.
+    char tmp_path[strlen(path) + 5];
+    sprintf(tmp_path, "%s.tmp", path);
+    FILE *f = fopen(tmp_path, "wb");
+    if (f == NULL) {
+        PrintAndLogEx(ERR, "Could not create file %s", tmp_path);
+        free(index);
+        free_bitflip_bitarrays();
+        free(path);
+        return PM3_EFILE;
+    }
+
+    bool ok = (fwrite(&header, sizeof(header), 1, f) == 1);
+    ok = ok && (fwrite(index, sizeof(bitflip_cache_entry_t), num_entries, f) == num_entries);
+    uint32_t padding = header.data_offset - sizeof(header) - num_entries * sizeof(bitflip_cache_entry_t);
+    uint8_t zeros[BITFLIP_CACHE_ALIGN] = {0};
+    ok = ok && (fwrite(zeros, 1, padding, f) == padding);
+    for (uint32_t i = 0; ok && i < num_entries; i++) {
+        ok = (fwrite(bitflip_bitarrays[index[i].odd_even][index[i].bitflip], BITFLIP_BITARRAY_SIZE, 1, f) == 1);
+    }
+    ok = (fclose(f) == 0) && ok;
+
+    free(index);
+    free_bitflip_bitarrays();
+
+    if (ok) {
+#ifdef _WIN32
+        remove(path);
+#endif
+        ok = (rename(tmp_path, path) == 0);
+    }
+    if (!ok) {
+        PrintAndLogEx(ERR, "Error writing bitflip cache %s", path);
+        remove(tmp_path);
+        free(path);
+        return PM3_EFILE;
+    }
+
+    PrintAndLogEx(SUCCESS, "Wrote %u bitflip state tables (%" PRIu64 " MiB) to " _YELLOW_("%s") " in %.1fs",
+                  num_entries, header.file_size >> 20, path, (float)(msclock() - start_time) / 1000.0);
+    free(path);
+    return PM3_SUCCESS;
+}
+
+
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // sum property bitarrays
 
@@ -521,6 +793,9 @@ static uint64_t last_sample_clock = 0;
 static uint64_t sample_period = 0;
 static uint64_t num_keys_tested = 0;
 static statelist_t *candidates = NULL;
+static const char *work_filename = NULL;
+static FILE *work_file = NULL;
+static hardnested_work_header_t work_header;
 
 
 static int add_nonce(uint32_t nonce_enc, uint8_t par_enc) {
@@ -1121,7 +1396,7 @@ static noncelistentry_t *SearchFor2ndByte(uint8_t b1, uint8_t b2) {
 
 
 static bool timeout(void) {
-    return (msclock() > last_sample_clock + sample_period);
+    return (msclock() > __atomic_load_n(&last_sample_clock, __ATOMIC_RELAXED) + __atomic_load_n(&sample_period, __ATOMIC_RELAXED));
 }
 
 
@@ -1376,15 +1651,112 @@ static void simulate_acquire_nonces() {
 }
 
 
+// Nonces are acquired by a producer thread while the main thread applies them.
+// Single producer, single consumer ring buffer of the device's replies.
+#define NONCE_QUEUE_SIZE    64  // replies, a power of 2
+
+typedef struct {
+    uint16_t num_sampled_nonces;
+    uint8_t data[PM3_CMD_DATA_SIZE];
+} nonce_batch_t;
+
+typedef struct {
+    nonce_batch_t batch[NONCE_QUEUE_SIZE];
+    uint32_t head;              // next batch to be written, written by the producer only
+    uint32_t tail;              // next batch to be read, written by the consumer only
+    bool stop;                  // acquisition completed, set by the consumer
+    bool done;                  // the producer has stopped
+    int result;                 // the producer's error, valid when done
+    uint8_t blockNo;
+    uint8_t keyType;
+    uint8_t trgBlockNo;
+    uint8_t trgKeyType;
+    uint8_t *key;
+    bool slow;
+    pm3_device_t *device;       // the device of the thread starting the acquisition
+} nonce_queue_t;
+
+
+static void
+#ifdef __has_attribute
+#if __has_attribute(force_align_arg_pointer)
+__attribute__((force_align_arg_pointer))
+#endif
+#endif
+*acquire_nonces_thread(void *args) {
+    nonce_queue_t *queue = (nonce_queue_t *)args;
+    int result = 0;
+    PacketResponseNG resp;
+
+    // threads start on the main device
+    SetCurrentDevice(queue->device);
+
+    while (!__atomic_load_n(&queue->stop, __ATOMIC_ACQUIRE)) {
+        // wait for a free slot
+        if (queue->head - __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE) == NONCE_QUEUE_SIZE) {
+            msleep(1);
+            continue;
+        }
+
+        clearCommandBuffer();
+        SendCommandMIX(CMD_HF_MIFARE_ACQ_ENCRYPTED_NONCES, queue->blockNo + queue->keyType * 0x100, queue->trgBlockNo + queue->trgKeyType * 0x100, queue->slow ? 0x0002 : 0, queue->key, 6);
+        if (!WaitForResponseTimeout(CMD_ACK, &resp, 3000)) {
+            result = 1;
+            break;
+        }
+        if (resp.oldarg[0]) {
+            result = resp.oldarg[0];  // error during nested_hard
+            break;
+        }
+
+        nonce_batch_t *batch = &queue->batch[queue->head % NONCE_QUEUE_SIZE];
+        batch->num_sampled_nonces = resp.oldarg[2];
+        memcpy(batch->data, resp.data.asBytes, sizeof(batch->data));
+        __atomic_store_n(&queue->head, queue->head + 1, __ATOMIC_RELEASE);
+
+        uint64_t now = msclock();
+        uint64_t last = __atomic_load_n(&last_sample_clock, __ATOMIC_RELAXED);
+        if (now - last < __atomic_load_n(&sample_period, __ATOMIC_RELAXED)) {
+            __atomic_store_n(&sample_period, now - last, __ATOMIC_RELAXED);
+        }
+        __atomic_store_n(&last_sample_clock, now, __ATOMIC_RELAXED);
+    }
+
+    queue->result = result;
+    __atomic_store_n(&queue->done, true, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+
+static void add_nonce_batch(nonce_batch_t *batch, FILE *fnonces) {
+    uint8_t *bufp = batch->data;
+    for (uint16_t i = 0; i < batch->num_sampled_nonces; i += 2) {
+        uint32_t nt_enc1 = bytes_to_num(bufp, 4);
+        uint32_t nt_enc2 = bytes_to_num(bufp + 4, 4);
+        uint8_t par_enc = bytes_to_num(bufp + 8, 1);
+
+        //PrintAndLogEx(NORMAL, "Encrypted nonce: %08x, encrypted_parity: %02x\n", nt_enc1, par_enc >> 4);
+        num_acquired_nonces += add_nonce(nt_enc1, par_enc >> 4);
+        //PrintAndLogEx(NORMAL, "Encrypted nonce: %08x, encrypted_parity: %02x\n", nt_enc2, par_enc & 0x0f);
+        num_acquired_nonces += add_nonce(nt_enc2, par_enc & 0x0f);
+
+        if (fnonces != NULL) {
+            fwrite(bufp, 1, 9, fnonces);
+        }
+        bufp += 9;
+    }
+    if (fnonces != NULL) {
+        fflush(fnonces);
+    }
+}
+
+
 static int acquire_nonces(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBlockNo, uint8_t trgKeyType, bool nonce_file_write, bool slow, char *filename) {
     last_sample_clock = msclock();
     sample_period = 2000; // initial rough estimate. Will be refined.
-    bool initialize = true;
-    bool field_off = false;
     hardnested_stage = CHECK_1ST_BYTES;
     bool acquisition_completed = false;
     uint8_t write_buf[9];
-    //uint32_t total_num_nonces = 0;
     float brute_force_depth;
     bool reported_suma8 = false;
     char progress_text[80];
@@ -1393,132 +1765,126 @@ static int acquire_nonces(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_
 
     num_acquired_nonces = 0;
 
-    clearCommandBuffer();
-
-    do {
-        uint32_t flags = 0;
-        flags |= initialize ? 0x0001 : 0;
-        flags |= slow ? 0x0002 : 0;
-        flags |= field_off ? 0x0004 : 0;
+    nonce_queue_t *queue = calloc(1, sizeof(nonce_queue_t));
+    if (queue == NULL) {
+        PrintAndLogEx(ERR, "Out of memory");
+        return PM3_EMALLOC;
+    }
+    queue->blockNo = blockNo;
+    queue->keyType = keyType;
+    queue->trgBlockNo = trgBlockNo;
+    queue->trgKeyType = trgKeyType;
+    queue->key = key;
+    queue->slow = slow;
+    queue->device = GetCurrentDevice();
 
+    // the first reply has the tag's UID, the producer thread is started afterwards
+    clearCommandBuffer();
+    SendCommandMIX(CMD_HF_MIFARE_ACQ_ENCRYPTED_NONCES, blockNo + keyType * 0x100, trgBlockNo + trgKeyType * 0x100, 0x0001 | (slow ? 0x0002 : 0), key, 6);
+    if (!WaitForResponseTimeout(CMD_ACK, &resp, 3000)) {
+        uint8_t nullkey[6] = {0};
+        //strange second call (iceman)
         clearCommandBuffer();
-        SendCommandMIX(CMD_HF_MIFARE_ACQ_ENCRYPTED_NONCES, blockNo + keyType * 0x100, trgBlockNo + trgKeyType * 0x100, flags, key, 6);
-
-        if (field_off) break;
-
-        if (initialize) {
-            if (!WaitForResponseTimeout(CMD_ACK, &resp, 3000)) {
-                uint8_t nullkey[6] = {0};
-                //strange second call (iceman)
-                clearCommandBuffer();
-                SendCommandMIX(CMD_HF_MIFARE_ACQ_ENCRYPTED_NONCES, blockNo + keyType * 0x100, trgBlockNo + trgKeyType * 0x100, 4, nullkey, sizeof(nullkey));
-                return 1;
-            }
-            if (resp.oldarg[0]) return resp.oldarg[0];  // error during nested_hard
+        SendCommandMIX(CMD_HF_MIFARE_ACQ_ENCRYPTED_NONCES, blockNo + keyType * 0x100, trgBlockNo + trgKeyType * 0x100, 4, nullkey, sizeof(nullkey));
+        free(queue);
+        return 1;
+    }
+    if (resp.oldarg[0]) {
+        free(queue);
+        return resp.oldarg[0];  // error during nested_hard
+    }
 
-            cuid = resp.oldarg[1];
-            if (nonce_file_write && fnonces == NULL) {
-                if ((fnonces = fopen(filename, "wb")) == NULL) {
-                    PrintAndLogEx(WARNING, "Could not create file %s", filename);
-                    return 3;
-                }
-                snprintf(progress_text, 80, "Writing acquired nonces to binary file %s", filename);
-                hardnested_print_progress(0, progress_text, (float)(1LL << 47), 0);
-                num_to_bytes(cuid, 4, write_buf);
-                fwrite(write_buf, 1, 4, fnonces);
-                fwrite(&trgBlockNo, 1, 1, fnonces);
-                fwrite(&trgKeyType, 1, 1, fnonces);
-                fflush(fnonces);
-            }
+    cuid = resp.oldarg[1];
+    if (nonce_file_write) {
+        if ((fnonces = fopen(filename, "wb")) == NULL) {
+            PrintAndLogEx(WARNING, "Could not create file %s", filename);
+            free(queue);
+            return 3;
         }
+        snprintf(progress_text, 80, "Writing acquired nonces to binary file %s", filename);
+        hardnested_print_progress(0, progress_text, (float)(1LL << 47), 0);
+        num_to_bytes(cuid, 4, write_buf);
+        fwrite(write_buf, 1, 4, fnonces);
+        fwrite(&trgBlockNo, 1, 1, fnonces);
+        fwrite(&trgKeyType, 1, 1, fnonces);
+        fflush(fnonces);
+    }
 
-        if (!initialize) {
-            uint16_t num_sampled_nonces = resp.oldarg[2];
-            uint8_t *bufp = resp.data.asBytes;
-            for (uint16_t i = 0; i < num_sampled_nonces; i += 2) {
-                uint32_t nt_enc1 = bytes_to_num(bufp, 4);
-                uint32_t nt_enc2 = bytes_to_num(bufp + 4, 4);
-                uint8_t par_enc = bytes_to_num(bufp + 8, 1);
+    queue->batch[0].num_sampled_nonces = resp.oldarg[2];
+    memcpy(queue->batch[0].data, resp.data.asBytes, sizeof(queue->batch[0].data));
+    queue->head = 1;
+    last_sample_clock = msclock();
 
-                //PrintAndLogEx(NORMAL, "Encrypted nonce: %08x, encrypted_parity: %02x\n", nt_enc1, par_enc >> 4);
-                num_acquired_nonces += add_nonce(nt_enc1, par_enc >> 4);
-                //PrintAndLogEx(NORMAL, "Encrypted nonce: %08x, encrypted_parity: %02x\n", nt_enc2, par_enc & 0x0f);
-                num_acquired_nonces += add_nonce(nt_enc2, par_enc & 0x0f);
+    pthread_t producer;
+    if (pthread_create(&producer, NULL, acquire_nonces_thread, queue) != 0) {
+        if (fnonces != NULL) {
+            fclose(fnonces);
+        }
+        free(queue);
+        return 1;
+    }
 
-                if (nonce_file_write) {
-                    fwrite(bufp, 1, 9, fnonces);
-                    fflush(fnonces);
-                }
-                bufp += 9;
-            }
-            //total_num_nonces += num_sampled_nonces;
-
-            if (first_byte_num == 256) {
-                if (hardnested_stage == CHECK_1ST_BYTES) {
-                    for (uint16_t i = 0; i < NUM_SUMS; i++) {
-                        if (first_byte_Sum == sums[i]) {
-                            first_byte_Sum = i;
-                            break;
-                        }
-                    }
-                    hardnested_stage |= CHECK_2ND_BYTES;
-                    apply_sum_a0();
-                }
-                update_nonce_data(true);
-                acquisition_completed = shrink_key_space(&brute_force_depth);
-                if (!reported_suma8) {
-                    char progress_string[80];
-                    sprintf(progress_string, "Apply Sum property. Sum(a0) = %d", sums[first_byte_Sum]);
-                    hardnested_print_progress(num_acquired_nonces, progress_string, brute_force_depth, 0);
-                    reported_suma8 = true;
-                } else {
-                    hardnested_print_progress(num_acquired_nonces, "Apply bit flip properties", brute_force_depth, 0);
-                }
-            } else {
-                update_nonce_data(true);
-                acquisition_completed = shrink_key_space(&brute_force_depth);
-                hardnested_print_progress(num_acquired_nonces, "Apply bit flip properties", brute_force_depth, 0);
+    int result = 0;
+    do {
+        // everything the device sent since the last reduction is applied at once
+        bool producer_done = __atomic_load_n(&queue->done, __ATOMIC_ACQUIRE);
+        uint32_t head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+        if (queue->tail == head) {
+            if (producer_done) {
+                result = queue->result;
+                break;
             }
+            msleep(1);
+            continue;
         }
-
-        if (acquisition_completed) {
-            field_off = true; // switch off field with next SendCommandOLD and then finish
+        for (uint32_t tail = queue->tail; tail != head; tail++) {
+            add_nonce_batch(&queue->batch[tail % NONCE_QUEUE_SIZE], fnonces);
         }
+        __atomic_store_n(&queue->tail, head, __ATOMIC_RELEASE);
 
-        if (!initialize) {
-            if (!WaitForResponseTimeout(CMD_ACK, &resp, 3000)) {
-                if (nonce_file_write) {
-                    fclose(fnonces);
+        if (first_byte_num == 256) {
+            if (hardnested_stage == CHECK_1ST_BYTES) {
+                for (uint16_t i = 0; i < NUM_SUMS; i++) {
+                    if (first_byte_Sum == sums[i]) {
+                        first_byte_Sum = i;
+                        break;
+                    }
                 }
-                return 1;
+                hardnested_stage |= CHECK_2ND_BYTES;
+                apply_sum_a0();
             }
-            if (resp.oldarg[0]) {
-                if (nonce_file_write) {
-                    fclose(fnonces);
-                }
-                return resp.oldarg[0];  // error during nested_hard
+            update_nonce_data(true);
+            acquisition_completed = shrink_key_space(&brute_force_depth);
+            if (!reported_suma8) {
+                char progress_string[80];
+                sprintf(progress_string, "Apply Sum property. Sum(a0) = %d", sums[first_byte_Sum]);
+                hardnested_print_progress(num_acquired_nonces, progress_string, brute_force_depth, 0);
+                reported_suma8 = true;
+            } else {
+                hardnested_print_progress(num_acquired_nonces, "Apply bit flip properties", brute_force_depth, 0);
             }
+        } else {
+            update_nonce_data(true);
+            acquisition_completed = shrink_key_space(&brute_force_depth);
+            hardnested_print_progress(num_acquired_nonces, "Apply bit flip properties", brute_force_depth, 0);
         }
+    } while (!acquisition_completed);
 
-        initialize = false;
-
-        if (msclock() - last_sample_clock < sample_period) {
-            sample_period = msclock() - last_sample_clock;
-        }
-        last_sample_clock = msclock();
+    __atomic_store_n(&queue->stop, true, __ATOMIC_RELEASE);
+    pthread_join(producer, NULL);
+    free(queue);
 
-    } while (!acquisition_completed || field_off);
+    if (acquisition_completed) {
+        // switch off field
+        clearCommandBuffer();
+        SendCommandMIX(CMD_HF_MIFARE_ACQ_ENCRYPTED_NONCES, blockNo + keyType * 0x100, trgBlockNo + trgKeyType * 0x100, 0x0004 | (slow ? 0x0002 : 0), key, 6);
+    }
 
     if (nonce_file_write) {
         fclose(fnonces);
     }
 
-    // PrintAndLogEx(NORMAL, "Sampled a total of %d nonces in %d seconds (%0.0f nonces/minute)",
-    // total_num_nonces,
-    // time(NULL)-time1,
-    // (float)total_num_nonces*60.0/(time(NULL)-time1));
-
-    return 0;
+    return result;
 }
 
 
@@ -1588,13 +1954,8 @@ static inline bool remaining_bits_match(uint_fast8_t num_common_bits, uint_fast8
 }
 
 
-static pthread_mutex_t statelist_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_mutex_t book_of_work_mutex = PTHREAD_MUTEX_INITIALIZER;
-
-
 typedef enum {
     TO_BE_DONE,
-    WORK_IN_PROGRESS,
     COMPLETED
 } work_status_t;
 
@@ -1606,7 +1967,6 @@ static struct sl_cache_entry {
 
 
 static void init_statelist_cache(void) {
-    pthread_mutex_lock(&statelist_cache_mutex);
     for (uint16_t i = 0; i < NUM_PART_SUMS; i++) {
         for (uint16_t j = 0; j < NUM_PART_SUMS; j++) {
             for (uint16_t k = 0; k < 2; k++) {
@@ -1616,12 +1976,10 @@ static void init_statelist_cache(void) {
             }
         }
     }
-    pthread_mutex_unlock(&statelist_cache_mutex);
 }
 
 
 static void free_statelist_cache(void) {
-    pthread_mutex_lock(&statelist_cache_mutex);
     for (uint16_t i = 0; i < NUM_PART_SUMS; i++) {
         for (uint16_t j = 0; j < NUM_PART_SUMS; j++) {
             for (uint16_t k = 0; k < 2; k++) {
@@ -1629,7 +1987,6 @@ static void free_statelist_cache(void) {
             }
         }
     }
-    pthread_mutex_unlock(&statelist_cache_mutex);
 }
 
 
@@ -1733,17 +2090,19 @@ static void add_cached_states(statelist_t *candidates, uint16_t part_sum_a0, uin
 }
 
 
-static void add_matching_states(statelist_t *candidates, uint8_t part_sum_a0, uint8_t part_sum_a8, odd_even_t odd_even) {
+// calculate the state list for one (part_sum_a0, part_sum_a8) cell and publish it in the statelist cache.
+// Each cell is calculated by exactly one thread, therefore no locking is required.
+static void add_matching_states(uint8_t part_sum_a0, uint8_t part_sum_a8, odd_even_t odd_even) {
     const uint32_t worstcase_size = 1 << 20;
-    candidates->states[odd_even] = (uint32_t *)malloc(sizeof(uint32_t) * worstcase_size);
-    if (candidates->states[odd_even] == NULL) {
+    uint32_t *states = (uint32_t *)malloc(sizeof(uint32_t) * worstcase_size);
+    if (states == NULL) {
         PrintAndLogEx(ERR, "Out of memory error in add_matching_states() - statelist.\n");
         exit(4);
     }
     uint32_t *candidates_bitarray = (uint32_t *)malloc_bitarray(sizeof(uint32_t) * worstcase_size);
     if (candidates_bitarray == NULL) {
         PrintAndLogEx(ERR, "Out of memory error in add_matching_states() - bitarray.\n");
-        free(candidates->states[odd_even]);
+        free(states);
         exit(4);
     }
 
@@ -1753,22 +2112,20 @@ static void add_matching_states(statelist_t *candidates, uint8_t part_sum_a0, ui
 
     bitarray_AND4(candidates_bitarray, bitarray_a0, bitarray_a8, bitarray_bitflips);
 
-    bitarray_to_list(best_first_bytes[0], candidates_bitarray, candidates->states[odd_even], &(candidates->len[odd_even]), odd_even);
+    uint32_t len;
+    bitarray_to_list(best_first_bytes[0], candidates_bitarray, states, &len, odd_even);
 
-    if (candidates->len[odd_even] == 0) {
-        free(candidates->states[odd_even]);
-        candidates->states[odd_even] = NULL;
-    } else if (candidates->len[odd_even] + 1 < worstcase_size) {
-        candidates->states[odd_even] = realloc(candidates->states[odd_even], sizeof(uint32_t) * (candidates->len[odd_even] + 1));
+    if (len == 0) {
+        free(states);
+        states = NULL;
+    } else if (len + 1 < worstcase_size) {
+        states = realloc(states, sizeof(uint32_t) * (len + 1));
     }
     free_bitarray(candidates_bitarray);
 
-    pthread_mutex_lock(&statelist_cache_mutex);
-    sl_cache[part_sum_a0 / 2][part_sum_a8 / 2][odd_even].sl = candidates->states[odd_even];
-    sl_cache[part_sum_a0 / 2][part_sum_a8 / 2][odd_even].len = candidates->len[odd_even];
+    sl_cache[part_sum_a0 / 2][part_sum_a8 / 2][odd_even].sl = states;
+    sl_cache[part_sum_a0 / 2][part_sum_a8 / 2][odd_even].len = len;
     sl_cache[part_sum_a0 / 2][part_sum_a8 / 2][odd_even].cache_status = COMPLETED;
-    pthread_mutex_unlock(&statelist_cache_mutex);
-    return;
 }
 
 static statelist_t *add_more_candidates(void) {
@@ -1856,20 +2213,61 @@ static bool TestIfKeyExists(uint64_t key) {
     return false;
 }
 
-static work_status_t book_of_work[NUM_PART_SUMS][NUM_PART_SUMS][NUM_PART_SUMS][NUM_PART_SUMS];
-
-static void init_book_of_work(void) {
-    for (uint8_t p = 0; p < NUM_PART_SUMS; p++) {
-        for (uint8_t q = 0; q < NUM_PART_SUMS; q++) {
-            for (uint8_t r = 0; r < NUM_PART_SUMS; r++) {
-                for (uint8_t s = 0; s < NUM_PART_SUMS; s++) {
-                    book_of_work[p][q][r][s] = TO_BE_DONE;
-                }
-            }
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// candidate generation
+//
+// The state lists of all (part_sum_a0, part_sum_a8, odd/even) cells required for a (Sum(a0), Sum(a8)) guess are
+// calculated by a pool of threads. The cells are sorted by their estimated size and dealt to per thread deques,
+// largest first. A thread takes work from the front of its own deque and, once this is empty, steals from the
+// back of the other threads' deques. Odd cells are calculated first, even cells are only calculated if they
+// are combined with at least one non empty odd cell.
+
+#define MAX_CELLS (NUM_PART_SUMS * NUM_PART_SUMS)
+
+typedef struct {
+    uint8_t part_sum_a0_idx;
+    uint8_t part_sum_a8_idx;
+    odd_even_t odd_even;
+    uint32_t estimated_states;
+} work_cell_t;
+
+typedef struct {
+    uint64_t range;                 // head (low 32 bits) and tail (high 32 bits) of items[], modified atomically only
+    uint16_t items[MAX_CELLS];      // indices into work_cells[]
+    uint16_t thread;
+    uint16_t num_threads;
+    // statistics
+    uint32_t num_cells;
+    uint32_t num_stolen;
+    uint64_t busy_time;
+} work_deque_t;
+
+static work_cell_t work_cells[MAX_CELLS];
+static work_deque_t *work_deques = NULL;
+
+static bool work_deque_take(work_deque_t *deque, bool from_back, uint16_t *item) {
+    uint64_t range = __atomic_load_n(&deque->range, __ATOMIC_ACQUIRE);
+    while (true) {
+        uint32_t head = range & 0xffffffff;
+        uint32_t tail = range >> 32;
+        if (head >= tail) {
+            return false;
+        }
+        uint32_t taken = from_back ? tail - 1 : head;
+        uint64_t new_range = from_back ? ((uint64_t)(tail - 1) << 32 | head) : ((uint64_t)tail << 32 | (head + 1));
+        if (__atomic_compare_exchange_n(&deque->range, &range, new_range, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            *item = deque->items[taken];
+            return true;
         }
     }
 }
 
+static int compare_work_cells(const void *a, const void *b) {
+    uint32_t sa = work_cells[*(uint16_t *)a].estimated_states;
+    uint32_t sb = work_cells[*(uint16_t *)b].estimated_states;
+    return (sa < sb) - (sa > sb);
+}
+
 static void
 #ifdef __has_attribute
 #if __has_attribute(force_align_arg_pointer)
@@ -1877,173 +2275,162 @@ __attribute__((force_align_arg_pointer))
 #endif
 #endif
 *generate_candidates_worker_thread(void *args) {
-    uint16_t *sum_args = (uint16_t *)args;
-    uint16_t sum_a0 = sums[sum_args[0]];
-    uint16_t sum_a8 = sums[sum_args[1]];
-    // uint16_t my_thread_number = sums[2];
+    work_deque_t *own = (work_deque_t *)args;
+
+    while (true) {
+        uint16_t cell;
+        bool stolen = false;
+        if (!work_deque_take(own, false, &cell)) {
+            for (uint16_t i = 1; i < own->num_threads && !stolen; i++) {
+                stolen = work_deque_take(&work_deques[(own->thread + i) % own->num_threads], true, &cell);
+            }
+            if (!stolen) {
+                break; // no work left anywhere. No new work is created while the threads are running.
+            }
+        }
+        uint64_t start = msclock();
+        add_matching_states(2 * work_cells[cell].part_sum_a0_idx, 2 * work_cells[cell].part_sum_a8_idx, work_cells[cell].odd_even);
+        own->busy_time += msclock() - start;
+        own->num_cells++;
+        if (stolen) {
+            own->num_stolen++;
+        }
+    }
 
-    bool there_might_be_more_work = true;
-    do {
-        there_might_be_more_work = false;
-        for (uint8_t p = 0; p < NUM_PART_SUMS; p++) {
-            for (uint8_t q = 0; q < NUM_PART_SUMS; q++) {
-                if (2 * p * (16 - 2 * q) + (16 - 2 * p) * 2 * q == sum_a0) {
-                    // PrintAndLogEx(NORMAL, "Reducing Partial Statelists (p,q) = (%d,%d) with lengths %d, %d\n",
-                    // p, q, partial_statelist[p].len[ODD_STATE], partial_statelist[q].len[EVEN_STATE]);
-                    for (uint8_t r = 0; r < NUM_PART_SUMS; r++) {
-                        for (uint8_t s = 0; s < NUM_PART_SUMS; s++) {
-                            if (2 * r * (16 - 2 * s) + (16 - 2 * r) * 2 * s == sum_a8) {
-                                pthread_mutex_lock(&book_of_work_mutex);
-                                if (book_of_work[p][q][r][s] != TO_BE_DONE) {  // this has been done or is currently been done by another thread. Look for some other work.
-                                    pthread_mutex_unlock(&book_of_work_mutex);
-                                    continue;
-                                }
+    return NULL;
+}
 
-                                pthread_mutex_lock(&statelist_cache_mutex);
-                                if (sl_cache[p][r][ODD_STATE].cache_status == WORK_IN_PROGRESS
-                                        || sl_cache[q][s][EVEN_STATE].cache_status == WORK_IN_PROGRESS) { // defer until not blocked by another thread.
-                                    pthread_mutex_unlock(&statelist_cache_mutex);
-                                    pthread_mutex_unlock(&book_of_work_mutex);
-                                    there_might_be_more_work = true;
-                                    continue;
-                                }
+// calculate the given cells on num_threads threads. Returns the elapsed time.
+static uint64_t run_work_cells(uint16_t num_cells, uint16_t num_threads) {
+    uint64_t start = msclock();
+    if (num_cells == 0) {
+        return 0;
+    }
 
-                                // we finally can do some work.
-                                book_of_work[p][q][r][s] = WORK_IN_PROGRESS;
-                                statelist_t *current_candidates = add_more_candidates();
+    uint16_t order[MAX_CELLS];
+    for (uint16_t i = 0; i < num_cells; i++) {
+        order[i] = i;
+    }
+    qsort(order, num_cells, sizeof(uint16_t), compare_work_cells);
 
-                                // Check for cached results and add them first
-                                bool odd_completed = false;
-                                if (sl_cache[p][r][ODD_STATE].cache_status == COMPLETED) {
-                                    add_cached_states(current_candidates, 2 * p, 2 * r, ODD_STATE);
-                                    odd_completed = true;
-                                }
-                                bool even_completed = false;
-                                if (sl_cache[q][s][EVEN_STATE].cache_status == COMPLETED) {
-                                    add_cached_states(current_candidates, 2 * q, 2 * s, EVEN_STATE);
-                                    even_completed = true;
-                                }
+    uint16_t items[num_threads];
+    memset(items, 0, sizeof(items));
+    for (uint16_t i = 0; i < num_cells; i++) {
+        work_deque_t *deque = &work_deques[i % num_threads];
+        deque->items[items[i % num_threads]++] = order[i];
+    }
+    for (uint16_t i = 0; i < num_threads; i++) {
+        work_deques[i].range = (uint64_t)items[i] << 32;
+    }
 
-                                bool work_required = true;
+    pthread_t thread_id[num_threads];
+    for (uint16_t i = 0; i < num_threads; i++) {
+        pthread_create(&thread_id[i], NULL, generate_candidates_worker_thread, &work_deques[i]);
+    }
+    // joining the threads publishes their statelist cache entries
+    for (uint16_t i = 0; i < num_threads; i++) {
+        pthread_join(thread_id[i], NULL);
+    }
 
-                                // if there had been two cached results, there is no more work to do
-                                if (even_completed && odd_completed) {
-                                    work_required = false;
-                                }
+    return msclock() - start;
+}
 
-                                // if there had been one cached empty result, there is no need to calculate the other part:
-                                if (work_required) {
-                                    if (even_completed && !current_candidates->len[EVEN_STATE]) {
-                                        current_candidates->len[ODD_STATE] = 0;
-                                        current_candidates->states[ODD_STATE] = NULL;
-                                        work_required = false;
-                                    }
-                                    if (odd_completed && !current_candidates->len[ODD_STATE]) {
-                                        current_candidates->len[EVEN_STATE] = 0;
-                                        current_candidates->states[EVEN_STATE] = NULL;
-                                        work_required = false;
-                                    }
-                                }
+static uint16_t add_work_cell(uint16_t num_cells, uint8_t part_sum_a0_idx, uint8_t part_sum_a8_idx, odd_even_t odd_even) {
+    if (sl_cache[part_sum_a0_idx][part_sum_a8_idx][odd_even].cache_status != TO_BE_DONE) {
+        return num_cells;
+    }
+    for (uint16_t i = 0; i < num_cells; i++) {
+        if (work_cells[i].part_sum_a0_idx == part_sum_a0_idx && work_cells[i].part_sum_a8_idx == part_sum_a8_idx && work_cells[i].odd_even == odd_even) {
+            return num_cells;
+        }
+    }
+    work_cells[num_cells].part_sum_a0_idx = part_sum_a0_idx;
+    work_cells[num_cells].part_sum_a8_idx = part_sum_a8_idx;
+    work_cells[num_cells].odd_even = odd_even;
+    work_cells[num_cells].estimated_states = estimated_num_states_part_sum(best_first_bytes[0], part_sum_a0_idx, part_sum_a8_idx, odd_even);
+    return num_cells + 1;
+}
 
-                                if (!work_required) {
-                                    pthread_mutex_unlock(&statelist_cache_mutex);
-                                    pthread_mutex_unlock(&book_of_work_mutex);
-                                } else {
-                                    // we really need to calculate something
-                                    if (even_completed) { // we had one cache hit with non-zero even states
-                                        // PrintAndLogEx(NORMAL, "Thread #%u: start working on  odd states p=%2d, r=%2d...\n", my_thread_number, p, r);
-                                        sl_cache[p][r][ODD_STATE].cache_status = WORK_IN_PROGRESS;
-                                        pthread_mutex_unlock(&statelist_cache_mutex);
-                                        pthread_mutex_unlock(&book_of_work_mutex);
-                                        add_matching_states(current_candidates, 2 * p, 2 * r, ODD_STATE);
-                                        work_required = false;
-                                    } else if (odd_completed) { // we had one cache hit with non-zero odd_states
-                                        // PrintAndLogEx(NORMAL, "Thread #%u: start working on even states q=%2d, s=%2d...\n", my_thread_number, q, s);
-                                        sl_cache[q][s][EVEN_STATE].cache_status = WORK_IN_PROGRESS;
-                                        pthread_mutex_unlock(&statelist_cache_mutex);
-                                        pthread_mutex_unlock(&book_of_work_mutex);
-                                        add_matching_states(current_candidates, 2 * q, 2 * s, EVEN_STATE);
-                                        work_required = false;
-                                    }
-                                }
+static void generate_candidates(uint8_t sum_a0_idx, uint8_t sum_a8_idx) {
 
-                                if (work_required) { // we had no cached result. Need to calculate both odd and even
-                                    sl_cache[p][r][ODD_STATE].cache_status = WORK_IN_PROGRESS;
-                                    sl_cache[q][s][EVEN_STATE].cache_status = WORK_IN_PROGRESS;
-                                    pthread_mutex_unlock(&statelist_cache_mutex);
-                                    pthread_mutex_unlock(&book_of_work_mutex);
-
-                                    add_matching_states(current_candidates, 2 * p, 2 * r, ODD_STATE);
-                                    if (current_candidates->len[ODD_STATE]) {
-                                        // PrintAndLogEx(NORMAL, "Thread #%u: start working on even states q=%2d, s=%2d...\n", my_thread_number, q, s);
-                                        add_matching_states(current_candidates, 2 * q, 2 * s, EVEN_STATE);
-                                    } else { // no need to calculate even states yet
-                                        pthread_mutex_lock(&statelist_cache_mutex);
-                                        sl_cache[q][s][EVEN_STATE].cache_status = TO_BE_DONE;
-                                        pthread_mutex_unlock(&statelist_cache_mutex);
-                                        current_candidates->len[EVEN_STATE] = 0;
-                                        current_candidates->states[EVEN_STATE] = NULL;
-                                    }
-                                }
+    uint16_t sum_a0 = sums[sum_a0_idx];
+    uint16_t sum_a8 = sums[sum_a8_idx];
 
-                                // update book of work
-                                pthread_mutex_lock(&book_of_work_mutex);
-                                book_of_work[p][q][r][s] = COMPLETED;
-                                pthread_mutex_unlock(&book_of_work_mutex);
-
-                                // if ((uint64_t)current_candidates->len[ODD_STATE] * current_candidates->len[EVEN_STATE]) {
-                                // PrintAndLogEx(NORMAL, "Candidates for p=%2u, q=%2u, r=%2u, s=%2u: %" PRIu32 " * %" PRIu32 " = %" PRIu64 " (2^%0.1f)\n",
-                                // 2*p, 2*q, 2*r, 2*s, current_candidates->len[ODD_STATE], current_candidates->len[EVEN_STATE],
-                                // (uint64_t)current_candidates->len[ODD_STATE] * current_candidates->len[EVEN_STATE],
-                                // log((uint64_t)current_candidates->len[ODD_STATE] * current_candidates->len[EVEN_STATE])/log(2));
-                                // uint32_t estimated_odd = estimated_num_states_part_sum(best_first_bytes[0], p, r, ODD_STATE);
-                                // uint32_t estimated_even= estimated_num_states_part_sum(best_first_bytes[0], q, s, EVEN_STATE);
-                                // uint64_t estimated_total = (uint64_t)estimated_odd * estimated_even;
-                                // PrintAndLogEx(NORMAL, "Estimated: %" PRIu32 " * %" PRIu32 " = %" PRIu64 " (2^%0.1f)\n", estimated_odd, estimated_even, estimated_total, log(estimated_total) / log(2));
-                                // if (estimated_odd < current_candidates->len[ODD_STATE] || estimated_even < current_candidates->len[EVEN_STATE]) {
-                                // PrintAndLogEx(NORMAL, "############################################################################ERROR! ESTIMATED < REAL !!!\n");
-                                // //exit(2);
-                                // }
-                                // }
-                            }
+    init_statelist_cache();
+
+    // the book of work: all (p, q, r, s) combinations matching Sum(a0) and Sum(a8)
+    uint8_t book_of_work[NUM_PART_SUMS * NUM_PART_SUMS * NUM_PART_SUMS * NUM_PART_SUMS][4];
+    uint16_t num_work = 0;
+    for (uint8_t p = 0; p < NUM_PART_SUMS; p++) {
+        for (uint8_t q = 0; q < NUM_PART_SUMS; q++) {
+            if (2 * p * (16 - 2 * q) + (16 - 2 * p) * 2 * q == sum_a0) {
+                for (uint8_t r = 0; r < NUM_PART_SUMS; r++) {
+                    for (uint8_t s = 0; s < NUM_PART_SUMS; s++) {
+                        if (2 * r * (16 - 2 * s) + (16 - 2 * r) * 2 * s == sum_a8) {
+                            book_of_work[num_work][0] = p;
+                            book_of_work[num_work][1] = q;
+                            book_of_work[num_work][2] = r;
+                            book_of_work[num_work][3] = s;
+                            num_work++;
                         }
                     }
                 }
             }
         }
-    } while (there_might_be_more_work);
-
-    return NULL;
-}
-
-
-static void generate_candidates(uint8_t sum_a0_idx, uint8_t sum_a8_idx) {
-
-    init_statelist_cache();
-    init_book_of_work();
+    }
 
-    // create mutexes for accessing the statelist cache and our "book of work"
-    pthread_mutex_init(&statelist_cache_mutex, NULL);
-    pthread_mutex_init(&book_of_work_mutex, NULL);
+    uint16_t num_threads = NUM_REDUCTION_WORKING_THREADS;
+    work_deques = (work_deque_t *)calloc(num_threads, sizeof(work_deque_t));
+    if (work_deques == NULL) {
+        PrintAndLogEx(ERR, "Out of memory error in generate_candidates(). Aborting...\n");
+        exit(4);
+    }
+    for (uint16_t i = 0; i < num_threads; i++) {
+        work_deques[i].thread = i;
+        work_deques[i].num_threads = num_threads;
+    }
 
-    // create and run worker threads
-    pthread_t thread_id[NUM_REDUCTION_WORKING_THREADS];
+    // 1st: all odd state lists
+    uint16_t num_cells = 0;
+    for (uint16_t i = 0; i < num_work; i++) {
+        num_cells = add_work_cell(num_cells, book_of_work[i][0], book_of_work[i][2], ODD_STATE);
+    }
+    uint16_t total_cells = num_cells;
+    uint64_t elapsed = run_work_cells(num_cells, num_threads);
 
-    uint16_t sums1[NUM_REDUCTION_WORKING_THREADS][3];
-    for (uint16_t i = 0; i < NUM_REDUCTION_WORKING_THREADS; i++) {
-        sums1[i][0] = sum_a0_idx;
-        sums1[i][1] = sum_a8_idx;
-        sums1[i][2] = i + 1;
-        pthread_create(thread_id + i, NULL, generate_candidates_worker_thread, sums1[i]);
+    // 2nd: the even state lists which are combined with at least one non empty odd state list
+    num_cells = 0;
+    for (uint16_t i = 0; i < num_work; i++) {
+        if (sl_cache[book_of_work[i][0]][book_of_work[i][2]][ODD_STATE].len) {
+            num_cells = add_work_cell(num_cells, book_of_work[i][1], book_of_work[i][3], EVEN_STATE);
+        }
     }
+    total_cells += num_cells;
+    elapsed += run_work_cells(num_cells, num_threads);
 
-    // wait for threads to terminate:
-    for (uint16_t i = 0; i < NUM_REDUCTION_WORKING_THREADS; i++) {
-        pthread_join(thread_id[i], NULL);
+    // assemble the candidates in book of work order
+    for (uint16_t i = 0; i < num_work; i++) {
+        statelist_t *current_candidates = add_more_candidates();
+        add_cached_states(current_candidates, 2 * book_of_work[i][0], 2 * book_of_work[i][2], ODD_STATE);
+        if (current_candidates->len[ODD_STATE]) {
+            add_cached_states(current_candidates, 2 * book_of_work[i][1], 2 * book_of_work[i][3], EVEN_STATE);
+        }
     }
 
-    // clean up mutex
-    pthread_mutex_destroy(&statelist_cache_mutex);
+    // report thread utilization
+    float min_utilization = 1.0;
+    float sum_utilization = 0.0;
+    for (uint16_t i = 0; i < num_threads; i++) {
+        float utilization = elapsed ? (float)work_deques[i].busy_time / elapsed : 1.0;
+        sum_utilization += utilization;
+        if (utilization < min_utilization) {
+            min_utilization = utilization;
+        }
+        PrintAndLogEx(DEBUG, "Thread #%2u: %2u state lists (%2u stolen), busy %6" PRIu64 "ms of %6" PRIu64 "ms (%3.0f%%)",
+                      i + 1, work_deques[i].num_cells, work_deques[i].num_stolen, work_deques[i].busy_time, elapsed, utilization * 100.0);
+    }
+    free(work_deques);
+    work_deques = NULL;
 
     maximum_states = 0;
     for (statelist_t *sl = candidates; sl != NULL; sl = sl->next) {
@@ -2059,6 +2446,10 @@ static void generate_candidates(uint8_t sum_a0_idx, uint8_t sum_a8_idx) {
     update_expected_brute_force(best_first_bytes[0]);
 
     hardnested_print_progress(num_acquired_nonces, "Apply Sum(a8) and all bytes bitflip properties", nonces[best_first_bytes[0]].expected_num_brute_force, 0);
+
+    char progress_text[80];
+    sprintf(progress_text, "%u state lists, thread utilization %1.0f%% avg, %1.0f%% min", total_cells, sum_utilization / num_threads * 100.0, min_utilization * 100.0);
+    hardnested_print_progress(num_acquired_nonces, progress_text, nonces[best_first_bytes[0]].expected_num_brute_force, 0);
 }
 
 static void free_candidates_memory(statelist_t *sl) {
@@ -2086,11 +2477,77 @@ static void pre_XOR_nonces(void) {
     }
 }
 
-static bool brute_force(uint64_t *found_key) {
+// append the candidates to the work file instead of brute forcing them. The nonces are written
+// with the first candidates, when they are already pre-XORed and the test nonces are prepared.
+static void export_candidates(void) {
+    if (work_file == NULL) {
+        memset(&work_header, 0, sizeof(work_header));
+        work_header.cuid = cuid;
+        memcpy(work_header.best_first_bytes, best_first_bytes, sizeof(best_first_bytes));
+        work_header.nonces_to_bruteforce = get_bf_test_nonces(work_header.bf_test_nonce, work_header.bf_test_nonce_par, work_header.bf_test_nonce_2nd_byte);
+        work_file = hardnested_work_create(work_filename, &work_header, nonces);
+        if (work_file == NULL) {
+            PrintAndLogEx(ERR, "Could not write work file %s", work_filename);
+            work_filename = NULL;
+            return;
+        }
+    }
+    if (hardnested_work_add_buckets(work_file, &work_header, candidates) == false) {
+        PrintAndLogEx(ERR, "Could not write work file %s", work_filename);
+        fclose(work_file);
+        remove(work_filename);
+        work_file = NULL;
+        work_filename = NULL;
+        return;
+    }
+    char progress_text[80];
+    snprintf(progress_text, sizeof(progress_text), "Exported %u buckets with 2^%1.1f keys to work file", work_header.num_buckets, log(work_header.num_states) / log(2.0));
+    hardnested_print_progress(num_acquired_nonces, progress_text, nonces[best_first_bytes[0]].expected_num_brute_force, 0);
+}
+
+static bool brute_force(uint64_t *found_key, bf_checkpoint_t *checkpoint) {
     if (known_target_key != -1) {
         TestIfKeyExists(known_target_key);
     }
-    return brute_force_bs(NULL, candidates, cuid, num_acquired_nonces, maximum_states, nonces, best_first_bytes, found_key);
+    if (work_filename != NULL) {
+        export_candidates();
+        return false;
+    }
+    return brute_force_bs(NULL, candidates, cuid, num_acquired_nonces, maximum_states, nonces, best_first_bytes, checkpoint, found_key);
+}
+
+
+static uint32_t nonce_set_hash(void) {
+    uint8_t *buf = calloc(num_acquired_nonces + 1, 5);
+    if (buf == NULL) {
+        PrintAndLogEx(ERR, "Out of memory error in nonce_set_hash(). Aborting...\n");
+        exit(4);
+    }
+    uint32_t n = 0;
+    for (uint16_t first_byte = 0; first_byte < 256; first_byte++) {
+        for (noncelistentry_t *p = nonces[first_byte].first; p != NULL && n < num_acquired_nonces; p = p->next) {
+            num_to_bytes(p->nonce_enc, 4, buf + 5 * n);
+            buf[5 * n + 4] = p->par_enc;
+            n++;
+        }
+    }
+    uint32_t hash;
+    crc32_ex(buf, 5 * n, (uint8_t *)&hash);
+    free(buf);
+    return hash;
+}
+
+
+// prepare the checkpoint for the brute force of a Sum(a8) guess (or of the bitflip candidates only)
+static void checkpoint_start_guess(bf_checkpoint_t *checkpoint, uint8_t sum_a8_idx) {
+    if (checkpoint == NULL) {
+        return;
+    }
+    if (checkpoint->data.sum_a8_idx != sum_a8_idx || checkpoint->data.best_first_byte != best_first_bytes[0]) {
+        checkpoint->data.bucket_count = 0;
+    }
+    checkpoint->data.sum_a8_idx = sum_a8_idx;
+    checkpoint->data.best_first_byte = best_first_bytes[0];
 }
 
 static uint16_t SumProperty(struct Crypto1State *s) {
@@ -2156,7 +2613,34 @@ static void set_test_state(uint8_t byte) {
     crypto1_destroy(pcs);
 }
 
-int mfnestedhard(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBlockNo, uint8_t trgKeyType, uint8_t *trgkey, bool nonce_file_read, bool nonce_file_write, bool slow, int tests, uint64_t *foundkey, char *filename) {
+// brute force rate of all SIMD cores supported by this CPU
+int hardnested_benchmark(void) {
+    char instr_set[12] = {0};
+    SetSIMDInstr(SIMD_AUTO);
+    SIMDExecInstr best = GetSIMDInstrAuto();
+
+    PrintAndLogEx(INFO, "Brute force benchmark using %d threads", num_CPUs());
+    PrintAndLogEx(NORMAL, "");
+    PrintAndLogEx(NORMAL, " SIMD core | million states/s | relative");
+    PrintAndLogEx(NORMAL, "-----------+------------------+---------");
+    float base_rate = 0.0;
+    for (int instr = SIMD_NONE; instr >= (int)best; instr--) {
+        SetSIMDInstr(instr);
+        get_SIMD_instruction_set(instr_set);
+        float bf_rate = 0.0;
+        for (uint8_t i = 0; i < 3; i++) {
+            bf_rate = MAX(bf_rate, brute_force_benchmark());
+        }
+        if (base_rate == 0.0) {
+            base_rate = bf_rate;
+        }
+        PrintAndLogEx(NORMAL, " %-9s | %16.0f | %7.2fx", instr_set, bf_rate / 1000000, bf_rate / base_rate);
+    }
+    SetSIMDInstr(SIMD_AUTO);
+    return PM3_SUCCESS;
+}
+
+int mfnestedhard(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBlockNo, uint8_t trgKeyType, uint8_t *trgkey, bool nonce_file_read, bool nonce_file_write, bool slow, bool resume, const char *work_file_name, int tests, uint64_t *foundkey, char *filename) {
     char progress_text[80];
     char instr_set[12] = {0};
 
@@ -2233,7 +2717,7 @@ int mfnestedhard(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBloc
                 pre_XOR_nonces();
                 prepare_bf_test_nonces(nonces, best_first_bytes[0]);
 
-                key_found = brute_force(foundkey);
+                key_found = brute_force(foundkey, NULL);
                 free(candidates->states[ODD_STATE]);
                 free(candidates->states[EVEN_STATE]);
                 free_candidates_memory(candidates);
@@ -2251,7 +2735,7 @@ int mfnestedhard(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBloc
                     }
                     generate_candidates(first_byte_Sum, nonces[best_first_bytes[0]].sum_a8_guess[j].sum_a8_idx);
 
-                    key_found = brute_force(foundkey);
+                    key_found = brute_force(foundkey, NULL);
                     free_statelist_cache();
                     free_candidates_memory(candidates);
                     candidates = NULL;
@@ -2334,6 +2818,27 @@ int mfnestedhard(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBloc
 
         Tests();
 
+        // brute force progress is saved next to the nonce file and can be resumed from there
+        bf_checkpoint_t checkpoint;
+        bf_checkpoint_t *cp = NULL;
+        char checkpoint_filename[FILE_PATH_SIZE + 12] = {0};
+        work_filename = work_file_name;
+        if (work_filename == NULL && (nonce_file_read || nonce_file_write) && filename != NULL && strlen(filename) > 0) {
+            cp = &checkpoint;
+            snprintf(checkpoint_filename, sizeof(checkpoint_filename), "%s.checkpoint", filename);
+            uint32_t nonce_hash = nonce_set_hash();
+            bf_checkpoint_init(cp, checkpoint_filename, cuid, nonce_hash);
+            if (resume) {
+                if (bf_checkpoint_read(cp) && cp->data.cuid == cuid && cp->data.nonce_hash == nonce_hash) {
+                    hardnested_print_progress(num_acquired_nonces, "Resuming from checkpoint", nonces[best_first_bytes[0]].expected_num_brute_force, 0);
+                } else {
+                    PrintAndLogEx(WARNING, "No matching checkpoint " _YELLOW_("%s") ", starting brute force from the beginning", checkpoint_filename);
+                    bf_checkpoint_init(cp, checkpoint_filename, cuid, nonce_hash);
+                }
+            }
+            PrintAndLogEx(INFO, "Brute force progress is saved to " _YELLOW_("%s") ", use option " _YELLOW_("--resume") " to continue an interrupted run", checkpoint_filename);
+        }
+
         free_bitflip_bitarrays();
         bool key_found = false;
         num_keys_tested = 0;
@@ -2357,7 +2862,8 @@ int mfnestedhard(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBloc
             pre_XOR_nonces();
             prepare_bf_test_nonces(nonces, best_first_bytes[0]);
 
-            key_found = brute_force(foundkey);
+            checkpoint_start_guess(cp, BF_CHECKPOINT_NO_SUM_A8);
+            key_found = brute_force(foundkey, cp);
             free(candidates->states[ODD_STATE]);
             free(candidates->states[EVEN_STATE]);
             free_candidates_memory(candidates);
@@ -2377,11 +2883,22 @@ int mfnestedhard(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBloc
                     hardnested_print_progress(num_acquired_nonces, progress_text, expected_brute_force, 0);
                 }
 
-                generate_candidates(first_byte_Sum, nonces[best_first_bytes[0]].sum_a8_guess[j].sum_a8_idx);
-                key_found = brute_force(foundkey);
-                free_statelist_cache();
-                free_candidates_memory(candidates);
-                candidates = NULL;
+                uint8_t sum_a8_idx = nonces[best_first_bytes[0]].sum_a8_guess[j].sum_a8_idx;
+                if (cp != NULL && cp->data.best_first_byte == best_first_bytes[0] && (cp->data.sum_a8_done & (1 << sum_a8_idx))) {
+                    hardnested_print_progress(num_acquired_nonces, "(Already brute forced before checkpoint)", expected_brute_force, 0);
+                } else {
+                    generate_candidates(first_byte_Sum, sum_a8_idx);
+                    checkpoint_start_guess(cp, sum_a8_idx);
+                    key_found = brute_force(foundkey, cp);
+                    free_statelist_cache();
+                    free_candidates_memory(candidates);
+                    candidates = NULL;
+                    if (!key_found && cp != NULL) {
+                        cp->data.sum_a8_done |= 1 << sum_a8_idx;
+                        cp->data.bucket_count = 0;
+                        bf_checkpoint_write(cp);
+                    }
+                }
                 if (!key_found) {
                     // update the statistics
                     nonces[best_first_bytes[0]].sum_a8_guess[j].prob = 0;
@@ -2392,6 +2909,23 @@ int mfnestedhard(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBloc
             }
         }
 
+        // nothing left to resume
+        if (cp != NULL) {
+            bf_checkpoint_remove(cp);
+        }
+
+        if (work_file != NULL) {
+            if (hardnested_work_close(work_file, &work_header)) {
+                PrintAndLogEx(SUCCESS, "Wrote %u buckets with %" PRIu64 " (2^%1.1f) keys to work file " _YELLOW_("%s"),
+                              work_header.num_buckets, work_header.num_states, log(work_header.num_states) / log(2.0), work_filename);
+                PrintAndLogEx(INFO, "Brute force it with " _YELLOW_("hardnested_worker %s <first shard>[-<last shard>]/<shards>"), work_filename);
+            } else {
+                PrintAndLogEx(ERR, "Could not write work file %s", work_filename);
+            }
+            work_file = NULL;
+        }
+        work_filename = NULL;
+
         free_nonces_memory();
         free_bitarray(all_bitflips_bitarray[ODD_STATE]);
         free_bitarray(all_bitflips_bitarray[EVEN_STATE]);
@@ -10,6 +10,7 @@
 //-----------------------------------------------------------------------------
 
 #include <stdio.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
@@ -20,6 +21,9 @@
 #include "ui.h"
 #include "cmdhw.h"
 #include "cmddata.h"
+#include "commonutil.h"   // ARRAYLEN
+#include "util.h"         // param_*
+#include "util_posix.h"   // usclock
 
 static int CmdHelp(const char *Cmd);
 
@@ -82,6 +86,21 @@ static int usage_hw_connect(void) {
     return PM3_SUCCESS;
 }
 
+static int usage_hw_latency(void) {
+    PrintAndLogEx(NORMAL, "Measure the round trip time of pings to the Proxmark3 and show a histogram");
+    PrintAndLogEx(NORMAL, "");
+    PrintAndLogEx(NORMAL, "Usage:  hw latency [h] [n <count>] [l <len>]");
+    PrintAndLogEx(NORMAL, "Options:");
+    PrintAndLogEx(NORMAL, "       h              This help");
+    PrintAndLogEx(NORMAL, "       n <count>      number of pings, default 1000");
+    PrintAndLogEx(NORMAL, "       l <len>        payload length, default 0");
+    PrintAndLogEx(NORMAL, "");
+    PrintAndLogEx(NORMAL, "Examples:");
+    PrintAndLogEx(NORMAL, "      hw latency n 10000");
+    PrintAndLogEx(NORMAL, "      hw latency l 512");
+    return PM3_SUCCESS;
+}
+
 static void lookupChipID(uint32_t iChipID, uint32_t mem_used) {
     char asBuff[120];
     memset(asBuff, 0, sizeof(asBuff));
@@ -501,13 +520,40 @@ static int CmdVersion(const char *Cmd) {
     return PM3_SUCCESS;
 }
 
+static void print_comms_stats(comms_stats_t *before) {
+    comms_stats_t now;
+    GetCommsStats(&now);
+
+    PrintAndLogEx(NORMAL, "");
+    PrintAndLogEx(NORMAL, " [ Client comms ]");
+    PrintAndLogEx(NORMAL, "  Frames received:...................%" PRIu64 " (%" PRIu64 " bytes)", now.frames, now.bytes);
+    if (now.reads > 0) {
+        PrintAndLogEx(NORMAL, "  Read calls:........................%" PRIu64 " (%.1f frames per read)", now.reads, (double)now.frames / now.reads);
+    }
+    uint64_t frames = now.frames - before->frames;
+    uint64_t reads = now.reads - before->reads;
+    if (reads > 0) {
+        PrintAndLogEx(NORMAL, "  This status:.......................%" PRIu64 " frames in %" PRIu64 " reads", frames, reads);
+    }
+    uint64_t ms = now.burst_end - now.burst_start;
+    if (ms > 0) {
+        PrintAndLogEx(NORMAL, "  Last burst:........................%" PRIu64 " frames in %" PRIu64 " ms, " _YELLOW_("%.1f") " kB/s",
+                      now.burst_frames, ms, (double)now.burst_bytes / ms);
+    }
+}
+
 static int CmdStatus(const char *Cmd) {
     (void)Cmd; // Cmd is not used so far
+    comms_stats_t before;
+    GetCommsStats(&before);
     clearCommandBuffer();
     PacketResponseNG resp;
     SendCommandNG(CMD_STATUS, NULL, 0);
-    if (WaitForResponseTimeout(CMD_STATUS, &resp, 2000) == false)
+    if (WaitForResponseTimeout(CMD_STATUS, &resp, 2000) == false) {
         PrintAndLogEx(WARNING, "Status command failed. Communication speed test timed out");
+        return PM3_SUCCESS;
+    }
+    print_comms_stats(&before);
     return PM3_SUCCESS;
 }
 
@@ -551,6 +597,99 @@ static int CmdPing(const char *Cmd) {
     return PM3_SUCCESS;
 }
 
+static int compare_uint64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : (x > y);
+}
+
+static int CmdLatency(const char *Cmd) {
+    // bucket upper limits in microseconds, the last bucket takes the rest
+    static const uint32_t limits[] = {250, 500, 1000, 2000, 5000, 10000, 20000, 50000, 100000};
+    uint32_t hist[ARRAYLEN(limits) + 1] = {0};
+    uint32_t count = 1000, len = 0;
+    uint8_t cmdp = 0;
+
+    while (param_getchar(Cmd, cmdp) != 0x00) {
+        switch (tolower(param_getchar(Cmd, cmdp))) {
+            case 'h':
+                return usage_hw_latency();
+            case 'n':
+                count = param_get32ex(Cmd, cmdp + 1, 1000, 10);
+                cmdp += 2;
+                break;
+            case 'l':
+                len = param_get32ex(Cmd, cmdp + 1, 0, 10);
+                cmdp += 2;
+                break;
+            default:
+                PrintAndLogEx(WARNING, "Unknown parameter '%c'", param_getchar(Cmd, cmdp));
+                return usage_hw_latency();
+        }
+    }
+    if (count == 0)
+        count = 1;
+    if (len > PM3_CMD_DATA_SIZE)
+        len = PM3_CMD_DATA_SIZE;
+
+    uint8_t data[PM3_CMD_DATA_SIZE] = {0};
+    for (uint16_t i = 0; i < len; i++)
+        data[i] = i & 0xFF;
+
+    PrintAndLogEx(INFO, "Sending %u pings with payload len=%u", count, len);
+
+    uint64_t *samples = calloc(count, sizeof(uint64_t));
+    if (samples == NULL) {
+        PrintAndLogEx(WARNING, "Failed to allocate memory");
+        return PM3_EMALLOC;
+    }
+    uint64_t min = UINT64_MAX, max = 0, sum = 0;
+    uint32_t received = 0;
+    clearCommandBuffer();
+    for (uint32_t n = 0; n < count; n++) {
+        PacketResponseNG resp;
+        uint64_t t1 = usclock();
+        SendCommandNG(CMD_PING, data, len);
+        if (WaitForResponseTimeout(CMD_PING, &resp, 1000) == false) {
+            PrintAndLogEx(WARNING, "Ping response " _RED_("timeout"));
+            break;
+        }
+        uint64_t us = usclock() - t1;
+
+        uint8_t b = 0;
+        while (b < ARRAYLEN(limits) && us >= limits[b])
+            b++;
+        hist[b]++;
+        min = MIN(min, us);
+        max = MAX(max, us);
+        sum += us;
+        samples[received++] = us;
+    }
+    if (received == 0) {
+        free(samples);
+        return PM3_ETIMEOUT;
+    }
+    qsort(samples, received, sizeof(uint64_t), compare_uint64);
+
+    PrintAndLogEx(NORMAL, "");
+    PrintAndLogEx(NORMAL, "  round trip          count");
+    PrintAndLogEx(NORMAL, "  ----------------+--------");
+    const char *bar = "##################################################";
+    for (uint8_t b = 0; b <= ARRAYLEN(limits); b++) {
+        int width = hist[b] * 50ULL / received;
+        if (b < ARRAYLEN(limits))
+            PrintAndLogEx(NORMAL, "  <  %7.2f ms   | %6u  %.*s", limits[b] / 1000.0, hist[b], width, bar);
+        else
+            PrintAndLogEx(NORMAL, "  >= %7.2f ms   | %6u  %.*s", limits[b - 1] / 1000.0, hist[b], width, bar);
+    }
+    PrintAndLogEx(NORMAL, "");
+    PrintAndLogEx(SUCCESS, "%u pings, min %.2f ms, avg %.2f ms, max %.2f ms, %.0f commands/s",
+                  received, min / 1000.0, (double)sum / received / 1000.0, max / 1000.0, sum ? received * 1000000.0 / sum : 0.0);
+    PrintAndLogEx(SUCCESS, "percentiles p50 %.2f ms, p90 %.2f ms, p99 %.2f ms",
+                  samples[received / 2] / 1000.0, samples[received * 9 / 10] / 1000.0, samples[received * 99 / 100] / 1000.0);
+    free(samples);
+    return PM3_SUCCESS;
+}
+
 static int CmdConnect(const char *Cmd) {
 
     uint32_t baudrate = USART_BAUD_RATE;
@@ -580,10 +719,10 @@ static int CmdConnect(const char *Cmd) {
 
     // default back to previous used serial port
     if (strlen(port) == 0) {
-        if (strlen((char *)conn.serial_port_name) == 0) {
+        if (strlen((char *)GetCommunicationArg()->serial_port_name) == 0) {
             return usage_hw_connect();
         }
-        memcpy(port, conn.serial_port_name, sizeof(port));
+        memcpy(port, GetCommunicationArg()->serial_port_name, sizeof(port));
     }
 
     if (session.pm3_present) {
@@ -591,7 +730,7 @@ static int CmdConnect(const char *Cmd) {
     }
 
     // 10 second timeout
-    OpenProxmark(port, false, 10, false, baudrate);
+    OpenProxmark(port, false, 10, baudrate);
 
     if (session.pm3_present && (TestProxmark() != PM3_SUCCESS)) {
         PrintAndLogEx(ERR, _RED_("ERROR:") "cannot communicate with the Proxmark3\n");
@@ -607,6 +746,7 @@ static command_t CommandTable[] = {
     {"dbg",           CmdDbg,         IfPm3Present,    "Set Proxmark3 debug level"},
     {"detectreader",  CmdDetectReader, IfPm3Present,    "['l'|'h'] -- Detect external reader field (option 'l' or 'h' to limit to LF or HF)"},
     {"fpgaoff",       CmdFPGAOff,     IfPm3Present,    "Set FPGA off"},
+    {"latency",       CmdLatency,     IfPm3Present,    "Histogram of the command round trip time"},
     {"lcd",           CmdLCD,         IfPm3Lcd,        "<HEX command> <count> -- Send command/data to LCD"},
     {"lcdreset",      CmdLCDReset,    IfPm3Lcd,        "Hardware reset LCD"},
     {"ping",          CmdPing,        IfPm3Present,    "Test if the Proxmark3 is responsive"},
@@ -18,10 +18,13 @@
 #include <string.h>
 #include <limits.h>
 #include <ctype.h>
+#include <pthread.h>
+#include <inttypes.h>
 
 #include "cmdparser.h"    // command_t
 #include "comms.h"
 #include "commonutil.h"  // ARRAYLEN
+#include "util_posix.h"     // msclock, num_CPUs
 
 #include "lfdemod.h"        // device/client demods of LF signals
 #include "ui.h"             // for show graph controls
@@ -193,6 +196,9 @@ static int usage_lf_find(void) {
     PrintAndLogEx(NORMAL, "       h             This help");
     PrintAndLogEx(NORMAL, "       <0|1>         Use data from Graphbuffer, if not set, try reading data from tag.");
     PrintAndLogEx(NORMAL, "       u             Search for Unknown tags, if not set, reads only known tags.");
+    PrintAndLogEx(NORMAL, "");
+    PrintAndLogEx(NORMAL, "All known tag demods run side by side, if several match the one with the most");
+    PrintAndLogEx(NORMAL, "repeated frames is shown and the others are listed.");
     PrintAndLogEx(NORMAL, "Examples:");
     PrintAndLogEx(NORMAL, "      lf search     = try reading data from tag & search for known tags");
     PrintAndLogEx(NORMAL, "      lf search 1   = use data from GraphBuffer & search for known tags");
@@ -675,9 +681,6 @@ int CmdLFSim(const char *Cmd) {
     //        1 clear bigbuff
     payload_up.flag = 0x1;
 
-    // fast push mode
-    conn.block_after_ACK = true;
-
     //can send only 512 bits at a time (1 byte sent per bit...)
     for (uint16_t i = 0; i < GraphTraceLen; i += PM3_CMD_DATA_SIZE - 3) {
 
@@ -696,8 +699,6 @@ int CmdLFSim(const char *Cmd) {
         payload_up.flag = 0;
     }
 
-    // Disable fast mode before last command
-    conn.block_after_ACK = false;
     printf("\n");
 
     PrintAndLogEx(INFO, "Simulating");
@@ -1167,6 +1168,162 @@ out:
     return retval;
 }
 
+// the known tags lf search looks for, ties are ranked in this order
+typedef struct {
+    const char *name;
+    lf_find_t find;
+    int (*demod)(void);
+    const char *cmd;
+} lf_search_tag_t;
+
+static const lf_search_tag_t lf_search_tags[] = {
+    {"HID Prox ID",             demodHID_buf,       demodHID,       "lf hid demod"},
+    {"AWID ID",                 demodAWID_buf,      demodAWID,      "lf awid demod"},
+    {"Paradox ID",              demodParadox_buf,   demodParadox,   "lf paradox demod"},
+    {"EM410x ID",               demodEM410x_buf,    demodEM410x,    "lf em 410x_demod"},
+    {"FDX-B ID",                demodFDX_buf,       demodFDX,       "lf fdx demod"},
+    {"Guardall G-Prox II ID",   demodGuard_buf,     demodGuard,     "lf gproxii demod"},
+    {"Idteck ID",               demodIdteck_buf,    demodIdteck,    "data rawdemod p1"},
+    {"Indala ID",               demodIndala_buf,    demodIndala,    "lf indala demod"},
+    {"IO Prox ID",              demodIOProx_buf,    demodIOProx,    "lf io demod"},
+    {"Jablotron ID",            demodJablotron_buf, demodJablotron, "lf jablotron demod"},
+    {"NEDAP ID",                demodNedap_buf,     demodNedap,     "lf nedap demod"},
+    {"NexWatch ID",             demodNexWatch_buf,  demodNexWatch,  "lf nexwatch demod"},
+    {"Noralsy ID",              demodNoralsy_buf,   demodNoralsy,   "lf noralsy demod"},
+    {"KERI ID",                 demodKeri_buf,      demodKeri,      "lf keri demod"},
+    {"PAC/Stanley ID",          demodPac_buf,       demodPac,       "lf pac demod"},
+    {"Presco ID",               demodPresco_buf,    demodPresco,    "lf presco demod"},
+    {"Pyramid ID",              demodPyramid_buf,   demodPyramid,   "lf pyramid demod"},
+    {"Securakey ID",            demodSecurakey_buf, demodSecurakey, "lf securakey demod"},
+    {"Viking ID",               demodViking_buf,    demodViking,    "lf viking demod"},
+    {"Visa2000 ID",             demodVisa2k_buf,    demodVisa2k,    "lf visa2000 demod"},
+    {"GALLAGHER ID",            demodGallagher_buf, demodGallagher, "lf gallagher demod"},
+//    {"Texas Instrument ID",     demodTI_buf,        demodTI,        "lf ti demod"},
+//    {"Fermax ID",               demodFermax_buf,    demodFermax,    "lf fermax demod"},
+//    {"Motorola FlexPass ID",    demodFlex_buf,      demodFlex,      "lf flexdemod"},
+};
+
+typedef struct {
+    int tag;                // in lf_search_tags
+    int res;
+    int confidence;
+    uint64_t ms;
+} lf_search_match_t;
+
+typedef struct {
+    const uint8_t *samples;
+    size_t len;
+    size_t next;
+    pthread_mutex_t lock;
+    lf_search_match_t *matches;
+} lf_search_t;
+
+// How sure a match is, by the copies of the frame the tag repeated around it.
+// A single copy passed the protocol checks only, each copy that agrees in all but
+// a few bits makes a chance decode of noise or of another tag less likely.
+static int lf_search_confidence(const lf_demod_t *d) {
+    size_t n = d->size;
+    if (n == 0 || d->idx + n > d->len)
+        return 0;
+
+    const uint8_t *frame = d->bits + d->idx;
+    int repeats = 0;
+    for (int dir = -1; dir <= 1; dir += 2) {
+        for (size_t k = 1; ; k++) {
+            const uint8_t *copy;
+            if (dir < 0) {
+                if (k * n > d->idx)
+                    break;
+                copy = frame - k * n;
+            } else {
+                if (d->idx + (k + 1) * n > d->len)
+                    break;
+                copy = frame + k * n;
+            }
+            size_t diff = 0;
+            for (size_t i = 0; i < n; i++)
+                diff += (copy[i] != frame[i]);
+            if (diff > n / 16)
+                break;
+            repeats++;
+        }
+    }
+    return (repeats == 0) ? 50 : MIN(100, 60 + 20 * repeats);
+}
+
+static void *lf_search_thread(void *arg) {
+    lf_search_t *s = arg;
+    lf_demod_t *d = calloc(1, sizeof(lf_demod_t));
+    if (d == NULL)
+        return NULL;
+
+    for (;;) {
+        pthread_mutex_lock(&s->lock);
+        size_t i = s->next++;
+        pthread_mutex_unlock(&s->lock);
+        if (i >= ARRAYLEN(lf_search_tags))
+            break;
+
+        memset(d, 0, sizeof(lf_demod_t));
+        uint64_t t = msclock();
+        lf_search_match_t *m = &s->matches[i];
+        m->res = lf_search_tags[i].find(s->samples, s->len, "", d);
+        m->confidence = (m->res == PM3_SUCCESS) ? lf_search_confidence(d) : 0;
+        m->ms = msclock() - t;
+    }
+    free(d);
+    return NULL;
+}
+
+static int cmp_lf_search_match(const void *a, const void *b) {
+    const lf_search_match_t *x = a, *y = b;
+    if (x->confidence != y->confidence)
+        return (x->confidence > y->confidence) ? -1 : 1;
+    return (x->tag < y->tag) ? -1 : (x->tag > y->tag);
+}
+
+// Runs all known tag demods on one snapshot of the samples and returns the matches best first.
+static int lf_search_tags_found(lf_search_match_t *matches, int num_threads, uint64_t *ms_sum, uint64_t *ms_max) {
+    lf_search_t s = {0};
+    uint8_t *samples = calloc(MAX_GRAPH_TRACE_LEN, sizeof(uint8_t));
+    s.matches = calloc(ARRAYLEN(lf_search_tags), sizeof(lf_search_match_t));
+    if (samples == NULL || s.matches == NULL) {
+        free(samples);
+        free(s.matches);
+        return 0;
+    }
+    s.samples = samples;
+    s.len = getFromGraphBuf(samples);
+    pthread_mutex_init(&s.lock, NULL);
+
+    pthread_t threads[ARRAYLEN(lf_search_tags)];
+    int started = 0;
+    for (; num_threads > 1 && started < num_threads; started++)
+        if (pthread_create(&threads[started], NULL, lf_search_thread, &s) != 0)
+            break;
+    if (started == 0)
+        lf_search_thread(&s);
+    for (int i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+    pthread_mutex_destroy(&s.lock);
+
+    int found = 0;
+    *ms_sum = *ms_max = 0;
+    for (size_t i = 0; i < ARRAYLEN(lf_search_tags); i++) {
+        *ms_sum += s.matches[i].ms;
+        *ms_max = MAX(*ms_max, s.matches[i].ms);
+        if (s.matches[i].res == PM3_SUCCESS) {
+            matches[found] = s.matches[i];
+            matches[found++].tag = i;
+        }
+    }
+    qsort(matches, found, sizeof(lf_search_match_t), cmp_lf_search_match);
+
+    free(samples);
+    free(s.matches);
+    return found;
+}
+
 int CmdLFfind(const char *Cmd) {
     int ans = 0;
     size_t minLength = 2000;
@@ -1225,32 +1382,33 @@ int CmdLFfind(const char *Cmd) {
 
     if (EM4x50Read("", false) == PM3_SUCCESS)  { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("EM4x50 ID") "found!"); return PM3_SUCCESS;}
 
-    if (demodHID() == PM3_SUCCESS)             { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("HID Prox ID") "found!"); goto out;}
-    if (demodAWID() == PM3_SUCCESS)            { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("AWID ID") "found!"); goto out;}
-    if (demodParadox() == PM3_SUCCESS)         { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Paradox ID") "found!"); goto out;}
-
-    if (demodEM410x() == PM3_SUCCESS)          { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("EM410x ID") "found!"); goto out;}
-    if (demodFDX() == PM3_SUCCESS)             { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("FDX-B ID") "found!"); goto out;}
-    if (demodGuard() == PM3_SUCCESS)           { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Guardall G-Prox II ID") "found!"); goto out; }
-    if (demodIdteck() == PM3_SUCCESS)          { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Idteck ID") "found!"); goto out;}
-    if (demodIndala() == PM3_SUCCESS)          { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Indala ID") "found!");  goto out;}
-    if (demodIOProx() == PM3_SUCCESS)          { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("IO Prox ID") "found!"); goto out;}
-    if (demodJablotron() == PM3_SUCCESS)       { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Jablotron ID") "found!"); goto out;}
-    if (demodNedap() == PM3_SUCCESS)           { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("NEDAP ID") "found!"); goto out;}
-    if (demodNexWatch() == PM3_SUCCESS)        { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("NexWatch ID") "found!"); goto out;}
-    if (demodNoralsy() == PM3_SUCCESS)         { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Noralsy ID") "found!"); goto out;}
-    if (demodKeri() == PM3_SUCCESS)            { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("KERI ID") "found!"); goto out;}
-    if (demodPac() == PM3_SUCCESS)             { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("PAC/Stanley ID") "found!"); goto out;}
-
-    if (demodPresco() == PM3_SUCCESS)          { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Presco ID") "found!"); goto out;}
-    if (demodPyramid() == PM3_SUCCESS)         { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Pyramid ID") "found!"); goto out;}
-    if (demodSecurakey() == PM3_SUCCESS)       { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Securakey ID") "found!"); goto out;}
-    if (demodViking() == PM3_SUCCESS)          { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Viking ID") "found!"); goto out;}
-    if (demodVisa2k() == PM3_SUCCESS)          { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Visa2000 ID") "found!"); goto out;}
-    if (demodGallagher() == PM3_SUCCESS)       { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("GALLAGHER ID") "found!"); goto out;}
-//    if (demodTI() == PM3_SUCCESS)              { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Texas Instrument ID") "found!"); goto out;}
-    //if (demodFermax() == PM3_SUCCESS)          { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Fermax ID") "found!"); goto out;}
-    //if (demodFlex() == PM3_SUCCESS)            { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Motorola FlexPass ID") "found!"); goto out;}
+    // em410x simulation etc uses 0/1 as signal data, convert it once for all demods
+    if (isGraphBitstream())
+        convertGraphFromBitstream();
+
+    lf_search_match_t matches[ARRAYLEN(lf_search_tags)];
+    int num_threads = MIN(num_CPUs(), (int)ARRAYLEN(lf_search_tags));
+    uint64_t ms_sum = 0, ms_max = 0, t = msclock();
+    int found = lf_search_tags_found(matches, num_threads, &ms_sum, &ms_max);
+    PrintAndLogEx(DEBUG, "DEBUG: %zu demods in %" PRIu64 " ms on %d threads, %" PRIu64 " ms one after another, slowest %" PRIu64 " ms",
+                  ARRAYLEN(lf_search_tags), msclock() - t, num_threads, ms_sum, ms_max);
+
+    // the best match again on the graph, for its output, DemodBuffer and clock grid.
+    // If its demod doesn't agree with the snapshot, the next one down the ranking
+    for (int m = 0; m < found; m++) {
+        const lf_search_tag_t *best = &lf_search_tags[matches[m].tag];
+        if (best->demod() != PM3_SUCCESS)
+            continue;
+
+        PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("%s") "found!", best->name);
+        if (found > 1) {
+            PrintAndLogEx(INFO, "");
+            PrintAndLogEx(INFO, "%d known tags matched, confidence by repeated frames:", found);
+            for (int i = 0; i < found; i++)
+                PrintAndLogEx(INFO, "  %3d%%  %-22s try " _YELLOW_("`%s`"), matches[i].confidence, lf_search_tags[matches[i].tag].name, lf_search_tags[matches[i].tag].cmd);
+        }
+        goto out;
+    }
 
     PrintAndLogEx(FAILED, _RED_("No known 125/134 kHz tags found!"));
 
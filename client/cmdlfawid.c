@@ -189,25 +189,20 @@ static int CmdAWIDWatch(const char *Cmd) {
 
 //by marshmellow
 //AWID Prox demod - FSK2a RF/50 with preamble of 00000001  (always a 96 bit data stream)
-//print full AWID Prox ID and some bit format details if found
-static int CmdAWIDDemod(const char *Cmd) {
+int demodAWID_buf(const uint8_t *samples, size_t len, const char *Cmd, lf_demod_t *d) {
     (void)Cmd; // Cmd is not used so far
 
-    uint8_t *bits = calloc(MAX_GRAPH_TRACE_LEN, sizeof(uint8_t));
-    if (bits == NULL) {
-        PrintAndLogEx(DEBUG, "DEBUG: Error - AWID failed to allocate memory");
-        return PM3_EMALLOC;
-    }
-
-    size_t size = getFromGraphBuf(bits);
+    size_t size = len;
     if (size == 0) {
         PrintAndLogEx(DEBUG, "DEBUG: Error - AWID not enough samples");
-        free(bits);
         return PM3_ENODATA;
     }
+    memcpy(d->bits, samples, size);
+    d->len = size;
+
     //get binary from fsk wave
     int waveIdx = 0;
-    int idx = detectAWID(bits, &size, &waveIdx);
+    int idx = detectAWID(d->bits, &size, &waveIdx);
     if (idx <= 0) {
 
         if (idx == -1)
@@ -223,13 +218,35 @@ static int CmdAWIDDemod(const char *Cmd) {
         else
             PrintAndLogEx(DEBUG, "DEBUG: Error - AWID error demoding fsk %d", idx);
 
-        free(bits);
         return PM3_ESOFT;
     }
 
-    setDemodBuff(bits, size, idx);
-    setClockGrid(50, waveIdx + (idx * 50));
+    // parity check, the output removes them from the bits themselves
+    uint8_t frame[96];
+    memcpy(frame, d->bits + idx, sizeof(frame));
+    if (removeParity(frame, 8, 4, 1, 88) != 66) {
+        PrintAndLogEx(DEBUG, "DEBUG: Error - AWID at parity check-tag size does not match AWID format");
+        return PM3_ESOFT;
+    }
+
+    d->idx = idx;
+    d->size = size;
+    d->clock = 50;
+    d->start_idx = waveIdx;
+    return PM3_SUCCESS;
+}
+
+//print full AWID Prox ID and some bit format details if found
+static int CmdAWIDDemod(const char *Cmd) {
+
+    lf_demod_t *d = NULL;
+    int res = demodGraph(demodAWID_buf, Cmd, &d);
+    if (res != PM3_SUCCESS)
+        return res;
 
+    uint8_t *bits = d->bits;
+    int idx = d->idx;
+    size_t size;
 
     // Index map
     // 0            10            20            30              40            50              60
@@ -250,11 +267,6 @@ static int CmdAWIDDemod(const char *Cmd) {
     uint32_t rawHi2 = bytebits_to_byte(bits + idx, 32);
 
     size = removeParity(bits, idx + 8, 4, 1, 88);
-    if (size != 66) {
-        PrintAndLogEx(DEBUG, "DEBUG: Error - AWID at parity check-tag size does not match AWID format");
-        free(bits);
-        return PM3_ESOFT;
-    }
     // ok valid card found!
 
     // Index map
@@ -322,7 +334,7 @@ static int CmdAWIDDemod(const char *Cmd) {
             }
             break;
     }
-    free(bits);
+    free(d);
 
     PrintAndLogEx(DEBUG, "DEBUG: AWID idx: %d, Len: %zu Printing Demod Buffer:", idx, size);
     if (g_debugMode)
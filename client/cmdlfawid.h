@@ -12,10 +12,12 @@
 #define CMDLFAWID_H__
 
 #include "common.h"
+#include "cmddata.h"  // lf_demod_t
 
 int CmdLFAWID(const char *Cmd);
 
 int demodAWID(void);
+int demodAWID_buf(const uint8_t *samples, size_t len, const char *Cmd, lf_demod_t *d);
 int getAWIDBits(uint8_t fmtlen, uint32_t fc, uint32_t cn, uint8_t *bits);
 
 #endif
@@ -426,17 +426,72 @@ int AskEm410xDecode(bool verbose, uint32_t *hi, uint64_t *lo) {
     return PM3_SUCCESS;
 }
 
+// see ASKDemod for what args are accepted, id kept in raw[0] (hi) and raw[1..2] (lo)
+int demodEM410x_buf(const uint8_t *samples, size_t len, const char *Cmd, lf_demod_t *d) {
+    int clk, invert, maxErr;
+    size_t maxLen;
+    bool amp;
+    if (getASKDemodArgs(Cmd, &clk, &invert, &maxErr, &maxLen, &amp) != PM3_SUCCESS) {
+        PrintAndLogEx(WARNING, "Invalid argument: %s", Cmd);
+        return PM3_EINVARG;
+    }
+
+    if (ASKDemod_buf(samples, len, clk, invert, maxErr, maxLen, amp, 1, d) != PM3_SUCCESS)
+        return PM3_ESOFT;
+
+    size_t idx = 0;
+    uint8_t bits[512] = {0};
+    size_t size = MIN(sizeof(bits), d->size);
+    memcpy(bits, d->bits, size);
+
+    uint32_t hi = 0;
+    uint64_t lo = 0;
+    int ans = Em410xDecode(bits, &size, &idx, &hi, &lo);
+    if (ans < 0) {
+
+        if (ans == -2)
+            PrintAndLogEx(DEBUG, "DEBUG: Error - Em410x not enough samples after demod");
+        else if (ans == -4)
+            PrintAndLogEx(DEBUG, "DEBUG: Error - Em410x preamble not found");
+        else if (ans == -5)
+            PrintAndLogEx(DEBUG, "DEBUG: Error - Em410x Size not correct: %zu", size);
+        else if (ans == -6)
+            PrintAndLogEx(DEBUG, "DEBUG: Error - Em410x parity failed");
+
+        return PM3_ESOFT;
+    }
+
+    PrintAndLogEx(DEBUG, "DEBUG: Em410x idx: %zu, Len: %zu", idx, size);
+    d->idx = idx + 1;
+    d->size = (size == 40) ? 64 : 128;
+    d->raw[0] = hi;
+    d->raw[1] = (uint32_t)(lo >> 32);
+    d->raw[2] = (uint32_t)lo;
+    return PM3_SUCCESS;
+}
+
 int AskEm410xDemod(const char *Cmd, uint32_t *hi, uint64_t *lo, bool verbose) {
-    bool st = true;
 
     // em410x simulation etc uses 0/1 as signal data. This must be converted in order to demod it back again
     if (isGraphBitstream()) {
         convertGraphFromBitstream();
     }
 
-    if (ASKDemod_ext(Cmd, false, false, 1, &st) != PM3_SUCCESS)
+    lf_demod_t *d = NULL;
+    if (demodGraph(demodEM410x_buf, Cmd, &d) != PM3_SUCCESS)
         return PM3_ESOFT;
-    return AskEm410xDecode(verbose, hi, lo);
+
+    *hi = d->raw[0];
+    *lo = ((uint64_t)d->raw[1] << 32) | d->raw[2];
+    free(d);
+
+    if (g_debugMode)
+        printDemodBuff();
+
+    if (verbose)
+        printEM410x(*hi, *lo);
+
+    return PM3_SUCCESS;
 }
 /*
 // this read loops on device side.
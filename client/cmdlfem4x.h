@@ -12,10 +12,12 @@
 #define CMDLFEM4X_H__
 
 #include "common.h"
+#include "cmddata.h"  // lf_demod_t
 
 int CmdLFEM4X(const char *Cmd);
 
 int demodEM410x(void);
+int demodEM410x_buf(const uint8_t *samples, size_t len, const char *Cmd, lf_demod_t *d);
 int EM4x50Read(const char *Cmd, bool verbose);
 bool EM4x05IsBlock0(uint32_t *word);
 
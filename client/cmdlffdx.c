@@ -186,17 +186,17 @@ static int CmdFDXBdemodBI(const char *Cmd) {
 
 //see ASKDemod for what args are accepted
 //almost the same demod as cmddata.c/CmdFDXBdemodBI
-static int CmdFdxDemod(const char *Cmd) {
+int demodFDX_buf(const uint8_t *samples, size_t len, const char *Cmd, lf_demod_t *d) {
     (void)Cmd; // Cmd is not used so far
 
     //Differential Biphase / di-phase (inverted biphase)
     //get binary from ask wave
-    if (ASKbiphaseDemod("0 32 1 100", false) != PM3_SUCCESS) {
+    if (ASKbiphaseDemod_buf(samples, len, 0, 32, 1, 100, d) != PM3_SUCCESS) {
         PrintAndLogEx(DEBUG, "DEBUG: Error - FDX-B ASKbiphaseDemod failed");
         return PM3_ESOFT;
     }
-    size_t size = DemodBufferLen;
-    int preambleIndex = detectFDXB(DemodBuffer, &size);
+    size_t size = d->size;
+    int preambleIndex = detectFDXB(d->bits, &size);
     if (preambleIndex < 0) {
 
         if (preambleIndex == -1)
@@ -210,16 +210,31 @@ static int CmdFdxDemod(const char *Cmd) {
         return PM3_ESOFT;
     }
 
-    // set and leave DemodBuffer intact
-    setDemodBuff(DemodBuffer, 128, preambleIndex);
-    setClockGrid(g_DemodClock, g_DemodStartIdx + (preambleIndex * g_DemodClock));
     // remove marker bits (1's every 9th digit after preamble) (pType = 2)
-    size = removeParity(DemodBuffer, 11, 9, 2, 117);
+    uint8_t frame[128];
+    memcpy(frame, d->bits + preambleIndex, sizeof(frame));
+    size = removeParity(frame, 11, 9, 2, 117);
     if (size != 104) {
         PrintAndLogEx(DEBUG, "DEBUG: Error - FDX-B error removeParity: %zu", size);
         return PM3_ESOFT;
     }
 
+    d->idx = preambleIndex;
+    d->size = 128;
+    return PM3_SUCCESS;
+}
+
+static int CmdFdxDemod(const char *Cmd) {
+
+    lf_demod_t *d = NULL;
+    if (demodGraph(demodFDX_buf, Cmd, &d) != PM3_SUCCESS)
+        return PM3_ESOFT;
+    int preambleIndex = d->idx;
+    free(d);
+
+    // DemodBuffer is set, remove its marker bits
+    size_t size = removeParity(DemodBuffer, 11, 9, 2, 117);
+
     //got a good demod
     uint64_t NationalCode = ((uint64_t)(bytebits_to_byteLSBF(DemodBuffer + 32, 6)) << 32) | bytebits_to_byteLSBF(DemodBuffer, 32);
     uint16_t countryCode = bytebits_to_byteLSBF(DemodBuffer + 38, 10);
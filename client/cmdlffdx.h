@@ -10,10 +10,12 @@
 #define CMDLFFDX_H__
 
 #include "common.h"
+#include "cmddata.h"  // lf_demod_t
 
 int CmdLFFdx(const char *Cmd);
 int detectFDXB(uint8_t *dest, size_t *size);
 int demodFDX(void);
+int demodFDX_buf(const uint8_t *samples, size_t len, const char *Cmd, lf_demod_t *d);
 int getFDXBits(uint64_t national_id, uint16_t country, uint8_t isanimal, uint8_t isextended, uint32_t extended, uint8_t *bits);
 
 #endif
@@ -11,6 +11,7 @@
 #include "cmdlfgallagher.h"
 
 #include <ctype.h>          //tolower
+#include <stdlib.h>         // free
 
 #include "commonutil.h"     // ARRAYLEN
 #include "common.h"
@@ -39,17 +40,16 @@ static int usage_lf_gallagher_clone(void) {
 }
 
 //see ASK/MAN Demod for what args are accepted
-static int CmdGallagherDemod(const char *Cmd) {
+int demodGallagher_buf(const uint8_t *samples, size_t len, const char *Cmd, lf_demod_t *d) {
 
     (void)Cmd;
-    bool st = true;
-    if (ASKDemod_ext("32 0 0 0", false, false, 1, &st) != PM3_SUCCESS) {
+    if (ASKDemod_buf(samples, len, 32, 0, 0, 0, false, 1, d) != PM3_SUCCESS) {
         PrintAndLogEx(DEBUG, "DEBUG: Error - GALLAGHER: ASKDemod failed");
         return PM3_ESOFT;
     }
 
-    size_t size = DemodBufferLen;
-    int ans = detectGallagher(DemodBuffer, &size);
+    size_t size = d->size;
+    int ans = detectGallagher(d->bits, &size);
     if (ans < 0) {
         if (ans == -1)
             PrintAndLogEx(DEBUG, "DEBUG: Error - GALLAGHER: too few bits found");
@@ -62,8 +62,17 @@ static int CmdGallagherDemod(const char *Cmd) {
 
         return PM3_ESOFT;
     }
-    setDemodBuff(DemodBuffer, 96, ans);
-    setClockGrid(g_DemodClock, g_DemodStartIdx + (ans * g_DemodClock));
+    d->idx = ans;
+    d->size = 96;
+    return PM3_SUCCESS;
+}
+
+static int CmdGallagherDemod(const char *Cmd) {
+
+    lf_demod_t *d = NULL;
+    if (demodGraph(demodGallagher_buf, Cmd, &d) != PM3_SUCCESS)
+        return PM3_ESOFT;
+    free(d);
 
     //got a good demod
     uint32_t raw1 = bytebits_to_byte(DemodBuffer, 32);
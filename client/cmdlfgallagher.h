@@ -11,10 +11,12 @@
 #define CMDLFGALLAGHER_H__
 
 #include "common.h"
+#include "cmddata.h"  // lf_demod_t
 
 int CmdLFGallagher(const char *Cmd);
 
 int demodGallagher(void);
+int demodGallagher_buf(const uint8_t *samples, size_t len, const char *Cmd, lf_demod_t *d);
 int detectGallagher(uint8_t *dest, size_t *size);
 #endif
 
@@ -61,22 +61,20 @@ static int usage_lf_guard_sim(void) {
 
 //by marshmellow
 //attempts to demodulate and identify a G_Prox_II verex/chubb card
-//WARNING: if it fails during some points it will destroy the DemodBuffer data
-// but will leave the GraphBuffer intact.
 //if successful it will push askraw data back to demod buffer ready for emulation
-static int CmdGuardDemod(const char *Cmd) {
+int demodGuard_buf(const uint8_t *samples, size_t len, const char *Cmd, lf_demod_t *d) {
     (void)Cmd; // Cmd is not used so far
 
     //Differential Biphase
     //get binary from ask wave
-    if (ASKbiphaseDemod("0 64 0 0", false) != PM3_SUCCESS) {
+    if (ASKbiphaseDemod_buf(samples, len, 0, 64, 0, 0, d) != PM3_SUCCESS) {
         PrintAndLogEx(DEBUG, "DEBUG: Error - gProxII ASKbiphaseDemod failed");
         return PM3_ESOFT;
     }
 
-    size_t size = DemodBufferLen;
+    size_t size = d->size;
 
-    int preambleIndex = detectGProxII(DemodBuffer, &size);
+    int preambleIndex = detectGProxII(d->bits, &size);
     if (preambleIndex < 0) {
 
         if (preambleIndex == -1)
@@ -93,19 +91,38 @@ static int CmdGuardDemod(const char *Cmd) {
     }
 
     //got a good demod of 96 bits
-    uint8_t ByteStream[8] = {0x00};
-    uint8_t xorKey = 0;
     size_t startIdx = preambleIndex + 6; //start after 6 bit preamble
 
     uint8_t bits_no_spacer[90];
-    //so as to not mess with raw DemodBuffer copy to a new sample array
-    memcpy(bits_no_spacer, DemodBuffer + startIdx, 90);
+    memcpy(bits_no_spacer, d->bits + startIdx, 90);
     // remove the 18 (90/5=18) parity bits (down to 72 bits (96-6-18=72))
-    size_t len = removeParity(bits_no_spacer, 0, 5, 3, 90); //source, startloc, paritylen, ptype, length_to_run
-    if (len != 72) {
-        PrintAndLogEx(DEBUG, "DEBUG: Error - gProxII spacer removal did not produce 72 bits: %zu, start: %zu", len, startIdx);
+    size_t plen = removeParity(bits_no_spacer, 0, 5, 3, 90); //source, startloc, paritylen, ptype, length_to_run
+    if (plen != 72) {
+        PrintAndLogEx(DEBUG, "DEBUG: Error - gProxII spacer removal did not produce 72 bits: %zu, start: %zu", plen, startIdx);
         return PM3_ESOFT;
     }
+
+    d->idx = preambleIndex;
+    d->size = 96;
+    return PM3_SUCCESS;
+}
+
+static int CmdGuardDemod(const char *Cmd) {
+
+    lf_demod_t *d = NULL;
+    if (demodGraph(demodGuard_buf, Cmd, &d) != PM3_SUCCESS)
+        return PM3_ESOFT;
+    free(d);
+
+    uint8_t ByteStream[8] = {0x00};
+    uint8_t xorKey = 0;
+
+    uint8_t bits_no_spacer[90];
+    //so as to not mess with raw DemodBuffer copy to a new sample array
+    memcpy(bits_no_spacer, DemodBuffer + 6, 90); //start after 6 bit preamble
+    // remove the 18 (90/5=18) parity bits (down to 72 bits (96-6-18=72))
+    removeParity(bits_no_spacer, 0, 5, 3, 90); //source, startloc, paritylen, ptype, length_to_run
+
     // get key and then get all 8 bytes of payload decoded
     xorKey = (uint8_t)bytebits_to_byteLSBF(bits_no_spacer, 8);
     for (size_t idx = 0; idx < 8; idx++) {
@@ -113,9 +130,6 @@ static int CmdGuardDemod(const char *Cmd) {
         PrintAndLogEx(DEBUG, "DEBUG: gProxII byte %zu after xor: %02x", idx, ByteStream[idx]);
     }
 
-    setDemodBuff(DemodBuffer, 96, preambleIndex);
-    setClockGrid(g_DemodClock, g_DemodStartIdx + (preambleIndex * g_DemodClock));
-
     //ByteStream contains 8 Bytes (64 bits) of decrypted raw tag data
     uint8_t fmtLen = ByteStream[0] >> 2;
     uint32_t FC = 0;
@@ -10,9 +10,11 @@
 #define CMDLFGUARD_H__
 
 #include "common.h"
+#include "cmddata.h"  // lf_demod_t
 
 int CmdLFGuard(const char *Cmd);
 int detectGProxII(uint8_t *bits, size_t *size);
 int demodGuard(void);
+int demodGuard_buf(const uint8_t *samples, size_t len, const char *Cmd, lf_demod_t *d);
 int getGuardBits(uint8_t fmtlen, uint32_t fc, uint32_t cn, uint8_t *guardBits);
 #endif
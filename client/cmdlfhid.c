@@ -22,6 +22,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
 
 #include <ctype.h>
 #include <inttypes.h>
@@ -145,27 +146,23 @@ static int sendTry(uint8_t format_idx, wiegand_card_t *card, uint32_t delay, boo
 
 //by marshmellow (based on existing demod + holiman's refactor)
 //HID Prox demod - FSK RF/50 with preamble of 00011101 (then manchester encoded)
-//print full HID Prox ID and some bit format details if found
-static int CmdHIDDemod(const char *Cmd) {
+int demodHID_buf(const uint8_t *samples, size_t len, const char *Cmd, lf_demod_t *d) {
     (void)Cmd; // Cmd is not used so far
 
-    // HID simulation etc uses 0/1 as signal data. This must be converted in order to demod it back again
-    if (isGraphBitstream()) {
-        convertGraphFromBitstream();
-    }
-
     //raw fsk demod no manchester decoding no start bit finding just get binary from wave
     uint32_t hi2 = 0, hi = 0, lo = 0;
 
-    uint8_t bits[GraphTraceLen];
-    size_t size = getFromGraphBuf(bits);
+    size_t size = len;
     if (size == 0) {
         PrintAndLogEx(DEBUG, "DEBUG: Error - HID not enough samples");
         return PM3_ESOFT;
     }
+    memcpy(d->bits, samples, size);
+    d->len = size;
+
     //get binary from fsk wave
     int waveIdx = 0;
-    int idx = HIDdemodFSK(bits, &size, &hi2, &hi, &lo, &waveIdx);
+    int idx = HIDdemodFSK(d->bits, &size, &hi2, &hi, &lo, &waveIdx);
     if (idx < 0) {
 
         if (idx == -1)
@@ -184,14 +181,38 @@ static int CmdHIDDemod(const char *Cmd) {
         return PM3_ESOFT;
     }
 
-    setDemodBuff(bits, size, idx);
-    setClockGrid(50, waveIdx + (idx * 50));
-
     if (hi2 == 0 && hi == 0 && lo == 0) {
         PrintAndLogEx(DEBUG, "DEBUG: Error - HID no values found");
         return PM3_ESOFT;
     }
 
+    d->idx = idx;
+    d->size = size;
+    d->clock = 50;
+    d->start_idx = waveIdx;
+    d->raw[0] = hi2;
+    d->raw[1] = hi;
+    d->raw[2] = lo;
+    return PM3_SUCCESS;
+}
+
+//print full HID Prox ID and some bit format details if found
+static int CmdHIDDemod(const char *Cmd) {
+
+    // HID simulation etc uses 0/1 as signal data. This must be converted in order to demod it back again
+    if (isGraphBitstream()) {
+        convertGraphFromBitstream();
+    }
+
+    lf_demod_t *d = NULL;
+    if (demodGraph(demodHID_buf, Cmd, &d) != PM3_SUCCESS)
+        return PM3_ESOFT;
+
+    uint32_t hi2 = d->raw[0], hi = d->raw[1], lo = d->raw[2];
+    int idx = d->idx;
+    size_t size = d->size;
+    free(d);
+
     if (hi2 != 0) { //extra large HID tags
         PrintAndLogEx(SUCCESS, "HID Prox TAG ID: %x%08x%08x (%u)", hi2, hi, lo, (lo >> 1) & 0xFFFF);
     } else {  //standard HID tags <38 bits
@@ -12,9 +12,11 @@
 #define CMDLFHID_H__
 
 #include "common.h"
+#include "cmddata.h"  // lf_demod_t
 
 int CmdLFHID(const char *Cmd);
 
 int demodHID(void);
+int demodHID_buf(const uint8_t *samples, size_t len, const char *Cmd, lf_demod_t *d);
 
 #endif
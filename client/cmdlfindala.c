@@ -71,25 +71,24 @@ static int usage_lf_indala_sim(void) {
 // Indala 26 bit decode
 // by marshmellow, martinbeier
 // optional arguments - same as PSKDemod (clock & invert & maxerr)
-static int CmdIndalaDemod(const char *Cmd) {
-
-    char cmdp = tolower(param_getchar(Cmd, 0));
-    if (cmdp == 'h') return usage_lf_indala_demod();
+// see PSKDemod for what args are accepted, clock defaults to 32
+int demodIndala_buf(const uint8_t *samples, size_t len, const char *Cmd, lf_demod_t *d) {
 
-    int ans;
-    if (strlen(Cmd) > 0)
-        ans = PSKDemod(Cmd, true);
-    else
-        ans = PSKDemod("32", true);
+    int clk = 32, invert = 0, maxErr = 100;
+    if (strlen(Cmd) > 0 && getDemodArgs(Cmd, &clk, &invert, &maxErr) != PM3_SUCCESS) {
+        PrintAndLogEx(WARNING, "Invalid argument: %s", Cmd);
+        return PM3_EINVARG;
+    }
 
+    int ans = PSKDemod_buf(samples, len, clk, invert, maxErr, d);
     if (ans != PM3_SUCCESS) {
         PrintAndLogEx(DEBUG, "DEBUG: Error - Indala can't demod signal: %d", ans);
         return PM3_ESOFT;
     }
 
-    uint8_t invert = 0;
-    size_t size = DemodBufferLen;
-    int idx = detectIndala(DemodBuffer, &size, &invert);
+    uint8_t inv = 0;
+    size_t size = d->size;
+    int idx = detectIndala(d->bits, &size, &inv);
     if (idx < 0) {
         if (idx == -1)
             PrintAndLogEx(DEBUG, "DEBUG: Error - Indala: not enough samples");
@@ -103,8 +102,20 @@ static int CmdIndalaDemod(const char *Cmd) {
             PrintAndLogEx(DEBUG, "DEBUG: Error - Indala: error demoding psk idx: %d", idx);
         return PM3_ESOFT;
     }
-    setDemodBuff(DemodBuffer, size, idx);
-    setClockGrid(g_DemodClock, g_DemodStartIdx + (idx * g_DemodClock));
+    d->idx = idx;
+    d->size = size;
+    return PM3_SUCCESS;
+}
+
+static int CmdIndalaDemod(const char *Cmd) {
+
+    char cmdp = tolower(param_getchar(Cmd, 0));
+    if (cmdp == 'h') return usage_lf_indala_demod();
+
+    lf_demod_t *d = NULL;
+    if (demodGraph(demodIndala_buf, Cmd, &d) != PM3_SUCCESS)
+        return PM3_ESOFT;
+    free(d);
 
     //convert UID to HEX
     uint32_t uid1 = bytebits_to_byte(DemodBuffer, 32);
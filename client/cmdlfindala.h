@@ -11,6 +11,7 @@
 #define CMDLFINDALA_H__
 
 #include "common.h"
+#include "cmddata.h"  // lf_demod_t
 
 int CmdLFINDALA(const char *Cmd);
 
@@ -19,5 +20,6 @@ int detectIndala26(uint8_t *bitStream, size_t *size, uint8_t *invert);
 int detectIndala64(uint8_t *bitStream, size_t *size, uint8_t *invert);
 int detectIndala224(uint8_t *bitStream, size_t *size, uint8_t *invert);
 int demodIndala(void);
+int demodIndala_buf(const uint8_t *samples, size_t len, const char *Cmd, lf_demod_t *d);
 
 #endif
@@ -85,19 +85,20 @@ static int CmdIOProxWatch(const char *Cmd) {
 
 //by marshmellow
 //IO-Prox demod - FSK RF/64 with preamble of 000000001
-//print ioprox ID and some format details
-static int CmdIOProxDemod(const char *Cmd) {
+int demodIOProx_buf(const uint8_t *samples, size_t len, const char *Cmd, lf_demod_t *d) {
     (void)Cmd; // Cmd is not used so far
-    int idx = 0, retval = PM3_SUCCESS;
-    uint8_t bits[MAX_GRAPH_TRACE_LEN] = {0};
-    size_t size = getFromGraphBuf(bits);
+    int idx = 0;
+    size_t size = len;
     if (size < 65) {
         PrintAndLogEx(DEBUG, "DEBUG: Error - IO prox not enough samples in GraphBuffer");
         return PM3_ESOFT;
     }
+    memcpy(d->bits, samples, size);
+    d->len = size;
+
     //get binary from fsk wave
     int waveIdx = 0;
-    idx = detectIOProx(bits, &size, &waveIdx);
+    idx = detectIOProx(d->bits, &size, &waveIdx);
     if (idx < 0) {
         if (g_debugMode) {
             if (idx == -1) {
@@ -118,17 +119,47 @@ static int CmdIOProxDemod(const char *Cmd) {
         }
         return PM3_ESOFT;
     }
-    setDemodBuff(bits, size, idx);
-    setClockGrid(64, waveIdx + (idx * 64));
 
     if (idx == 0) {
         if (g_debugMode) {
             PrintAndLogEx(DEBUG, "DEBUG: Error - IO prox data not found - FSK Bits: %zu", size);
-            if (size > 92) PrintAndLogEx(DEBUG, "%s", sprint_bin_break(bits, 92, 16));
+            if (size > 92) PrintAndLogEx(DEBUG, "%s", sprint_bin_break(d->bits, 92, 16));
         }
         return PM3_ESOFT;
     }
 
+    uint8_t crc = bytebits_to_byte(d->bits + idx + 54, 8);
+    uint8_t calccrc = 0;
+
+    for (uint8_t i = 1; i < 6; ++i) {
+        calccrc += bytebits_to_byte(d->bits + idx + 9 * i, 8);
+    }
+    calccrc &= 0xff;
+    calccrc = 0xff - calccrc;
+
+    if (crc != calccrc) {
+        PrintAndLogEx(DEBUG, "DEBUG: Error - IO prox crc failed 0x%02X != 0x%02X", crc, calccrc);
+        return PM3_ESOFT;
+    }
+
+    d->idx = idx;
+    d->size = size;
+    d->clock = 64;
+    d->start_idx = waveIdx;
+    return PM3_SUCCESS;
+}
+
+//print ioprox ID and some format details
+static int CmdIOProxDemod(const char *Cmd) {
+
+    lf_demod_t *d = NULL;
+    if (demodGraph(demodIOProx_buf, Cmd, &d) != PM3_SUCCESS)
+        return PM3_ESOFT;
+
+    uint8_t *bits = d->bits;
+    int idx = d->idx;
+    size_t size = d->size;
+
     //Index map
     //0           10          20          30          40          50          60
     //|           |           |           |           |           |           |
@@ -151,35 +182,15 @@ static int CmdIOProxDemod(const char *Cmd) {
     uint8_t version = bytebits_to_byte(bits + idx + 27, 8); //14,4
     uint8_t facilitycode = bytebits_to_byte(bits + idx + 18, 8) ;
     uint16_t number = (bytebits_to_byte(bits + idx + 36, 8) << 8) | (bytebits_to_byte(bits + idx + 45, 8)); //36,9
-    uint8_t crc = bytebits_to_byte(bits + idx + 54, 8);
-    uint8_t calccrc = 0;
 
-    for (uint8_t i = 1; i < 6; ++i) {
-        calccrc += bytebits_to_byte(bits + idx + 9 * i, 8);
-    }
-    calccrc &= 0xff;
-    calccrc = 0xff - calccrc;
-
-    char crcStr[30];
-    memset(crcStr, 0x00, sizeof(crcStr));
-
-    if (crc == calccrc) {
-        snprintf(crcStr, 3, "ok");
-
-    } else {
-        PrintAndLogEx(DEBUG, "DEBUG: Error - IO prox crc failed");
-
-        snprintf(crcStr, sizeof(crcStr), "failed 0x%02X != 0x%02X", crc, calccrc);
-        retval = PM3_ESOFT;
-    }
-
-    PrintAndLogEx(SUCCESS, "IO Prox XSF(%02d)%02x:%05d (%08x%08x) [crc %s]", version, facilitycode, number, code, code2, crcStr);
+    PrintAndLogEx(SUCCESS, "IO Prox XSF(%02d)%02x:%05d (%08x%08x) [crc ok]", version, facilitycode, number, code, code2);
 
     if (g_debugMode) {
         PrintAndLogEx(DEBUG, "DEBUG: IO prox idx: %d, Len: %zu, Printing demod buffer:", idx, size);
         printDemodBuff();
     }
-    return retval;
+    free(d);
+    return PM3_SUCCESS;
 }
 
 // this read is the "normal" read,  which download lf signal and tries to demod here.
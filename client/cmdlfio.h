@@ -5,10 +5,12 @@
 #define CMDLFIO_H__
 
 #include "common.h"
+#include "cmddata.h"  // lf_demod_t
 
 int CmdLFIO(const char *Cmd);
 
 int demodIOProx(void);
+int demodIOProx_buf(const uint8_t *samples, size_t len, const char *Cmd, lf_demod_t *d);
 int getIOProxBits(uint8_t version, uint8_t fc, uint16_t cn, uint8_t *bits);
 
 #endif
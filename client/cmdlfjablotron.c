@@ -76,17 +76,17 @@ static uint64_t getJablontronCardId(uint64_t rawcode) {
 }
 
 //see ASKDemod for what args are accepted
-static int CmdJablotronDemod(const char *Cmd) {
+int demodJablotron_buf(const uint8_t *samples, size_t len, const char *Cmd, lf_demod_t *d) {
     (void)Cmd; // Cmd is not used so far
 
     //Differential Biphase / di-phase (inverted biphase)
     //get binary from ask wave
-    if (ASKbiphaseDemod("0 64 1 0", false) != PM3_SUCCESS) {
+    if (ASKbiphaseDemod_buf(samples, len, 0, 64, 1, 0, d) != PM3_SUCCESS) {
         if (g_debugMode) PrintAndLogEx(DEBUG, "DEBUG: Error - Jablotron ASKbiphaseDemod failed");
         return PM3_ESOFT;
     }
-    size_t size = DemodBufferLen;
-    int ans = detectJablotron(DemodBuffer, &size);
+    size_t size = d->size;
+    int ans = detectJablotron(d->bits, &size);
     if (ans < 0) {
         if (g_debugMode) {
             if (ans == -1)
@@ -103,8 +103,17 @@ static int CmdJablotronDemod(const char *Cmd) {
         return PM3_ESOFT;
     }
 
-    setDemodBuff(DemodBuffer, 64, ans);
-    setClockGrid(g_DemodClock, g_DemodStartIdx + (ans * g_DemodClock));
+    d->idx = ans;
+    d->size = 64;
+    return PM3_SUCCESS;
+}
+
+static int CmdJablotronDemod(const char *Cmd) {
+
+    lf_demod_t *d = NULL;
+    if (demodGraph(demodJablotron_buf, Cmd, &d) != PM3_SUCCESS)
+        return PM3_ESOFT;
+    free(d);
 
     //got a good demod
     uint32_t raw1 = bytebits_to_byte(DemodBuffer, 32);
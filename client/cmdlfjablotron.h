@@ -10,10 +10,12 @@
 #define CMDLFJABLOTRON_H__
 
 #include "common.h"
+#include "cmddata.h"  // lf_demod_t
 
 int CmdLFJablotron(const char *Cmd);
 
 int demodJablotron(void);
+int demodJablotron_buf(const uint8_t *samples, size_t len, const char *Cmd, lf_demod_t *d);
 int detectJablotron(uint8_t *bits, size_t *size);
 int getJablotronBits(uint64_t fullcode, uint8_t *bits);
 
@@ -54,16 +54,16 @@ static int usage_lf_keri_sim(void) {
     return PM3_SUCCESS;
 }
 
-static int CmdKeriDemod(const char *Cmd) {
+int demodKeri_buf(const uint8_t *samples, size_t len, const char *Cmd, lf_demod_t *d) {
     (void)Cmd; // Cmd is not used so far
 
-    if (PSKDemod("", false) != PM3_SUCCESS) {
+    if (PSKDemod_buf(samples, len, 0, 0, 100, d) != PM3_SUCCESS) {
         PrintAndLogEx(DEBUG, "DEBUG: Error - KERI: PSK1 Demod failed");
         return PM3_ESOFT;
     }
     bool invert = false;
-    size_t size = DemodBufferLen;
-    int idx = detectKeri(DemodBuffer, &size, &invert);
+    size_t size = d->size;
+    int idx = detectKeri(d->bits, &size, &invert);
     if (idx < 0) {
         if (idx == -1)
             PrintAndLogEx(DEBUG, "DEBUG: Error - KERI: too few bits found");
@@ -76,8 +76,20 @@ static int CmdKeriDemod(const char *Cmd) {
 
         return PM3_ESOFT;
     }
-    setDemodBuff(DemodBuffer, size, idx);
-    setClockGrid(g_DemodClock, g_DemodStartIdx + (idx * g_DemodClock));
+    d->idx = idx;
+    d->size = size;
+    d->invert = invert;
+    return PM3_SUCCESS;
+}
+
+static int CmdKeriDemod(const char *Cmd) {
+
+    lf_demod_t *d = NULL;
+    if (demodGraph(demodKeri_buf, Cmd, &d) != PM3_SUCCESS)
+        return PM3_ESOFT;
+    size_t size = d->size;
+    bool invert = d->invert;
+    free(d);
 
     //got a good demod
     uint32_t raw1 = bytebits_to_byte(DemodBuffer, 32);
@@ -239,7 +251,7 @@ int detectKeri(uint8_t *dest, size_t *size, bool *invert) {
 
         // if didn't find preamble try again inverting
         uint8_t preamble_i[] = {0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0};
-        if (!preambleSearch(DemodBuffer, preamble_i, sizeof(preamble_i), size, &startIdx))
+        if (!preambleSearch(dest, preamble_i, sizeof(preamble_i), size, &startIdx))
             return -2;
 
         *invert ^= 1;
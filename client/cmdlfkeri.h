@@ -10,10 +10,12 @@
 #define CMDLFKERI_H__
 
 #include "common.h"
+#include "cmddata.h"  // lf_demod_t
 
 int CmdLFKeri(const char *Cmd);
 
 int demodKeri(void);
+int demodKeri_buf(const uint8_t *samples, size_t len, const char *Cmd, lf_demod_t *d);
 int detectKeri(uint8_t *dest, size_t *size, bool *invert);
 
 #endif
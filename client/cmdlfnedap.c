@@ -99,35 +99,46 @@ static uint8_t isEven_64_63(const uint8_t *data) { // 8
 }
 
 //NEDAP demod - ASK/Biphase (or Diphase),  RF/64 with preamble of 1111111110  (always a 128 bit data stream)
-static int CmdLFNedapDemod(const char *Cmd) {
+int demodNedap_buf(const uint8_t *samples, size_t len, const char *Cmd, lf_demod_t *d) {
     (void)Cmd; // Cmd is not used so far
 
-    uint8_t data[16], buffer[7], r0, r1, r2, r3, r4, r5, idxC1, idxC2, idxC3, idxC4, idxC5, fixed0, fixed1, unk1, unk2, subtype; // 4 bits
     size_t size, offset = 0;
-    uint16_t checksum, customerCode; // 12 bits
-    uint32_t badgeId; // max 99999
 
-    if (ASKbiphaseDemod("0 64 1 0", false) != PM3_SUCCESS) {
+    if (ASKbiphaseDemod_buf(samples, len, 0, 64, 1, 0, d) != PM3_SUCCESS) {
         if (g_debugMode) PrintAndLogEx(DEBUG, "DEBUG: Error - NEDAP: ASK/Biphase Demod failed");
         return PM3_ESOFT;
     }
 
-    size = DemodBufferLen;
-    if (!preambleSearch(DemodBuffer, (uint8_t *) preamble, sizeof(preamble), &size, &offset)) {
+    size = d->size;
+    if (!preambleSearch(d->bits, (uint8_t *) preamble, sizeof(preamble), &size, &offset)) {
         PrintAndLogEx(DEBUG, "DEBUG: Error - NEDAP: preamble not found");
         return PM3_ESOFT;
     }
 
-    // set plot
-    setDemodBuff(DemodBuffer, size, offset);
-    setClockGrid(g_DemodClock, g_DemodStartIdx + (g_DemodClock * offset));
-
     // sanity checks
     if ((size != 128) && (size != 64)) {
         PrintAndLogEx(DEBUG, "DEBUG: Error - NEDAP: Size not correct: %zu", size);
         return PM3_ESOFT;
     }
 
+    d->idx = offset;
+    d->size = size;
+    return PM3_SUCCESS;
+}
+
+static int CmdLFNedapDemod(const char *Cmd) {
+
+    uint8_t data[16], buffer[7], r0, r1, r2, r3, r4, r5, idxC1, idxC2, idxC3, idxC4, idxC5, fixed0, fixed1, unk1, unk2, subtype; // 4 bits
+    size_t size;
+    uint16_t checksum, customerCode; // 12 bits
+    uint32_t badgeId; // max 99999
+
+    lf_demod_t *d = NULL;
+    if (demodGraph(demodNedap_buf, Cmd, &d) != PM3_SUCCESS)
+        return PM3_ESOFT;
+    size = d->size;
+    free(d);
+
     if (bits_to_array(DemodBuffer, size, data) != PM3_SUCCESS) {
         PrintAndLogEx(DEBUG, "DEBUG: Error - NEDAP: bits_to_array error\n");
         return PM3_ESOFT;
@@ -10,10 +10,12 @@
 #define CMDLFNEDAP_H__
 
 #include "common.h"
+#include "cmddata.h"  // lf_demod_t
 
 int CmdLFNedap(const char *Cmd);
 
 int demodNedap(void);
+int demodNedap_buf(const uint8_t *samples, size_t len, const char *Cmd, lf_demod_t *d);
 int detectNedap(uint8_t *dest, size_t *size);
 int getNedapBits(uint32_t cn, uint8_t *nedapBits);
 
@@ -10,6 +10,7 @@
 
 #include "cmdlfnexwatch.h"
 #include <ctype.h>          // tolower
+#include <stdlib.h>         // free
 
 #include "commonutil.h"     // ARRAYLEN
 #include "cmdparser.h"    // command_t
@@ -36,16 +37,16 @@ static int usage_lf_nexwatch_clone(void) {
     return PM3_SUCCESS;
 }
 
-static int CmdNexWatchDemod(const char *Cmd) {
+int demodNexWatch_buf(const uint8_t *samples, size_t len, const char *Cmd, lf_demod_t *d) {
     (void)Cmd; // Cmd is not used so far
 
-    if (PSKDemod("", false) != PM3_SUCCESS) {
+    if (PSKDemod_buf(samples, len, 0, 0, 100, d) != PM3_SUCCESS) {
         PrintAndLogEx(DEBUG, "DEBUG: Error - NexWatch can't demod signal");
         return PM3_ESOFT;
     }
     bool invert = false;
-    size_t size = DemodBufferLen;
-    int idx = detectNexWatch(DemodBuffer, &size, &invert);
+    size_t size = d->size;
+    int idx = detectNexWatch(d->bits, &size, &invert);
     if (idx <= 0) {
         if (idx == -1)
             PrintAndLogEx(DEBUG, "DEBUG: Error - NexWatch not enough samples");
@@ -63,8 +64,20 @@ static int CmdNexWatchDemod(const char *Cmd) {
         return PM3_ESOFT;
     }
 
-    setDemodBuff(DemodBuffer, size, idx + 4);
-    setClockGrid(g_DemodClock, g_DemodStartIdx + ((idx + 4) * g_DemodClock));
+    d->idx = idx + 4;
+    d->size = size;
+    d->invert = invert;
+    return PM3_SUCCESS;
+}
+
+static int CmdNexWatchDemod(const char *Cmd) {
+
+    lf_demod_t *d = NULL;
+    if (demodGraph(demodNexWatch_buf, Cmd, &d) != PM3_SUCCESS)
+        return PM3_ESOFT;
+    size_t size = d->size;
+    bool invert = d->invert;
+    free(d);
 
 //    idx = 8 + 32; // 8 = preamble, 32 = reserved bits (always 0)
 
@@ -176,10 +189,10 @@ int detectNexWatch(uint8_t *dest, size_t *size, bool *invert) {
 
     size_t startIdx = 0;
 
-    if (!preambleSearch(DemodBuffer, preamble, sizeof(preamble), size, &startIdx)) {
+    if (!preambleSearch(dest, preamble, sizeof(preamble), size, &startIdx)) {
         // if didn't find preamble try again inverting
         uint8_t preamble_i[28] = {1, 1, 1, 1, 1, 0, 1, 0, 1, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1};
-        if (!preambleSearch(DemodBuffer, preamble_i, sizeof(preamble_i), size, &startIdx)) return -4;
+        if (!preambleSearch(dest, preamble_i, sizeof(preamble_i), size, &startIdx)) return -4;
         *invert ^= 1;
     }
 
@@ -10,9 +10,11 @@
 #define CMDLFNEXWATCH_H__
 
 #include "common.h"
+#include "cmddata.h"  // lf_demod_t
 
 int CmdLFNEXWATCH(const char *Cmd);
 
 int demodNexWatch(void);
+int demodNexWatch_buf(const uint8_t *samples, size_t len, const char *Cmd, lf_demod_t *d);
 int detectNexWatch(uint8_t *dest, size_t *size, bool *invert);
 #endif
@@ -62,22 +62,17 @@ static uint8_t noralsy_chksum(uint8_t *bits, uint8_t len) {
 }
 
 //see ASKDemod for what args are accepted
-static int CmdNoralsyDemod(const char *Cmd) {
+int demodNoralsy_buf(const uint8_t *samples, size_t len, const char *Cmd, lf_demod_t *d) {
     (void)Cmd; // Cmd is not used so far
 
     //ASK / Manchester
-    bool st = true;
-    if (ASKDemod_ext("32 0 0", false, false, 1, &st) != PM3_SUCCESS) {
+    if (ASKDemod_buf(samples, len, 32, 0, 0, 0, false, 1, d) != PM3_SUCCESS) {
         if (g_debugMode) PrintAndLogEx(DEBUG, "DEBUG: Error - Noralsy: ASK/Manchester Demod failed");
         return PM3_ESOFT;
     }
-    if (!st) {
-        if (g_debugMode) PrintAndLogEx(DEBUG, "DEBUG: Error - Noralsy: sequence terminator not found");
-        return PM3_ESOFT;
-    }
 
-    size_t size = DemodBufferLen;
-    int ans = detectNoralsy(DemodBuffer, &size);
+    size_t size = d->size;
+    int ans = detectNoralsy(d->bits, &size);
     if (ans < 0) {
         if (g_debugMode) {
             if (ans == -1)
@@ -91,8 +86,35 @@ static int CmdNoralsyDemod(const char *Cmd) {
         }
         return PM3_ESOFT;
     }
-    setDemodBuff(DemodBuffer, 96, ans);
-    setClockGrid(g_DemodClock, g_DemodStartIdx + (ans * g_DemodClock));
+
+    // calc checksums
+    uint8_t *frame = d->bits + ans;
+    uint8_t calc1 = noralsy_chksum(frame + 32, 40);
+    uint8_t calc2 = noralsy_chksum(frame, 76);
+    uint8_t chk1 = 0, chk2 = 0;
+    chk1 = bytebits_to_byte(frame + 72, 4);
+    chk2 = bytebits_to_byte(frame + 76, 4);
+    // test checksums
+    if (chk1 != calc1) {
+        if (g_debugMode) PrintAndLogEx(DEBUG, "DEBUG: Error - Noralsy: checksum 1 failed %x - %x\n", chk1, calc1);
+        return PM3_ESOFT;
+    }
+    if (chk2 != calc2) {
+        if (g_debugMode) PrintAndLogEx(DEBUG, "DEBUG: Error - Noralsy: checksum 2 failed %x - %x\n", chk2, calc2);
+        return PM3_ESOFT;
+    }
+
+    d->idx = ans;
+    d->size = 96;
+    return PM3_SUCCESS;
+}
+
+static int CmdNoralsyDemod(const char *Cmd) {
+
+    lf_demod_t *d = NULL;
+    if (demodGraph(demodNoralsy_buf, Cmd, &d) != PM3_SUCCESS)
+        return PM3_ESOFT;
+    free(d);
 
     //got a good demod
     uint32_t raw1 = bytebits_to_byte(DemodBuffer, 32);
@@ -108,22 +130,6 @@ static int CmdNoralsyDemod(const char *Cmd) {
     year = BCD2DEC(year);
     year += (year > 60) ? 1900 : 2000;
 
-    // calc checksums
-    uint8_t calc1 = noralsy_chksum(DemodBuffer + 32, 40);
-    uint8_t calc2 = noralsy_chksum(DemodBuffer, 76);
-    uint8_t chk1 = 0, chk2 = 0;
-    chk1 = bytebits_to_byte(DemodBuffer + 72, 4);
-    chk2 = bytebits_to_byte(DemodBuffer + 76, 4);
-    // test checksums
-    if (chk1 != calc1) {
-        if (g_debugMode) PrintAndLogEx(DEBUG, "DEBUG: Error - Noralsy: checksum 1 failed %x - %x\n", chk1, calc1);
-        return PM3_ESOFT;
-    }
-    if (chk2 != calc2) {
-        if (g_debugMode) PrintAndLogEx(DEBUG, "DEBUG: Error - Noralsy: checksum 2 failed %x - %x\n", chk2, calc2);
-        return PM3_ESOFT;
-    }
-
     PrintAndLogEx(SUCCESS, "Noralsy Tag Found: Card ID %u, Year: %u Raw: %08X%08X%08X", cardid, year, raw1, raw2, raw3);
     if (raw1 != 0xBB0214FF) {
         PrintAndLogEx(WARNING, "Unknown bits set in first block! Expected 0xBB0214FF, Found: 0x%08X", raw1);
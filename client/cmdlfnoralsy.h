@@ -10,10 +10,12 @@
 #define CMDLFNORALSY_H__
 
 #include "common.h"
+#include "cmddata.h"  // lf_demod_t
 
 int CmdLFNoralsy(const char *Cmd);
 
 int demodNoralsy(void);
+int demodNoralsy_buf(const uint8_t *samples, size_t len, const char *Cmd, lf_demod_t *d);
 int detectNoralsy(uint8_t *dest, size_t *size);
 int getnoralsyBits(uint32_t id, uint16_t year, uint8_t *bits);
 
@@ -10,6 +10,7 @@
 #include "cmdlfpac.h"
 
 #include <ctype.h>          //tolower
+#include <stdlib.h>         // free
 
 #include "commonutil.h"     // ARRAYLEN
 #include "common.h"
@@ -38,15 +39,22 @@ static int usage_lf_pac_clone(void) {
 }
 
 //see NRZDemod for what args are accepted
-static int CmdPacDemod(const char *Cmd) {
+// see NRZrawDemod for what args are accepted
+int demodPac_buf(const uint8_t *samples, size_t len, const char *Cmd, lf_demod_t *d) {
+
+    int clk, invert, maxErr;
+    if (getDemodArgs(Cmd, &clk, &invert, &maxErr) != PM3_SUCCESS) {
+        PrintAndLogEx(WARNING, "(NRZrawDemod) Invalid argument: %s", Cmd);
+        return PM3_EINVARG;
+    }
 
     //NRZ
-    if (NRZrawDemod(Cmd, false) != PM3_SUCCESS) {
+    if (NRZrawDemod_buf(samples, len, clk, invert, maxErr, d) != PM3_SUCCESS) {
         PrintAndLogEx(DEBUG, "DEBUG: Error - PAC: NRZ Demod failed");
         return PM3_ESOFT;
     }
-    size_t size = DemodBufferLen;
-    int ans = detectPac(DemodBuffer, &size);
+    size_t size = d->size;
+    int ans = detectPac(d->bits, &size);
     if (ans < 0) {
         if (ans == -1)
             PrintAndLogEx(DEBUG, "DEBUG: Error - PAC: too few bits found");
@@ -59,8 +67,17 @@ static int CmdPacDemod(const char *Cmd) {
 
         return PM3_ESOFT;
     }
-    setDemodBuff(DemodBuffer, 128, ans);
-    setClockGrid(g_DemodClock, g_DemodStartIdx + (ans * g_DemodClock));
+    d->idx = ans;
+    d->size = 128;
+    return PM3_SUCCESS;
+}
+
+static int CmdPacDemod(const char *Cmd) {
+
+    lf_demod_t *d = NULL;
+    if (demodGraph(demodPac_buf, Cmd, &d) != PM3_SUCCESS)
+        return PM3_ESOFT;
+    free(d);
 
     //got a good demod
     uint32_t raw1 = bytebits_to_byte(DemodBuffer, 32);
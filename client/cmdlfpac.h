@@ -10,10 +10,12 @@
 #define CMDLFPAC_H__
 
 #include "common.h"
+#include "cmddata.h"  // lf_demod_t
 
 int CmdLFPac(const char *Cmd);
 
 int demodPac(void);
+int demodPac_buf(const uint8_t *samples, size_t len, const char *Cmd, lf_demod_t *d);
 int detectPac(uint8_t *dest, size_t *size);
 #endif
 
@@ -60,21 +60,21 @@ static int usage_lf_paradox_sim(void) {
 
 //by marshmellow
 //Paradox Prox demod - FSK2a RF/50 with preamble of 00001111 (then manchester encoded)
-//print full Paradox Prox ID and some bit format details if found
-static int CmdParadoxDemod(const char *Cmd) {
+int demodParadox_buf(const uint8_t *samples, size_t len, const char *Cmd, lf_demod_t *d) {
     (void)Cmd; // Cmd is not used so far
     //raw fsk demod no manchester decoding no start bit finding just get binary from wave
-    uint8_t bits[MAX_GRAPH_TRACE_LEN] = {0};
-    size_t size = getFromGraphBuf(bits);
+    size_t size = len;
     if (size == 0) {
         PrintAndLogEx(DEBUG, "DEBUG: Error - Paradox not enough samples");
         return PM3_ESOFT;
     }
+    memcpy(d->bits, samples, size);
+    d->len = size;
 
     uint32_t hi2 = 0, hi = 0, lo = 0;
     int waveIdx = 0;
     //get binary from fsk wave
-    int idx = detectParadox(bits, &size, &hi2, &hi, &lo, &waveIdx);
+    int idx = detectParadox(d->bits, &size, &hi2, &hi, &lo, &waveIdx);
     if (idx < 0) {
 
         if (idx == -1)
@@ -93,14 +93,33 @@ static int CmdParadoxDemod(const char *Cmd) {
         return PM3_ESOFT;
     }
 
-    setDemodBuff(bits, size, idx);
-    setClockGrid(50, waveIdx + (idx * 50));
-
     if (hi2 == 0 && hi == 0 && lo == 0) {
         PrintAndLogEx(DEBUG, "DEBUG: Error - Paradox no value found");
         return PM3_ESOFT;
     }
 
+    d->idx = idx;
+    d->size = size;
+    d->clock = 50;
+    d->start_idx = waveIdx;
+    d->raw[0] = hi2;
+    d->raw[1] = hi;
+    d->raw[2] = lo;
+    return PM3_SUCCESS;
+}
+
+//print full Paradox Prox ID and some bit format details if found
+static int CmdParadoxDemod(const char *Cmd) {
+
+    lf_demod_t *d = NULL;
+    if (demodGraph(demodParadox_buf, Cmd, &d) != PM3_SUCCESS)
+        return PM3_ESOFT;
+
+    uint8_t *bits = d->bits;
+    int idx = d->idx;
+    size_t size = d->size;
+    uint32_t hi = d->raw[1], lo = d->raw[2];
+
     uint32_t fc = ((hi & 0x3) << 6) | (lo >> 26);
     uint32_t cardnum = (lo >> 10) & 0xFFFF;
     uint32_t rawLo = bytebits_to_byte(bits + idx + 64, 32);
@@ -116,6 +135,7 @@ static int CmdParadoxDemod(const char *Cmd) {
                   rawHi,
                   rawLo
                  );
+    free(d);
 
     PrintAndLogEx(DEBUG, "DEBUG: Paradox idx: %d, len: %zu, Printing Demod Buffer:", idx, size);
     if (g_debugMode)
@@ -10,9 +10,11 @@
 #define CMDLFPARADOX_H__
 
 #include "common.h"
+#include "cmddata.h"  // lf_demod_t
 
 int CmdLFParadox(const char *Cmd);
 
 int demodParadox(void);
+int demodParadox_buf(const uint8_t *samples, size_t len, const char *Cmd, lf_demod_t *d);
 int detectParadox(uint8_t *dest, size_t *size, uint32_t *hi2, uint32_t *hi, uint32_t *lo, int *waveStartIdx);
 #endif
@@ -57,15 +57,14 @@ static int usage_lf_presco_sim(void) {
 }
 
 //see ASKDemod for what args are accepted
-static int CmdPrescoDemod(const char *Cmd) {
+int demodPresco_buf(const uint8_t *samples, size_t len, const char *Cmd, lf_demod_t *d) {
     (void)Cmd; // Cmd is not used so far
-    bool st = true;
-    if (ASKDemod_ext("32 0 0 0 0 a", false, false, 1, &st) != PM3_SUCCESS) {
+    if (ASKDemod_buf(samples, len, 32, 0, 0, 0, false, 1, d) != PM3_SUCCESS) {
         PrintAndLogEx(DEBUG, "DEBUG: Error Presco ASKDemod failed");
         return PM3_ESOFT;
     }
-    size_t size = DemodBufferLen;
-    int ans = detectPresco(DemodBuffer, &size);
+    size_t size = d->size;
+    int ans = detectPresco(d->bits, &size);
     if (ans < 0) {
         if (ans == -1)
             PrintAndLogEx(DEBUG, "DEBUG: Error - Presco: too few bits found");
@@ -77,8 +76,17 @@ static int CmdPrescoDemod(const char *Cmd) {
             PrintAndLogEx(DEBUG, "DEBUG: Error - Presco: ans: %d", ans);
         return PM3_ESOFT;
     }
-    setDemodBuff(DemodBuffer, 128, ans);
-    setClockGrid(g_DemodClock, g_DemodStartIdx + (ans * g_DemodClock));
+    d->idx = ans;
+    d->size = 128;
+    return PM3_SUCCESS;
+}
+
+static int CmdPrescoDemod(const char *Cmd) {
+
+    lf_demod_t *d = NULL;
+    if (demodGraph(demodPresco_buf, Cmd, &d) != PM3_SUCCESS)
+        return PM3_ESOFT;
+    free(d);
 
     //got a good demod
     uint32_t raw1 = bytebits_to_byte(DemodBuffer, 32);
@@ -10,10 +10,12 @@
 #define CMDLFPRESCO_H__
 
 #include "common.h"
+#include "cmddata.h"  // lf_demod_t
 
 int CmdLFPresco(const char *Cmd);
 
 int demodPresco(void);
+int demodPresco_buf(const uint8_t *samples, size_t len, const char *Cmd, lf_demod_t *d);
 int detectPresco(uint8_t *dest, size_t *size);
 int getPrescoBits(uint32_t fullcode, uint8_t *prescoBits);
 int getWiegandFromPresco(const char *Cmd, uint32_t *sitecode, uint32_t *usercode, uint32_t *fullcode, bool *Q5);
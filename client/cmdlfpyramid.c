@@ -64,19 +64,20 @@ static int usage_lf_pyramid_sim(void) {
 
 //by marshmellow
 //Pyramid Prox demod - FSK RF/50 with preamble of 0000000000000001  (always a 128 bit data stream)
-//print full Farpointe Data/Pyramid Prox ID and some bit format details if found
-static int CmdPyramidDemod(const char *Cmd) {
+int demodPyramid_buf(const uint8_t *samples, size_t len, const char *Cmd, lf_demod_t *d) {
     (void)Cmd; // Cmd is not used so far
     //raw fsk demod no manchester decoding no start bit finding just get binary from wave
-    uint8_t bits[MAX_GRAPH_TRACE_LEN] = {0};
-    size_t size = getFromGraphBuf(bits);
+    size_t size = len;
     if (size == 0) {
         PrintAndLogEx(DEBUG, "DEBUG: Error - Pyramid not enough samples");
         return PM3_ESOFT;
     }
+    memcpy(d->bits, samples, size);
+    d->len = size;
+
     //get binary from fsk wave
     int waveIdx = 0;
-    int idx = detectPyramid(bits, &size, &waveIdx);
+    int idx = detectPyramid(d->bits, &size, &waveIdx);
     if (idx < 0) {
         if (idx == -1)
             PrintAndLogEx(DEBUG, "DEBUG: Error - Pyramid: not enough samples");
@@ -92,8 +93,36 @@ static int CmdPyramidDemod(const char *Cmd) {
             PrintAndLogEx(DEBUG, "DEBUG: Error - Pyramid: error demoding fsk idx: %d", idx);
         return PM3_ESOFT;
     }
-    setDemodBuff(bits, size, idx);
-    setClockGrid(50, waveIdx + (idx * 50));
+
+    // parity check, the output removes them from the bits themselves
+    uint8_t frame[128];
+    memcpy(frame, d->bits + idx, sizeof(frame));
+    size_t plen = removeParity(frame, 8, 8, 1, 120);
+    if (plen != 105) {
+        if (plen == 0)
+            PrintAndLogEx(DEBUG, "DEBUG: Error - Pyramid: parity check failed - IDX: %d, hi3: %08X", idx, bytebits_to_byte(d->bits + idx, 32));
+        else
+            PrintAndLogEx(DEBUG, "DEBUG: Error - Pyramid: at parity check - tag size does not match Pyramid format, SIZE: %zu, IDX: %d, hi3: %08X", plen, idx, bytebits_to_byte(d->bits + idx, 32));
+        return PM3_ESOFT;
+    }
+
+    d->idx = idx;
+    d->size = size;
+    d->clock = 50;
+    d->start_idx = waveIdx;
+    return PM3_SUCCESS;
+}
+
+//print full Farpointe Data/Pyramid Prox ID and some bit format details if found
+static int CmdPyramidDemod(const char *Cmd) {
+
+    lf_demod_t *d = NULL;
+    if (demodGraph(demodPyramid_buf, Cmd, &d) != PM3_SUCCESS)
+        return PM3_ESOFT;
+
+    uint8_t *bits = d->bits;
+    int idx = d->idx;
+    size_t size;
 
     // Index map
     // 0           10          20          30            40          50          60
@@ -133,13 +162,6 @@ static int CmdPyramidDemod(const char *Cmd) {
     uint32_t rawHi3 = bytebits_to_byte(bits + idx, 32);
 
     size = removeParity(bits, idx + 8, 8, 1, 120);
-    if (size != 105) {
-        if (size == 0)
-            PrintAndLogEx(DEBUG, "DEBUG: Error - Pyramid: parity check failed - IDX: %d, hi3: %08X", idx, rawHi3);
-        else
-            PrintAndLogEx(DEBUG, "DEBUG: Error - Pyramid: at parity check - tag size does not match Pyramid format, SIZE: %zu, IDX: %d, hi3: %08X", size, idx, rawHi3);
-        return PM3_ESOFT;
-    }
 
     // ok valid card found!
 
@@ -205,6 +227,7 @@ static int CmdPyramidDemod(const char *Cmd) {
     if (g_debugMode)
         printDemodBuff();
 
+    free(d);
     return PM3_SUCCESS;
 }
 
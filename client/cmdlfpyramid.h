@@ -10,10 +10,12 @@
 #define CMDLFPYRAMID_H__
 
 #include "common.h"
+#include "cmddata.h"  // lf_demod_t
 
 int CmdLFPyramid(const char *Cmd);
 
 int demodPyramid(void);
+int demodPyramid_buf(const uint8_t *samples, size_t len, const char *Cmd, lf_demod_t *d);
 int detectPyramid(uint8_t *dest, size_t *size, int *waveStartIdx);
 int getPyramidBits(uint32_t fc, uint32_t cn, uint8_t *pyramidBits);
 #endif
@@ -11,6 +11,7 @@
 
 #include <string.h>         // memcpy
 #include <ctype.h>          // tolower
+#include <stdlib.h>         // free
 
 #include "commonutil.h"     // ARRAYLEN
 #include "cmdparser.h"      // command_t
@@ -39,20 +40,19 @@ static int usage_lf_securakey_clone(void) {
 }
 
 //see ASKDemod for what args are accepted
-static int CmdSecurakeyDemod(const char *Cmd) {
+int demodSecurakey_buf(const uint8_t *samples, size_t len, const char *Cmd, lf_demod_t *d) {
     (void)Cmd; // Cmd is not used so far
 
     //ASK / Manchester
-    bool st = false;
-    if (ASKDemod_ext("40 0 0", false, false, 1, &st) != PM3_SUCCESS) {
+    if (ASKDemod_buf(samples, len, 40, 0, 0, 0, false, 1, d) != PM3_SUCCESS) {
         PrintAndLogEx(DEBUG, "DEBUG: Error - Securakey: ASK/Manchester Demod failed");
         return PM3_ESOFT;
     }
-    if (st)
+    if (d->st)
         return PM3_ESOFT;
 
-    size_t size = DemodBufferLen;
-    int ans = detectSecurakey(DemodBuffer, &size);
+    size_t size = d->size;
+    int ans = detectSecurakey(d->bits, &size);
     if (ans < 0) {
         if (ans == -1)
             PrintAndLogEx(DEBUG, "DEBUG: Error - Securakey: too few bits found");
@@ -64,8 +64,27 @@ static int CmdSecurakeyDemod(const char *Cmd) {
             PrintAndLogEx(DEBUG, "DEBUG: Error - Securakey: ans: %d", ans);
         return PM3_ESOFT;
     }
-    setDemodBuff(DemodBuffer, 96, ans);
-    setClockGrid(g_DemodClock, g_DemodStartIdx + (ans * g_DemodClock));
+
+    //securakey's max bitlen is 40 bits...
+    uint8_t bits_no_spacer[85];
+    memcpy(bits_no_spacer, d->bits + ans + 11, 85);
+    if (removeParity(bits_no_spacer, 0, 9, 3, 85) == 85 - 9 && bytebits_to_byte(bits_no_spacer + 2, 6) > 40) {
+        PrintAndLogEx(DEBUG, "DEBUG: Error bitLen too long: %u", bytebits_to_byte(bits_no_spacer + 2, 6));
+        return PM3_ESOFT;
+    }
+
+    d->idx = ans;
+    d->size = 96;
+    return PM3_SUCCESS;
+}
+
+static int CmdSecurakeyDemod(const char *Cmd) {
+
+    lf_demod_t *d = NULL;
+    if (demodGraph(demodSecurakey_buf, Cmd, &d) != PM3_SUCCESS)
+        return PM3_ESOFT;
+    size_t size;
+    free(d);
 
     //got a good demod
     uint32_t raw1 = bytebits_to_byte(DemodBuffer, 32);
@@ -10,10 +10,12 @@
 #define CMDLFSECURAKEY_H__
 
 #include "common.h"
+#include "cmddata.h"  // lf_demod_t
 
 int CmdLFSecurakey(const char *Cmd);
 
 int demodSecurakey(void);
+int demodSecurakey_buf(const uint8_t *samples, size_t len, const char *Cmd, lf_demod_t *d);
 int detectSecurakey(uint8_t *dest, size_t *size);
 
 #endif
@@ -429,16 +429,8 @@ int clone_t55xx_tag(uint32_t *blockdata, uint8_t numblocks) {
 
     PacketResponseNG resp;
 
-    // fast push mode
-    conn.block_after_ACK = true;
-
     for (int8_t i = 0; i < numblocks; i++) {
 
-        // Disable fast mode on last packet
-        if (i == numblocks - 1) {
-            conn.block_after_ACK = false;
-        }
-
         clearCommandBuffer();
 
         t55xx_write_block_t ng;
@@ -2959,7 +2951,6 @@ static int CmdT55xxChkPwds(const char *Cmd) {
     char filename[FILE_PATH_SIZE] = {0};
     bool found = false;
     uint8_t timeout = 0;
-    uint8_t *keyBlock = NULL;
     bool from_flash = false;
     bool try_all_dl_modes = false;
     uint8_t downlink_mode = 0;
@@ -3050,33 +3041,33 @@ static int CmdT55xxChkPwds(const char *Cmd) {
     }
 
     if (use_pwd_file) {
-        uint16_t keycount = 0;
+        dictionary_t dict;
 
-        int res = loadFileDICTIONARY_safe(filename, (void **) &keyBlock, 4, &keycount);
-        if (res != PM3_SUCCESS || keycount == 0 || keyBlock == NULL) {
+        int res = openFileDICTIONARY(filename, 4, &dict);
+        if (res != PM3_SUCCESS || dict.keycount == 0) {
             PrintAndLogEx(WARNING, "No keys found in file");
-            if (keyBlock != NULL)
-                free(keyBlock);
+            if (res == PM3_SUCCESS)
+                closeFileDICTIONARY(&dict);
 
             return PM3_ESOFT;
         }
 
         // loop
         uint64_t curr_password = 0x00;
-        for (uint16_t c = 0; c < keycount; ++c) {
+        for (uint64_t c = 0; c < dict.keycount; ++c) {
 
             if (!session.pm3_present) {
                 PrintAndLogEx(WARNING, "Device offline\n");
-                free(keyBlock);
+                closeFileDICTIONARY(&dict);
                 return PM3_ENODATA;
             }
 
             if (IsCancelled()) {
-                free(keyBlock);
+                closeFileDICTIONARY(&dict);
                 return PM3_EOPABORTED;
             }
 
-            curr_password = bytes_to_num(keyBlock + 4 * c, 4);
+            curr_password = bytes_to_num(dict.keys + 4 * c, 4);
 
             PrintAndLogEx(INFO, "Testing %08"PRIX64, curr_password);
             for (dl_mode = downlink_mode; dl_mode <= 3; dl_mode++) {
@@ -3089,7 +3080,7 @@ static int CmdT55xxChkPwds(const char *Cmd) {
                 if (found) {
                     PrintAndLogEx(SUCCESS, "Found valid password: [ " _GREEN_("%08"PRIX64) "]", curr_password);
                     dl_mode = 4; // Exit other downlink mode checks
-                    c = keycount; // Exit loop
+                    c = dict.keycount; // Exit loop
                 }
 
                 if (!try_all_dl_modes) // Exit loop if not trying all downlink modes
@@ -3097,10 +3088,9 @@ static int CmdT55xxChkPwds(const char *Cmd) {
             }
         }
         if (!found) PrintAndLogEx(WARNING, "Check pwd failed");
+        closeFileDICTIONARY(&dict);
     }
 
-    free(keyBlock);
-
 out:
     t1 = msclock() - t1;
     PrintAndLogEx(SUCCESS, "\nTime in check pwd: %.0f seconds\n", (float)t1 / 1000.0);
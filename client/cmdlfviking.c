@@ -53,26 +53,42 @@ static int usage_lf_viking_sim(void) {
 
 //by marshmellow
 //see ASKDemod for what args are accepted
-static int CmdVikingDemod(const char *Cmd) {
-    if (ASKDemod(Cmd, false, false, 1) != PM3_SUCCESS) {
+// see ASKDemod for what args are accepted
+int demodViking_buf(const uint8_t *samples, size_t len, const char *Cmd, lf_demod_t *d) {
+    int clk, invert, maxErr;
+    size_t maxLen;
+    bool amp;
+    if (getASKDemodArgs(Cmd, &clk, &invert, &maxErr, &maxLen, &amp) != PM3_SUCCESS) {
+        PrintAndLogEx(WARNING, "Invalid argument: %s", Cmd);
+        return PM3_EINVARG;
+    }
+    if (ASKDemod_buf(samples, len, clk, invert, maxErr, maxLen, amp, 1, d) != PM3_SUCCESS) {
         PrintAndLogEx(DEBUG, "DEBUG: Error - Viking ASKDemod failed");
         return PM3_ESOFT;
     }
-    size_t size = DemodBufferLen;
-    int ans = detectViking(DemodBuffer, &size);
+    size_t size = d->size;
+    int ans = detectViking(d->bits, &size);
     if (ans < 0) {
         PrintAndLogEx(DEBUG, "DEBUG: Error - Viking Demod %d %s", ans, (ans == -5) ? _RED_("[chksum error]") : "");
         return PM3_ESOFT;
     }
+    d->idx = ans;
+    d->size = 64;
+    return PM3_SUCCESS;
+}
+
+static int CmdVikingDemod(const char *Cmd) {
+    lf_demod_t *d = NULL;
+    if (demodGraph(demodViking_buf, Cmd, &d) != PM3_SUCCESS)
+        return PM3_ESOFT;
+    free(d);
     //got a good demod
-    uint32_t raw1 = bytebits_to_byte(DemodBuffer + ans, 32);
-    uint32_t raw2 = bytebits_to_byte(DemodBuffer + ans + 32, 32);
-    uint32_t cardid = bytebits_to_byte(DemodBuffer + ans + 24, 32);
-    uint8_t  checksum = bytebits_to_byte(DemodBuffer + ans + 32 + 24, 8);
+    uint32_t raw1 = bytebits_to_byte(DemodBuffer, 32);
+    uint32_t raw2 = bytebits_to_byte(DemodBuffer + 32, 32);
+    uint32_t cardid = bytebits_to_byte(DemodBuffer + 24, 32);
+    uint8_t  checksum = bytebits_to_byte(DemodBuffer + 32 + 24, 8);
     PrintAndLogEx(SUCCESS, "Viking Tag Found: Card ID " _YELLOW_("%08X")" checksum "_YELLOW_("%02X"), cardid, checksum);
     PrintAndLogEx(SUCCESS, "Raw hex: %08X%08X", raw1, raw2);
-    setDemodBuff(DemodBuffer, 64, ans);
-    setClockGrid(g_DemodClock, g_DemodStartIdx + (ans * g_DemodClock));
     return PM3_SUCCESS;
 }
 
@@ -10,10 +10,12 @@
 #define CMDLFVIKING_H__
 
 #include "common.h"
+#include "cmddata.h"  // lf_demod_t
 
 int CmdLFViking(const char *Cmd);
 
 int demodViking(void);
+int demodViking_buf(const uint8_t *samples, size_t len, const char *Cmd, lf_demod_t *d);
 int detectViking(uint8_t *src, size_t *size);
 uint64_t getVikingBits(uint32_t id);
 
@@ -98,22 +98,18 @@ static uint8_t visa_parity(uint32_t id) {
 *
 **/
 //see ASKDemod for what args are accepted
-static int CmdVisa2kDemod(const char *Cmd) {
+int demodVisa2k_buf(const uint8_t *samples, size_t len, const char *Cmd, lf_demod_t *d) {
     (void)Cmd; // Cmd is not used so far
 
-    save_restoreGB(GRAPH_SAVE);
-
     //CmdAskEdgeDetect("");
 
     //ASK / Manchester
-    bool st = true;
-    if (ASKDemod_ext("64 0 0", false, false, 1, &st) != PM3_SUCCESS) {
+    if (ASKDemod_buf(samples, len, 64, 0, 0, 0, false, 1, d) != PM3_SUCCESS) {
         PrintAndLogEx(DEBUG, "DEBUG: Error - Visa2k: ASK/Manchester Demod failed");
-        save_restoreGB(GRAPH_RESTORE);
         return PM3_ESOFT;
     }
-    size_t size = DemodBufferLen;
-    int ans = detectVisa2k(DemodBuffer, &size);
+    size_t size = d->size;
+    int ans = detectVisa2k(d->bits, &size);
     if (ans < 0) {
         if (ans == -1)
             PrintAndLogEx(DEBUG, "DEBUG: Error - Visa2k: too few bits found");
@@ -124,16 +120,11 @@ static int CmdVisa2kDemod(const char *Cmd) {
         else
             PrintAndLogEx(DEBUG, "DEBUG: Error - Visa2k: ans: %d", ans);
 
-        save_restoreGB(GRAPH_RESTORE);
         return PM3_ESOFT;
     }
-    setDemodBuff(DemodBuffer, 96, ans);
-    setClockGrid(g_DemodClock, g_DemodStartIdx + (ans * g_DemodClock));
 
-    //got a good demod
-    uint32_t raw1 = bytebits_to_byte(DemodBuffer, 32);
-    uint32_t raw2 = bytebits_to_byte(DemodBuffer + 32, 32);
-    uint32_t raw3 = bytebits_to_byte(DemodBuffer + 64, 32);
+    uint32_t raw2 = bytebits_to_byte(d->bits + ans + 32, 32);
+    uint32_t raw3 = bytebits_to_byte(d->bits + ans + 64, 32);
 
     // chksum
     uint8_t calc = visa_chksum(raw2);
@@ -142,7 +133,6 @@ static int CmdVisa2kDemod(const char *Cmd) {
     // test checksums
     if (chk != calc) {
         PrintAndLogEx(DEBUG, "DEBUG: error: Visa2000 checksum failed %x - %x\n", chk, calc);
-        save_restoreGB(GRAPH_RESTORE);
         return PM3_ESOFT;
     }
     // parity
@@ -150,9 +140,26 @@ static int CmdVisa2kDemod(const char *Cmd) {
     uint8_t chk_par = (raw3 & 0xFF0) >> 4;
     if (calc_par != chk_par) {
         PrintAndLogEx(DEBUG, "DEBUG: error: Visa2000 parity failed %x - %x\n", chk_par, calc_par);
-        save_restoreGB(GRAPH_RESTORE);
         return PM3_ESOFT;
     }
+
+    d->idx = ans;
+    d->size = 96;
+    return PM3_SUCCESS;
+}
+
+static int CmdVisa2kDemod(const char *Cmd) {
+
+    lf_demod_t *d = NULL;
+    if (demodGraph(demodVisa2k_buf, Cmd, &d) != PM3_SUCCESS)
+        return PM3_ESOFT;
+    free(d);
+
+    //got a good demod
+    uint32_t raw1 = bytebits_to_byte(DemodBuffer, 32);
+    uint32_t raw2 = bytebits_to_byte(DemodBuffer + 32, 32);
+    uint32_t raw3 = bytebits_to_byte(DemodBuffer + 64, 32);
+
     PrintAndLogEx(SUCCESS, "Visa2000 Tag Found: Card ID %u,  Raw: %08X%08X%08X", raw2,  raw1, raw2, raw3);
     return PM3_SUCCESS;
 }
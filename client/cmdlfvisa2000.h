@@ -10,11 +10,13 @@
 #define CMDLFVISA2000_H__
 
 #include "common.h"
+#include "cmddata.h"  // lf_demod_t
 
 int CmdLFVisa2k(const char *Cmd);
 
 int getvisa2kBits(uint64_t fullcode, uint8_t *bits);
 int demodVisa2k(void);
+int demodVisa2k_buf(const uint8_t *samples, size_t len, const char *Cmd, lf_demod_t *d);
 int detectVisa2k(uint8_t *dest, size_t *size);
 
 #endif
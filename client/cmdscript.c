@@ -66,6 +66,9 @@ static int CmdScriptRun(const char *Cmd) {
         PrintAndLogEx(SUCCESS, "Executing Lua script: %s, args '%s'\n", script_path, arguments);
         luascriptfile_idx++;
 
+        // the script may select other devices
+        pm3_device_t *prev_device = GetCurrentDevice();
+
         // create new Lua state
         lua_State *lua_state;
         lua_state = luaL_newstate();
@@ -104,6 +107,8 @@ static int CmdScriptRun(const char *Cmd) {
 
         //luaL_dofile(lua_state, buf);
         // close the Lua state
+        close_pm3_devices(lua_state);
+        SetCurrentDevice(prev_device);
         lua_close(lua_state);
         luascriptfile_idx--;
         PrintAndLogEx(SUCCESS, "\nFinished %s\n", preferredName);
@@ -12,55 +12,111 @@
 #include "comms.h"
 
 #include <inttypes.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <sys/time.h>   // gettimeofday
 
 #include "uart.h"
 #include "ui.h"
 #include "crc16.h"
-#include "util_posix.h" // msclock
+#include "rledelta.h"   // compressed downloads
+#include "util_posix.h" // msclock, usclock
 #include "util_darwin.h" // en/dis-ableNapp();
 
 //#define COMMS_DEBUG
 //#define COMMS_DEBUG_RAW
 
-// Serial port that we are communicating with the PM3 on.
-static serial_port sp = NULL;
-
-communication_arg_t conn;
-capabilities_t pm3_capabilities;
-
-static pthread_t communication_thread;
-static bool comm_thread_dead = false;
-
-// Transmit buffer.
-static PacketCommandOLD txBuffer;
-static PacketCommandNGRaw txBufferNG;
-size_t txBufferNGLen;
-static bool txBuffer_pending = false;
-static pthread_mutex_t txBufferMutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t txBufferSig = PTHREAD_COND_INITIALIZER;
-
-// Used by PacketResponseReceived as a ring buffer for messages that are yet to be
-// processed by a command handler (WaitForResponse{,Timeout})
-static PacketResponseNG rxBuffer[CMD_BUFFER_SIZE];
-
-// Points to the next empty position to write to
-static int cmd_head = 0;
+// Transmit buffer. NG frames are queued, so pipelined commands don't wait for each other
+#define TX_QUEUE_SIZE PIPELINE_WINDOW
+
+// longest sleep on rxBufferSig, the waiters still check their timeouts and warnings
+#define RX_WAIT_SLICE_MS 100
+
+// packets further apart than this start a new burst
+#define COMMS_BURST_GAP_MS 100
+
+// Everything about one connected Proxmark3
+struct pm3_device {
+    // Serial port that we are communicating with the PM3 on.
+    serial_port sp;
+    communication_arg_t conn;
+    capabilities_t capabilities;
+    bool present;                           // devices but the main one, see session.pm3_present
+
+    pthread_t communication_thread;
+    pthread_t sender_thread;
+    bool comm_thread_dead;
+
+    PacketCommandOLD txBuffer;
+    bool txBuffer_pending;                  // OLD frame in txBuffer
+    PacketCommandNGSeqRaw txBufferNG[TX_QUEUE_SIZE];
+    size_t txBufferNGLen[TX_QUEUE_SIZE];
+    uint8_t txBufferNG_head;                // next NG frame to send
+    uint8_t txBufferNG_count;               // NG frames queued
+    pthread_mutex_t txBufferMutex;
+    pthread_cond_t txBufferSig;
+
+    // Used by PacketResponseReceived as a ring buffer for messages that are yet to be
+    // processed by a command handler (WaitForResponse{,Timeout})
+    PacketResponseNG rxBuffer[CMD_BUFFER_SIZE];
+    // Points to the next empty position to write to
+    int cmd_head;
+    // Points to the position of the last unread command
+    int cmd_tail;
+    // to lock rxBuffer operations from different threads
+    pthread_mutex_t rxBufferMutex;
+    // signalled by storeReply, WaitForResponse and dl_it sleep on it instead of polling
+    pthread_cond_t rxBufferSig;
+
+    // Start time for WaitForResponseTimeout & dl_it, so we can reset timeout when we get packets
+    // as sending lot of these packets can slow down things wuite a lot on slow links (e.g. hw status or lf read at 9600)
+    uint64_t timeout_start_time;
+    uint64_t last_packet_time;
+
+    // sequence number of the last sequenced frame sent, taken atomically. One thread sends at a
+    // time, WaitForResponseInternal drops replies with another waiter's sequence number
+    uint16_t last_seq;
+
+    // received frames, written by the communication thread only
+    comms_stats_t comms_stats;
+};
+
+// The device of the command line, what the client talks to unless a thread selects another one
+static pm3_device_t main_device = {
+    .txBufferMutex = PTHREAD_MUTEX_INITIALIZER,
+    .txBufferSig = PTHREAD_COND_INITIALIZER,
+    .rxBufferMutex = PTHREAD_MUTEX_INITIALIZER,
+    .rxBufferSig = PTHREAD_COND_INITIALIZER,
+};
+
+// device of the calling thread, NULL for the main device
+static __thread pm3_device_t *current_device = NULL;
+
+static pm3_device_t *CurrentDevice(void) {
+    return current_device ? current_device : &main_device;
+}
 
-// Points to the position of the last unread command
-static int cmd_tail = 0;
+static bool DevicePresent(pm3_device_t *dev) {
+    return (dev == &main_device) ? session.pm3_present : dev->present;
+}
 
-// to lock rxBuffer operations from different threads
-static pthread_mutex_t rxBufferMutex = PTHREAD_MUTEX_INITIALIZER;
+static void SetDevicePresent(pm3_device_t *dev, bool present) {
+    if (dev == &main_device)
+        session.pm3_present = present;
+    else
+        dev->present = present;
+}
 
-// Global start time for WaitForResponseTimeout & dl_it, so we can reset timeout when we get packets
-// as sending lot of these packets can slow down things wuite a lot on slow links (e.g. hw status or lf read at 9600)
-static uint64_t timeout_start_time;
+communication_arg_t *GetCommunicationArg(void) {
+    return &CurrentDevice()->conn;
+}
 
-static uint64_t last_packet_time;
+capabilities_t *GetCapabilities(void) {
+    return &CurrentDevice()->capabilities;
+}
 
-static bool dl_it(uint8_t *dest, uint32_t bytes, PacketResponseNG *response, size_t ms_timeout, bool show_warning, uint32_t rec_cmd);
+static bool dl_it(pm3_device_t *dev, uint8_t *dest, uint32_t bytes, PacketResponseNG *response, size_t ms_timeout, bool show_warning, uint32_t rec_cmd);
 
 // Simple alias to track usages linked to the Bootloader, these commands must not be migrated.
 // - commands sent to enter bootloader mode as we might have to talk to old firmwares
@@ -78,6 +134,8 @@ void SendCommandOLD(uint64_t cmd, uint64_t arg0, uint64_t arg1, uint64_t arg2, v
     if (len && data)
         memcpy(&c.d, data, len);
 
+    pm3_device_t *dev = CurrentDevice();
+
 #ifdef COMMS_DEBUG
     PrintAndLogEx(NORMAL, "Sending %s", "OLD");
 #endif
@@ -87,38 +145,39 @@ void SendCommandOLD(uint64_t cmd, uint64_t arg0, uint64_t arg1, uint64_t arg2, v
     print_hex_break((uint8_t *)&c.d, sizeof(c.d), 32);
 #endif
 
-    if (!session.pm3_present) {
+    if (!DevicePresent(dev)) {
         PrintAndLogEx(WARNING, "Sending bytes to Proxmark3 failed." _YELLOW_("offline"));
         return;
     }
 
-    pthread_mutex_lock(&txBufferMutex);
+    pthread_mutex_lock(&dev->txBufferMutex);
     /**
     This causes hangups at times, when the pm3 unit is unresponsive or disconnected. The main console thread is alive,
     but comm thread just spins here. Not good.../holiman
     **/
-    while (txBuffer_pending) {
-        // wait for communication thread to complete sending a previous commmand
-        pthread_cond_wait(&txBufferSig, &txBufferMutex);
+    while (dev->txBuffer_pending || dev->txBufferNG_count) {
+        // wait for the sender thread to complete sending a previous commmand
+        pthread_cond_wait(&dev->txBufferSig, &dev->txBufferMutex);
     }
 
-    txBuffer = c;
-    txBuffer_pending = true;
+    dev->txBuffer = c;
+    dev->txBuffer_pending = true;
 
-    // tell communication thread that a new command can be send
-    pthread_cond_signal(&txBufferSig);
+    // tell the sender thread that a new command can be send
+    pthread_cond_broadcast(&dev->txBufferSig);
 
-    pthread_mutex_unlock(&txBufferMutex);
+    pthread_mutex_unlock(&dev->txBufferMutex);
 
 //__atomic_test_and_set(&txcmd_pending, __ATOMIC_SEQ_CST);
 }
 
-static void SendCommandNG_internal(uint16_t cmd, uint8_t *data, size_t len, bool ng) {
+static void SendCommandNG_internal(uint16_t cmd, uint8_t *data, size_t len, bool ng, bool with_seq, uint16_t seq) {
 #ifdef COMMS_DEBUG
     PrintAndLogEx(NORMAL, "Sending %s", ng ? "NG" : "MIX");
 #endif
 
-    if (!session.pm3_present) {
+    pm3_device_t *dev = CurrentDevice();
+    if (!DevicePresent(dev)) {
         PrintAndLogEx(NORMAL, "Sending bytes to proxmark failed - offline");
         return;
     }
@@ -127,60 +186,66 @@ static void SendCommandNG_internal(uint16_t cmd, uint8_t *data, size_t len, bool
         return;
     }
 
-    PacketCommandNGPostamble *tx_post = (PacketCommandNGPostamble *)((uint8_t *)&txBufferNG + sizeof(PacketCommandNGPreamble) + len);
-
-    pthread_mutex_lock(&txBufferMutex);
+    pthread_mutex_lock(&dev->txBufferMutex);
     /**
     This causes hangups at times, when the pm3 unit is unresponsive or disconnected. The main console thread is alive,
     but comm thread just spins here. Not good.../holiman
     **/
-    while (txBuffer_pending) {
-        // wait for communication thread to complete sending a previous commmand
-        pthread_cond_wait(&txBufferSig, &txBufferMutex);
+    while (dev->txBuffer_pending || dev->txBufferNG_count == TX_QUEUE_SIZE) {
+        // wait for the sender thread to complete sending a previous commmand
+        pthread_cond_wait(&dev->txBufferSig, &dev->txBufferMutex);
     }
 
-    txBufferNG.pre.magic = COMMANDNG_PREAMBLE_MAGIC;
-    txBufferNG.pre.ng = ng;
-    txBufferNG.pre.length = len;
-    txBufferNG.pre.cmd = cmd;
+    uint8_t slot = (dev->txBufferNG_head + dev->txBufferNG_count) % TX_QUEUE_SIZE;
+    PacketCommandNGSeqRaw *frame = &dev->txBufferNG[slot];
+    size_t header_len = sizeof(PacketCommandNGPreamble) + (with_seq ? sizeof(frame->seq) : 0);
+    uint8_t *payload = with_seq ? frame->data : (uint8_t *)&frame->seq;
+    PacketCommandNGPostamble *tx_post = (PacketCommandNGPostamble *)((uint8_t *)frame + header_len + len);
+
+    frame->pre.magic = with_seq ? COMMANDNG_SEQ_PREAMBLE_MAGIC : COMMANDNG_PREAMBLE_MAGIC;
+    frame->pre.ng = ng;
+    frame->pre.length = len;
+    frame->pre.cmd = cmd;
+    if (with_seq)
+        frame->seq = seq;
     if (len > 0 && data)
-        memcpy(&txBufferNG.data, data, len);
+        memcpy(payload, data, len);
 
-    if ((conn.send_via_fpc_usart && conn.send_with_crc_on_fpc) || ((!conn.send_via_fpc_usart) && conn.send_with_crc_on_usb)) {
+    if ((dev->conn.send_via_fpc_usart && dev->conn.send_with_crc_on_fpc) || ((!dev->conn.send_via_fpc_usart) && dev->conn.send_with_crc_on_usb)) {
         uint8_t first, second;
-        compute_crc(CRC_14443_A, (uint8_t *)&txBufferNG, sizeof(PacketCommandNGPreamble) + len, &first, &second);
+        compute_crc(CRC_14443_A, (uint8_t *)frame, header_len + len, &first, &second);
         tx_post->crc = (first << 8) + second;
     } else {
         tx_post->crc = COMMANDNG_POSTAMBLE_MAGIC;
     }
 
-    txBufferNGLen = sizeof(PacketCommandNGPreamble) + len + sizeof(PacketCommandNGPostamble);
+    dev->txBufferNGLen[slot] = header_len + len + sizeof(PacketCommandNGPostamble);
 
 #ifdef COMMS_DEBUG_RAW
-    print_hex_break((uint8_t *)&txBufferNG.pre, sizeof(PacketCommandNGPreamble), 32);
+    print_hex_break((uint8_t *)&frame->pre, header_len, 32);
     if (ng) {
-        print_hex_break((uint8_t *)&txBufferNG.data, len, 32);
+        print_hex_break(payload, len, 32);
     } else {
-        print_hex_break((uint8_t *)&txBufferNG.data, 3 * sizeof(uint64_t), 32);
-        print_hex_break((uint8_t *)&txBufferNG.data + 3 * sizeof(uint64_t), len - 3 * sizeof(uint64_t), 32);
+        print_hex_break(payload, 3 * sizeof(uint64_t), 32);
+        print_hex_break(payload + 3 * sizeof(uint64_t), len - 3 * sizeof(uint64_t), 32);
     }
     print_hex_break((uint8_t *)tx_post, sizeof(PacketCommandNGPostamble), 32);
 #endif
-    txBuffer_pending = true;
+    dev->txBufferNG_count++;
 
-    // tell communication thread that a new command can be send
-    pthread_cond_signal(&txBufferSig);
+    // tell the sender thread that a new command can be send
+    pthread_cond_broadcast(&dev->txBufferSig);
 
-    pthread_mutex_unlock(&txBufferMutex);
+    pthread_mutex_unlock(&dev->txBufferMutex);
 
 //__atomic_test_and_set(&txcmd_pending, __ATOMIC_SEQ_CST);
 }
 
 void SendCommandNG(uint16_t cmd, uint8_t *data, size_t len) {
-    SendCommandNG_internal(cmd, data, len, true);
+    SendCommandNG_internal(cmd, data, len, true, false, 0);
 }
 
-void SendCommandMIX(uint64_t cmd, uint64_t arg0, uint64_t arg1, uint64_t arg2, void *data, size_t len) {
+static void SendCommandMIX_internal(uint64_t cmd, uint64_t arg0, uint64_t arg1, uint64_t arg2, void *data, size_t len, bool with_seq, uint16_t seq) {
     uint64_t arg[3] = {arg0, arg1, arg2};
     if (len > PM3_CMD_DATA_SIZE_MIX) {
         PrintAndLogEx(WARNING, "Sending %zu bytes of payload is too much for MIX frames, abort", len);
@@ -190,7 +255,26 @@ void SendCommandMIX(uint64_t cmd, uint64_t arg0, uint64_t arg1, uint64_t arg2, v
     memcpy(cmddata, arg, sizeof(arg));
     if (len && data)
         memcpy(cmddata + sizeof(arg), data, len);
-    SendCommandNG_internal(cmd, cmddata, len + sizeof(arg), false);
+    SendCommandNG_internal(cmd, cmddata, len + sizeof(arg), false, with_seq, seq);
+}
+
+void SendCommandMIX(uint64_t cmd, uint64_t arg0, uint64_t arg1, uint64_t arg2, void *data, size_t len) {
+    SendCommandMIX_internal(cmd, arg0, arg1, arg2, data, len, false, 0);
+}
+
+// Sequenced frames, if the device supports them. Returns the sequence number to pass to WaitForResponseSeq
+uint16_t SendCommandNGSeq(uint16_t cmd, uint8_t *data, size_t len) {
+    pm3_device_t *dev = CurrentDevice();
+    uint16_t seq = __atomic_add_fetch(&dev->last_seq, 1, __ATOMIC_RELAXED);
+    SendCommandNG_internal(cmd, data, len, true, dev->capabilities.sequenced_frames, seq);
+    return seq;
+}
+
+uint16_t SendCommandMIXSeq(uint64_t cmd, uint64_t arg0, uint64_t arg1, uint64_t arg2, void *data, size_t len) {
+    pm3_device_t *dev = CurrentDevice();
+    uint16_t seq = __atomic_add_fetch(&dev->last_seq, 1, __ATOMIC_RELAXED);
+    SendCommandMIX_internal(cmd, arg0, arg1, arg2, data, len, dev->capabilities.sequenced_frames, seq);
+    return seq;
 }
 
 
@@ -202,65 +286,103 @@ void SendCommandMIX(uint64_t cmd, uint64_t arg0, uint64_t arg1, uint64_t arg2, v
  */
 void clearCommandBuffer() {
     //This is a very simple operation
-    pthread_mutex_lock(&rxBufferMutex);
-    cmd_tail = cmd_head;
-    pthread_mutex_unlock(&rxBufferMutex);
+    pm3_device_t *dev = CurrentDevice();
+    pthread_mutex_lock(&dev->rxBufferMutex);
+    dev->cmd_tail = dev->cmd_head;
+    pthread_mutex_unlock(&dev->rxBufferMutex);
 }
 /**
  * @brief storeCommand stores a USB command in a circular buffer
  * @param UC
  */
-static void storeReply(PacketResponseNG *packet) {
-    pthread_mutex_lock(&rxBufferMutex);
-    if ((cmd_head + 1) % CMD_BUFFER_SIZE == cmd_tail) {
+static void storeReply(pm3_device_t *dev, PacketResponseNG *packet) {
+    pthread_mutex_lock(&dev->rxBufferMutex);
+    if ((dev->cmd_head + 1) % CMD_BUFFER_SIZE == dev->cmd_tail) {
         //If these two are equal, we're about to overwrite in the
         // circular buffer.
         PrintAndLogEx(FAILED, "WARNING: Command buffer about to overwrite command! This needs to be fixed!");
         fflush(stdout);
     }
     //Store the command at the 'head' location
-    PacketResponseNG *destination = &rxBuffer[cmd_head];
+    PacketResponseNG *destination = &dev->rxBuffer[dev->cmd_head];
     memcpy(destination, packet, sizeof(PacketResponseNG));
 
     //increment head and wrap
-    cmd_head = (cmd_head + 1) % CMD_BUFFER_SIZE;
-    pthread_mutex_unlock(&rxBufferMutex);
+    dev->cmd_head = (dev->cmd_head + 1) % CMD_BUFFER_SIZE;
+    pthread_cond_broadcast(&dev->rxBufferSig);
+    pthread_mutex_unlock(&dev->rxBufferMutex);
 }
 /**
  * @brief getCommand gets a command from an internal circular buffer.
  * @param response location to write command
  * @return 1 if response was returned, 0 if nothing has been received
  */
-static int getReply(PacketResponseNG *packet) {
-    pthread_mutex_lock(&rxBufferMutex);
+static int getReply(pm3_device_t *dev, PacketResponseNG *packet) {
+    pthread_mutex_lock(&dev->rxBufferMutex);
     //If head == tail, there's nothing to read, or if we just got initialized
-    if (cmd_head == cmd_tail)  {
-        pthread_mutex_unlock(&rxBufferMutex);
+    if (dev->cmd_head == dev->cmd_tail)  {
+        pthread_mutex_unlock(&dev->rxBufferMutex);
         return 0;
     }
 
     //Pick out the next unread command
-    memcpy(packet, &rxBuffer[cmd_tail], sizeof(PacketResponseNG));
+    memcpy(packet, &dev->rxBuffer[dev->cmd_tail], sizeof(PacketResponseNG));
 
     //Increment tail - this is a circular buffer, so modulo buffer size
-    cmd_tail = (cmd_tail + 1) % CMD_BUFFER_SIZE;
+    dev->cmd_tail = (dev->cmd_tail + 1) % CMD_BUFFER_SIZE;
 
-    pthread_mutex_unlock(&rxBufferMutex);
+    pthread_mutex_unlock(&dev->rxBufferMutex);
     return 1;
 }
 
+/**
+ * @brief waitReply sleeps until a reply is stored or ms milliseconds have passed
+ * @param ms longest time to wait
+ */
+static void waitReply(pm3_device_t *dev, uint32_t ms) {
+    struct timespec deadline;
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    uint64_t nsec = (uint64_t)now.tv_usec * 1000 + (uint64_t)ms * 1000000;
+    deadline.tv_sec = now.tv_sec + nsec / 1000000000;
+    deadline.tv_nsec = nsec % 1000000000;
+
+    pthread_mutex_lock(&dev->rxBufferMutex);
+    if (dev->cmd_head == dev->cmd_tail)
+        pthread_cond_timedwait(&dev->rxBufferSig, &dev->rxBufferMutex, &deadline);
+    pthread_mutex_unlock(&dev->rxBufferMutex);
+}
+
 //-----------------------------------------------------------------------------
 // Entry point into our code: called whenever we received a packet over USB
 // that we weren't necessarily expecting, for example a debug print.
 //-----------------------------------------------------------------------------
-static void PacketResponseReceived(PacketResponseNG *packet) {
+static void PacketResponseReceived(pm3_device_t *dev, PacketResponseNG *packet) {
 
     // we got a packet, reset WaitForResponseTimeout timeout
-    uint64_t prev_clk = __atomic_load_n(&last_packet_time, __ATOMIC_SEQ_CST);
+    uint64_t prev_clk = __atomic_load_n(&dev->last_packet_time, __ATOMIC_SEQ_CST);
     uint64_t clk = msclock();
-    __atomic_store_n(&timeout_start_time,  clk, __ATOMIC_SEQ_CST);
-    __atomic_store_n(&last_packet_time, clk, __ATOMIC_SEQ_CST);
-    (void) prev_clk;
+    __atomic_store_n(&dev->timeout_start_time,  clk, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&dev->last_packet_time, clk, __ATOMIC_SEQ_CST);
+
+    size_t frame_len = sizeof(PacketResponseOLD);
+    if (packet->magic != 0) {
+        frame_len = sizeof(PacketResponseNGPreamble) + sizeof(PacketResponseNGPostamble) + packet->length;
+        if (packet->has_seq)
+            frame_len += sizeof(uint16_t);
+        if (packet->ng == false)
+            frame_len += sizeof(packet->oldarg);
+    }
+    if (clk - prev_clk > COMMS_BURST_GAP_MS || dev->comms_stats.burst_start == 0) {
+        __atomic_store_n(&dev->comms_stats.burst_start, clk, __ATOMIC_RELAXED);
+        __atomic_store_n(&dev->comms_stats.burst_frames, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&dev->comms_stats.burst_bytes, 0, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&dev->comms_stats.burst_end, clk, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&dev->comms_stats.burst_frames, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&dev->comms_stats.burst_bytes, frame_len, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&dev->comms_stats.frames, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&dev->comms_stats.bytes, frame_len, __ATOMIC_RELAXED);
 //    PrintAndLogEx(NORMAL, "[%07"PRIu64"] RECV %s magic %08x length %04x status %04x crc %04x cmd %04x",
 //                clk - prev_clk, packet->ng ? "NG" : "OLD", packet->magic, packet->length, packet->status, packet->crc, packet->cmd);
 
@@ -310,13 +432,64 @@ static void PacketResponseReceived(PacketResponseNG *packet) {
         // CMD_DOWNLOAD_BIGBUF packages which is not dealt with. I wonder if simply ignoring them will
         // work. lets try it.
         default: {
-            storeReply(packet);
+            storeReply(dev, packet);
             break;
         }
     }
 }
 
 
+// The sender thread.
+// sends the queued frames as soon as they are queued, so commands don't wait for the
+// receiving side to time out on an idle link.
+//
+static void
+#ifdef __has_attribute
+#if __has_attribute(force_align_arg_pointer)
+__attribute__((force_align_arg_pointer))
+#endif
+#endif
+*uart_sender(void *targ) {
+    pm3_device_t *dev = (pm3_device_t *)targ;
+
+    pthread_mutex_lock(&dev->txBufferMutex);
+    while (dev->conn.run) {
+
+        if (!dev->txBuffer_pending && !dev->txBufferNG_count) {
+            pthread_cond_wait(&dev->txBufferSig, &dev->txBufferMutex);
+            continue;
+        }
+
+        int res = PM3_SUCCESS;
+        // all queued NG packets
+        while (dev->txBufferNG_count) {
+            PacketCommandNGSeqRaw *frame = &dev->txBufferNG[dev->txBufferNG_head];
+            if (uart_send(dev->sp, (uint8_t *) frame, dev->txBufferNGLen[dev->txBufferNG_head]) == PM3_EIO)
+                res = PM3_EIO;
+            dev->conn.last_command = frame->pre.cmd;
+            dev->txBufferNG_head = (dev->txBufferNG_head + 1) % TX_QUEUE_SIZE;
+            dev->txBufferNG_count--;
+        }
+        if (dev->txBuffer_pending) {
+            if (uart_send(dev->sp, (uint8_t *) &dev->txBuffer, sizeof(PacketCommandOLD)) == PM3_EIO)
+                res = PM3_EIO;
+            dev->conn.last_command = dev->txBuffer.cmd;
+            dev->txBuffer_pending = false;
+        }
+
+        // main thread doesn't know send failed, it finds out the same way as for a receive failure
+        if (res == PM3_EIO)
+            __atomic_test_and_set(&dev->comm_thread_dead, __ATOMIC_SEQ_CST);
+
+        // tell main thread that txBuffer is empty
+        pthread_cond_broadcast(&dev->txBufferSig);
+    }
+    pthread_mutex_unlock(&dev->txBufferMutex);
+
+    pthread_exit(NULL);
+    return NULL;
+}
+
 // The communications thread.
 // signals to main thread when a response is ready to process.
 //
@@ -327,91 +500,103 @@ __attribute__((force_align_arg_pointer))
 #endif
 #endif
 *uart_communication(void *targ) {
-    communication_arg_t *connection = (communication_arg_t *)targ;
+    pm3_device_t *dev = (pm3_device_t *)targ;
     uint32_t rxlen;
     bool commfailed = false;
     PacketResponseNG rx;
-    PacketResponseNGRaw rx_raw;
+    PacketResponseNGSeqRaw rx_raw;
 
 #if defined(__MACH__) && defined(__APPLE__)
     disableAppNap("Proxmark3 polling UART");
 #endif
 
-    // is this connection->run a cross thread call?
-    while (connection->run) {
+    // is this dev->conn.run a cross thread call?
+    while (dev->conn.run) {
         rxlen = 0;
-        bool ACK_received = false;
         bool error = false;
         int res;
 
         // Signal to main thread that communications seems off.
         // main thread will kill and restart this thread.
         if (commfailed) {
-            if (conn.last_command != CMD_HARDWARE_RESET) {
+            if (dev->conn.last_command != CMD_HARDWARE_RESET) {
                 PrintAndLogEx(WARNING, "Communicating with Proxmark3 device " _RED_("failed"));
             }
-            __atomic_test_and_set(&comm_thread_dead, __ATOMIC_SEQ_CST);
+            __atomic_test_and_set(&dev->comm_thread_dead, __ATOMIC_SEQ_CST);
             break;
         }
 
-        res = uart_receive(sp, (uint8_t *)&rx_raw.pre, sizeof(PacketResponseNGPreamble), &rxlen);
+        res = uart_receive(dev->sp, (uint8_t *)&rx_raw.pre, sizeof(PacketResponseNGPreamble), &rxlen);
         if ((res == PM3_SUCCESS) && (rxlen == sizeof(PacketResponseNGPreamble))) {
             rx.magic = rx_raw.pre.magic;
             uint16_t length = rx_raw.pre.length;
             rx.ng = rx_raw.pre.ng;
             rx.status = rx_raw.pre.status;
             rx.cmd = rx_raw.pre.cmd;
-            if (rx.magic == RESPONSENG_PREAMBLE_MAGIC) { // New style NG reply
+            rx.has_seq = false;
+            rx.seq = 0;
+            if (rx.magic == RESPONSENG_PREAMBLE_MAGIC || rx.magic == RESPONSENG_SEQ_PREAMBLE_MAGIC) { // New style NG reply
+                size_t header_len = sizeof(PacketResponseNGPreamble);
+                uint64_t arg[3];
+                PacketResponseNGPostamble foopost;
+
                 if (length > PM3_CMD_DATA_SIZE) {
                     PrintAndLogEx(WARNING, "Received packet frame with incompatible length: 0x%04x", length);
                     error = true;
                 }
-                if ((!error) && (length > 0)) { // Get the variable length payload
-
-                    res = uart_receive(sp, (uint8_t *)&rx_raw.data, length, &rxlen);
-                    if ((res != PM3_SUCCESS) || (rxlen != length)) {
+                if ((!error) && (rx.magic == RESPONSENG_SEQ_PREAMBLE_MAGIC)) { // Get the sequence number
+                    res = uart_receive(dev->sp, (uint8_t *)&rx_raw.seq, sizeof(rx_raw.seq), &rxlen);
+                    if ((res != PM3_SUCCESS) || (rxlen != sizeof(rx_raw.seq))) {
+                        PrintAndLogEx(WARNING, "Received sequenced packet frame without sequence number");
+                        error = true;
+                    }
+                    rx.has_seq = true;
+                    rx.seq = rx_raw.seq;
+                    header_len += sizeof(rx_raw.seq);
+                }
+                if ((!error) && (!rx.ng) && (length < sizeof(arg))) {
+                    PrintAndLogEx(WARNING, "Received MIX packet frame with incompatible length: 0x%04x", length);
+                    error = true;
+                }
+                // Get the variable length payload, straight into rx. The uart layer
+                // serves it from its read buffer, there is no intermediate frame copy.
+                if ((!error) && (!rx.ng)) {
+                    res = uart_receive(dev->sp, (uint8_t *)arg, sizeof(arg), &rxlen);
+                    if ((res != PM3_SUCCESS) || (rxlen != sizeof(arg))) {
                         PrintAndLogEx(WARNING, "Received packet frame with variable part too short? %d/%d", rxlen, length);
                         error = true;
-                    } else {
-
-                        if (rx.ng) {      // Received a valid NG frame
-                            memcpy(&rx.data, &rx_raw.data, length);
-                            rx.length = length;
-                            if ((rx.cmd == conn.last_command) && (rx.status == PM3_SUCCESS)) {
-                                ACK_received = true;
-                            }
-                        } else {
-                            uint64_t arg[3];
-                            if (length < sizeof(arg)) {
-                                PrintAndLogEx(WARNING, "Received MIX packet frame with incompatible length: 0x%04x", length);
-                                error = true;
-                            }
-                            if (!error) { // Received a valid MIX frame
-                                memcpy(arg, &rx_raw.data, sizeof(arg));
-                                rx.oldarg[0] = arg[0];
-                                rx.oldarg[1] = arg[1];
-                                rx.oldarg[2] = arg[2];
-                                memcpy(&rx.data, ((uint8_t *)&rx_raw.data) + sizeof(arg), length - sizeof(arg));
-                                rx.length = length - sizeof(arg);
-                                if (rx.cmd == CMD_ACK) {
-                                    ACK_received = true;
-                                }
-                            }
-                        }
+                    }
+                    rx.oldarg[0] = arg[0];
+                    rx.oldarg[1] = arg[1];
+                    rx.oldarg[2] = arg[2];
+                }
+                rx.length = rx.ng ? length : length - sizeof(arg);
+                if ((!error) && (rx.length > 0)) {
+                    res = uart_receive(dev->sp, rx.data.asBytes, rx.length, &rxlen);
+                    if ((res != PM3_SUCCESS) || (rxlen != rx.length)) {
+                        PrintAndLogEx(WARNING, "Received packet frame with variable part too short? %d/%d", rxlen, rx.length);
+                        error = true;
                     }
                 }
                 if (!error) {                        // Get the postamble
-                    res = uart_receive(sp, (uint8_t *)&rx_raw.foopost, sizeof(PacketResponseNGPostamble), &rxlen);
+                    res = uart_receive(dev->sp, (uint8_t *)&foopost, sizeof(PacketResponseNGPostamble), &rxlen);
                     if ((res != PM3_SUCCESS) || (rxlen != sizeof(PacketResponseNGPostamble))) {
                         PrintAndLogEx(WARNING, "Received packet frame without postamble");
                         error = true;
                     }
                 }
                 if (!error) {                        // Check CRC, accept MAGIC as placeholder
-                    rx.crc = rx_raw.foopost.crc;
+                    rx.crc = foopost.crc;
                     if (rx.crc != RESPONSENG_POSTAMBLE_MAGIC) {
+                        // only a real CRC (FPC) needs the frame contiguous again
+                        uint8_t *payload = rx.has_seq ? rx_raw.data : (uint8_t *)&rx_raw.seq;
+                        if (!rx.ng) {
+                            memcpy(payload, arg, sizeof(arg));
+                            payload += sizeof(arg);
+                        }
+                        memcpy(payload, rx.data.asBytes, rx.length);
                         uint8_t first, second;
-                        compute_crc(CRC_14443_A, (uint8_t *)&rx_raw, sizeof(PacketResponseNGPreamble) + length, &first, &second);
+                        compute_crc(CRC_14443_A, (uint8_t *)&rx_raw, header_len + length, &first, &second);
                         if ((first << 8) + second != rx.crc) {
                             PrintAndLogEx(WARNING, "Received packet frame with invalid CRC %02X%02X <> %04X", first, second, rx.crc);
                             error = true;
@@ -423,17 +608,19 @@ __attribute__((force_align_arg_pointer))
                     PrintAndLogEx(NORMAL, "Receiving %s:", rx.ng ? "NG" : "MIX");
 #endif
 #ifdef COMMS_DEBUG_RAW
-                    print_hex_break((uint8_t *)&rx_raw.pre, sizeof(PacketResponseNGPreamble), 32);
-                    print_hex_break((uint8_t *)&rx_raw.data, rx_raw.pre.length, 32);
-                    print_hex_break((uint8_t *)&rx_raw.foopost, sizeof(PacketResponseNGPostamble), 32);
+                    print_hex_break((uint8_t *)&rx_raw.pre, header_len, 32);
+                    if (!rx.ng)
+                        print_hex_break((uint8_t *)arg, sizeof(arg), 32);
+                    print_hex_break(rx.data.asBytes, rx.length, 32);
+                    print_hex_break((uint8_t *)&foopost, sizeof(PacketResponseNGPostamble), 32);
 #endif
-                    PacketResponseReceived(&rx);
+                    PacketResponseReceived(dev, &rx);
                 }
             } else {                               // Old style reply
                 PacketResponseOLD rx_old;
                 memcpy(&rx_old, &rx_raw.pre, sizeof(PacketResponseNGPreamble));
 
-                res = uart_receive(sp, ((uint8_t *)&rx_old) + sizeof(PacketResponseNGPreamble), sizeof(PacketResponseOLD) - sizeof(PacketResponseNGPreamble), &rxlen);
+                res = uart_receive(dev->sp, ((uint8_t *)&rx_old) + sizeof(PacketResponseNGPreamble), sizeof(PacketResponseOLD) - sizeof(PacketResponseNGPreamble), &rxlen);
                 if ((res != PM3_SUCCESS) || (rxlen != sizeof(PacketResponseOLD) - sizeof(PacketResponseNGPreamble))) {
                     PrintAndLogEx(WARNING, "Received packet OLD frame with payload too short? %d/%zu", rxlen, sizeof(PacketResponseOLD) - sizeof(PacketResponseNGPreamble));
                     error = true;
@@ -451,16 +638,14 @@ __attribute__((force_align_arg_pointer))
                     rx.magic = 0;
                     rx.status = 0;
                     rx.crc = 0;
+                    rx.has_seq = false;
                     rx.cmd = rx_old.cmd;
                     rx.oldarg[0] = rx_old.arg[0];
                     rx.oldarg[1] = rx_old.arg[1];
                     rx.oldarg[2] = rx_old.arg[2];
                     rx.length = PM3_CMD_DATA_SIZE;
                     memcpy(&rx.data, &rx_old.d, rx.length);
-                    PacketResponseReceived(&rx);
-                    if (rx.cmd == CMD_ACK) {
-                        ACK_received = true;
-                    }
+                    PacketResponseReceived(dev, &rx);
                 }
             }
         } else {
@@ -474,53 +659,9 @@ __attribute__((force_align_arg_pointer))
         }
 
         // TODO if error, shall we resync ?
-
-        pthread_mutex_lock(&txBufferMutex);
-
-        if (connection->block_after_ACK) {
-            // if we just received an ACK, wait here until a new command is to be transmitted
-            // This is only working on OLD frames, and only used by flasher and flashmem
-            if (ACK_received) {
-#ifdef COMMS_DEBUG
-                PrintAndLogEx(NORMAL, "Received ACK, fast TX mode: ignoring other RX till TX");
-#endif
-                while (!txBuffer_pending) {
-                    pthread_cond_wait(&txBufferSig, &txBufferMutex);
-                }
-            }
-        }
-
-        if (txBuffer_pending) {
-
-            if (txBufferNGLen) { // NG packet
-                res = uart_send(sp, (uint8_t *) &txBufferNG, txBufferNGLen);
-                if (res == PM3_EIO) {
-                    commfailed = true;
-                }
-                conn.last_command = txBufferNG.pre.cmd;
-                txBufferNGLen = 0;
-            } else {
-                res = uart_send(sp, (uint8_t *) &txBuffer, sizeof(PacketCommandOLD));
-                if (res == PM3_EIO) {
-                    commfailed = true;
-                }
-                conn.last_command = txBuffer.cmd;
-            }
-
-            txBuffer_pending = false;
-
-            // main thread doesn't know send failed...
-
-            // tell main thread that txBuffer is empty
-            pthread_cond_signal(&txBufferSig);
-        }
-
-        pthread_mutex_unlock(&txBufferMutex);
     }
 
-    // when thread dies, we close the serial port.
-    uart_close(sp);
-    sp = NULL;
+    // the serial port is closed by CloseProxmark, once the sender thread is gone as well
 
 #if defined(__MACH__) && defined(__APPLE__)
     enableAppNap();
@@ -530,56 +671,72 @@ __attribute__((force_align_arg_pointer))
     return NULL;
 }
 
+void GetCommsStats(comms_stats_t *stats) {
+    pm3_device_t *dev = CurrentDevice();
+    stats->frames = __atomic_load_n(&dev->comms_stats.frames, __ATOMIC_RELAXED);
+    stats->bytes = __atomic_load_n(&dev->comms_stats.bytes, __ATOMIC_RELAXED);
+    stats->burst_frames = __atomic_load_n(&dev->comms_stats.burst_frames, __ATOMIC_RELAXED);
+    stats->burst_bytes = __atomic_load_n(&dev->comms_stats.burst_bytes, __ATOMIC_RELAXED);
+    stats->burst_start = __atomic_load_n(&dev->comms_stats.burst_start, __ATOMIC_RELAXED);
+    stats->burst_end = __atomic_load_n(&dev->comms_stats.burst_end, __ATOMIC_RELAXED);
+    stats->reads = 0;
+    stats->read_bytes = 0;
+    if (dev->sp != NULL)
+        uart_get_stats(dev->sp, &stats->reads, &stats->read_bytes);
+}
+
 bool IsCommunicationThreadDead(void) {
-    bool ret = __atomic_load_n(&comm_thread_dead, __ATOMIC_SEQ_CST);
+    pm3_device_t *dev = CurrentDevice();
+    bool ret = __atomic_load_n(&dev->comm_thread_dead, __ATOMIC_SEQ_CST);
     return ret;
 }
 
-bool OpenProxmark(void *port, bool wait_for_port, int timeout, bool flash_mode, uint32_t speed) {
+bool OpenProxmark(void *port, bool wait_for_port, int timeout, uint32_t speed) {
+    pm3_device_t *dev = CurrentDevice();
 
     char *portname = (char *)port;
     if (!wait_for_port) {
         PrintAndLogEx(INFO, "Using UART port " _YELLOW_("%s"), portname);
-        sp = uart_open(portname, speed);
+        dev->sp = uart_open(portname, speed);
     } else {
         PrintAndLogEx(SUCCESS, "Waiting for Proxmark3 to appear on " _YELLOW_("%s"), portname);
         fflush(stdout);
         int openCount = 0;
         do {
-            sp = uart_open(portname, speed);
+            dev->sp = uart_open(portname, speed);
             msleep(500);
             printf(".");
             fflush(stdout);
-        } while (++openCount < timeout && (sp == INVALID_SERIAL_PORT || sp == CLAIMED_SERIAL_PORT));
+        } while (++openCount < timeout && (dev->sp == INVALID_SERIAL_PORT || dev->sp == CLAIMED_SERIAL_PORT));
     }
 
     // check result of uart opening
-    if (sp == INVALID_SERIAL_PORT) {
+    if (dev->sp == INVALID_SERIAL_PORT) {
         PrintAndLogEx(WARNING, "\n" _RED_("ERROR:") "invalid serial port " _YELLOW_("%s"), portname);
-        sp = NULL;
+        dev->sp = NULL;
         return false;
-    } else if (sp == CLAIMED_SERIAL_PORT) {
+    } else if (dev->sp == CLAIMED_SERIAL_PORT) {
         PrintAndLogEx(WARNING, "\n" _RED_("ERROR:") "serial port " _YELLOW_("%s") " is claimed by another process", portname);
-        sp = NULL;
+        dev->sp = NULL;
         return false;
     } else {
         // start the communication thread
-        if (portname != (char *)conn.serial_port_name) {
+        if (portname != (char *)dev->conn.serial_port_name) {
             uint16_t len = MIN(strlen(portname), FILE_PATH_SIZE - 1);
-            memset(conn.serial_port_name, 0, FILE_PATH_SIZE);
-            memcpy(conn.serial_port_name, portname, len);
+            memset(dev->conn.serial_port_name, 0, FILE_PATH_SIZE);
+            memcpy(dev->conn.serial_port_name, portname, len);
         }
-        conn.run = true;
-        conn.block_after_ACK = flash_mode;
+        dev->conn.run = true;
         // Flags to tell where to add CRC on sent replies
-        conn.send_with_crc_on_usb = false;
-        conn.send_with_crc_on_fpc = true;
+        dev->conn.send_with_crc_on_usb = false;
+        dev->conn.send_with_crc_on_fpc = true;
         // "Session" flag, to tell via which interface next msgs should be sent: USB or FPC USART
-        conn.send_via_fpc_usart = false;
+        dev->conn.send_via_fpc_usart = false;
 
-        pthread_create(&communication_thread, NULL, &uart_communication, &conn);
-        __atomic_clear(&comm_thread_dead, __ATOMIC_SEQ_CST);
-        session.pm3_present = true;
+        __atomic_clear(&dev->comm_thread_dead, __ATOMIC_SEQ_CST);
+        pthread_create(&dev->communication_thread, NULL, &uart_communication, dev);
+        pthread_create(&dev->sender_thread, NULL, &uart_sender, dev);
+        SetDevicePresent(dev, true);
 
         fflush(stdout);
 
@@ -589,6 +746,7 @@ bool OpenProxmark(void *port, bool wait_for_port, int timeout, bool flash_mode,
 
 // check if we can communicate with Pm3
 int TestProxmark(void) {
+    pm3_device_t *dev = CurrentDevice();
 
     PacketResponseNG resp;
     uint16_t len = 32;
@@ -596,7 +754,7 @@ int TestProxmark(void) {
     for (uint16_t i = 0; i < len; i++)
         data[i] = i & 0xFF;
 
-    __atomic_store_n(&last_packet_time,  msclock(), __ATOMIC_SEQ_CST);
+    __atomic_store_n(&dev->last_packet_time,  msclock(), __ATOMIC_SEQ_CST);
     clearCommandBuffer();
     SendCommandNG(CMD_PING, data, len);
 
@@ -624,22 +782,33 @@ int TestProxmark(void) {
         return PM3_ETIMEOUT;
     }
 
-    if ((resp.length != sizeof(pm3_capabilities)) || (resp.data.asBytes[0] != CAPABILITIES_VERSION)) {
-        PrintAndLogEx(ERR, _RED_("Capabilities structure version sent by Proxmark3 is not the same as the one used by the client!"));
+    uint8_t version = resp.data.asBytes[0];
+    if ((resp.length != sizeof(dev->capabilities)) || (version < CAPABILITIES_VERSION_MIN) || (version > CAPABILITIES_VERSION)) {
+        PrintAndLogEx(ERR, _RED_("Capabilities structure version sent by Proxmark3 is not supported by the client!"));
         PrintAndLogEx(ERR, _RED_("Please flash the Proxmark with the same version as the client."));
         return PM3_EDEVNOTSUPP;
     }
 
-    memcpy(&pm3_capabilities, resp.data.asBytes, MIN(sizeof(capabilities_t), resp.length));
-    conn.send_via_fpc_usart = pm3_capabilities.via_fpc;
-    conn.uart_speed = pm3_capabilities.baudrate;
+    memcpy(&dev->capabilities, resp.data.asBytes, MIN(sizeof(capabilities_t), resp.length));
+
+    // older firmware leaves the bits of later flags uninitialised
+    if (version < 4)
+        dev->capabilities.sequenced_frames = false;
+    if (version < 5)
+        dev->capabilities.compressed_download = false;
+    if (version < 6)
+        dev->capabilities.mifare_chkkeys_stream = false;
+    if (version < CAPABILITIES_VERSION)
+        PrintAndLogEx(WARNING, "Proxmark3 firmware is older than the client, some commands fall back to slower variants");
+    dev->conn.send_via_fpc_usart = dev->capabilities.via_fpc;
+    dev->conn.uart_speed = dev->capabilities.baudrate;
 
     PrintAndLogEx(INFO, "Communicating with PM3 over %s%s",
-                  conn.send_via_fpc_usart ? _YELLOW_("FPC UART") : _YELLOW_("USB-CDC"),
-                  memcmp(conn.serial_port_name, "tcp:", 4) == 0 ? "over " _YELLOW_("TCP") : "");
+                  dev->conn.send_via_fpc_usart ? _YELLOW_("FPC UART") : _YELLOW_("USB-CDC"),
+                  memcmp(dev->conn.serial_port_name, "tcp:", 4) == 0 ? "over " _YELLOW_("TCP") : "");
 
-    if (conn.send_via_fpc_usart) {
-        PrintAndLogEx(INFO, "PM3 UART serial baudrate: " _YELLOW_("%u") "\n", conn.uart_speed);
+    if (dev->conn.send_via_fpc_usart) {
+        PrintAndLogEx(INFO, "PM3 UART serial baudrate: " _YELLOW_("%u") "\n", dev->conn.uart_speed);
     } else {
         int res = uart_reconfigure_timeouts(UART_USB_CLIENT_RX_TIMEOUT_MS);
         if (res != PM3_SUCCESS) {
@@ -650,25 +819,102 @@ int TestProxmark(void) {
 }
 
 void CloseProxmark(void) {
-    conn.run = false;
+    pm3_device_t *dev = CurrentDevice();
+
+    // wake up the sender thread, it sleeps until there is something to send
+    pthread_mutex_lock(&dev->txBufferMutex);
+    dev->conn.run = false;
+    pthread_cond_broadcast(&dev->txBufferSig);
+    pthread_mutex_unlock(&dev->txBufferMutex);
 
 #ifdef __BIONIC__
-    if (communication_thread != 0) {
-        pthread_join(communication_thread, NULL);
+    if (dev->communication_thread != 0) {
+        pthread_join(dev->communication_thread, NULL);
+    }
+    if (dev->sender_thread != 0) {
+        pthread_join(dev->sender_thread, NULL);
     }
 #else
-    pthread_join(communication_thread, NULL);
+    pthread_join(dev->communication_thread, NULL);
+    pthread_join(dev->sender_thread, NULL);
 #endif
 
-    if (sp) {
-        uart_close(sp);
+    if (dev->sp) {
+        uart_close(dev->sp);
     }
 
     // Clean up our state
-    sp = NULL;
-    memset(&communication_thread, 0, sizeof(pthread_t));
+    dev->sp = NULL;
+    memset(&dev->communication_thread, 0, sizeof(pthread_t));
+    memset(&dev->sender_thread, 0, sizeof(pthread_t));
+    dev->txBuffer_pending = false;
+    dev->txBufferNG_count = 0;
+
+    SetDevicePresent(dev, false);
+}
+
+pm3_device_t *GetCurrentDevice(void) {
+    return CurrentDevice();
+}
+
+// Selects the device the calling thread talks to, NULL for the main device. Returns the previous one
+pm3_device_t *SetCurrentDevice(pm3_device_t *dev) {
+    pm3_device_t *prev = CurrentDevice();
+    current_device = (dev == &main_device) ? NULL : dev;
+    return prev;
+}
+
+// Opens and tests an additional Proxmark3, with its own communication threads. The calling
+// thread's current device is left unchanged. Returns NULL if the device can't be reached
+pm3_device_t *OpenProxmarkDevice(const char *port, uint32_t speed) {
+    pm3_device_t *dev = calloc(1, sizeof(pm3_device_t));
+    if (dev == NULL) {
+        PrintAndLogEx(WARNING, "Failed to allocate memory");
+        return NULL;
+    }
+    pthread_mutex_init(&dev->txBufferMutex, NULL);
+    pthread_cond_init(&dev->txBufferSig, NULL);
+    pthread_mutex_init(&dev->rxBufferMutex, NULL);
+    pthread_cond_init(&dev->rxBufferSig, NULL);
+
+    pm3_device_t *prev = SetCurrentDevice(dev);
+    bool ok = OpenProxmark((void *)port, false, 0, speed);
+    if (ok && TestProxmark() != PM3_SUCCESS) {
+        PrintAndLogEx(ERR, "Can't communicate with Proxmark3 on " _YELLOW_("%s"), port);
+        CloseProxmark();
+        ok = false;
+    }
+    SetCurrentDevice(prev);
+
+    if (!ok) {
+        CloseProxmarkDevice(dev);
+        return NULL;
+    }
+    return dev;
+}
+
+// Closes a device from OpenProxmarkDevice, if the calling thread had selected it, it is back on the main device
+void CloseProxmarkDevice(pm3_device_t *dev) {
+    if (dev == NULL || dev == &main_device)
+        return;
+
+    pm3_device_t *prev = SetCurrentDevice(dev);
+    if (dev->present)
+        CloseProxmark();
+    SetCurrentDevice(prev == dev ? NULL : prev);
+
+    pthread_mutex_destroy(&dev->txBufferMutex);
+    pthread_cond_destroy(&dev->txBufferSig);
+    pthread_mutex_destroy(&dev->rxBufferMutex);
+    pthread_cond_destroy(&dev->rxBufferSig);
+    free(dev);
+}
 
-    session.pm3_present = false;
+// Port name of a device, for messages
+const char *GetDevicePort(pm3_device_t *dev) {
+    if (dev == NULL)
+        dev = CurrentDevice();
+    return (const char *)dev->conn.serial_port_name;
 }
 
 // Gives a rough estimate of the communication delay based on channel & baudrate
@@ -680,9 +926,9 @@ void CloseProxmark(void) {
 //   9600 -> 1100..1150ms
 //           ~ = 12000000 / USART_BAUD_RATE
 // Let's take 2x (maybe we need more for BT link?)
-static size_t communication_delay(void) {
-    if (conn.send_via_fpc_usart)  // needed also for Windows USB USART??
-        return 2 * (12000000 / conn.uart_speed);
+static size_t communication_delay(pm3_device_t *dev) {
+    if (dev->conn.send_via_fpc_usart)  // needed also for Windows USB USART??
+        return 2 * (12000000 / dev->conn.uart_speed);
     return 0;
 }
 
@@ -696,7 +942,8 @@ static size_t communication_delay(void) {
  * @param show_warning display message after 3 seconds
  * @return true if command was returned, otherwise false
  */
-bool WaitForResponseTimeoutW(uint32_t cmd, PacketResponseNG *response, size_t ms_timeout, bool show_warning) {
+static bool WaitForResponseInternal(uint32_t cmd, bool match_seq, uint16_t seq, PacketResponseNG *response, size_t ms_timeout, bool show_warning) {
+    pm3_device_t *dev = CurrentDevice();
 
     PacketResponseNG resp;
 
@@ -705,15 +952,20 @@ bool WaitForResponseTimeoutW(uint32_t cmd, PacketResponseNG *response, size_t ms
 
     // Add delay depending on the communication channel & speed
     if (ms_timeout != (size_t) - 1)
-        ms_timeout += communication_delay();
+        ms_timeout += communication_delay(dev);
 
-    __atomic_store_n(&timeout_start_time,  msclock(), __ATOMIC_SEQ_CST);
+    __atomic_store_n(&dev->timeout_start_time,  msclock(), __ATOMIC_SEQ_CST);
 
     // Wait until the command is received
     while (true) {
 
-        while (getReply(response)) {
+        while (getReply(dev, response)) {
             if (cmd == CMD_UNKNOWN || response->cmd == cmd) {
+                // replies to other sequenced frames are left over from earlier commands
+                if (match_seq && response->has_seq && response->seq != seq) {
+                    PrintAndLogEx(DEBUG, "Skipping reply to sequence %u while waiting for %u", response->seq, seq);
+                    continue;
+                }
                 return true;
             }
             if (response->cmd == CMD_WTX && response->length == sizeof(uint16_t)) {
@@ -724,22 +976,74 @@ bool WaitForResponseTimeoutW(uint32_t cmd, PacketResponseNG *response, size_t ms
             }
         }
 
-        uint64_t tmp_clk = __atomic_load_n(&timeout_start_time, __ATOMIC_SEQ_CST);
-        if ((ms_timeout != (size_t) -1) && (msclock() - tmp_clk > ms_timeout))
+        uint64_t tmp_clk = __atomic_load_n(&dev->timeout_start_time, __ATOMIC_SEQ_CST);
+        uint64_t elapsed = msclock() - tmp_clk;
+        if ((ms_timeout != (size_t) -1) && (elapsed > ms_timeout))
             break;
 
-        if (msclock() - tmp_clk > 3000 && show_warning) {
+        if (elapsed > 3000 && show_warning) {
             // 3 seconds elapsed (but this doesn't mean the timeout was exceeded)
 //            PrintAndLogEx(INFO, "Waiting for a response from the Proxmark3...");
             PrintAndLogEx(INFO, "You can cancel this operation by pressing the pm3 button");
             show_warning = false;
         }
-        // just to avoid CPU busy loop:
-        msleep(10);
+
+        uint32_t slice = RX_WAIT_SLICE_MS;
+        if ((ms_timeout != (size_t) -1) && (ms_timeout - elapsed < slice))
+            slice = ms_timeout - elapsed + 1;
+        waitReply(dev, slice);
     }
     return false;
 }
 
+bool WaitForResponseTimeoutW(uint32_t cmd, PacketResponseNG *response, size_t ms_timeout, bool show_warning) {
+    return WaitForResponseInternal(cmd, false, 0, response, ms_timeout, show_warning);
+}
+
+/**
+ * @brief Waits for the reply to a command sent with SendCommandNGSeq or SendCommandMIXSeq.
+ * Replies without sequence number (OLD frames, devices without sequenced frames) are matched by cmd only
+ */
+bool WaitForResponseSeq(uint32_t cmd, uint16_t seq, PacketResponseNG *response, size_t ms_timeout) {
+    return WaitForResponseInternal(cmd, true, seq, response, ms_timeout, true);
+}
+
+/**
+ * @brief Sends count commands with up to PIPELINE_WINDOW of them in flight and hands the
+ * replies to reply() in order. send(index) sends command index with SendCommand{NG,MIX}Seq and
+ * returns its sequence number. Only for commands which don't abort on incoming data.
+ * @return PM3_SUCCESS, PM3_ETIMEOUT or the first error returned by reply()
+ */
+int SendCommandsPipelined(uint32_t count, uint32_t reply_cmd, size_t ms_timeout, pipeline_send_t send, pipeline_reply_t reply, void *ctx) {
+    pm3_device_t *dev = CurrentDevice();
+    // two frames fit the 1024 bytes of the device's FIFO on FPC, one is being processed
+    uint32_t window = dev->conn.send_via_fpc_usart ? 2 : PIPELINE_WINDOW;
+    if (!dev->capabilities.sequenced_frames)
+        window = 1;
+
+    uint16_t seqs[PIPELINE_WINDOW];
+    uint32_t sent = 0, done = 0;
+    int res = PM3_SUCCESS;
+
+    clearCommandBuffer();
+    while (done < sent || (sent < count && res == PM3_SUCCESS)) {
+        while (sent < count && sent - done < window && res == PM3_SUCCESS) {
+            seqs[sent % PIPELINE_WINDOW] = send(sent, ctx);
+            sent++;
+        }
+
+        PacketResponseNG resp;
+        if (!WaitForResponseSeq(reply_cmd, seqs[done % PIPELINE_WINDOW], &resp, ms_timeout))
+            return PM3_ETIMEOUT;
+
+        // after an error, only the replies of the commands in flight are collected
+        if (res == PM3_SUCCESS)
+            res = reply(done, &resp, ctx);
+        done++;
+    }
+    return res;
+}
+
 bool WaitForResponseTimeout(uint32_t cmd, PacketResponseNG *response, size_t ms_timeout) {
     return WaitForResponseTimeoutW(cmd, response, ms_timeout, true);
 }
@@ -764,6 +1068,7 @@ bool WaitForResponse(uint32_t cmd, PacketResponseNG *response) {
 * @return true if command was returned, otherwise false
 */
 bool GetFromDevice(DeviceMemType_t memtype, uint8_t *dest, uint32_t bytes, uint32_t start_index, uint8_t *data, uint32_t datalen, PacketResponseNG *response, size_t ms_timeout, bool show_warning) {
+    pm3_device_t *dev = CurrentDevice();
 
     if (dest == NULL) return false;
     if (bytes == 0) return true;
@@ -775,44 +1080,49 @@ bool GetFromDevice(DeviceMemType_t memtype, uint8_t *dest, uint32_t bytes, uint3
     // clear
     clearCommandBuffer();
 
+    // older firmware sends the raw bytes
+    uint32_t flags = dev->capabilities.compressed_download ? DOWNLOAD_COMPRESSED : 0;
+
     switch (memtype) {
         case BIG_BUF: {
-            SendCommandMIX(CMD_DOWNLOAD_BIGBUF, start_index, bytes, 0, NULL, 0);
-            return dl_it(dest, bytes, response, ms_timeout, show_warning, CMD_DOWNLOADED_BIGBUF);
+            SendCommandMIX(CMD_DOWNLOAD_BIGBUF, start_index, bytes, flags, NULL, 0);
+            return dl_it(dev, dest, bytes, response, ms_timeout, show_warning, CMD_DOWNLOADED_BIGBUF);
         }
         case BIG_BUF_EML: {
-            SendCommandMIX(CMD_DOWNLOAD_EML_BIGBUF, start_index, bytes, 0, NULL, 0);
-            return dl_it(dest, bytes, response, ms_timeout, show_warning, CMD_DOWNLOADED_EML_BIGBUF);
+            SendCommandMIX(CMD_DOWNLOAD_EML_BIGBUF, start_index, bytes, flags, NULL, 0);
+            return dl_it(dev, dest, bytes, response, ms_timeout, show_warning, CMD_DOWNLOADED_EML_BIGBUF);
         }
         case SPIFFS: {
-            SendCommandMIX(CMD_SPIFFS_DOWNLOAD, start_index, bytes, 0, data, datalen);
-            return dl_it(dest, bytes, response, ms_timeout, show_warning, CMD_SPIFFS_DOWNLOADED);
+            SendCommandMIX(CMD_SPIFFS_DOWNLOAD, start_index, bytes, flags, data, datalen);
+            return dl_it(dev, dest, bytes, response, ms_timeout, show_warning, CMD_SPIFFS_DOWNLOADED);
         }
         case FLASH_MEM: {
-            SendCommandMIX(CMD_FLASHMEM_DOWNLOAD, start_index, bytes, 0, NULL, 0);
-            return dl_it(dest, bytes, response, ms_timeout, show_warning, CMD_FLASHMEM_DOWNLOADED);
+            SendCommandMIX(CMD_FLASHMEM_DOWNLOAD, start_index, bytes, flags, NULL, 0);
+            return dl_it(dev, dest, bytes, response, ms_timeout, show_warning, CMD_FLASHMEM_DOWNLOADED);
         }
         case SIM_MEM: {
             //SendCommandMIX(CMD_DOWNLOAD_SIM_MEM, start_index, bytes, 0, NULL, 0);
-            //return dl_it(dest, bytes, response, ms_timeout, show_warning, CMD_DOWNLOADED_SIMMEM);
+            //return dl_it(dev, dest, bytes, response, ms_timeout, show_warning, CMD_DOWNLOADED_SIMMEM);
             return false;
         }
     }
     return false;
 }
 
-static bool dl_it(uint8_t *dest, uint32_t bytes, PacketResponseNG *response, size_t ms_timeout, bool show_warning, uint32_t rec_cmd) {
+static bool dl_it(pm3_device_t *dev, uint8_t *dest, uint32_t bytes, PacketResponseNG *response, size_t ms_timeout, bool show_warning, uint32_t rec_cmd) {
 
     uint32_t bytes_completed = 0;
-    __atomic_store_n(&timeout_start_time,  msclock(), __ATOMIC_SEQ_CST);
+    uint32_t frames = 0;
+    uint64_t dl_start = usclock();
+    __atomic_store_n(&dev->timeout_start_time,  msclock(), __ATOMIC_SEQ_CST);
 
     // Add delay depending on the communication channel & speed
     if (ms_timeout != (size_t) -1)
-        ms_timeout += communication_delay();
+        ms_timeout += communication_delay(dev);
 
     while (true) {
 
-        if (getReply(response)) {
+        if (getReply(dev, response)) {
 
             // sample_buf is a array pointer, located in data.c
             // arg0 = offset in transfer. Startindex of this chunk
@@ -821,6 +1131,22 @@ static bool dl_it(uint8_t *dest, uint32_t bytes, PacketResponseNG *response, siz
             if (response->cmd == rec_cmd) {
 
                 uint32_t offset = response->oldarg[0];
+                frames++;
+
+                if (response->oldarg[1] & DOWNLOAD_COMPRESSED) {
+                    uint32_t raw_bytes = response->oldarg[1] & ~DOWNLOAD_COMPRESSED;
+                    if (offset + raw_bytes > bytes) {
+                        PrintAndLogEx(FAILED, "ERROR: Out of bounds when downloading from device,  offset %u | len %u | total len %u > buf_size %u", offset, raw_bytes,  offset + raw_bytes,  bytes);
+                        break;
+                    }
+                    if (rledelta_decode(response->data.asBytes, response->length, dest + offset, raw_bytes) != (int)raw_bytes) {
+                        PrintAndLogEx(FAILED, "ERROR: Corrupt compressed block when downloading from device,  offset %u | len %u", offset, raw_bytes);
+                        break;
+                    }
+                    bytes_completed += raw_bytes;
+                    continue;
+                }
+
                 uint32_t copy_bytes = MIN(bytes - bytes_completed, response->oldarg[1]);
                 //uint32_t tracelen = response->oldarg[2];
 
@@ -837,6 +1163,10 @@ static bool dl_it(uint8_t *dest, uint32_t bytes, PacketResponseNG *response, siz
                 memcpy(dest + offset, response->data.asBytes, copy_bytes);
                 bytes_completed += copy_bytes;
             } else if (response->cmd == CMD_ACK) {
+                // a download can take less than a millisecond, at least 1us for the rate
+                uint64_t us = MAX(usclock() - dl_start, 1);
+                PrintAndLogEx(DEBUG, "Downloaded %u bytes in %u frames, %.3f ms, %.1f kB/s",
+                              bytes_completed, frames, us / 1000.0, (double)bytes_completed * 1000 / us);
                 return true;
             } else if (response->cmd == CMD_WTX && response->length == sizeof(uint16_t)) {
                 uint16_t wtx = response->data.asDwords[0] & 0xFFFF;
@@ -846,18 +1176,24 @@ static bool dl_it(uint8_t *dest, uint32_t bytes, PacketResponseNG *response, siz
             }
         }
 
-        uint64_t tmp_clk = __atomic_load_n(&timeout_start_time, __ATOMIC_SEQ_CST);
-        if (msclock() - tmp_clk > ms_timeout) {
+        uint64_t tmp_clk = __atomic_load_n(&dev->timeout_start_time, __ATOMIC_SEQ_CST);
+        uint64_t elapsed = msclock() - tmp_clk;
+        if (elapsed > ms_timeout) {
             PrintAndLogEx(FAILED, "Timed out while trying to download data from device");
             break;
         }
 
-        if (msclock() - tmp_clk > 3000 && show_warning) {
+        if (elapsed > 3000 && show_warning) {
             // 3 seconds elapsed (but this doesn't mean the timeout was exceeded)
             PrintAndLogEx(NORMAL, "Waiting for a response from the Proxmark3...");
             PrintAndLogEx(NORMAL, "You can cancel this operation by pressing the pm3 button");
             show_warning = false;
         }
+
+        uint32_t slice = RX_WAIT_SLICE_MS;
+        if (ms_timeout - elapsed < slice)
+            slice = ms_timeout - elapsed + 1;
+        waitReply(dev, slice);
     }
     return false;
 }
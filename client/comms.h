@@ -44,8 +44,7 @@ typedef enum {
 } DeviceMemType_t;
 
 typedef struct {
-    bool run; // If TRUE, continue running the uart_communication thread
-    bool block_after_ACK; // if true, block after receiving an ACK package
+    bool run; // If TRUE, continue running the uart_communication and uart_sender threads
     // Flags to tell where to add CRC on sent replies
     bool send_with_crc_on_usb;
     bool send_with_crc_on_fpc;
@@ -57,24 +56,61 @@ typedef struct {
     uint8_t serial_port_name[FILE_PATH_SIZE];
 } communication_arg_t;
 
-extern communication_arg_t conn;
+// A connected Proxmark3. The client talks to the device of the command line unless the
+// calling thread selects another one with SetCurrentDevice. The selection is per thread and
+// new threads start on the main device, a thread sending commands must select its creator's
+typedef struct pm3_device pm3_device_t;
+
+// connection and capabilities of the calling thread's current device
+communication_arg_t *GetCommunicationArg(void);
+capabilities_t *GetCapabilities(void);
+
+// throughput of the communication thread, reads and read_bytes count since the port was opened
+typedef struct {
+    uint64_t frames;        // frames received
+    uint64_t bytes;         // bytes of these frames
+    uint64_t reads;         // read system calls
+    uint64_t read_bytes;    // bytes returned by these reads
+    // last burst: frames less than 100ms apart
+    uint64_t burst_frames;
+    uint64_t burst_bytes;
+    uint64_t burst_start;   // msclock()
+    uint64_t burst_end;
+} comms_stats_t;
 
-void *uart_receiver(void *targ);
 void SendCommandBL(uint64_t cmd, uint64_t arg0, uint64_t arg1, uint64_t arg2, void *data, size_t len);
 void SendCommandOLD(uint64_t cmd, uint64_t arg0, uint64_t arg1, uint64_t arg2, void *data, size_t len);
 void SendCommandNG(uint16_t cmd, uint8_t *data, size_t len);
 void SendCommandMIX(uint64_t cmd, uint64_t arg0, uint64_t arg1, uint64_t arg2, void *data, size_t len);
+uint16_t SendCommandNGSeq(uint16_t cmd, uint8_t *data, size_t len);
+uint16_t SendCommandMIXSeq(uint64_t cmd, uint64_t arg0, uint64_t arg1, uint64_t arg2, void *data, size_t len);
 void clearCommandBuffer(void);
+void GetCommsStats(comms_stats_t *stats);
 
 #define FLASHMODE_SPEED 460800
 bool IsCommunicationThreadDead(void);
-bool OpenProxmark(void *port, bool wait_for_port, int timeout, bool flash_mode, uint32_t speed);
+bool OpenProxmark(void *port, bool wait_for_port, int timeout, uint32_t speed);
 int TestProxmark(void);
 void CloseProxmark(void);
 
+pm3_device_t *OpenProxmarkDevice(const char *port, uint32_t speed);
+void CloseProxmarkDevice(pm3_device_t *dev);
+pm3_device_t *SetCurrentDevice(pm3_device_t *dev);
+pm3_device_t *GetCurrentDevice(void);
+const char *GetDevicePort(pm3_device_t *dev);
+
 bool WaitForResponseTimeoutW(uint32_t cmd, PacketResponseNG *response, size_t ms_timeout, bool show_warning);
 bool WaitForResponseTimeout(uint32_t cmd, PacketResponseNG *response, size_t ms_timeout);
 bool WaitForResponse(uint32_t cmd, PacketResponseNG *response);
+bool WaitForResponseSeq(uint32_t cmd, uint16_t seq, PacketResponseNG *response, size_t ms_timeout);
+
+// commands in flight with SendCommandsPipelined over USB
+#define PIPELINE_WINDOW 4
+// sends command index, returns the sequence number from SendCommand{NG,MIX}Seq
+typedef uint16_t (*pipeline_send_t)(uint32_t index, void *ctx);
+// handles the reply to command index, an error stops the pipeline
+typedef int (*pipeline_reply_t)(uint32_t index, PacketResponseNG *response, void *ctx);
+int SendCommandsPipelined(uint32_t count, uint32_t reply_cmd, size_t ms_timeout, pipeline_send_t send, pipeline_reply_t reply, void *ctx);
 
 //bool GetFromDevice(DeviceMemType_t memtype, uint8_t *dest, uint32_t bytes, uint32_t start_index, PacketResponseNG *response, size_t ms_timeout, bool show_warning);
 bool GetFromDevice(DeviceMemType_t memtype, uint8_t *dest, uint32_t bytes, uint32_t start_index, uint8_t *data, uint32_t datalen, PacketResponseNG *response, size_t ms_timeout, bool show_warning);
@@ -46,8 +46,11 @@
 #include "commonutil.h"
 #include "proxmark3.h"
 #include "util.h"
+#include "crc32.h"
 #ifdef _WIN32
 #include "scandir.h"
+#else
+#include <sys/mman.h>
 #endif
 
 #define PATH_MAX_LENGTH 200
@@ -780,68 +783,35 @@ out:
     return retval;
 }
 
-int loadFileDICTIONARY_safe(const char *preferredName, void **pdata, uint8_t keylen, uint16_t *keycnt) {
+// Parses a text dictionary. The keys buffer doubles as it fills up.
+static int parseFileDICTIONARY(const char *path, uint8_t keylen, uint8_t **pkeys, uint64_t *keycount) {
 
-    int retval = PM3_SUCCESS;
+    size_t mem_size = 1024 * keylen;
+    *keycount = 0;
+    *pkeys = calloc(mem_size, sizeof(uint8_t));
+    if (*pkeys == NULL)
+        return PM3_EMALLOC;
 
-    char *path;
-    if (searchFile(&path, DICTIONARIES_SUBDIR, preferredName, ".dic", false) != PM3_SUCCESS)
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        PrintAndLogEx(WARNING, "file not found or locked. '" _YELLOW_("%s")"'", path);
+        free(*pkeys);
+        *pkeys = NULL;
         return PM3_EFILE;
-
-    // t5577 == 4bytes
-    // mifare == 6 bytes
-    // iclass == 8 bytes
-    // default to 6 bytes.
-    if (keylen != 4 && keylen != 6 && keylen != 8) {
-        keylen = 6;
     }
 
-    size_t mem_size;
-    size_t block_size = 10 * keylen;
-
     // double up since its chars
-    keylen <<= 1;
-
+    uint8_t hexlen = keylen << 1;
     char line[255];
 
-    // allocate some space for the dictionary
-    *pdata = calloc(block_size, sizeof(uint8_t));
-    if (*pdata == NULL) {
-        free(path);
-        return PM3_EFILE;
-    }
-    mem_size = block_size;
-
-    FILE *f = fopen(path, "r");
-    if (!f) {
-        PrintAndLogEx(WARNING, "file not found or locked. '" _YELLOW_("%s")"'", path);
-        retval = PM3_EFILE;
-        goto out;
-    }
-
     // read file
     while (fgets(line, sizeof(line), f)) {
 
-        // check if we have enough space (if not allocate more)
-        if ((((size_t)(*keycnt)) * (keylen >> 1)) >= mem_size) {
-
-            mem_size += block_size;
-            *pdata = realloc(*pdata, mem_size);
-
-            if (*pdata == NULL) {
-                retval = PM3_EFILE;
-                fclose(f);
-                goto out;
-            } else {
-                memset(*pdata + (mem_size - block_size), 0, block_size);
-            }
-        }
-
         // add null terminator
-        line[keylen] = 0;
+        line[hexlen] = 0;
 
         // smaller keys than expected is skipped
-        if (strlen(line) < keylen)
+        if (strlen(line) < hexlen)
             continue;
 
         // The line start with # is comment, skip
@@ -849,24 +819,188 @@ int loadFileDICTIONARY_safe(const char *preferredName, void **pdata, uint8_t key
             continue;
 
         if (!isxdigit(line[0])) {
-            PrintAndLogEx(FAILED, "file content error. '%s' must include " _BLUE_("%2d") "HEX symbols", line, keylen);
+            PrintAndLogEx(FAILED, "file content error. '%s' must include " _BLUE_("%2d") "HEX symbols", line, hexlen);
             continue;
         }
 
+        // check if we have enough space (if not allocate more)
+        if ((*keycount + 1) * keylen > mem_size) {
+            uint8_t *tmp = realloc(*pkeys, mem_size * 2);
+            if (tmp == NULL) {
+                free(*pkeys);
+                *pkeys = NULL;
+                fclose(f);
+                return PM3_EMALLOC;
+            }
+            *pkeys = tmp;
+            mem_size *= 2;
+        }
+
         uint64_t key = strtoull(line, NULL, 16);
+        num_to_bytes(key, keylen, *pkeys + *keycount * keylen);
+        (*keycount)++;
 
-        num_to_bytes(key, keylen >> 1, *pdata + (*keycnt * (keylen >> 1)));
+        memset(line, 0, sizeof(line));
+    }
+    fclose(f);
+    return PM3_SUCCESS;
+}
 
-        (*keycnt)++;
+static uint32_t dictionary_header_crc(const dictionary_header_t *header) {
+    dictionary_header_t tmp = *header;
+    uint32_t crc;
+    tmp.header_crc = 0;
+    crc32_ex((uint8_t *)&tmp, sizeof(tmp), (uint8_t *)&crc);
+    return crc;
+}
 
-        memset(line, 0, sizeof(line));
+// maps a compiled dictionary. PM3_ESOFT if it isn't one.
+static int mapFileDICTIONARY(const char *path, uint8_t keylen, dictionary_t *dict) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        PrintAndLogEx(WARNING, "file not found or locked. '" _YELLOW_("%s")"'", path);
+        return PM3_EFILE;
+    }
+
+    dictionary_header_t header;
+    if (fread(&header, sizeof(header), 1, f) != 1 || memcmp(header.magic, DICTIONARY_MAGIC, sizeof(header.magic)) != 0) {
+        fclose(f);
+        return PM3_ESOFT;
+    }
+
+    fseek(f, 0, SEEK_END);
+    long end = ftell(f);
+    uint64_t file_size = (end < 0) ? 0 : (uint64_t)end;
+    if (header.version != DICTIONARY_VERSION
+            || header.header_crc != dictionary_header_crc(&header)
+            || header.header_size < sizeof(header)
+            || header.keylen == 0) {
+        PrintAndLogEx(ERR, "corrupt or unsupported compiled dictionary. '" _YELLOW_("%s")"'", path);
+        fclose(f);
+        return PM3_EFILE;
+    }
+    if (header.keylen != keylen) {
+        PrintAndLogEx(ERR, "dictionary has %u byte keys, expected %u. '" _YELLOW_("%s")"'", header.keylen, keylen, path);
+        fclose(f);
+        return PM3_EFILE;
+    }
+    // the keys must fill the file exactly, no multiplication a huge keycount could wrap
+    if (file_size < header.header_size
+            || (file_size - header.header_size) % header.keylen != 0
+            || header.keycount != (file_size - header.header_size) / header.keylen) {
+        PrintAndLogEx(ERR, "corrupt compiled dictionary, size mismatch. '" _YELLOW_("%s")"'", path);
+        fclose(f);
+        return PM3_EFILE;
+    }
+
+    dict->keylen = header.keylen;
+    dict->flags = header.flags;
+    dict->keycount = header.keycount;
+    dict->map_size = file_size;
+
+#ifdef _WIN32
+    // no mmap, read it
+    dict->map = malloc(file_size);
+    if (dict->map == NULL) {
+        fclose(f);
+        return PM3_EMALLOC;
     }
+    fseek(f, 0, SEEK_SET);
+    bool ok = (fread(dict->map, 1, file_size, f) == file_size);
     fclose(f);
-    PrintAndLogEx(SUCCESS, "loaded " _GREEN_("%2d") "keys from dictionary file " _YELLOW_("%s"), *keycnt, path);
+    if (!ok) {
+        free(dict->map);
+        dict->map = NULL;
+        return PM3_EFILE;
+    }
+#else
+    dict->map = mmap(NULL, file_size, PROT_READ, MAP_SHARED, fileno(f), 0);
+    fclose(f);
+    if (dict->map == MAP_FAILED) {
+        dict->map = NULL;
+        PrintAndLogEx(ERR, "could not map dictionary. '" _YELLOW_("%s")"'", path);
+        return PM3_EFILE;
+    }
+    madvise(dict->map, file_size, MADV_SEQUENTIAL);
+#endif
+    dict->keys = (uint8_t *)dict->map + header.header_size;
+    return PM3_SUCCESS;
+}
 
-out:
+int openFileDICTIONARY(const char *preferredName, uint8_t keylen, dictionary_t *dict) {
+
+    memset(dict, 0, sizeof(dictionary_t));
+
+    // t5577 == 4bytes
+    // mifare == 6 bytes
+    // iclass == 8 bytes
+    // default to 6 bytes.
+    if (keylen != 4 && keylen != 6 && keylen != 8) {
+        keylen = 6;
+    }
+
+    char *path;
+    if (searchFile(&path, DICTIONARIES_SUBDIR, preferredName, ".bdic", true) != PM3_SUCCESS
+            && searchFile(&path, DICTIONARIES_SUBDIR, preferredName, ".dic", false) != PM3_SUCCESS)
+        return PM3_EFILE;
+
+    int res = mapFileDICTIONARY(path, keylen, dict);
+    if (res == PM3_SUCCESS) {
+        PrintAndLogEx(SUCCESS, "mapped " _GREEN_("%" PRIu64) "keys from compiled dictionary file " _YELLOW_("%s"), dict->keycount, path);
+    } else if (res == PM3_ESOFT) {
+        dict->keylen = keylen;
+        res = parseFileDICTIONARY(path, keylen, &dict->keys, &dict->keycount);
+        if (res == PM3_SUCCESS)
+            PrintAndLogEx(SUCCESS, "loaded " _GREEN_("%2" PRIu64) "keys from dictionary file " _YELLOW_("%s"), dict->keycount, path);
+    }
     free(path);
-    return retval;
+    return res;
+}
+
+void closeFileDICTIONARY(dictionary_t *dict) {
+    if (dict->map != NULL) {
+#ifdef _WIN32
+        free(dict->map);
+#else
+        munmap(dict->map, dict->map_size);
+#endif
+    } else {
+        free(dict->keys);
+    }
+    memset(dict, 0, sizeof(dictionary_t));
+}
+
+int loadFileDICTIONARY_safe(const char *preferredName, void **pdata, uint8_t keylen, uint32_t *keycnt) {
+
+    *pdata = NULL;
+    *keycnt = 0;
+
+    dictionary_t dict;
+    int res = openFileDICTIONARY(preferredName, keylen, &dict);
+    if (res != PM3_SUCCESS)
+        return res;
+
+    if (dict.keycount > UINT32_MAX) {
+        PrintAndLogEx(ERR, "dictionary too large, %" PRIu64 " keys", dict.keycount);
+        closeFileDICTIONARY(&dict);
+        return PM3_EOVFLOW;
+    }
+
+    if (dict.map == NULL) {
+        // text, hand over the parsed keys
+        *pdata = dict.keys;
+    } else {
+        *pdata = calloc(dict.keycount + 1, dict.keylen);
+        if (*pdata == NULL) {
+            closeFileDICTIONARY(&dict);
+            return PM3_EMALLOC;
+        }
+        memcpy(*pdata, dict.keys, dict.keycount * dict.keylen);
+    }
+    *keycnt = dict.keycount;
+    if (dict.map != NULL)
+        closeFileDICTIONARY(&dict);
+    return PM3_SUCCESS;
 }
 
 int convertOldMfuDump(uint8_t **dump, size_t *dumplen) {
@@ -70,6 +70,36 @@ typedef enum {
     DICTIONARY,
 } DumpFileType_t;
 
+// Compiled dictionary (.bdic), written by tools/pm3_dic2bin.py.
+// A header and then the keys, <keylen> bytes each, big endian like the text files.
+// All fields little endian.
+#define DICTIONARY_MAGIC            "PM3DICT"
+#define DICTIONARY_VERSION          1
+#define DICTIONARY_SORTED           0x01    // keys in ascending order, no duplicates
+#define DICTIONARY_BY_FREQUENCY     0x02    // keys most frequent first, no duplicates
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint8_t keylen;
+    uint8_t flags;
+    uint16_t header_size;       // offset of the first key
+    uint64_t keycount;
+    uint32_t header_crc;        // crc32 of the header with this field zero
+    uint32_t reserved;
+} PACKED dictionary_header_t;
+
+// A dictionary, text or compiled. Compiled ones are mapped, the keys are paged in as they are used.
+typedef struct {
+    uint8_t keylen;
+    uint8_t flags;
+    uint64_t keycount;
+    uint8_t *keys;
+    // private
+    void *map;
+    size_t map_size;
+} dictionary_t;
+
 int fileExists(const char *filename);
 
 /**
@@ -191,7 +221,19 @@ int loadFileDICTIONARY(const char *preferredName, void *data, size_t *datalen, u
  * @param keylen  the number of bytes a key per row is
  * @return 0 for ok, 1 for failz
 */
-int loadFileDICTIONARY_safe(const char *preferredName, void **pdata, uint8_t keylen, uint16_t *keycnt);
+int loadFileDICTIONARY_safe(const char *preferredName, void **pdata, uint8_t keylen, uint32_t *keycnt);
+
+/**
+ * @brief  Opens a dictionary without copying it. A compiled dictionary <preferredName>.bdic is
+ * preferred to the text file <preferredName>.dic, it is mapped read only.
+ *
+ * @param preferredName
+ * @param keylen  the number of bytes of a key
+ * @param dict  the opened dictionary, close it with closeFileDICTIONARY
+ * @return PM3_SUCCESS if ok
+*/
+int openFileDICTIONARY(const char *preferredName, uint8_t keylen, dictionary_t *dict);
+void closeFileDICTIONARY(dictionary_t *dict);
 
 /**
  * @brief  Utility function to check and convert old mfu dump format to new
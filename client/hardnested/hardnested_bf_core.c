@@ -61,6 +61,9 @@ THE SOFTWARE.
 #include "parity.h"
 #include "util.h"
 #include "common.h"
+#if defined (__AVX512F__)
+#include <immintrin.h>
+#endif
 
 // bitslice type
 // while AVX supports 256 bit vector floating point operations, we need integer operations for boolean logic
@@ -92,6 +95,27 @@ typedef union {
 #define f20b(a,b,c,d) (((a&b)|c)^((a^b)&(c|d)))
 #define f20c(a,b,c,d,e) ((a|((b|e)&(d^e)))^((a^(b&d))&((c^d)|(b&e))))
 
+#if defined (__AVX512F__)
+// AVX-512 evaluates any boolean function of three vectors with a single vpternlogq. f20a and f20b
+// need three of them, f20c (expanded on a: a ? f1(b,c,d,e) : f0(b,c,d,e)) five, instead of up to 12 and/or/xor.
+#define ternlog(a, b, c, imm) ((bitslice_value_t)_mm512_ternarylogic_epi64((__m512i)(a), (__m512i)(b), (__m512i)(c), (imm)))
+static inline bitslice_value_t f20a_ternlog(bitslice_value_t a, bitslice_value_t b, bitslice_value_t c, bitslice_value_t d) {
+    return ternlog(ternlog(a, b, c, 0x2b), ternlog(a, b, c, 0x59), d, 0x27);
+}
+static inline bitslice_value_t f20b_ternlog(bitslice_value_t a, bitslice_value_t b, bitslice_value_t c, bitslice_value_t d) {
+    return ternlog(ternlog(a, b, c, 0x0d), ternlog(a, c, d, 0x2d), b, 0x2e);
+}
+static inline bitslice_value_t f20c_ternlog(bitslice_value_t a, bitslice_value_t b, bitslice_value_t c, bitslice_value_t d, bitslice_value_t e) {
+    return ternlog(a, ternlog(ternlog(b, c, e, 0x13), b, d, 0xda), ternlog(ternlog(b, c, d, 0x75), b, e, 0xac), 0xca);
+}
+#undef f20a
+#undef f20b
+#undef f20c
+#define f20a(a,b,c,d) f20a_ternlog(a,b,c,d)
+#define f20b(a,b,c,d) f20b_ternlog(a,b,c,d)
+#define f20c(a,b,c,d,e) f20c_ternlog(a,b,c,d,e)
+#endif
+
 // bit indexing
 #define get_bit(n, word) (((word) >> (n)) & 1)
 #define get_vector_bit(slice, value) get_bit((slice)&0x3f, value.bytes64[(slice)>>6])
@@ -428,6 +452,10 @@ uint64_t CRACK_STATES_BITSLICED(uint32_t cuid, uint8_t *best_first_bytes, statel
 
                         // this is much faster on my gcc, because somehow a memcmp needlessly spills/fills all the xmm registers to/from the stack - ???
                         // the short-circuiting also helps
+#if defined (__AVX512F__)
+                        // one mask test covers all 512 lanes
+                        if (_mm512_test_epi64_mask((__m512i)results.value, (__m512i)results.value) == 0) {
+#else
                         if (results.bytes64[0] == 0
 #if MAX_BITSLICES > 64
                                 && results.bytes64[1] == 0
@@ -437,6 +465,7 @@ uint64_t CRACK_STATES_BITSLICED(uint32_t cuid, uint8_t *best_first_bytes, statel
                                 && results.bytes64[3] == 0
 #endif
                            ) {
+#endif
 #if defined (DEBUG_BRUTE_FORCE)
                             if (elimination_step < MAX_ELIMINATION_STEP) {
                                 keys_eliminated[elimination_step] += MAX_BITSLICES;
@@ -660,4 +689,52 @@ void bitslice_test_nonces(uint32_t nonces_to_bruteforce, uint32_t *bf_test_nonce
     (*bitslice_test_nonces_function_p)(nonces_to_bruteforce, bf_test_nonce, bf_test_nonce_par);
 }
 
+// helpers shared by all SIMD variants (and by hardnested_worker)
+inline uint8_t trailing_zeros(uint8_t byte) {
+    static const uint8_t trailing_zeros_LUT[256] = {
+        8, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+        4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+        5, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+        4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+        6, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+        4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+        5, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+        4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+        7, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+        4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+        5, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+        4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+        6, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+        4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+        5, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+        4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0
+    };
+
+    return trailing_zeros_LUT[byte];
+}
+
+bool verify_key(uint32_t cuid, noncelist_t *nonces, uint8_t *best_first_bytes, uint32_t odd, uint32_t even) {
+    struct Crypto1State pcs;
+    for (uint16_t test_first_byte = 1; test_first_byte < 256; test_first_byte++) {
+        noncelistentry_t *test_nonce = nonces[best_first_bytes[test_first_byte]].first;
+        while (test_nonce != NULL) {
+            pcs.odd = odd;
+            pcs.even = even;
+            lfsr_rollback_byte(&pcs, (cuid >> 24) ^ best_first_bytes[0], true);
+            for (int8_t byte_pos = 3; byte_pos >= 0; byte_pos--) {
+                uint8_t test_par_enc_bit = (test_nonce->par_enc >> byte_pos) & 0x01;     // the encoded parity bit
+                uint8_t test_byte_enc = (test_nonce->nonce_enc >> (8 * byte_pos)) & 0xff; // the encoded nonce byte
+                uint8_t test_byte_dec = crypto1_byte(&pcs, test_byte_enc /* ^ (cuid >> (8*byte_pos)) */, true) ^ test_byte_enc; // decode the nonce byte
+                uint8_t ks_par = filter(pcs.odd);                                        // the keystream bit to encode/decode the parity bit
+                uint8_t test_par_enc2 = ks_par ^ evenparity8(test_byte_dec);             // determine the decoded byte's parity and encode it
+                if (test_par_enc_bit != test_par_enc2) {
+                    return false;
+                }
+            }
+            test_nonce = test_nonce->next;
+        }
+    }
+    return true;
+}
+
 #endif
@@ -67,11 +67,14 @@ THE SOFTWARE.
 #include "parity.h"
 #include "fileutils.h"
 #include "pm3_cmd.h"
+#include "crc32.h"
 
 #define NUM_BRUTE_FORCE_THREADS         (num_CPUs())
 #define DEFAULT_BRUTE_FORCE_RATE        (120000000.0) // if benchmark doesn't succeed
 #define TEST_BENCH_SIZE                 (6000)        // number of odd and even states for brute force benchmark
 #define TEST_BENCH_FILENAME             "hardnested_bf_bench_data.bin"
+#define CHECKPOINT_MAGIC                "PM3HNCP"
+#define CHECKPOINT_VERSION              1
 //#define WRITE_BENCH_FILE
 
 // debugging options
@@ -88,58 +91,23 @@ static uint32_t bf_test_nonce[256];
 static uint8_t bf_test_nonce_2nd_byte[256];
 static uint8_t bf_test_nonce_par[256];
 static uint32_t bucket_count = 0;
-static statelist_t *buckets[128];
+static statelist_t *buckets[BF_MAX_BUCKETS];
 static uint32_t keys_found = 0;
 static uint64_t num_keys_tested;
 static uint64_t found_bs_key = 0;
+static pthread_mutex_t checkpoint_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+typedef struct {
+    bool silent;
+    int thread_ID;
+    uint32_t cuid;
+    uint32_t num_acquired_nonces;
+    uint64_t maximum_states;
+    noncelist_t *nonces;
+    uint8_t *best_first_bytes;
+    bf_checkpoint_t *checkpoint;
+} crack_states_thread_arg_t;
 
-inline uint8_t trailing_zeros(uint8_t byte) {
-    static const uint8_t trailing_zeros_LUT[256] = {
-        8, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
-        4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
-        5, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
-        4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
-        6, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
-        4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
-        5, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
-        4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
-        7, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
-        4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
-        5, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
-        4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
-        6, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
-        4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
-        5, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
-        4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0
-    };
-
-    return trailing_zeros_LUT[byte];
-}
-
-
-bool verify_key(uint32_t cuid, noncelist_t *nonces, uint8_t *best_first_bytes, uint32_t odd, uint32_t even) {
-    struct Crypto1State pcs;
-    for (uint16_t test_first_byte = 1; test_first_byte < 256; test_first_byte++) {
-        noncelistentry_t *test_nonce = nonces[best_first_bytes[test_first_byte]].first;
-        while (test_nonce != NULL) {
-            pcs.odd = odd;
-            pcs.even = even;
-            lfsr_rollback_byte(&pcs, (cuid >> 24) ^ best_first_bytes[0], true);
-            for (int8_t byte_pos = 3; byte_pos >= 0; byte_pos--) {
-                uint8_t test_par_enc_bit = (test_nonce->par_enc >> byte_pos) & 0x01;     // the encoded parity bit
-                uint8_t test_byte_enc = (test_nonce->nonce_enc >> (8 * byte_pos)) & 0xff; // the encoded nonce byte
-                uint8_t test_byte_dec = crypto1_byte(&pcs, test_byte_enc /* ^ (cuid >> (8*byte_pos)) */, true) ^ test_byte_enc; // decode the nonce byte
-                uint8_t ks_par = filter(pcs.odd);                                        // the keystream bit to encode/decode the parity bit
-                uint8_t test_par_enc2 = ks_par ^ evenparity8(test_byte_dec);             // determine the decoded byte's parity and encode it
-                if (test_par_enc_bit != test_par_enc2) {
-                    return false;
-                }
-            }
-            test_nonce = test_nonce->next;
-        }
-    }
-    return true;
-}
 static void *
 #ifdef __has_attribute
 #if __has_attribute(force_align_arg_pointer)
@@ -147,22 +115,13 @@ __attribute__((force_align_arg_pointer))
 #endif
 #endif
 crack_states_thread(void *x) {
-    struct arg {
-        bool silent;
-        int thread_ID;
-        uint32_t cuid;
-        uint32_t num_acquired_nonces;
-        uint64_t maximum_states;
-        noncelist_t *nonces;
-        uint8_t *best_first_bytes;
-    } *thread_arg;
-
-    thread_arg = (struct arg *)x;
+    crack_states_thread_arg_t *thread_arg = (crack_states_thread_arg_t *)x;
+    bf_checkpoint_t *checkpoint = thread_arg->checkpoint;
     const int thread_id = thread_arg->thread_ID;
     uint32_t current_bucket = thread_id;
     while (current_bucket < bucket_count) {
         statelist_t *bucket = buckets[current_bucket];
-        if (bucket) {
+        if (bucket && (checkpoint == NULL || !checkpoint->data.bucket_done[current_bucket])) {
 #if defined (DEBUG_BRUTE_FORCE)
             PrintAndLogEx(INFO, "Thread %u starts working on bucket %u\n", thread_id, current_bucket);
 #endif
@@ -180,6 +139,14 @@ crack_states_thread(void *x) {
             } else if (keys_found) {
                 break;
             } else {
+                if (checkpoint != NULL) {
+                    pthread_mutex_lock(&checkpoint_mutex);
+                    // whole buckets only, num_keys_tested also counts buckets cut short
+                    checkpoint->data.bucket_done[current_bucket] = true;
+                    checkpoint->data.num_keys_tested += (uint64_t)bucket->len[EVEN_STATE] * bucket->len[ODD_STATE];
+                    bf_checkpoint_write(checkpoint);
+                    pthread_mutex_unlock(&checkpoint_mutex);
+                }
                 if (!thread_arg->silent) {
                     char progress_text[80];
                     sprintf(progress_text, "Brute force phase: %6.02f%%\t", 100.0 * (float)num_keys_tested / (float)(thread_arg->maximum_states));
@@ -264,6 +231,15 @@ void prepare_bf_test_nonces(noncelist_t *nonces, uint8_t best_first_byte) {
 }
 
 
+// the test nonces prepared by prepare_bf_test_nonces(), for export to a hardnested work file
+uint32_t get_bf_test_nonces(uint32_t *test_nonce, uint8_t *test_nonce_par, uint8_t *test_nonce_2nd_byte) {
+    memcpy(test_nonce, bf_test_nonce, sizeof(bf_test_nonce));
+    memcpy(test_nonce_par, bf_test_nonce_par, sizeof(bf_test_nonce_par));
+    memcpy(test_nonce_2nd_byte, bf_test_nonce_2nd_byte, sizeof(bf_test_nonce_2nd_byte));
+    return nonces_to_bruteforce;
+}
+
+
 #if defined (WRITE_BENCH_FILE)
 static void write_benchfile(statelist_t *candidates) {
 
@@ -294,7 +270,81 @@ static void write_benchfile(statelist_t *candidates) {
 #endif
 
 
-bool brute_force_bs(float *bf_rate, statelist_t *candidates, uint32_t cuid, uint32_t num_acquired_nonces, uint64_t maximum_states, noncelist_t *nonces, uint8_t *best_first_bytes, uint64_t *foundkey) {
+void bf_checkpoint_init(bf_checkpoint_t *checkpoint, const char *filename, uint32_t cuid, uint32_t nonce_hash) {
+    memset(checkpoint, 0, sizeof(bf_checkpoint_t));
+    checkpoint->filename = filename;
+    memcpy(checkpoint->data.magic, CHECKPOINT_MAGIC, sizeof(checkpoint->data.magic));
+    checkpoint->data.version = CHECKPOINT_VERSION;
+    checkpoint->data.cuid = cuid;
+    checkpoint->data.nonce_hash = nonce_hash;
+    checkpoint->data.sum_a8_idx = BF_CHECKPOINT_NO_SUM_A8;
+}
+
+
+// the checkpoint in file byte order and back
+static void bf_checkpoint_le(bf_checkpoint_data_t *data) {
+    data->version = HARDNESTED_LE32(data->version);
+    data->cuid = HARDNESTED_LE32(data->cuid);
+    data->nonce_hash = HARDNESTED_LE32(data->nonce_hash);
+    data->sum_a8_done = HARDNESTED_LE32(data->sum_a8_done);
+    data->bucket_count = HARDNESTED_LE32(data->bucket_count);
+    data->bucket_hash = HARDNESTED_LE32(data->bucket_hash);
+    data->num_keys_tested = HARDNESTED_LE64(data->num_keys_tested);
+}
+
+
+bool bf_checkpoint_read(bf_checkpoint_t *checkpoint) {
+    FILE *f = fopen(checkpoint->filename, "rb");
+    if (f == NULL) {
+        return false;
+    }
+    bf_checkpoint_data_t data;
+    size_t bytes_read = fread(&data, 1, sizeof(data), f);
+    fclose(f);
+    bf_checkpoint_le(&data);
+    if (bytes_read != sizeof(data)
+            || memcmp(data.magic, CHECKPOINT_MAGIC, sizeof(data.magic)) != 0
+            || data.version != CHECKPOINT_VERSION
+            || data.bucket_count > BF_MAX_BUCKETS) {
+        PrintAndLogEx(WARNING, "Invalid checkpoint file %s", checkpoint->filename);
+        return false;
+    }
+    checkpoint->data = data;
+    return true;
+}
+
+
+// the checkpoint is written to a temporary file first, an interruption never leaves a truncated checkpoint behind.
+bool bf_checkpoint_write(bf_checkpoint_t *checkpoint) {
+    char tmp_filename[strlen(checkpoint->filename) + 5];
+    sprintf(tmp_filename, "%s.tmp", checkpoint->filename);
+    FILE *f = fopen(tmp_filename, "wb");
+    if (f == NULL) {
+        PrintAndLogEx(WARNING, "Could not write checkpoint file %s", tmp_filename);
+        return false;
+    }
+    bf_checkpoint_data_t data = checkpoint->data;
+    bf_checkpoint_le(&data);
+    bool ok = (fwrite(&data, sizeof(data), 1, f) == 1);
+    ok = (fclose(f) == 0) && ok;
+#ifdef _WIN32
+    remove(checkpoint->filename);
+#endif
+    if (!ok || rename(tmp_filename, checkpoint->filename) != 0) {
+        PrintAndLogEx(WARNING, "Could not write checkpoint file %s", checkpoint->filename);
+        remove(tmp_filename);
+        return false;
+    }
+    return true;
+}
+
+
+void bf_checkpoint_remove(bf_checkpoint_t *checkpoint) {
+    remove(checkpoint->filename);
+}
+
+
+bool brute_force_bs(float *bf_rate, statelist_t *candidates, uint32_t cuid, uint32_t num_acquired_nonces, uint64_t maximum_states, noncelist_t *nonces, uint8_t *best_first_bytes, bf_checkpoint_t *checkpoint, uint64_t *foundkey) {
 #if defined (WRITE_BENCH_FILE)
     write_benchfile(candidates);
 #endif
@@ -308,13 +358,43 @@ bool brute_force_bs(float *bf_rate, statelist_t *candidates, uint32_t cuid, uint
 
     // count number of states to go
     bucket_count = 0;
+    uint32_t bucket_sizes[2 * BF_MAX_BUCKETS];
     for (statelist_t *p = candidates; p != NULL; p = p->next) {
         if (p->states[ODD_STATE] != NULL && p->states[EVEN_STATE] != NULL) {
+            if (bucket_count == BF_MAX_BUCKETS) {
+                PrintAndLogEx(ERR, "Too many candidate buckets in brute_force_bs(). Aborting...\n");
+                exit(4);
+            }
+            bucket_sizes[2 * bucket_count] = p->len[ODD_STATE];
+            bucket_sizes[2 * bucket_count + 1] = p->len[EVEN_STATE];
             buckets[bucket_count] = p;
             bucket_count++;
         }
     }
 
+    if (checkpoint != NULL) {
+        uint32_t bucket_hash;
+        crc32_ex((uint8_t *)bucket_sizes, bucket_count * 2 * sizeof(uint32_t), (uint8_t *)&bucket_hash);
+        if (checkpoint->data.bucket_count == bucket_count && checkpoint->data.bucket_hash == bucket_hash) {
+            uint32_t buckets_done = 0;
+            for (uint32_t i = 0; i < bucket_count; i++) {
+                buckets_done += checkpoint->data.bucket_done[i];
+            }
+            num_keys_tested = checkpoint->data.num_keys_tested;
+            if (buckets_done > 0) {
+                char progress_text[80];
+                sprintf(progress_text, "Resuming brute force, %u of %u buckets already done", buckets_done, bucket_count);
+                hardnested_print_progress(num_acquired_nonces, progress_text, nonces[best_first_bytes[0]].expected_num_brute_force - (float)num_keys_tested / 2, 0);
+            }
+        } else {
+            memset(checkpoint->data.bucket_done, 0, sizeof(checkpoint->data.bucket_done));
+            checkpoint->data.bucket_count = bucket_count;
+            checkpoint->data.bucket_hash = bucket_hash;
+            checkpoint->data.num_keys_tested = 0;
+        }
+        bf_checkpoint_write(checkpoint);
+    }
+
     uint64_t start_time = msclock();
 
 #if defined(__linux__) ||  defined(__APPLE__)
@@ -323,15 +403,7 @@ bool brute_force_bs(float *bf_rate, statelist_t *candidates, uint32_t cuid, uint
 #endif
 
     pthread_t threads[NUM_BRUTE_FORCE_THREADS];
-    struct args {
-        bool silent;
-        int thread_ID;
-        uint32_t cuid;
-        uint32_t num_acquired_nonces;
-        uint64_t maximum_states;
-        noncelist_t *nonces;
-        uint8_t *best_first_bytes;
-    } thread_args[NUM_BRUTE_FORCE_THREADS];
+    crack_states_thread_arg_t thread_args[NUM_BRUTE_FORCE_THREADS];
 
     for (uint32_t i = 0; i < NUM_BRUTE_FORCE_THREADS; i++) {
         thread_args[i].thread_ID = i;
@@ -341,6 +413,7 @@ bool brute_force_bs(float *bf_rate, statelist_t *candidates, uint32_t cuid, uint
         thread_args[i].maximum_states = maximum_states;
         thread_args[i].nonces = nonces;
         thread_args[i].best_first_bytes = best_first_bytes;
+        thread_args[i].checkpoint = checkpoint;
         pthread_create(&threads[i], NULL, crack_states_thread, (void *)&thread_args[i]);
     }
     for (uint32_t i = 0; i < NUM_BRUTE_FORCE_THREADS; i++) {
@@ -461,7 +534,7 @@ float brute_force_benchmark() {
 
     float bf_rate;
     uint64_t found_key = 0;
-    brute_force_bs(&bf_rate, test_candidates, 0, 0, maximum_states, NULL, 0, &found_key);
+    brute_force_bs(&bf_rate, test_candidates, 0, 0, maximum_states, NULL, 0, NULL, &found_key);
 
     free(test_candidates[0].states[ODD_STATE]);
     free(test_candidates[0].states[EVEN_STATE]);
@@ -19,6 +19,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "common.h"         // BSWAP_32, BSWAP_64
 #include "cmdhfmfhard.h"
 
 typedef struct {
@@ -27,8 +28,47 @@ typedef struct {
     void *next;
 } statelist_t;
 
+// checkpoint and work files are little endian on every host, these convert in both directions
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define HARDNESTED_LE32(x)              BSWAP_32(x)
+#define HARDNESTED_LE64(x)              BSWAP_64(x)
+#else
+#define HARDNESTED_LE32(x)              (x)
+#define HARDNESTED_LE64(x)              (x)
+#endif
+
+#define BF_MAX_BUCKETS                  128
+#define BF_CHECKPOINT_NO_SUM_A8         0xff // brute force of bitflip candidates, without a Sum(a8) guess
+
+// brute force progress, as saved in a checkpoint file, all fields little endian
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t cuid;
+    uint32_t nonce_hash;                // crc32 over the nonce set
+    uint8_t best_first_byte;
+    uint8_t sum_a8_idx;                 // Sum(a8) guess being brute forced
+    uint16_t reserved;
+    uint32_t sum_a8_done;               // bitmask of Sum(a8) guesses brute forced without success
+    uint32_t bucket_count;              // 0: brute force of current guess not yet started
+    uint32_t bucket_hash;               // crc32 over the bucket sizes
+    uint64_t num_keys_tested;           // keys in the buckets done
+    uint8_t bucket_done[BF_MAX_BUCKETS];
+} PACKED bf_checkpoint_data_t;
+
+typedef struct {
+    const char *filename;
+    bf_checkpoint_data_t data;
+} bf_checkpoint_t;
+
+void bf_checkpoint_init(bf_checkpoint_t *checkpoint, const char *filename, uint32_t cuid, uint32_t nonce_hash);
+bool bf_checkpoint_read(bf_checkpoint_t *checkpoint);
+bool bf_checkpoint_write(bf_checkpoint_t *checkpoint);
+void bf_checkpoint_remove(bf_checkpoint_t *checkpoint);
+
 void prepare_bf_test_nonces(noncelist_t *nonces, uint8_t best_first_byte);
-bool brute_force_bs(float *bf_rate, statelist_t *candidates, uint32_t cuid, uint32_t num_acquired_nonces, uint64_t maximum_states, noncelist_t *nonces, uint8_t *best_first_bytes, uint64_t *found_key);
+uint32_t get_bf_test_nonces(uint32_t *test_nonce, uint8_t *test_nonce_par, uint8_t *test_nonce_2nd_byte);
+bool brute_force_bs(float *bf_rate, statelist_t *candidates, uint32_t cuid, uint32_t num_acquired_nonces, uint64_t maximum_states, noncelist_t *nonces, uint8_t *best_first_bytes, bf_checkpoint_t *checkpoint, uint64_t *found_key);
 float brute_force_benchmark(void);
 uint8_t trailing_zeros(uint8_t byte);
 bool verify_key(uint32_t cuid, noncelist_t *nonces, uint8_t *best_first_bytes, uint32_t odd, uint32_t even);
@@ -0,0 +1,265 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// hardnested work files: the nonces and candidate states of a hardnested
+// attack, exported by the client and brute forced by hardnested_worker.
+// Linked into the headless worker, therefore no dependencies on the client UI.
+//-----------------------------------------------------------------------------
+
+#include "hardnested_work.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+// the header in file byte order and back
+static void header_le(hardnested_work_header_t *header) {
+    header->version = HARDNESTED_LE32(header->version);
+    header->cuid = HARDNESTED_LE32(header->cuid);
+    header->num_nonces = HARDNESTED_LE32(header->num_nonces);
+    header->num_buckets = HARDNESTED_LE32(header->num_buckets);
+    header->num_states = HARDNESTED_LE64(header->num_states);
+    header->nonces_to_bruteforce = HARDNESTED_LE32(header->nonces_to_bruteforce);
+    for (uint16_t i = 0; i < 256; i++) {
+        header->bf_test_nonce[i] = HARDNESTED_LE32(header->bf_test_nonce[i]);
+    }
+    header->reserved = HARDNESTED_LE32(header->reserved);
+}
+
+
+static bool write_header(FILE *f, hardnested_work_header_t *header) {
+    hardnested_work_header_t le = *header;
+    header_le(&le);
+    return (fwrite(&le, sizeof(le), 1, f) == 1);
+}
+
+
+static bool write_le32(FILE *f, const uint32_t *values, uint32_t count) {
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    uint32_t buf[1024];
+    for (uint32_t i = 0; i < count; i += 1024) {
+        uint32_t n = (count - i < 1024) ? count - i : 1024;
+        for (uint32_t j = 0; j < n; j++) {
+            buf[j] = HARDNESTED_LE32(values[i + j]);
+        }
+        if (fwrite(buf, sizeof(uint32_t), n, f) != n) {
+            return false;
+        }
+    }
+    return true;
+#else
+    return (fwrite(values, sizeof(uint32_t), count, f) == count);
+#endif
+}
+
+
+static bool read_le32(FILE *f, uint32_t *values, uint32_t count) {
+    if (fread(values, sizeof(uint32_t), count, f) != count) {
+        return false;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        values[i] = HARDNESTED_LE32(values[i]);
+    }
+    return true;
+}
+
+
+FILE *hardnested_work_create(const char *filename, hardnested_work_header_t *header, noncelist_t *nonces) {
+    FILE *f = fopen(filename, "wb");
+    if (f == NULL) {
+        return NULL;
+    }
+
+    memcpy(header->magic, HARDNESTED_WORK_MAGIC, sizeof(header->magic));
+    header->version = HARDNESTED_WORK_VERSION;
+    header->num_nonces = 0;
+    header->num_buckets = 0;
+    header->num_states = 0;
+    bool ok = write_header(f, header);
+
+    for (uint16_t i = 0; i < 256 && ok; i++) {
+        uint32_t count = 0;
+        for (noncelistentry_t *p = nonces[i].first; p != NULL; p = p->next) {
+            count++;
+        }
+        ok = write_le32(f, &count, 1);
+        for (noncelistentry_t *p = nonces[i].first; p != NULL && ok; p = p->next) {
+            ok = write_le32(f, &p->nonce_enc, 1)
+                 && (fwrite(&p->par_enc, sizeof(p->par_enc), 1, f) == 1);
+        }
+        header->num_nonces += count;
+    }
+
+    if (!ok) {
+        fclose(f);
+        remove(filename);
+        return NULL;
+    }
+    return f;
+}
+
+
+bool hardnested_work_add_buckets(FILE *f, hardnested_work_header_t *header, statelist_t *candidates) {
+    for (statelist_t *p = candidates; p != NULL; p = p->next) {
+        if (p->states[0] == NULL || p->states[1] == NULL || p->len[0] == 0 || p->len[1] == 0) {
+            continue;
+        }
+        if (!write_le32(f, p->len, 2)
+                || !write_le32(f, p->states[0], p->len[0])
+                || !write_le32(f, p->states[1], p->len[1])) {
+            return false;
+        }
+        header->num_buckets++;
+        header->num_states += (uint64_t)p->len[0] * p->len[1];
+    }
+    return true;
+}
+
+
+// rewrite the header with the final number of buckets and states
+bool hardnested_work_close(FILE *f, hardnested_work_header_t *header) {
+    bool ok = (fseek(f, 0, SEEK_SET) == 0)
+              && write_header(f, header);
+    ok = (fclose(f) == 0) && ok;
+    return ok;
+}
+
+
+void hardnested_work_free(hardnested_work_t *work) {
+    if (work->nonces != NULL) {
+        for (uint16_t i = 0; i < 256; i++) {
+            noncelistentry_t *p = work->nonces[i].first;
+            while (p != NULL) {
+                noncelistentry_t *next = p->next;
+                free(p);
+                p = next;
+            }
+        }
+        free(work->nonces);
+        work->nonces = NULL;
+    }
+    if (work->buckets != NULL) {
+        for (uint32_t i = 0; i < work->header.num_buckets; i++) {
+            free(work->buckets[i].states[0]);
+            free(work->buckets[i].states[1]);
+        }
+        free(work->buckets);
+        work->buckets = NULL;
+    }
+}
+
+
+// bytes between the file position and the end of the file
+static uint64_t bytes_left(FILE *f, long file_size) {
+    long pos = ftell(f);
+    return (pos < 0 || pos > file_size) ? 0 : (uint64_t)(file_size - pos);
+}
+
+
+static bool read_nonce_lists(FILE *f, long file_size, hardnested_work_t *work) {
+    uint32_t nonces_read = 0;
+    for (uint16_t i = 0; i < 256; i++) {
+        uint32_t count;
+        if (!read_le32(f, &count, 1) || count > work->header.num_nonces - nonces_read
+                || (uint64_t)count * 5 > bytes_left(f, file_size)) {
+            return false;
+        }
+        noncelistentry_t **tail = &work->nonces[i].first;
+        for (uint32_t j = 0; j < count; j++) {
+            noncelistentry_t *p = calloc(1, sizeof(noncelistentry_t));
+            if (p == NULL) {
+                return false;
+            }
+            *tail = p;
+            tail = (noncelistentry_t **)&p->next;
+            if (!read_le32(f, &p->nonce_enc, 1)
+                    || fread(&p->par_enc, sizeof(p->par_enc), 1, f) != 1) {
+                return false;
+            }
+        }
+        work->nonces[i].num = count;
+        nonces_read += count;
+    }
+    return (nonces_read == work->header.num_nonces);
+}
+
+
+static bool read_buckets(FILE *f, long file_size, hardnested_work_t *work) {
+    uint64_t num_states = 0;
+    for (uint32_t i = 0; i < work->header.num_buckets; i++) {
+        statelist_t *p = &work->buckets[i];
+        if (!read_le32(f, p->len, 2) || p->len[0] == 0 || p->len[1] == 0
+                || ((uint64_t)p->len[0] + p->len[1]) * sizeof(uint32_t) > bytes_left(f, file_size)) {
+            return false;
+        }
+        for (uint8_t j = 0; j < 2; j++) {
+            p->states[j] = malloc(p->len[j] * sizeof(uint32_t));
+            if (p->states[j] == NULL || !read_le32(f, p->states[j], p->len[j])) {
+                return false;
+            }
+        }
+        num_states += (uint64_t)p->len[0] * p->len[1];
+    }
+    return (num_states == work->header.num_states) && bytes_left(f, file_size) == 0;
+}
+
+
+static bool read_header(FILE *f, hardnested_work_header_t *header) {
+    if (fread(header, sizeof(hardnested_work_header_t), 1, f) != 1) {
+        return false;
+    }
+    header_le(header);
+    return memcmp(header->magic, HARDNESTED_WORK_MAGIC, sizeof(header->magic)) == 0
+           && header->version == HARDNESTED_WORK_VERSION
+           && header->nonces_to_bruteforce <= 256;
+}
+
+
+bool hardnested_work_read_header(const char *filename, hardnested_work_header_t *header) {
+    FILE *f = fopen(filename, "rb");
+    if (f == NULL) {
+        return false;
+    }
+    bool ok = read_header(f, header);
+    fclose(f);
+    return ok;
+}
+
+
+bool hardnested_work_read(const char *filename, hardnested_work_t *work) {
+    memset(work, 0, sizeof(hardnested_work_t));
+
+    FILE *f = fopen(filename, "rb");
+    if (f == NULL) {
+        return false;
+    }
+
+    fseek(f, 0, SEEK_END);
+    long file_size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    if (file_size < 0 || !read_header(f, &work->header)) {
+        fclose(f);
+        return false;
+    }
+
+    // the header counts must fit the file before anything is allocated for them,
+    // a bucket takes at least its two lengths and one state of each list
+    work->nonces = calloc(256, sizeof(noncelist_t));
+    bool ok = (work->nonces != NULL) && read_nonce_lists(f, file_size, work)
+              && (uint64_t)work->header.num_buckets * 4 * sizeof(uint32_t) <= bytes_left(f, file_size);
+    if (ok && work->header.num_buckets > 0) {
+        work->buckets = calloc(work->header.num_buckets, sizeof(statelist_t));
+        ok = (work->buckets != NULL);
+    }
+    ok = ok && read_buckets(f, file_size, work);
+    fclose(f);
+
+    if (!ok) {
+        hardnested_work_free(work);
+        return false;
+    }
+    return true;
+}
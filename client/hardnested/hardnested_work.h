@@ -0,0 +1,55 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// hardnested work files: the nonces and candidate states of a hardnested
+// attack, exported by the client and brute forced by hardnested_worker
+//-----------------------------------------------------------------------------
+
+#ifndef HARDNESTED_WORK_H__
+#define HARDNESTED_WORK_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "hardnested_bruteforce.h" // statelist_t, noncelist_t
+
+#define HARDNESTED_WORK_MAGIC       "PM3HNWF"
+#define HARDNESTED_WORK_VERSION     1
+
+// All fields little endian, work files can move between hosts
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t cuid;
+    uint32_t num_nonces;
+    uint32_t num_buckets;
+    uint64_t num_states;                // total number of keys in all buckets
+    uint8_t best_first_bytes[256];
+    uint32_t nonces_to_bruteforce;      // the prepared test nonces, see prepare_bf_test_nonces()
+    uint32_t bf_test_nonce[256];
+    uint8_t bf_test_nonce_par[256];
+    uint8_t bf_test_nonce_2nd_byte[256];
+    uint32_t reserved;                  // no padding, the header has the same layout with every compiler
+} hardnested_work_header_t;
+
+// the file layout is:
+//   header
+//   256 nonce lists:  uint32_t count, count * {uint32_t nonce_enc, uint8_t par_enc}
+//   num_buckets *     {uint32_t len[2], len[0] * states[0], len[1] * states[1]}, indices as in statelist_t
+typedef struct {
+    hardnested_work_header_t header;
+    noncelist_t *nonces;                // [256], only the nonce lists are filled in
+    statelist_t *buckets;               // [header.num_buckets]
+} hardnested_work_t;
+
+FILE *hardnested_work_create(const char *filename, hardnested_work_header_t *header, noncelist_t *nonces);
+bool hardnested_work_add_buckets(FILE *f, hardnested_work_header_t *header, statelist_t *candidates);
+bool hardnested_work_close(FILE *f, hardnested_work_header_t *header);
+
+bool hardnested_work_read_header(const char *filename, hardnested_work_header_t *header);
+bool hardnested_work_read(const char *filename, hardnested_work_t *work);
+void hardnested_work_free(hardnested_work_t *work);
+
+#endif
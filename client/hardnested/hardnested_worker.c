@@ -0,0 +1,316 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// hardnested_worker - headless brute forcer for hardnested work files
+//
+// `hf mf hardnested ... x <work file>` exports the nonces and candidate
+// states instead of brute forcing them. The key space is split into shards:
+// shard k of n holds the k-th n-th of the odd states of every bucket, i.e.
+// every shard covers the most probable buckets first and all shards have about
+// the same size. Any number of workers, on one or several machines, process
+// disjoint shard ranges and write a small result file each. The merge mode
+// reports the key and which shards are still missing.
+//-----------------------------------------------------------------------------
+
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "util_posix.h"      // num_CPUs
+#include "hardnested_work.h"
+#include "hardnested_bf_core.h"
+
+#define RESULT_HEADER           "hardnested_worker result"
+#define PROGRESS_INTERVAL       10 // seconds
+
+typedef enum {
+    EVEN_STATE = 0,
+    ODD_STATE = 1
+} odd_even_t;
+
+static hardnested_work_t work;
+static uint32_t first_shard;
+static uint32_t num_shards;
+static uint32_t shards_in_range;
+static uint32_t num_units;              // buckets * shards in range
+static uint32_t next_unit = 0;
+static uint32_t keys_found = 0;
+static uint64_t num_keys_tested = 0;
+static uint64_t found_key = 0;
+static uint64_t shard_states = 0;       // number of keys in the shard range
+static time_t start_time;
+static time_t last_progress;
+
+static void usage(const char *prog) {
+    printf("Brute force the candidates of a hardnested work file\n\n");
+    printf(" syntax: %s <work file> [<first shard>[-<last shard>]/<shards>] [threads]\n", prog);
+    printf("         %s -m <work file> <result files...>\n\n", prog);
+    printf("   the work file is created with: hf mf hardnested ... x <work file>\n");
+    printf("   each worker writes <work file>.<first>-<last>.result, -m merges them\n\n");
+    printf(" example, four processes on one or more machines:\n");
+    printf("   %s nonces.work 0/4 & %s nonces.work 1/4 & ...\n", prog, prog);
+    printf("   %s -m nonces.work nonces.work.*.result\n", prog);
+}
+
+// the part of a bucket which belongs to a shard
+static bool shard_slice(const statelist_t *bucket, uint32_t shard, statelist_t *slice) {
+    uint32_t len = bucket->len[ODD_STATE];
+    uint32_t start = (uint64_t)len * shard / num_shards;
+    uint32_t end = (uint64_t)len * (shard + 1) / num_shards;
+    slice->states[ODD_STATE] = bucket->states[ODD_STATE] + start;
+    slice->len[ODD_STATE] = end - start;
+    slice->states[EVEN_STATE] = bucket->states[EVEN_STATE];
+    slice->len[EVEN_STATE] = bucket->len[EVEN_STATE];
+    slice->next = NULL;
+    return (slice->len[ODD_STATE] != 0);
+}
+
+// units are ordered bucket by bucket, i.e. the most probable candidates are tested first
+static bool unit_slice(uint32_t unit, statelist_t *slice) {
+    return shard_slice(&work.buckets[unit / shards_in_range], first_shard + unit % shards_in_range, slice);
+}
+
+static void print_progress(void) {
+    time_t now = time(NULL);
+    uint64_t tested = __atomic_load_n(&num_keys_tested, __ATOMIC_SEQ_CST);
+    double elapsed = difftime(now, start_time);
+    printf("%6.0fs %6.2f%%  %" PRIu64 " keys, %1.0f million keys/s\n",
+           elapsed, shard_states ? 100.0 * tested / shard_states : 100.0, tested, elapsed > 0 ? tested / elapsed / 1000000 : 0.0);
+    fflush(stdout);
+}
+
+static void *
+#ifdef __has_attribute
+#if __has_attribute(force_align_arg_pointer)
+__attribute__((force_align_arg_pointer))
+#endif
+#endif
+worker_thread(void *x) {
+    (void)x;
+    while (!__atomic_load_n(&keys_found, __ATOMIC_SEQ_CST)) {
+        uint32_t unit = __atomic_fetch_add(&next_unit, 1, __ATOMIC_SEQ_CST);
+        if (unit >= num_units) {
+            break;
+        }
+        statelist_t slice;
+        if (!unit_slice(unit, &slice)) {
+            continue;
+        }
+        uint64_t key = crack_states_bitsliced(work.header.cuid, work.header.best_first_bytes, &slice, &keys_found, &num_keys_tested,
+                                              work.header.nonces_to_bruteforce, work.header.bf_test_nonce_2nd_byte, work.nonces);
+        if (key != -1) {
+            __atomic_store_n(&found_key, key, __ATOMIC_SEQ_CST);
+            __atomic_fetch_add(&keys_found, 1, __ATOMIC_SEQ_CST);
+            break;
+        }
+        time_t now = time(NULL);
+        time_t last = __atomic_load_n(&last_progress, __ATOMIC_SEQ_CST);
+        if (difftime(now, last) >= PROGRESS_INTERVAL && __atomic_compare_exchange_n(&last_progress, &last, now, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+            print_progress();
+        }
+    }
+    return NULL;
+}
+
+static bool write_result(const char *filename, uint32_t last_shard) {
+    FILE *f = fopen(filename, "w");
+    if (f == NULL) {
+        return false;
+    }
+    fprintf(f, RESULT_HEADER "\n");
+    fprintf(f, "cuid %08" PRIx32 "\n", work.header.cuid);
+    fprintf(f, "shards %" PRIu32 "-%" PRIu32 "/%" PRIu32 "\n", first_shard, last_shard, num_shards);
+    fprintf(f, "tested %" PRIu64 "\n", num_keys_tested);
+    if (keys_found) {
+        fprintf(f, "key %012" PRIx64 "\n", found_key);
+    } else {
+        fprintf(f, "key none\n");
+    }
+    return (fclose(f) == 0);
+}
+
+static int brute_force_shards(const char *work_filename, const char *shard_arg, int num_threads) {
+    uint32_t last_shard;
+    first_shard = 0;
+    last_shard = 0;
+    num_shards = 1;
+    if (shard_arg != NULL) {
+        if (sscanf(shard_arg, "%" SCNu32 "-%" SCNu32 "/%" SCNu32, &first_shard, &last_shard, &num_shards) != 3) {
+            if (sscanf(shard_arg, "%" SCNu32 "/%" SCNu32, &first_shard, &num_shards) != 2) {
+                printf("Invalid shard range %s\n", shard_arg);
+                return 1;
+            }
+            last_shard = first_shard;
+        }
+    }
+    if (num_shards == 0 || first_shard > last_shard || last_shard >= num_shards) {
+        printf("Invalid shard range %s\n", shard_arg);
+        return 1;
+    }
+
+    if (!hardnested_work_read(work_filename, &work)) {
+        printf("Could not read work file %s\n", work_filename);
+        return 1;
+    }
+
+    shards_in_range = last_shard - first_shard + 1;
+    num_units = work.header.num_buckets * shards_in_range;
+    for (uint32_t unit = 0; unit < num_units; unit++) {
+        statelist_t slice;
+        if (unit_slice(unit, &slice)) {
+            shard_states += (uint64_t)slice.len[ODD_STATE] * slice.len[EVEN_STATE];
+        }
+    }
+    printf("cuid %08" PRIx32 ", %" PRIu32 " nonces, %" PRIu32 " buckets, %" PRIu64 " keys\n",
+           work.header.cuid, work.header.num_nonces, work.header.num_buckets, work.header.num_states);
+    printf("Brute forcing shards %" PRIu32 "-%" PRIu32 " of %" PRIu32 " (%" PRIu64 " keys) using %d threads\n",
+           first_shard, last_shard, num_shards, shard_states, num_threads);
+    fflush(stdout);
+
+    bitslice_test_nonces(work.header.nonces_to_bruteforce, work.header.bf_test_nonce, work.header.bf_test_nonce_par);
+
+    start_time = time(NULL);
+    last_progress = start_time;
+    pthread_t threads[num_threads];
+    for (int i = 0; i < num_threads; i++) {
+        pthread_create(&threads[i], NULL, worker_thread, NULL);
+    }
+    for (int i = 0; i < num_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    print_progress();
+
+    if (keys_found) {
+        printf("Key found: %012" PRIx64 "\n", found_key);
+    } else {
+        printf("Key not found in shards %" PRIu32 "-%" PRIu32 "\n", first_shard, last_shard);
+    }
+
+    char result_filename[strlen(work_filename) + 32];
+    sprintf(result_filename, "%s.%" PRIu32 "-%" PRIu32 ".result", work_filename, first_shard, last_shard);
+    if (!write_result(result_filename, last_shard)) {
+        printf("Could not write result file %s\n", result_filename);
+    }
+
+    hardnested_work_free(&work);
+    return keys_found ? 0 : 2;
+}
+
+static int merge_results(const char *work_filename, int num_files, char *result_filenames[]) {
+    hardnested_work_header_t header;
+    if (!hardnested_work_read_header(work_filename, &header)) {
+        printf("Could not read work file %s\n", work_filename);
+        return 1;
+    }
+
+    uint32_t shards = 0;
+    uint8_t *done = NULL;
+    uint64_t tested = 0;
+    bool key_found = false;
+    uint64_t key = 0;
+
+    for (int i = 0; i < num_files; i++) {
+        FILE *f = fopen(result_filenames[i], "r");
+        if (f == NULL) {
+            printf("Could not open result file %s\n", result_filenames[i]);
+            continue;
+        }
+        char line[64] = {0};
+        uint32_t r_cuid, r_first, r_last, r_shards;
+        uint64_t r_tested, r_key;
+        char r_keystr[16] = {0};
+        bool ok = (fgets(line, sizeof(line), f) != NULL) && strncmp(line, RESULT_HEADER, strlen(RESULT_HEADER)) == 0
+                  && fscanf(f, " cuid %" SCNx32, &r_cuid) == 1
+                  && fscanf(f, " shards %" SCNu32 "-%" SCNu32 "/%" SCNu32, &r_first, &r_last, &r_shards) == 3
+                  && fscanf(f, " tested %" SCNu64, &r_tested) == 1
+                  && fscanf(f, " key %15s", r_keystr) == 1;
+        fclose(f);
+        if (!ok || r_shards == 0 || r_first > r_last || r_last >= r_shards) {
+            printf("Invalid result file %s\n", result_filenames[i]);
+            continue;
+        }
+        if (r_cuid != header.cuid) {
+            printf("Result file %s belongs to cuid %08" PRIx32 ", ignored\n", result_filenames[i], r_cuid);
+            continue;
+        }
+        if (done == NULL) {
+            shards = r_shards;
+            done = calloc(shards, sizeof(uint8_t));
+            if (done == NULL) {
+                printf("Out of memory\n");
+                return 1;
+            }
+        } else if (r_shards != shards) {
+            printf("Result file %s uses %" PRIu32 " instead of %" PRIu32 " shards, ignored\n", result_filenames[i], r_shards, shards);
+            continue;
+        }
+        tested += r_tested;
+        if (sscanf(r_keystr, "%" SCNx64, &r_key) == 1) {
+            key_found = true;
+            key = r_key;
+        } else {
+            // a worker which found the key stops early, only complete ranges are done
+            memset(done + r_first, 1, r_last - r_first + 1);
+        }
+    }
+
+    printf("cuid %08" PRIx32 ", %" PRIu32 " buckets, %" PRIu64 " keys\n", header.cuid, header.num_buckets, header.num_states);
+    printf("%" PRIu64 " keys tested (%1.2f%%)\n", tested, header.num_states ? 100.0 * tested / header.num_states : 0.0);
+
+    if (done != NULL) {
+        uint32_t missing = 0;
+        for (uint32_t s = 0; s < shards; s++) {
+            if (!done[s]) {
+                uint32_t e = s;
+                while (e + 1 < shards && !done[e + 1]) {
+                    e++;
+                }
+                if (missing == 0) {
+                    printf("Missing shards (of %" PRIu32 "):", shards);
+                }
+                if (e > s) {
+                    printf(" %" PRIu32 "-%" PRIu32, s, e);
+                } else {
+                    printf(" %" PRIu32, s);
+                }
+                missing += e - s + 1;
+                s = e;
+            }
+        }
+        if (missing) {
+            printf("\n");
+        } else {
+            printf("All %" PRIu32 " shards done\n", shards);
+        }
+        free(done);
+    }
+
+    if (key_found) {
+        printf("Key found: %012" PRIx64 "\n", key);
+        return 0;
+    }
+    printf("Key not found\n");
+    return 2;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc >= 3 && strcmp(argv[1], "-m") == 0) {
+        return merge_results(argv[2], argc - 3, argv + 3);
+    }
+    if (argc < 2 || argc > 4 || argv[1][0] == '-') {
+        usage(argv[0]);
+        return 1;
+    }
+    int num_threads = (argc > 3) ? atoi(argv[3]) : num_CPUs();
+    if (num_threads <= 0) {
+        num_threads = 1;
+    }
+    return brute_force_shards(argv[1], (argc > 2) ? argv[2] : NULL, num_threads);
+}
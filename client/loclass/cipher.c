@@ -44,6 +44,8 @@
 #include <stdint.h>
 #ifndef ON_DEVICE
 #include "fileutils.h"
+#include "commonutil.h"  // ARRAYLEN
+#include "util_posix.h"  // msclock
 #endif
 
 
@@ -209,10 +211,13 @@ static void MAC(uint8_t *k, BitstreamIn input, BitstreamOut out) {
     output(k, initState, &input_32_zeroes, &out);
 }
 
-void doMAC(uint8_t *cc_nr_p, uint8_t *div_key_p, uint8_t mac[4]) {
+/**
+ * The reference MAC above, as written in the paper. doMAC and doMAC_N use the
+ * byte wide version below, testMAC checks that both agree.
+ **/
+static void doMAC_reference(uint8_t *cc_nr_p, uint8_t *div_key_p, uint8_t mac[4]) {
     uint8_t cc_nr[13] = { 0 };
     uint8_t div_key[8];
-    //cc_nr=(uint8_t*) calloc(length+1, sizeof(uint8_t));
 
     memcpy(cc_nr, cc_nr_p, 12);
     memcpy(div_key, div_key_p, 8);
@@ -225,26 +230,217 @@ void doMAC(uint8_t *cc_nr_p, uint8_t *div_key_p, uint8_t mac[4]) {
     //The output MAC must also be reversed
     reverse_arraybytes(dest, sizeof(dest));
     memcpy(mac, dest, 4);
-    //free(cc_nr);
+}
+
+/**
+ * Byte wide cipher, the same as armsrc/optimized_cipher.c. The state is updated in place,
+ * select() is a lookup table and the input and output bits are taken LSB first, so the
+ * bytes need no reversing.
+ **/
+static const uint8_t select_LUT[256] = {
+    00, 03, 02, 01, 02, 03, 00, 01, 04, 07, 07, 04, 06, 07, 05, 04,
+    01, 02, 03, 00, 02, 03, 00, 01, 05, 06, 06, 05, 06, 07, 05, 04,
+    06, 05, 04, 07, 04, 05, 06, 07, 06, 05, 05, 06, 04, 05, 07, 06,
+    07, 04, 05, 06, 04, 05, 06, 07, 07, 04, 04, 07, 04, 05, 07, 06,
+    06, 05, 04, 07, 04, 05, 06, 07, 02, 01, 01, 02, 00, 01, 03, 02,
+    03, 00, 01, 02, 00, 01, 02, 03, 07, 04, 04, 07, 04, 05, 07, 06,
+    00, 03, 02, 01, 02, 03, 00, 01, 00, 03, 03, 00, 02, 03, 01, 00,
+    05, 06, 07, 04, 06, 07, 04, 05, 05, 06, 06, 05, 06, 07, 05, 04,
+    02, 01, 00, 03, 00, 01, 02, 03, 06, 05, 05, 06, 04, 05, 07, 06,
+    03, 00, 01, 02, 00, 01, 02, 03, 07, 04, 04, 07, 04, 05, 07, 06,
+    02, 01, 00, 03, 00, 01, 02, 03, 02, 01, 01, 02, 00, 01, 03, 02,
+    03, 00, 01, 02, 00, 01, 02, 03, 03, 00, 00, 03, 00, 01, 03, 02,
+    04, 07, 06, 05, 06, 07, 04, 05, 00, 03, 03, 00, 02, 03, 01, 00,
+    01, 02, 03, 00, 02, 03, 00, 01, 05, 06, 06, 05, 06, 07, 05, 04,
+    04, 07, 06, 05, 06, 07, 04, 05, 04, 07, 07, 04, 06, 07, 05, 04,
+    01, 02, 03, 00, 02, 03, 00, 01, 01, 02, 02, 01, 02, 03, 01, 00
+};
+
+static inline void successor_byte(const uint8_t *k, State *s, uint8_t y) {
+    uint16_t Tt = s->t & 0xc533;
+    Tt = Tt ^ (Tt >> 1);
+    Tt = Tt ^ (Tt >> 4);
+    Tt = Tt ^ (Tt >> 10);
+    Tt = Tt ^ (Tt >> 8);
+
+    s->t = (s->t >> 1);
+    s->t |= (Tt ^ (s->r >> 7) ^ (s->r >> 3)) << 15;
+
+    uint8_t B = s->b;
+    B ^= s->b >> 6;
+    B ^= s->b >> 5;
+    B ^= s->b >> 4;
+
+    s->b = s->b >> 1;
+    s->b |= (B ^ s->r) << 7;
+
+    uint8_t sel = select_LUT[s->r] & 0x04;
+    sel |= (select_LUT[s->r] ^ ((Tt ^ y) << 1)) & 0x02;
+    sel |= (select_LUT[s->r] ^ Tt) & 0x01;
+
+    uint8_t r = s->r;
+    s->r = (k[sel] ^ s->b) + s->l;
+    s->l = s->r + r;
+}
+
+static void suc_bytes(const uint8_t *k, State *s, const uint8_t *in, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        uint8_t head = in[i];
+        for (int bit = 0; bit < 8; bit++, head >>= 1)
+            successor_byte(k, s, head);
+    }
+}
+
+static void output_bytes(const uint8_t *k, State *s, uint8_t *out, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        uint8_t bout = 0;
+        for (int bit = 0; bit < 8; bit++) {
+            bout |= ((s->r >> 2) & 1) << bit;
+            successor_byte(k, s, 0);
+        }
+        out[i] = bout;
+    }
+}
+
+static void MAC_bytes(const uint8_t *k, const uint8_t *input, size_t length, uint8_t mac[4]) {
+    State s = {
+        ((k[0] ^ 0x4c) + 0xEC) & 0xFF,// l
+        ((k[0] ^ 0x4c) + 0x21) & 0xFF,// r
+        0x4c, // b
+        0xE012 // t
+    };
+    suc_bytes(k, &s, input, length);
+    output_bytes(k, &s, mac, 4);
+}
+
+void doMAC(uint8_t *cc_nr_p, uint8_t *div_key_p, uint8_t mac[4]) {
+    MAC_bytes(div_key_p, cc_nr_p, 12, mac);
 }
 
 void doMAC_N(uint8_t *address_data_p, uint8_t address_data_size, uint8_t *div_key_p, uint8_t mac[4]) {
-    uint8_t *address_data;
-    uint8_t div_key[8];
-    address_data = (uint8_t *) calloc(address_data_size, sizeof(uint8_t));
+    MAC_bytes(div_key_p, address_data_p, address_data_size, mac);
+}
 
-    memcpy(address_data, address_data_p, address_data_size);
-    memcpy(div_key, div_key_p, 8);
+/**
+ * Bitsliced cipher, 64 keys at a time. Bit j of lane n of a register is bit n of plane [j],
+ * the registers are ripple carry added and k[select] is a multiplexer tree over the key planes.
+ * All lanes see the same input bits, which makes it a fit for bruteforcing keys.
+ **/
+typedef struct {
+    uint64_t l[8], r[8], b[8], t[16];
+} StateSliced;
 
-    reverse_arraybytes(address_data, address_data_size);
-    BitstreamIn bitstream = {address_data, address_data_size * 8, 0};
-    uint8_t dest [] = {0, 0, 0, 0, 0, 0, 0, 0};
-    BitstreamOut out = { dest, sizeof(dest) * 8, 0 };
-    MAC(div_key, bitstream, out);
-    //The output MAC must also be reversed
-    reverse_arraybytes(dest, sizeof(dest));
-    memcpy(mac, dest, 4);
-    free(address_data);
+typedef struct {
+    uint64_t k[8][8];       // [key byte][bit]
+    uint64_t d01[4][8];     // k[2i] ^ k[2i + 1], first level of the multiplexers
+} KeySliced;
+
+static inline void add_sliced(uint64_t *sum, const uint64_t *a, const uint64_t *b) {
+    uint64_t carry = 0;
+    for (int j = 0; j < 8; j++) {
+        uint64_t x = a[j] ^ b[j];
+        sum[j] = x ^ carry;
+        carry = (a[j] & b[j]) | (carry & x);
+    }
+}
+
+static inline void successor_sliced(const KeySliced *k, StateSliced *s, uint64_t y) {
+    uint64_t Tt = s->t[0] ^ s->t[1] ^ s->t[4] ^ s->t[5] ^ s->t[8] ^ s->t[10] ^ s->t[14] ^ s->t[15];
+    uint64_t t15 = Tt ^ s->r[7] ^ s->r[3];
+    memmove(&s->t[0], &s->t[1], 15 * sizeof(uint64_t));
+    s->t[15] = t15;
+
+    uint64_t b7 = s->b[0] ^ s->b[6] ^ s->b[5] ^ s->b[4] ^ s->r[0];
+    memmove(&s->b[0], &s->b[1], 7 * sizeof(uint64_t));
+    s->b[7] = b7;
+
+    // select(), the paper's r0 is bit 7
+    const uint64_t *r = s->r;
+    uint64_t z0 = (r[7] & r[5]) ^ (r[6] & ~r[4]) ^ (r[5] | r[3]);
+    uint64_t z1 = (r[7] | r[5]) ^ (r[2] | r[0]) ^ r[6] ^ r[1] ^ Tt ^ y;
+    uint64_t z2 = (r[4] & ~r[2]) ^ (r[3] & r[1]) ^ r[0] ^ Tt;
+
+    uint64_t v[8];
+    for (int j = 0; j < 8; j++) {
+        uint64_t m0 = k->k[0][j] ^ (k->d01[0][j] & z2);
+        uint64_t m1 = k->k[2][j] ^ (k->d01[1][j] & z2);
+        uint64_t m2 = k->k[4][j] ^ (k->d01[2][j] & z2);
+        uint64_t m3 = k->k[6][j] ^ (k->d01[3][j] & z2);
+        m0 ^= (m0 ^ m1) & z1;
+        m2 ^= (m2 ^ m3) & z1;
+        v[j] = (m0 ^ ((m0 ^ m2) & z0)) ^ s->b[j];
+    }
+
+    uint64_t r_old[8];
+    memcpy(r_old, s->r, sizeof(r_old));
+    add_sliced(s->r, v, s->l);
+    add_sliced(s->l, s->r, r_old);
+}
+
+// spreads byte i of the lanes over the planes dest[0..7]
+static void slice_bytes(const uint8_t *bytes, size_t stride, uint32_t lanes, uint64_t dest[8]) {
+    memset(dest, 0, 8 * sizeof(uint64_t));
+    for (uint32_t n = 0; n < lanes; n++) {
+        uint8_t v = bytes[n * stride];
+        for (int j = 0; j < 8; j++)
+            dest[j] |= (uint64_t)((v >> j) & 1) << n;
+    }
+}
+
+static void MAC_sliced(const uint8_t *input, size_t length, const uint8_t (*keys)[8], uint32_t lanes, uint8_t (*macs)[4]) {
+    KeySliced k;
+    StateSliced s;
+
+    for (int i = 0; i < 8; i++)
+        slice_bytes(&keys[0][i], 8, lanes, k.k[i]);
+    for (int i = 0; i < 4; i++)
+        for (int j = 0; j < 8; j++)
+            k.d01[i][j] = k.k[2 * i][j] ^ k.k[2 * i + 1][j];
+
+    uint8_t init_l[64], init_r[64];
+    for (uint32_t n = 0; n < lanes; n++) {
+        init_l[n] = ((keys[n][0] ^ 0x4c) + 0xEC) & 0xFF;
+        init_r[n] = ((keys[n][0] ^ 0x4c) + 0x21) & 0xFF;
+    }
+    slice_bytes(init_l, 1, lanes, s.l);
+    slice_bytes(init_r, 1, lanes, s.r);
+    for (int j = 0; j < 8; j++)
+        s.b[j] = ((0x4c >> j) & 1) ? ~0ULL : 0;
+    for (int j = 0; j < 16; j++)
+        s.t[j] = ((0xE012 >> j) & 1) ? ~0ULL : 0;
+
+    for (size_t i = 0; i < length; i++)
+        for (int bit = 0; bit < 8; bit++)
+            successor_sliced(&k, &s, ((input[i] >> bit) & 1) ? ~0ULL : 0);
+
+    uint64_t out[32];
+    for (int i = 0; i < 32; i++) {
+        out[i] = s.r[2];
+        successor_sliced(&k, &s, 0);
+    }
+
+    for (uint32_t n = 0; n < lanes; n++) {
+        for (int i = 0; i < 4; i++) {
+            uint8_t v = 0;
+            for (int bit = 0; bit < 8; bit++)
+                v |= ((out[i * 8 + bit] >> n) & 1) << bit;
+            macs[n][i] = v;
+        }
+    }
+}
+
+/**
+ * @brief Calculates the reader MACs of one cc_nr for many keys, bitsliced, MAC_SLICE keys at a time
+ * @param cc_nr_p 12 bytes, as for doMAC
+ * @param div_keys the diversified keys
+ * @param count number of keys
+ * @param macs where to store the MACs
+ */
+void doMAC_many(uint8_t *cc_nr_p, const uint8_t (*div_keys)[8], uint32_t count, uint8_t (*macs)[4]) {
+    for (uint32_t i = 0; i < count; i += MAC_SLICE) {
+        uint32_t lanes = (count - i < MAC_SLICE) ? count - i : MAC_SLICE;
+        MAC_sliced(cc_nr_p, 12, div_keys + i, lanes, macs + i);
+    }
 }
 
 #ifndef ON_DEVICE
@@ -268,6 +464,82 @@ int testMAC() {
         printarr("    Correct_MAC   ", correct_MAC, 4);
         return PM3_ESOFT;
     }
+
+    // the byte wide and the bitsliced MAC against the reference
+    PrintAndLogEx(SUCCESS, "Testing fast MAC calculations...");
+    uint8_t keys[3 * MAC_SLICE + 5][8];
+    uint8_t macs[ARRAYLEN(keys)][4];
+    srand(0x1337);
+    for (size_t i = 0; i < sizeof(cc_nr); i++)
+        cc_nr[i] = rand() & 0xFF;
+    for (size_t i = 0; i < ARRAYLEN(keys); i++)
+        for (size_t j = 0; j < 8; j++)
+            keys[i][j] = rand() & 0xFF;
+
+    doMAC_many(cc_nr, (const uint8_t (*)[8])keys, ARRAYLEN(keys), macs);
+    for (size_t i = 0; i < ARRAYLEN(keys); i++) {
+        uint8_t reference_mac[4];
+        doMAC_reference(cc_nr, keys[i], reference_mac);
+        doMAC(cc_nr, keys[i], calculated_mac);
+        if (memcmp(calculated_mac, reference_mac, 4) != 0 || memcmp(macs[i], reference_mac, 4) != 0) {
+            PrintAndLogEx(FAILED, "FAILED: fast MAC calculation failed:");
+            printarr("    Key           ", keys[i], 8);
+            printarr("    Byte wide MAC ", calculated_mac, 4);
+            printarr("    Bitsliced MAC ", macs[i], 4);
+            printarr("    Reference MAC ", reference_mac, 4);
+            return PM3_ESOFT;
+        }
+    }
+    PrintAndLogEx(SUCCESS, "Fast MAC calculations OK!");
+    return PM3_SUCCESS;
+}
+
+/**
+ * @brief Measures the MAC calculations per second of the reference, the byte wide and the
+ * bitsliced cipher, single threaded
+ */
+int benchMAC(void) {
+    uint8_t cc_nr[12];
+    uint8_t (*keys)[8] = calloc(64 * MAC_SLICE, sizeof(*keys));
+    uint8_t (*macs)[4] = calloc(64 * MAC_SLICE, sizeof(*macs));
+    if (keys == NULL || macs == NULL) {
+        PrintAndLogEx(WARNING, "Failed to allocate memory");
+        free(keys);
+        free(macs);
+        return PM3_EMALLOC;
+    }
+    const uint32_t count = 64 * MAC_SLICE;
+    for (size_t i = 0; i < sizeof(cc_nr); i++)
+        cc_nr[i] = rand() & 0xFF;
+    for (uint32_t i = 0; i < count; i++)
+        for (size_t j = 0; j < 8; j++)
+            keys[i][j] = rand() & 0xFF;
+
+    PrintAndLogEx(INFO, "MAC engine      MACs/s");
+    PrintAndLogEx(INFO, "-----------+------------");
+
+    // the reference is slow, 1/16 of the keys
+    uint64_t t1 = msclock();
+    for (uint32_t i = 0; i < count / 16; i++)
+        doMAC_reference(cc_nr, keys[i], macs[i]);
+    uint64_t ms = msclock() - t1;
+    PrintAndLogEx(INFO, "reference  | %10.0f", (count / 16) * 1000.0 / (ms ? ms : 1));
+
+    t1 = msclock();
+    for (int rep = 0; rep < 4; rep++)
+        for (uint32_t i = 0; i < count; i++)
+            doMAC(cc_nr, keys[i], macs[i]);
+    ms = msclock() - t1;
+    PrintAndLogEx(INFO, "byte wide  | %10.0f", 4 * count * 1000.0 / (ms ? ms : 1));
+
+    t1 = msclock();
+    for (int rep = 0; rep < 4; rep++)
+        doMAC_many(cc_nr, (const uint8_t (*)[8])keys, count, macs);
+    ms = msclock() - t1;
+    PrintAndLogEx(INFO, "bitsliced  | %10.0f", 4 * count * 1000.0 / (ms ? ms : 1));
+
+    free(keys);
+    free(macs);
     return PM3_SUCCESS;
 }
 #endif
@@ -44,8 +44,13 @@
 void doMAC(uint8_t *cc_nr_p, uint8_t *div_key_p, uint8_t mac[4]);
 void doMAC_N(uint8_t *address_data_p, uint8_t address_data_size, uint8_t *div_key_p, uint8_t mac[4]);
 
+// doMAC_many calculates this many MACs at a time, counts which are multiples of it are the fastest
+#define MAC_SLICE 64
+void doMAC_many(uint8_t *cc_nr_p, const uint8_t (*div_keys)[8], uint32_t count, uint8_t (*macs)[4]);
+
 #ifndef ON_DEVICE
 int testMAC(void);
+int benchMAC(void);
 #endif
 
 #endif // CIPHER_H
@@ -46,7 +46,9 @@
 #include "elite_crack.h"
 #include "fileutils.h"
 #include "mbedtls/des.h"
-#include "util_posix.h"
+#include "util_posix.h"     // num_CPUs
+#include "commonutil.h"     // MIN, MAX
+#include <pthread.h>
 
 /**
  * @brief Permutes a key from standard NIST format to Iclass specific format
@@ -172,10 +174,9 @@ static void rk(uint8_t *key, uint8_t n, uint8_t *outp_key) {
     return;
 }
 
-static mbedtls_des_context ctx_enc;
-static mbedtls_des_context ctx_dec;
-
+// Contexts are local, hash2 runs on several threads for hf iclass chk / lookup.
 static void desdecrypt_iclass(uint8_t *iclass_key, uint8_t *input, uint8_t *output) {
+    mbedtls_des_context ctx_dec;
     uint8_t key_std_format[8] = {0};
     permutekey_rev(iclass_key, key_std_format);
     mbedtls_des_setkey_dec(&ctx_dec, key_std_format);
@@ -183,12 +184,28 @@ static void desdecrypt_iclass(uint8_t *iclass_key, uint8_t *input, uint8_t *outp
 }
 
 static void desencrypt_iclass(uint8_t *iclass_key, uint8_t *input, uint8_t *output) {
+    mbedtls_des_context ctx_enc;
     uint8_t key_std_format[8] = {0};
     permutekey_rev(iclass_key, key_std_format);
     mbedtls_des_setkey_enc(&ctx_enc, key_std_format);
     mbedtls_des_crypt_ecb(&ctx_enc, input, output);
 }
 
+// Encrypt and decrypt with the same key, one key schedule. The decryption subkeys are
+// the encryption ones in reverse order, as mbedtls_des_setkey_dec swaps them.
+static void descrypt2_iclass(uint8_t *iclass_key, uint8_t *dec_input, uint8_t *dec_output, uint8_t *enc_input, uint8_t *enc_output) {
+    mbedtls_des_context ctx_enc, ctx_dec;
+    uint8_t key_std_format[8] = {0};
+    permutekey_rev(iclass_key, key_std_format);
+    mbedtls_des_setkey_enc(&ctx_enc, key_std_format);
+    for (int i = 0; i < 32; i += 2) {
+        ctx_dec.sk[i] = ctx_enc.sk[30 - i];
+        ctx_dec.sk[i + 1] = ctx_enc.sk[31 - i];
+    }
+    mbedtls_des_crypt_ecb(&ctx_dec, dec_input, dec_output);
+    mbedtls_des_crypt_ecb(&ctx_enc, enc_input, enc_output);
+}
+
 /**
  * @brief Insert uint8_t[8] custom master key to calculate hash2 and return key_select.
  * @param key unpermuted custom key
@@ -236,8 +253,7 @@ void hash2(uint8_t *key64, uint8_t *outp_keytable) {
         rk(key64, i, temp_output);
         //y [i] = DES enc (rk(K cus , i), y [i−1] )
 
-        desdecrypt_iclass(temp_output, z[i - 1], z[i]);
-        desencrypt_iclass(temp_output, y[i - 1], y[i]);
+        descrypt2_iclass(temp_output, z[i - 1], z[i], y[i - 1], y[i]);
     }
 
     if (outp_keytable != NULL) {
@@ -279,6 +295,98 @@ static int _readFromDump(uint8_t dump[], dumpdata *item, uint8_t i) {
     return 0;
 }
 */
+// candidates a thread takes at a time
+#define BRUTEFORCE_CHUNK   0x1000
+#define MAX_LOCLASS_THREADS 64
+
+// one bruteforceItem, shared by its threads
+typedef struct {
+    dumpdata *item;
+    uint8_t key_index[8];
+    uint8_t bytes_to_recover[3];
+    uint8_t numbytes_to_recover;
+    uint8_t keytable[128];      // the key bytes known so far
+    uint32_t endmask;
+    uint32_t next;              // atomic, first candidate of the next chunk
+    uint32_t found;             // atomic, smallest matching candidate, endmask if none
+    uint64_t tried;             // atomic, candidates tried
+} bruteforce_t;
+
+// the key of candidate brute, the bytes to recover come from its lower 24 bits
+static void bruteforce_key(bruteforce_t *bf, uint32_t brute, uint8_t key_sel[8]) {
+    uint8_t table[128];
+    memcpy(table, bf->keytable, sizeof(table));
+    for (int i = 0; i < bf->numbytes_to_recover; i++)
+        table[bf->bytes_to_recover[i]] = brute >> (i * 8) & 0xFF;
+    for (int i = 0; i < 8; i++)
+        key_sel[i] = table[bf->key_index[i]];
+}
+
+static void *bruteforce_thread(void *arg) {
+    bruteforce_t *bf = arg;
+    uint8_t div_keys[MAC_SLICE][8];
+    uint8_t macs[MAC_SLICE][4];
+
+    while (true) {
+        uint32_t start = __atomic_fetch_add(&bf->next, BRUTEFORCE_CHUNK, __ATOMIC_RELAXED);
+        // stop at the end, or past a candidate which is already found
+        if (start >= bf->endmask || start > __atomic_load_n(&bf->found, __ATOMIC_RELAXED))
+            break;
+
+        uint32_t end = MIN(start + BRUTEFORCE_CHUNK, bf->endmask);
+        for (uint32_t brute = start; brute < end; brute += MAC_SLICE) {
+            uint32_t lanes = MIN(end - brute, MAC_SLICE);
+            for (uint32_t n = 0; n < lanes; n++) {
+                uint8_t key_sel[8], key_sel_p[8];
+                bruteforce_key(bf, brute + n, key_sel);
+                //Permute from iclass format to standard format
+                permutekey_rev(key_sel, key_sel_p);
+                //Diversify
+                diversifyKey(bf->item->csn, key_sel_p, div_keys[n]);
+            }
+            //Calc macs
+            doMAC_many(bf->item->cc_nr, (const uint8_t (*)[8])div_keys, lanes, macs);
+
+            for (uint32_t n = 0; n < lanes; n++) {
+                if (memcmp(macs[n], bf->item->mac, 4) != 0)
+                    continue;
+                uint32_t found = __atomic_load_n(&bf->found, __ATOMIC_RELAXED);
+                while (brute + n < found && !__atomic_compare_exchange_n(&bf->found, &found, brute + n, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                    ;
+                break;
+            }
+        }
+        __atomic_fetch_add(&bf->tried, end - start, __ATOMIC_RELAXED);
+
+        if (((start + BRUTEFORCE_CHUNK) & 0xFFFF) == 0) {
+            printf("%3d,", ((start + BRUTEFORCE_CHUNK) >> 16) & 0xFF);
+            if ((((start + BRUTEFORCE_CHUNK) >> 16) % 0x10) == 0)
+                printf("\n");
+            fflush(stdout);
+        }
+    }
+    return NULL;
+}
+
+// runs the bruteforce on num_threads threads, the calling thread if none can be started
+static void bruteforce_run(bruteforce_t *bf, int num_threads) {
+    pthread_t threads[MAX_LOCLASS_THREADS];
+    int started = 0;
+
+    num_threads = MAX(1, MIN(num_threads, MAX_LOCLASS_THREADS));
+    // small searches aren't worth the threads
+    if (bf->endmask <= BRUTEFORCE_CHUNK)
+        num_threads = 1;
+
+    for (; num_threads > 1 && started < num_threads; started++)
+        if (pthread_create(&threads[started], NULL, bruteforce_thread, bf) != 0)
+            break;
+    if (started == 0)
+        bruteforce_thread(bf);
+    for (int i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+}
+
 //static uint32_t startvalue = 0;
 /**
  * @brief Performs brute force attack against a dump-data item, containing csn, cc_nr and mac.
@@ -291,17 +399,13 @@ static int _readFromDump(uint8_t dump[], dumpdata *item, uint8_t i) {
  * @param keytable where to write found values.
  * @return
  */
-int bruteforceItem(dumpdata item, uint16_t keytable[]) {
+static int bruteforce_item(dumpdata *item, uint16_t keytable[], int num_threads) {
     int errors = 0;
     int found = false;
-    uint8_t key_sel_p[8] = {0};
-    uint8_t div_key[8] = {0};
-    uint8_t key_sel[8] = {0};
-    uint8_t calculated_MAC[4] = {0};
 
     //Get the key index (hash1)
     uint8_t key_index[8] = {0};
-    hash1(item.csn, key_index);
+    hash1(item->csn, key_index);
 
     /*
      * Determine which bytes to retrieve. A hash is typically
@@ -319,29 +423,23 @@ int bruteforceItem(dumpdata item, uint16_t keytable[]) {
     uint8_t numbytes_to_recover = 0 ;
     int i;
     for (i = 0; i < 8; i++) {
-        if (keytable[key_index[i]] & (CRACKED | BEING_CRACKED)) continue;
+        if (__atomic_load_n(&keytable[key_index[i]], __ATOMIC_RELAXED) & (CRACKED | BEING_CRACKED)) continue;
 
         bytes_to_recover[numbytes_to_recover++] = key_index[i];
-        keytable[key_index[i]] |= BEING_CRACKED;
+        __atomic_fetch_or(&keytable[key_index[i]], BEING_CRACKED, __ATOMIC_RELAXED);
 
         if (numbytes_to_recover > 3) {
             PrintAndLogEx(FAILED, "The CSN requires > 3 byte bruteforce, not supported");
-            printvar("[-] CSN", item.csn, 8);
+            printvar("[-] CSN", item->csn, 8);
             printvar("[-] HASH1", key_index, 8);
             PrintAndLogEx(NORMAL, "");
             //Before we exit, reset the 'BEING_CRACKED' to zero
-            keytable[bytes_to_recover[0]]  &= ~BEING_CRACKED;
-            keytable[bytes_to_recover[1]]  &= ~BEING_CRACKED;
-            keytable[bytes_to_recover[2]]  &= ~BEING_CRACKED;
+            for (i = 0; i < numbytes_to_recover; i++)
+                __atomic_fetch_and(&keytable[bytes_to_recover[i]], ~BEING_CRACKED, __ATOMIC_RELAXED);
             return 1;
         }
     }
 
-    /*
-     *A uint32 has room for 4 bytes, we'll only need 24 of those bits to bruteforce up to three bytes,
-     */
-    //uint32_t brute = startvalue;
-    uint32_t brute = 0;
     /*
        Determine where to stop the bruteforce. A 1-byte attack stops after 256 tries,
        (when brute reaches 0x100). And so on...
@@ -349,77 +447,54 @@ int bruteforceItem(dumpdata item, uint16_t keytable[]) {
        bytes_to_recover = 2 --> endmask = 0x000010000
        bytes_to_recover = 3 --> endmask = 0x001000000
     */
-
     uint32_t endmask =  1 << 8 * numbytes_to_recover;
     PrintAndLogEx(NORMAL, "----------------------------");
     for (i = 0 ; i < numbytes_to_recover && numbytes_to_recover > 1; i++)
         PrintAndLogEx(INFO, "Bruteforcing byte %d", bytes_to_recover[i]);
 
-    while (!found && !(brute & endmask)) {
-
-        //Update the keytable with the brute-values
-        for (i = 0; i < numbytes_to_recover; i++) {
-            keytable[bytes_to_recover[i]] &= 0xFF00;
-            keytable[bytes_to_recover[i]] |= (brute >> (i * 8) & 0xFF);
-        }
-
-        // Piece together the key
-        key_sel[0] = keytable[key_index[0]] & 0xFF;
-        key_sel[1] = keytable[key_index[1]] & 0xFF;
-        key_sel[2] = keytable[key_index[2]] & 0xFF;
-        key_sel[3] = keytable[key_index[3]] & 0xFF;
-        key_sel[4] = keytable[key_index[4]] & 0xFF;
-        key_sel[5] = keytable[key_index[5]] & 0xFF;
-        key_sel[6] = keytable[key_index[6]] & 0xFF;
-        key_sel[7] = keytable[key_index[7]] & 0xFF;
-
-        //Permute from iclass format to standard format
-        permutekey_rev(key_sel, key_sel_p);
-        //Diversify
-        diversifyKey(item.csn, key_sel_p, div_key);
-        //Calc mac
-        doMAC(item.cc_nr, div_key, calculated_MAC);
-
-        // success
-        if (memcmp(calculated_MAC, item.mac, 4) == 0) {
-            printf("\r\n");
-            for (i = 0 ; i < numbytes_to_recover; i++) {
-                PrintAndLogEx(INFO, "%d: 0x%02x", bytes_to_recover[i], 0xFF & keytable[bytes_to_recover[i]]);
-            }
-            found = true;
-            break;
-        }
-
-        brute++;
-        if ((brute & 0xFFFF) == 0) {
-            printf("%3d,", (brute >> 16) & 0xFF);
-            if (((brute >> 16) % 0x10) == 0)
-                printf("\n");
-            fflush(stdout);
-        }
+    bruteforce_t bf;
+    memset(&bf, 0, sizeof(bf));
+    bf.item = item;
+    memcpy(bf.key_index, key_index, sizeof(key_index));
+    memcpy(bf.bytes_to_recover, bytes_to_recover, sizeof(bytes_to_recover));
+    bf.numbytes_to_recover = numbytes_to_recover;
+    bf.endmask = endmask;
+    bf.found = endmask;
+    for (i = 0; i < 128; i++)
+        bf.keytable[i] = __atomic_load_n(&keytable[i], __ATOMIC_RELAXED) & 0xFF;
+
+    bruteforce_run(&bf, num_threads);
+
+    found = (bf.found < endmask);
+    if (found) {
+        printf("\r\n");
+        for (i = 0; i < numbytes_to_recover; i++)
+            PrintAndLogEx(INFO, "%d: 0x%02x", bytes_to_recover[i], bf.found >> (i * 8) & 0xFF);
     }
 
     if (!found) {
         PrintAndLogEx(NORMAL, "\n");
         PrintAndLogEx(WARNING, "Failed to recover %d bytes using the following CSN", numbytes_to_recover);
-        printvar("[!] CSN", item.csn, 8);
+        printvar("[!] CSN", item->csn, 8);
         errors++;
 
         //Before we exit, reset the 'BEING_CRACKED' to zero
         for (i = 0; i < numbytes_to_recover; i++) {
-            keytable[bytes_to_recover[i]]  &= 0xFF;
-            keytable[bytes_to_recover[i]]  |= CRACK_FAILED;
+            uint16_t value = __atomic_load_n(&keytable[bytes_to_recover[i]], __ATOMIC_RELAXED) & 0xFF;
+            __atomic_store_n(&keytable[bytes_to_recover[i]], value | CRACK_FAILED, __ATOMIC_RELAXED);
         }
     } else {
-        //PrintAndLogEx(SUCCESS, "DES calcs: %u", brute);
-        for (i = 0; i < numbytes_to_recover; i++) {
-            keytable[bytes_to_recover[i]]  &= 0xFF;
-            keytable[bytes_to_recover[i]]  |= CRACKED;
-        }
+        // one store per byte, items on other threads read the keytable
+        for (i = 0; i < numbytes_to_recover; i++)
+            __atomic_store_n(&keytable[bytes_to_recover[i]], (bf.found >> (i * 8) & 0xFF) | CRACKED, __ATOMIC_RELAXED);
     }
     return errors;
 }
 
+int bruteforceItem(dumpdata item, uint16_t keytable[]) {
+    return bruteforce_item(&item, keytable, num_CPUs());
+}
+
 /**
  * From dismantling iclass-paper:
  *  Assume that an adversary somehow learns the first 16 bytes of hash2(K_cus ), i.e., y [0] and z [0] .
@@ -483,31 +558,156 @@ int calculateMasterKey(uint8_t first16bytes[], uint64_t master_key[]) {
     }
     return 0;
 }
+// items of one scheduling round, each on its own thread
+typedef struct {
+    dumpdata *item;
+    uint16_t *keytable;
+    int num_threads;
+    int errors;
+} bruteforce_job_t;
+
+static void *bruteforce_job(void *arg) {
+    bruteforce_job_t *job = arg;
+    job->errors = bruteforce_item(job->item, job->keytable, job->num_threads);
+    return NULL;
+}
+
+// number of distinct key bytes of an item which aren't cracked yet, and a mask of them
+static int unknown_bytes(dumpdata *item, uint16_t keytable[], uint64_t mask[2]) {
+    uint8_t key_index[8];
+    int n = 0;
+    hash1(item->csn, key_index);
+    mask[0] = mask[1] = 0;
+    for (int i = 0; i < 8; i++) {
+        uint8_t k = key_index[i];
+        if ((keytable[k] & CRACKED) || (mask[k >> 6] >> (k & 63) & 1))
+            continue;
+        mask[k >> 6] |= 1ULL << (k & 63);
+        n++;
+    }
+    return n;
+}
+
+/**
+ * The items in file order, each bruteforced on all CPUs. What the attack did before the scheduler.
+ */
+static int bruteforce_sequential(dumpdata *items, size_t num_items, uint16_t keytable[]) {
+    int errors = 0;
+    for (size_t i = 0; i < num_items && errors == 0; i++)
+        errors += bruteforce_item(&items[i], keytable, num_CPUs());
+    return errors;
+}
+
+/**
+ * Schedules the items in rounds. Each round replans the remaining items against the bytes
+ * cracked so far and takes those with the fewest bytes left to recover, as long as they
+ * don't share one, so that the cheap items crack bytes the expensive ones then don't need.
+ * The items of a round run concurrently, the CPUs are split between them.
+ */
+static int bruteforce_scheduled(dumpdata *items, size_t num_items, uint16_t keytable[], int *rounds) {
+    bool *done = calloc(num_items, sizeof(bool));
+    bruteforce_job_t *jobs = calloc(num_items, sizeof(bruteforce_job_t));
+    pthread_t *threads = calloc(num_items, sizeof(pthread_t));
+    if (done == NULL || jobs == NULL || threads == NULL) {
+        PrintAndLogEx(WARNING, "Failed to allocate memory");
+        free(done);
+        free(jobs);
+        free(threads);
+        return 1;
+    }
+
+    int errors = 0;
+    int cpus = num_CPUs();
+    *rounds = 0;
+    while (errors == 0) {
+        // plan
+        int min_unknown = 9;
+        for (size_t i = 0; i < num_items; i++) {
+            uint64_t mask[2];
+            if (!done[i])
+                min_unknown = MIN(min_unknown, unknown_bytes(&items[i], keytable, mask));
+        }
+        if (min_unknown == 9)
+            break;
+
+        uint64_t taken[2] = {0, 0};
+        size_t num_jobs = 0;
+        for (size_t i = 0; i < num_items; i++) {
+            uint64_t mask[2];
+            if (done[i] || unknown_bytes(&items[i], keytable, mask) != min_unknown)
+                continue;
+            if ((mask[0] & taken[0]) || (mask[1] & taken[1]))
+                continue;
+            taken[0] |= mask[0];
+            taken[1] |= mask[1];
+            done[i] = true;
+            jobs[num_jobs].item = &items[i];
+            jobs[num_jobs].keytable = keytable;
+            jobs[num_jobs].errors = 0;
+            num_jobs++;
+            // more than 3 bytes fails, bruteforce_item reports it
+            if (min_unknown > 3)
+                break;
+        }
+
+        // run. Items with all bytes known only verify their MAC, no threads for that
+        size_t started = 0;
+        for (size_t j = 0; j < num_jobs; j++)
+            jobs[j].num_threads = (min_unknown == 0) ? 1 : MAX(1, cpus / (int)num_jobs);
+        for (; min_unknown > 0 && num_jobs > 1 && started < num_jobs; started++)
+            if (pthread_create(&threads[started], NULL, bruteforce_job, &jobs[started]) != 0)
+                break;
+        for (size_t j = started; j < num_jobs; j++)
+            bruteforce_job(&jobs[j]);
+        for (size_t j = 0; j < started; j++)
+            pthread_join(threads[j], NULL);
+
+        for (size_t j = 0; j < num_jobs; j++)
+            errors += jobs[j].errors;
+        (*rounds)++;
+    }
+
+    free(done);
+    free(jobs);
+    free(threads);
+    return errors;
+}
+
 /**
  * @brief Same as bruteforcefile, but uses a an array of dumpdata instead
  * @param dump
  * @param dumpsize
  * @param keytable
+ * @param sequential bruteforce the items one by one in file order instead of scheduling them
  * @return
  */
-int bruteforceDump(uint8_t dump[], size_t dumpsize, uint16_t keytable[]) {
+int bruteforceDump(uint8_t dump[], size_t dumpsize, uint16_t keytable[], bool sequential) {
     uint8_t i;
     int errors = 0;
     size_t itemsize = sizeof(dumpdata);
+    size_t num_items = dumpsize / itemsize;
+    int rounds = 0;
 
     uint64_t t1 = msclock();
 
-    dumpdata *attack = (dumpdata *) calloc(itemsize, sizeof(uint8_t));
-
-    for (i = 0 ; i * itemsize < dumpsize ; i++) {
-        memcpy(attack, dump + i * itemsize, itemsize);
-        errors += bruteforceItem(*attack, keytable);
-        if (errors)
-            break;
+    dumpdata *attack = (dumpdata *) calloc(num_items + 1, itemsize);
+    if (attack == NULL) {
+        PrintAndLogEx(WARNING, "Failed to allocate memory");
+        return 1;
     }
+    memcpy(attack, dump, num_items * itemsize);
+
+    if (sequential)
+        errors = bruteforce_sequential(attack, num_items, keytable);
+    else
+        errors = bruteforce_scheduled(attack, num_items, keytable, &rounds);
+
     free(attack);
     t1 = msclock() - t1;
-    PrintAndLogEx(SUCCESS, "time: %" PRIu64 " seconds", t1 / 1000);
+    if (sequential)
+        PrintAndLogEx(SUCCESS, "time: %" PRIu64 ".%01" PRIu64 " seconds, %zu items one by one", t1 / 1000, (t1 % 1000) / 100, num_items);
+    else
+        PrintAndLogEx(SUCCESS, "time: %" PRIu64 ".%01" PRIu64 " seconds, %zu items in %d rounds on %d threads", t1 / 1000, (t1 % 1000) / 100, num_items, rounds, num_CPUs());
 
 
     if (errors) {
@@ -539,7 +739,7 @@ int bruteforceDump(uint8_t dump[], size_t dumpsize, uint16_t keytable[]) {
  * @param filename
  * @return
  */
-int bruteforceFile(const char *filename, uint16_t keytable[]) {
+int bruteforceFile(const char *filename, uint16_t keytable[], bool sequential) {
 
     size_t dumplen = 0;
     uint8_t *dump = NULL;
@@ -547,7 +747,7 @@ int bruteforceFile(const char *filename, uint16_t keytable[]) {
         return PM3_EFILE;
     }
 
-    uint8_t res = bruteforceDump(dump, dumplen, keytable);
+    uint8_t res = bruteforceDump(dump, dumplen, keytable, sequential);
     free(dump);
     return res;
 }
@@ -557,9 +757,55 @@ int bruteforceFile(const char *filename, uint16_t keytable[]) {
  * @param filename
  * @return
  */
-int bruteforceFileNoKeys(const char *filename) {
+int bruteforceFileNoKeys(const char *filename, bool sequential) {
     uint16_t keytable[128] = {0};
-    return bruteforceFile(filename, keytable);
+    return bruteforceFile(filename, keytable, sequential);
+}
+
+/**
+ * @brief Measures the MAC engines and the candidate keys per second of bruteforceItem,
+ * on one thread and on all CPUs, with a two byte search that finds nothing
+ * @return
+ */
+int benchElite(void) {
+    PrintAndLogEx(INFO, "Benchmarking iClass MAC calculation...");
+    int res = benchMAC();
+    if (res != PM3_SUCCESS)
+        return res;
+
+    uint8_t k_cus[8] = {0x5B, 0x7C, 0x62, 0xC4, 0x91, 0xC1, 0x1B, 0x39};
+    dumpdata item = {
+        {0x00, 0x0B, 0x0F, 0xFF, 0xF7, 0xFF, 0x12, 0xE0},
+        {0xFE, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00},
+        {0x00, 0x00, 0x00, 0x00}
+    };
+
+    bruteforce_t bf;
+    memset(&bf, 0, sizeof(bf));
+    bf.item = &item;
+    hash1(item.csn, bf.key_index);
+    hash2(k_cus, bf.keytable);
+    bf.bytes_to_recover[0] = bf.key_index[0];
+    bf.bytes_to_recover[1] = bf.key_index[2];
+    bf.numbytes_to_recover = 2;
+    bf.endmask = 1 << 16;
+
+    PrintAndLogEx(NORMAL, "");
+    PrintAndLogEx(INFO, "Bruteforce      threads     keys/s");
+    PrintAndLogEx(INFO, "-----------+-----------+-----------");
+    int cpus = num_CPUs();
+    for (int threads = 1; threads <= cpus; threads = (threads == cpus) ? cpus + 1 : cpus) {
+        bf.next = 0;
+        bf.tried = 0;
+        bf.found = bf.endmask;
+        uint64_t t1 = msclock();
+        bruteforce_run(&bf, threads);
+        uint64_t ms = msclock() - t1;
+        printf("\r");
+        PrintAndLogEx(INFO, "2 bytes    | %9d | %10.0f", threads, bf.tried * 1000.0 / (ms ? ms : 1));
+    }
+    PrintAndLogEx(INFO, "A 3 byte recovery is 2^24 keys");
+    return PM3_SUCCESS;
 }
 
 // ---------------------------------------------------------------------------------
@@ -588,7 +834,7 @@ static int _testBruteforce() {
         **** The 64-bit HS Custom Key Value = 5B7C62C491C11B39 ****
     **/
     uint16_t keytable[128] = {0};
-    int errors = bruteforceFile("iclass_dump.bin", keytable);
+    int errors = bruteforceFile("iclass_dump.bin", keytable, false);
     if (errors) {
         PrintAndLogEx(ERR, "Error: The file " _YELLOW_("iclass_dump.bin") "was not found!");
     }
@@ -58,24 +58,26 @@ void permutekey_rev(uint8_t key[8], uint8_t dest[8]);
  * @param filename
  * @param keytable an arrah (128 x 16 bit ints). This is where the keydata is stored.
  * OBS! the upper part of the 16 bits store crack-status,
+ * @param sequential bruteforce the items one by one in file order instead of scheduling them
  * @return
  */
-int bruteforceFile(const char *filename, uint16_t keytable[]);
+int bruteforceFile(const char *filename, uint16_t keytable[], bool sequential);
 /**
  *
  * @brief Same as above, if you don't care about the returned keytable (results only printed on screen)
  * @param filename
  * @return
  */
-int bruteforceFileNoKeys(const char *filename);
+int bruteforceFileNoKeys(const char *filename, bool sequential);
 /**
  * @brief Same as bruteforcefile, but uses a an array of dumpdata instead
  * @param dump
  * @param dumpsize
  * @param keytable
+ * @param sequential bruteforce the items one by one in file order instead of scheduling them
  * @return
  */
-int bruteforceDump(uint8_t dump[], size_t dumpsize, uint16_t keytable[]);
+int bruteforceDump(uint8_t dump[], size_t dumpsize, uint16_t keytable[], bool sequential);
 
 /**
   This is how we expect each 'entry' in a dumpfile to look
@@ -126,6 +128,12 @@ int calculateMasterKey(uint8_t first16bytes[], uint64_t master_key[]);
  */
 int testElite(bool slowtests);
 
+/**
+ * @brief Benchmark of the MAC engines and the bruteforce
+ * @return
+ */
+int benchElite(void);
+
 /**
       Here are some pretty optimal values that can be used to recover necessary data in only
       eight auth attempts.
@@ -202,8 +202,6 @@ local function perform_check(numsectors)
         keys[i] = {0,0,'',''}
     end
 
-    core.fast_push_mode(true)
-
     local start_time = os.time()
 
     for sector = 0, #keys do
@@ -232,8 +230,6 @@ local function perform_check(numsectors)
     print('')
     print('[+] mfckeys - Checkkey execution time: '..os.difftime(end_time, start_time)..' sec')
 
-    core.fast_push_mode(false)
-
     display_results(keys)
 
     -- save to dumpkeys.bin
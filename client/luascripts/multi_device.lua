@@ -0,0 +1,99 @@
+local getopt = require('getopt')
+
+copyright = ''
+author = ''
+version = 'v1.0.0'
+desc = [[
+This script runs a client command on several Proxmark3s connected to this client.
+The device of the command line is device 0, it gets the command first.
+
+The devices run the command one after another, not in parallel: client commands
+share the graph buffer and other global state, so only one of them can run at a time.
+Each device still has its own connection, a command waits only for its own device.
+]]
+example = [[
+     -- read the tags on two more readers
+     script run multi_device -p /dev/ttyACM1,/dev/ttyACM2 -c hf 14a reader
+
+     -- status of a reader over TCP
+     script run multi_device -p tcp:192.168.0.10:4321 -c hw status
+]]
+usage = [[
+script run multi_device -h -p <ports> -c <command>
+
+Arguments:
+    -h             : this help
+    -p <ports>     : comma separated serial ports of the additional devices
+    -b <baudrate>  : baudrate of the additional devices
+    -c <command>   : client command to run on each device, default "hw version".
+                     Must be the last option, the rest of the line is the command
+]]
+---
+-- This is only meant to be used when errors occur
+local function oops(err)
+    print('ERROR:', err)
+    core.clearCommandBuffer()
+    return nil, err
+end
+---
+-- Usage help
+local function help()
+    print(copyright)
+    print(author)
+    print(version)
+    print(desc)
+    print('Example usage')
+    print(example)
+    print(usage)
+end
+---
+-- The main entry point
+function main(args)
+
+    local ports = {}
+    local baudrate = nil
+    local cmd = 'hw version'
+
+    -- the command takes the rest of the line
+    local opts, rest = args:match('^(.-)%-c%s+(.*)$')
+    if opts then
+        args = opts
+        cmd = rest
+    end
+
+    -- Read the parameters
+    for o, a in getopt.getopt(args, 'hp:b:') do
+        if o == 'h' then return help() end
+        if o == 'p' then
+            for port in string.gmatch(a, '[^,]+') do table.insert(ports, port) end
+        end
+        if o == 'b' then baudrate = tonumber(a) end
+    end
+
+    if #ports == 0 then return oops('no ports given') end
+
+    -- device 0 is the one of the command line
+    local devices = { 0 }
+    for _, port in ipairs(ports) do
+        local id, err = core.open_device(port, baudrate)
+        if id == nil then return oops(err) end
+        print(('device %d on %s'):format(id, port))
+        table.insert(devices, id)
+    end
+
+    -- one device after the other, see desc
+    for _, id in ipairs(devices) do
+        print( string.rep('--', 20) )
+        print(('device %d: %s'):format(id, cmd))
+        core.select_device(id)
+        core.console(cmd)
+    end
+    core.select_device(0)
+
+    -- devices left open are closed when the script ends
+    for i = 2, #devices do
+        core.close_device(devices[i])
+    end
+end
+
+main(args)
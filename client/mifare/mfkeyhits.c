@@ -0,0 +1,280 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// MIFARE Classic key hit statistics for hf mf chk / fchk
+//
+// Keys found on a card are counted under the card's fingerprint, ATQA, SAK and
+// the first UID byte, in ~/.proxmark3/mf_key_hits.txt. Before a check the keys
+// with hits on cards of the same fingerprint go first, then the keys with hits
+// on any card, the rest stays in dictionary order.
+//-----------------------------------------------------------------------------
+
+#include "mfkeyhits.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pm3_cmd.h"        // PM3_*
+#include "commonutil.h"     // num_to_bytes
+#include "ui.h"             // PrintAndLog, searchHomeFilePath
+
+typedef struct {
+    uint32_t fingerprint;
+    uint64_t key;
+    uint32_t hits;
+} mf_keyhit_t;
+
+typedef struct {
+    mf_keyhit_t *items;
+    uint32_t count;
+    uint32_t size;
+} mf_keyhits_t;
+
+// a key of the statistics and where the check would have tried it
+typedef struct {
+    uint64_t key;
+    uint32_t fp_hits;       // on cards with the same fingerprint
+    uint32_t all_hits;      // on any card
+    uint64_t pos;           // in the keys as given, UINT64_MAX if not there
+} mf_keyrank_t;
+
+static int cmp_keyhit(const void *a, const void *b) {
+    const mf_keyhit_t *x = a, *y = b;
+    if (x->fingerprint != y->fingerprint)
+        return x->fingerprint < y->fingerprint ? -1 : 1;
+    if (x->key != y->key)
+        return x->key < y->key ? -1 : 1;
+    return 0;
+}
+
+static int cmp_keyrank_key(const void *a, const void *b) {
+    const mf_keyrank_t *x = a, *y = b;
+    if (x->key != y->key)
+        return x->key < y->key ? -1 : 1;
+    return 0;
+}
+
+// most hits on this kind of card first, ties in dictionary order
+static int cmp_keyrank_hits(const void *a, const void *b) {
+    const mf_keyrank_t *x = a, *y = b;
+    if (x->fp_hits != y->fp_hits)
+        return x->fp_hits > y->fp_hits ? -1 : 1;
+    if (x->all_hits != y->all_hits)
+        return x->all_hits > y->all_hits ? -1 : 1;
+    if (x->pos != y->pos)
+        return x->pos < y->pos ? -1 : 1;
+    return 0;
+}
+
+static mf_keyhit_t *keyhits_add(mf_keyhits_t *db, uint32_t fingerprint, uint64_t key, uint32_t hits) {
+    if (db->count == db->size) {
+        uint32_t size = db->size ? db->size * 2 : 256;
+        mf_keyhit_t *p = realloc(db->items, size * sizeof(mf_keyhit_t));
+        if (p == NULL)
+            return NULL;
+        db->items = p;
+        db->size = size;
+    }
+    mf_keyhit_t *h = &db->items[db->count++];
+    h->fingerprint = fingerprint;
+    h->key = key;
+    h->hits = hits;
+    return h;
+}
+
+static void keyhits_load(mf_keyhits_t *db) {
+    memset(db, 0, sizeof(mf_keyhits_t));
+
+    char *path = NULL;
+    if (searchHomeFilePath(&path, MF_KEYHITS_FILE, false) != PM3_SUCCESS)
+        return;
+    FILE *f = fopen(path, "r");
+    free(path);
+    if (f == NULL)
+        return;
+
+    char line[80];
+    while (fgets(line, sizeof(line), f)) {
+        uint32_t fingerprint, hits;
+        uint64_t key;
+        if (line[0] == '#' || sscanf(line, "%" SCNx32 " %" SCNx64 " %" SCNu32, &fingerprint, &key, &hits) != 3)
+            continue;
+        if (keyhits_add(db, fingerprint, key & 0xFFFFFFFFFFFF, hits) == NULL)
+            break;
+    }
+    fclose(f);
+    qsort(db->items, db->count, sizeof(mf_keyhit_t), cmp_keyhit);
+}
+
+static int keyhits_save(mf_keyhits_t *db) {
+    char *path = NULL;
+    if (searchHomeFilePath(&path, MF_KEYHITS_FILE, true) != PM3_SUCCESS)
+        return PM3_EFILE;
+    FILE *f = fopen(path, "w");
+    free(path);
+    if (f == NULL)
+        return PM3_EFILE;
+
+    fprintf(f, "# hf mf chk / fchk key hits: <ATQA SAK UID[0]> <key> <cards>\n");
+    for (uint32_t i = 0; i < db->count; i++)
+        fprintf(f, "%08" PRIx32 " %012" PRIx64 " %" PRIu32 "\n", db->items[i].fingerprint, db->items[i].key, db->items[i].hits);
+    fclose(f);
+    return PM3_SUCCESS;
+}
+
+uint32_t mfKeyHitsFingerprint(uint8_t *atqa, uint8_t sak, uint8_t *uid) {
+    return (uint32_t)atqa[1] << 24 | (uint32_t)atqa[0] << 16 | (uint32_t)sak << 8 | uid[0];
+}
+
+// Puts the keys with hits first. Keys of a compiled dictionary can't be moved,
+// the ones with hits are copied in front of keyBlock and checked twice if they fail.
+int mfKeyHitsReorder(uint32_t fingerprint, uint8_t **keyBlock, int *keycnt, uint32_t *keyitems, dictionary_t *dict) {
+
+    mf_keyhits_t db;
+    keyhits_load(&db);
+    if (db.count == 0) {
+        free(db.items);
+        return PM3_SUCCESS;
+    }
+
+    // hits per key, sorted by key
+    mf_keyrank_t *rank = calloc(db.count, sizeof(mf_keyrank_t));
+    if (rank == NULL) {
+        free(db.items);
+        return PM3_EMALLOC;
+    }
+    for (uint32_t i = 0; i < db.count; i++) {
+        rank[i].key = db.items[i].key;
+        rank[i].all_hits = db.items[i].hits;
+        rank[i].fp_hits = (db.items[i].fingerprint == fingerprint) ? db.items[i].hits : 0;
+        rank[i].pos = UINT64_MAX;
+    }
+    free(db.items);
+    qsort(rank, db.count, sizeof(mf_keyrank_t), cmp_keyrank_key);
+
+    uint32_t nrank = 0;
+    for (uint32_t i = 0; i < db.count; i++) {
+        if (nrank && rank[nrank - 1].key == rank[i].key) {
+            rank[nrank - 1].all_hits += rank[i].all_hits;
+            rank[nrank - 1].fp_hits += rank[i].fp_hits;
+        } else {
+            rank[nrank++] = rank[i];
+        }
+    }
+
+    // where the keys are in the check as given, first occurrence wins
+    for (int i = *keycnt - 1; i >= 0; i--) {
+        mf_keyrank_t k = { .key = bytes_to_num(*keyBlock + i * 6, 6) };
+        mf_keyrank_t *r = bsearch(&k, rank, nrank, sizeof(mf_keyrank_t), cmp_keyrank_key);
+        if (r)
+            r->pos = i;
+    }
+    for (uint64_t j = 0; j < dict->keycount; j++) {
+        mf_keyrank_t k = { .key = bytes_to_num(dict->keys + j * 6, 6) };
+        mf_keyrank_t *r = bsearch(&k, rank, nrank, sizeof(mf_keyrank_t), cmp_keyrank_key);
+        if (r && r->pos == UINT64_MAX)
+            r->pos = *keycnt + j;
+    }
+
+    // drop keys not in this check
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < nrank; i++)
+        if (rank[i].pos != UINT64_MAX)
+            rank[n++] = rank[i];
+
+    if (n == 0) {
+        free(rank);
+        return PM3_SUCCESS;
+    }
+
+    uint32_t from_dict = 0;
+    for (uint32_t i = 0; i < n; i++)
+        if (rank[i].pos >= (uint64_t)*keycnt)
+            from_dict++;
+
+    uint8_t *keys = calloc(*keycnt + from_dict + 64, 6);
+    if (keys == NULL) {
+        free(rank);
+        return PM3_EMALLOC;
+    }
+
+    // ranked keys first, then the others of keyBlock in their order
+    uint32_t cnt = n;
+    for (int i = 0; i < *keycnt; i++) {
+        mf_keyrank_t k = { .key = bytes_to_num(*keyBlock + i * 6, 6) };
+        if (bsearch(&k, rank, n, sizeof(mf_keyrank_t), cmp_keyrank_key) == NULL)
+            memcpy(keys + cnt++ * 6, *keyBlock + i * 6, 6);
+    }
+
+    qsort(rank, n, sizeof(mf_keyrank_t), cmp_keyrank_hits);
+    for (uint32_t i = 0; i < n; i++)
+        num_to_bytes(rank[i].key, 6, keys + i * 6);
+
+    // expected auths to the first hit, by the hit frequency on this kind of card or any card
+    double sum = 0, e_new = 0, e_old = 0;
+    bool by_fp = rank[0].fp_hits > 0;
+    for (uint32_t i = 0; i < n; i++)
+        sum += by_fp ? rank[i].fp_hits : rank[i].all_hits;
+    for (uint32_t i = 0; i < n; i++) {
+        double p = (by_fp ? rank[i].fp_hits : rank[i].all_hits) / sum;
+        e_new += p * (i + 1);
+        e_old += p * (rank[i].pos + 1);
+    }
+
+    PrintAndLogEx(SUCCESS, "key statistics for " _YELLOW_("%08x") "- %u keys with hits first (%u of the compiled dictionary), expected auths to a key " _GREEN_("%.1f") "instead of %.1f",
+                  fingerprint, n, from_dict, e_new, e_old);
+
+    free(*keyBlock);
+    *keyBlock = keys;
+    *keycnt = cnt;
+    *keyitems = cnt + from_dict + 64;
+    free(rank);
+    return PM3_SUCCESS;
+}
+
+// counts each key found on the card once
+int mfKeyHitsRecord(uint32_t fingerprint, sector_t *e_sector, uint8_t sectorsCnt) {
+
+    mf_keyhits_t db;
+    keyhits_load(&db);
+    uint32_t sorted = db.count;
+
+    uint64_t seen[80];
+    uint8_t nseen = 0;
+    uint32_t added = 0;
+    for (uint8_t i = 0; i < sectorsCnt; i++) {
+        for (uint8_t j = 0; j < 2; j++) {
+            if (e_sector[i].foundKey[j] == 0)
+                continue;
+
+            uint64_t key = e_sector[i].Key[j];
+            bool dup = false;
+            for (uint8_t s = 0; s < nseen && !dup; s++)
+                dup = seen[s] == key;
+            if (dup || nseen == ARRAYLEN(seen))
+                continue;
+            seen[nseen++] = key;
+
+            mf_keyhit_t k = { .fingerprint = fingerprint, .key = key };
+            mf_keyhit_t *h = bsearch(&k, db.items, sorted, sizeof(mf_keyhit_t), cmp_keyhit);
+            if (h) {
+                h->hits++;
+            } else if (keyhits_add(&db, fingerprint, key, 1) == NULL) {
+                break;
+            }
+            added++;
+        }
+    }
+
+    int res = PM3_SUCCESS;
+    if (added) {
+        qsort(db.items, db.count, sizeof(mf_keyhit_t), cmp_keyhit);
+        res = keyhits_save(&db);
+    }
+    free(db.items);
+    return res;
+}
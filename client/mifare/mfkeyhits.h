@@ -0,0 +1,22 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// MIFARE Classic key hit statistics for hf mf chk / fchk
+//-----------------------------------------------------------------------------
+
+#ifndef MFKEYHITS_H
+#define MFKEYHITS_H
+
+#include "common.h"
+#include "fileutils.h"      // dictionary_t
+#include "mifarehost.h"     // sector_t
+
+#define MF_KEYHITS_FILE     "mf_key_hits.txt"
+
+uint32_t mfKeyHitsFingerprint(uint8_t *atqa, uint8_t sak, uint8_t *uid);
+int mfKeyHitsReorder(uint32_t fingerprint, uint8_t **keyBlock, int *keycnt, uint32_t *keyitems, dictionary_t *dict);
+int mfKeyHitsRecord(uint32_t fingerprint, sector_t *e_sector, uint8_t sectorsCnt);
+
+#endif
@@ -13,6 +13,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 
 #include "comms.h"
 #include "commonutil.h"
@@ -22,6 +23,7 @@
 #include "crc16.h"
 #include "protocols.h"
 #include "mfkey.h"
+#include "radixsort.h"
 #include "util_posix.h"  // msclock
 
 
@@ -185,22 +187,136 @@ int mfCheckKeys(uint8_t blockNo, uint8_t keyType, bool clear_trace, uint8_t keyc
     return PM3_SUCCESS;
 }
 
-// Sends chunks of keys to device.
-// 0 == ok all keys found
-// 1 ==
-// 2 == Time-out, aborting
-int mfCheckKeys_fast(uint8_t sectorsCnt, uint8_t firstChunk, uint8_t lastChunk, uint8_t strategy,
-                     uint32_t size, uint8_t *keyBlock, sector_t *e_sector, bool use_flashmemory) {
+// Key check as a stream of packets. Up to CHKKEYS_STREAM_WINDOW packets are sent before
+// waiting for a reply, the device finds the next packet in its buffer when it is done
+// with the current one. The field stays on from mfCheckKeys_stream_start() to
+// mfCheckKeys_stream_end() or until the key is found. Devices without the
+// mifare_chkkeys_stream capability check each packet with mfCheckKeys() instead.
+#define CHKKEYS_STREAM_WINDOW   2
 
-    uint64_t t2 = msclock();
-    uint32_t timeout = 0;
+static int chkkeys_stream_send(chkkeys_stream_t *stream, uint8_t flags, uint8_t keycnt, uint8_t *keyBlock) {
+    uint8_t data[PM3_CMD_DATA_SIZE] = {0};
+    mf_chkkeys_stream_t *payload = (mf_chkkeys_stream_t *)data;
+    payload->keytype = stream->keyType;
+    payload->blockno = stream->blockNo;
+    payload->flags = flags;
+    payload->keycnt = keycnt;
+    if (keycnt)
+        memcpy(payload->keys, keyBlock, 6 * keycnt);
+    SendCommandNG(CMD_HF_MIFARE_CHKKEYS_STREAM, data, sizeof(mf_chkkeys_stream_t) + 6 * keycnt);
+    stream->in_flight++;
+    return PM3_SUCCESS;
+}
 
-    // send keychunk
-    clearCommandBuffer();
-    SendCommandOLD(CMD_HF_MIFARE_CHKKEYS_FAST, (sectorsCnt | (firstChunk << 8) | (lastChunk << 12)), ((use_flashmemory << 8) | strategy), size, keyBlock, 6 * size);
+static int chkkeys_stream_wait(chkkeys_stream_t *stream) {
     PacketResponseNG resp;
+    if (!WaitForResponseTimeout(CMD_HF_MIFARE_CHKKEYS_STREAM, &resp, 2500)) {
+        stream->status = PM3_ETIMEOUT;
+        stream->in_flight = 0;
+        return PM3_ETIMEOUT;
+    }
+    stream->in_flight--;
+
+    mf_chkkeys_stream_result_t *keyresult = (mf_chkkeys_stream_result_t *)resp.data.asBytes;
+    stream->checked += keyresult->checked;
+    if (keyresult->found && !stream->found) {
+        stream->found = true;
+        stream->key = bytes_to_num(keyresult->key, sizeof(keyresult->key));
+    }
+    // after a found key the device answers the packets in flight with PM3_EOPABORTED
+    if (resp.status != PM3_SUCCESS && !stream->found && stream->status == PM3_SUCCESS)
+        stream->status = resp.status;
+    return stream->status;
+}
+
+int mfCheckKeys_stream_start(chkkeys_stream_t *stream, uint8_t blockNo, uint8_t keyType, bool clear_trace) {
+    memset(stream, 0, sizeof(chkkeys_stream_t));
+    stream->blockNo = blockNo;
+    stream->keyType = keyType;
+    stream->status = PM3_SUCCESS;
+    if (GetCapabilities()->mifare_chkkeys_stream == false) {
+        stream->fallback = true;
+        stream->clear_trace = clear_trace;
+        return PM3_SUCCESS;
+    }
+    clearCommandBuffer();
+    // no keys yet, the device sets up the field while the host is busy
+    return chkkeys_stream_send(stream, MF_CHKKEYS_STREAM_FIRST | (clear_trace ? MF_CHKKEYS_STREAM_CLEARTRACE : 0), 0, NULL);
+}
+
+// returns PM3_SUCCESS while the stream is running, check stream->found
+int mfCheckKeys_stream_add(chkkeys_stream_t *stream, uint8_t keycnt, uint8_t *keyBlock) {
+    if (stream->fallback) {
+        if (stream->status != PM3_SUCCESS || stream->found)
+            return stream->status;
+        int res = mfCheckKeys(stream->blockNo, stream->keyType, stream->clear_trace, keycnt, keyBlock, &stream->key);
+        stream->clear_trace = false;
+        stream->checked += keycnt;
+        if (res == PM3_SUCCESS)
+            stream->found = true;
+        else if (res != PM3_ESOFT)
+            stream->status = res;
+        return stream->status;
+    }
+
+    while (stream->in_flight >= CHKKEYS_STREAM_WINDOW && stream->status == PM3_SUCCESS && !stream->found)
+        chkkeys_stream_wait(stream);
+
+    if (stream->status != PM3_SUCCESS || stream->found)
+        return stream->status;
+
+    return chkkeys_stream_send(stream, 0, keycnt, keyBlock);
+}
+
+// waits for the packets in flight, PM3_SUCCESS if the key was found
+int mfCheckKeys_stream_end(chkkeys_stream_t *stream) {
+    if (stream->status == PM3_SUCCESS && !stream->found && !stream->fallback)
+        chkkeys_stream_send(stream, MF_CHKKEYS_STREAM_LAST, 0, NULL);
+
+    while (stream->in_flight && stream->status != PM3_ETIMEOUT)
+        chkkeys_stream_wait(stream);
+
+    if (stream->found)
+        return PM3_SUCCESS;
+    return stream->status == PM3_SUCCESS ? PM3_ESOFT : stream->status;
+}
+
+// Merges the keys of a CMD_HF_MIFARE_CHKKEYS_FAST reply into e_sector.
+// The device answers every chunk with all keys found so far, new ones are
+// printed as they come in. Firmware without that only sends them at the end.
+static void chkkeys_fast_merge(PacketResponseNG *resp, uint8_t sectorsCnt, sector_t *e_sector) {
+
+    if (resp->length < 480 + 10)
+        return;
+
+    // success array. each byte is status of key
+    uint8_t arr[80];
+    uint64_t foo = bytes_to_num(resp->data.asBytes + 480, 8);
+    uint16_t bar = (resp->data.asBytes[489] << 8 | resp->data.asBytes[488]);
 
-    while (!WaitForResponseTimeout(CMD_ACK, &resp, 2000)) {
+    for (uint8_t i = 0; i < 64; i++)
+        arr[i] = (foo >> i) & 0x1;
+
+    for (uint8_t i = 0; i < 16; i++)
+        arr[i + 64] = (bar >> i) & 0x1;
+
+    icesector_t *tmp = (icesector_t *)resp->data.asBytes;
+
+    for (int i = 0; i < sectorsCnt; i++) {
+        for (int j = 0; j < 2; j++) {
+            if (e_sector[i].foundKey[j] || arr[(i * 2) + j] == 0)
+                continue;
+
+            e_sector[i].Key[j] = bytes_to_num(j ? tmp[i].keyB : tmp[i].keyA, 6);
+            e_sector[i].foundKey[j] = 1;
+            PrintAndLogEx(SUCCESS, "found key " _GREEN_("%012" PRIx64) "for sector %3d key %c", e_sector[i].Key[j], i, j ? 'B' : 'A');
+        }
+    }
+}
+
+static int chkkeys_fast_wait(PacketResponseNG *resp) {
+    uint32_t timeout = 0;
+    while (!WaitForResponseTimeout(CMD_ACK, resp, 2000)) {
         timeout++;
         printf(".");
         fflush(stdout);
@@ -212,6 +328,31 @@ int mfCheckKeys_fast(uint8_t sectorsCnt, uint8_t firstChunk, uint8_t lastChunk,
             return PM3_ETIMEOUT;
         }
     }
+    return PM3_SUCCESS;
+}
+
+static void chkkeys_fast_send(uint8_t sectorsCnt, uint8_t firstChunk, uint8_t lastChunk, uint8_t strategy,
+                              uint32_t size, uint8_t *keyBlock, bool use_flashmemory) {
+    SendCommandOLD(CMD_HF_MIFARE_CHKKEYS_FAST, (sectorsCnt | (firstChunk << 8) | (lastChunk << 12)), ((use_flashmemory << 8) | strategy), size, keyBlock, 6 * size);
+}
+
+// Sends chunks of keys to device.
+// 0 == ok all keys found
+// 1 ==
+// 2 == Time-out, aborting
+int mfCheckKeys_fast(uint8_t sectorsCnt, uint8_t firstChunk, uint8_t lastChunk, uint8_t strategy,
+                     uint32_t size, uint8_t *keyBlock, sector_t *e_sector, bool use_flashmemory) {
+
+    uint64_t t2 = msclock();
+
+    // send keychunk
+    clearCommandBuffer();
+    chkkeys_fast_send(sectorsCnt, firstChunk, lastChunk, strategy, size, keyBlock, use_flashmemory);
+
+    PacketResponseNG resp;
+    if (chkkeys_fast_wait(&resp) != PM3_SUCCESS)
+        return PM3_ETIMEOUT;
+
     t2 = msclock() - t2;
 
     // time to convert the returned data.
@@ -219,49 +360,93 @@ int mfCheckKeys_fast(uint8_t sectorsCnt, uint8_t firstChunk, uint8_t lastChunk,
 
     PrintAndLogEx(SUCCESS, "\nChunk: %.1fs | found %u/%u keys (%u)", (float)(t2 / 1000.0), curr_keys, (sectorsCnt << 1), size);
 
-    // all keys?
-    if (curr_keys == sectorsCnt * 2 || lastChunk) {
+    chkkeys_fast_merge(&resp, sectorsCnt, e_sector);
 
-        // success array. each byte is status of key
-        uint8_t arr[80];
-        uint64_t foo = 0;
-        uint16_t bar = 0;
-        foo = bytes_to_num(resp.data.asBytes + 480, 8);
-        bar = (resp.data.asBytes[489]  << 8 | resp.data.asBytes[488]);
+    if (curr_keys == sectorsCnt * 2)
+        return PM3_SUCCESS;
 
-        for (uint8_t i = 0; i < 64; i++)
-            arr[i] = (foo >> i) & 0x1;
+    return PM3_ESOFT;
+}
 
-        for (uint8_t i = 0; i < 16; i++)
-            arr[i + 64] = (bar >> i) & 0x1;
+// Fast key check as a stream of chunks. The next chunk is sent before the reply
+// of the current one is in, so it sits in the device's receive buffer while the
+// current one is tried against the card. One stream per strategy, the device
+// drops the field after the last chunk or when its button is pressed.
 
-        // initialize storage for found keys
-        icesector_t *tmp = calloc(sectorsCnt, sizeof(icesector_t));
-        if (tmp == NULL)
-            return PM3_EMALLOC;
+static int chkkeys_fast_stream_wait(chkkeys_fast_stream_t *stream) {
+    PacketResponseNG resp;
+    if (chkkeys_fast_wait(&resp) != PM3_SUCCESS) {
+        stream->status = PM3_ETIMEOUT;
+        stream->in_flight = 0;
+        return PM3_ETIMEOUT;
+    }
+    stream->in_flight--;
 
-        memcpy(tmp, resp.data.asBytes, sectorsCnt * sizeof(icesector_t));
+    // a queued chunk starts when the one before is done
+    uint64_t now = msclock();
+    uint64_t t2 = now - MAX(stream->sent_at[stream->head], stream->last_reply);
+    stream->last_reply = now;
+    uint32_t size = stream->sizes[stream->head];
+    stream->head = (stream->head + 1) % CHKKEYS_FAST_WINDOW;
 
-        for (int i = 0; i < sectorsCnt; i++) {
-            // key A
-            if (!e_sector[i].foundKey[0]) {
-                e_sector[i].Key[0] =  bytes_to_num(tmp[i].keyA, 6);
-                e_sector[i].foundKey[0] = arr[(i * 2) ];
-            }
-            // key B
-            if (!e_sector[i].foundKey[1]) {
-                e_sector[i].Key[1] =  bytes_to_num(tmp[i].keyB, 6);
-                e_sector[i].foundKey[1] = arr[(i * 2) + 1 ];
-            }
-        }
-        free(tmp);
+    // chunks answered after all keys were found carry nothing new
+    if (stream->status != PM3_ESOFT)
+        return stream->status;
 
-        if (curr_keys == sectorsCnt * 2)
-            return PM3_SUCCESS;
-        if (lastChunk)
-            return PM3_ESOFT;
+    uint8_t curr_keys = resp.oldarg[0];
+    PrintAndLogEx(SUCCESS, "\nChunk: %.1fs | found %u/%u keys (%u)", (float)(t2 / 1000.0), curr_keys, (stream->sectorsCnt << 1), size);
+
+    chkkeys_fast_merge(&resp, stream->sectorsCnt, stream->e_sector);
+
+    if (curr_keys == stream->sectorsCnt * 2) {
+        stream->status = PM3_SUCCESS;
+    } else if (resp.oldarg[1]) {
+        PrintAndLogEx(WARNING, "\naborted via button press\n");
+        stream->status = PM3_EOPABORTED;
     }
-    return PM3_ESOFT;
+    return stream->status;
+}
+
+void mfCheckKeys_fast_stream_start(chkkeys_fast_stream_t *stream, uint8_t sectorsCnt, uint8_t strategy, sector_t *e_sector) {
+    memset(stream, 0, sizeof(chkkeys_fast_stream_t));
+    stream->sectorsCnt = sectorsCnt;
+    stream->strategy = strategy;
+    stream->e_sector = e_sector;
+    stream->first = true;
+    stream->status = PM3_ESOFT;
+    clearCommandBuffer();
+}
+
+// PM3_ESOFT while keys are missing, PM3_SUCCESS when all keys are found, PM3_EOPABORTED after the device button
+int mfCheckKeys_fast_stream_add(chkkeys_fast_stream_t *stream, bool lastChunk, uint32_t size, uint8_t *keyBlock) {
+    while (stream->in_flight >= CHKKEYS_FAST_WINDOW && stream->status == PM3_ESOFT)
+        chkkeys_fast_stream_wait(stream);
+
+    if (stream->status != PM3_ESOFT)
+        return stream->status;
+
+    uint8_t tail = (stream->head + stream->in_flight) % CHKKEYS_FAST_WINDOW;
+    stream->sent_at[tail] = msclock();
+    stream->sizes[tail] = size;
+    chkkeys_fast_send(stream->sectorsCnt, stream->first, lastChunk, stream->strategy, size, keyBlock, false);
+    stream->in_flight++;
+    stream->first = false;
+    return stream->status;
+}
+
+// waits for the chunks in flight
+int mfCheckKeys_fast_stream_end(chkkeys_fast_stream_t *stream) {
+    while (stream->in_flight && stream->status != PM3_ETIMEOUT)
+        chkkeys_fast_stream_wait(stream);
+    return stream->status;
+}
+
+// ends the session early with an empty last chunk, so the device drops the field
+int mfCheckKeys_fast_stream_abort(chkkeys_fast_stream_t *stream) {
+    uint8_t none[6] = {0};
+    if (stream->first == false)
+        mfCheckKeys_fast_stream_add(stream, true, 0, none);
+    return mfCheckKeys_fast_stream_end(stream);
 }
 
 // PM3 imp of J-Run mf_key_brute (part 2)
@@ -315,14 +500,14 @@ static int Compare16Bits(const void *a, const void *b) {
     return -1;
 }
 
-// wrapper function for multi-threaded lfsr_recovery32
+// wrapper function for multi-threaded lfsr_recovery32. Reference implementation, only used by mfnested_benchmark()
 static void
 #ifdef __has_attribute
 #if __has_attribute(force_align_arg_pointer)
 __attribute__((force_align_arg_pointer))
 #endif
 #endif
-*nested_worker_thread(void *arg) {
+*nested_worker_thread_qsort(void *arg) {
     struct Crypto1State *p1;
     StateList_t *statelist = arg;
     statelist->head.slhead = lfsr_recovery32(statelist->ks1, statelist->nt ^ statelist->uid);
@@ -336,12 +521,326 @@ __attribute__((force_align_arg_pointer))
     return statelist->head.slhead;
 }
 
-int mfnested(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBlockNo, uint8_t trgKeyType, uint8_t *resultKey, bool calibrate) {
-    uint16_t i;
-    uint32_t uid;
-    StateList_t statelists[2];
+// the candidate keys of both statelists, merged with Compare16Bits and qsort. Reference implementation of nested_intersect()
+static uint32_t nested_intersect_qsort(StateList_t *statelists) {
     struct Crypto1State *p1, *p2, *p3, *p4;
+    pthread_t thread_id[2];
+
+    for (int i = 0; i < 2; i++)
+        pthread_create(thread_id + i, NULL, nested_worker_thread_qsort, &statelists[i]);
+    for (int i = 0; i < 2; i++)
+        pthread_join(thread_id[i], (void *)&statelists[i].head.slhead);
 
+    p1 = p3 = statelists[0].head.slhead;
+    p2 = p4 = statelists[1].head.slhead;
+
+    while (p1 <= statelists[0].tail.sltail && p2 <= statelists[1].tail.sltail) {
+        if (Compare16Bits(p1, p2) == 0) {
+
+            struct Crypto1State savestate;
+            savestate = *p1;
+            while (Compare16Bits(p1, &savestate) == 0 && p1 <= statelists[0].tail.sltail) {
+                *p3 = *p1;
+                lfsr_rollback_word(p3, statelists[0].nt ^ statelists[0].uid, 0);
+                p3++;
+                p1++;
+            }
+            savestate = *p2;
+            while (Compare16Bits(p2, &savestate) == 0 && p2 <= statelists[1].tail.sltail) {
+                *p4 = *p2;
+                lfsr_rollback_word(p4, statelists[1].nt ^ statelists[1].uid, 0);
+                p4++;
+                p2++;
+            }
+        } else {
+            while (Compare16Bits(p1, p2) == -1) p1++;
+            while (Compare16Bits(p1, p2) == 1) p2++;
+        }
+    }
+
+    *(uint64_t *)p3 = -1;
+    *(uint64_t *)p4 = -1;
+    statelists[0].len = p3 - statelists[0].head.slhead;
+    statelists[1].len = p4 - statelists[1].head.slhead;
+
+    qsort(statelists[0].head.keyhead, statelists[0].len, sizeof(uint64_t), compare_uint64);
+    qsort(statelists[1].head.keyhead, statelists[1].len, sizeof(uint64_t), compare_uint64);
+    return intersection(statelists[0].head.keyhead, statelists[1].head.keyhead);
+}
+
+// the same 16 bits of the cryptostate Compare16Bits() looks at
+static inline uint16_t StateBits16(const struct Crypto1State *s) {
+    return ((s->odd >> 16) & 0x00ff) | ((s->even >> 8) & 0xff00);
+}
+
+typedef struct {
+    StateList_t *statelist;
+    uint32_t *buckets;          // [0x10001], start of each 16 bit bucket in the sorted statelist
+    int num_threads;
+} nested_worker_t;
+
+// recover the statelist and counting sort it on the 16 bits, out of place
+static void
+#ifdef __has_attribute
+#if __has_attribute(force_align_arg_pointer)
+__attribute__((force_align_arg_pointer))
+#endif
+#endif
+*nested_worker_thread(void *arg) {
+    nested_worker_t *worker = arg;
+    StateList_t *statelist = worker->statelist;
+    struct Crypto1State *p1, *sorted;
+
+    statelist->head.slhead = lfsr_recovery32_mt(statelist->ks1, statelist->nt ^ statelist->uid, worker->num_threads);
+    if (statelist->head.slhead == NULL)
+        return NULL;
+
+    for (p1 = statelist->head.slhead; p1->odd | p1->even; p1++) {};
+    statelist->len = p1 - statelist->head.slhead;
+
+    // room for the -1 terminator needed by intersection()
+    sorted = calloc(statelist->len + 1, sizeof(struct Crypto1State));
+    uint32_t *pos = calloc(0x10000, sizeof(uint32_t));
+    if (sorted == NULL || pos == NULL) {
+        free(sorted);
+        free(pos);
+        free(statelist->head.slhead);
+        statelist->head.slhead = NULL;
+        return NULL;
+    }
+
+    uint32_t *buckets = worker->buckets;
+    memset(buckets, 0, 0x10001 * sizeof(uint32_t));
+    for (p1 = statelist->head.slhead; p1 < statelist->head.slhead + statelist->len; p1++)
+        buckets[StateBits16(p1) + 1]++;
+    for (uint32_t i = 1; i <= 0x10000; i++)
+        buckets[i] += buckets[i - 1];
+
+    memcpy(pos, buckets, 0x10000 * sizeof(uint32_t));
+    for (p1 = statelist->head.slhead; p1 < statelist->head.slhead + statelist->len; p1++)
+        sorted[pos[StateBits16(p1)]++] = *p1;
+
+    free(pos);
+    free(statelist->head.slhead);
+    statelist->head.slhead = sorted;
+    return sorted;
+}
+
+typedef struct {
+    struct Crypto1State *first;
+    struct Crypto1State *last;
+    uint32_t in;
+} nested_rollback_t;
+
+static void *nested_rollback_thread(void *arg) {
+    nested_rollback_t *rollback = arg;
+    for (struct Crypto1State *p = rollback->first; p < rollback->last; p++)
+        lfsr_rollback_word(p, rollback->in, 0);
+    return NULL;
+}
+
+// roll back both lists on all CPUs, each list is cut into num_threads / 2 slices
+static void nested_rollback(StateList_t *statelists, int num_threads) {
+    int slices = num_threads / 2;
+    if (slices < 1)
+        slices = 1;
+    if (slices > 32)
+        slices = 32;
+
+    pthread_t thread_id[2 * 32];
+    nested_rollback_t rollback[2 * 32];
+    int n = 0;
+    for (int i = 0; i < 2; i++) {
+        uint32_t len = statelists[i].len;
+        for (int j = 0; j < slices; j++, n++) {
+            rollback[n].first = statelists[i].head.slhead + (uint64_t)len * j / slices;
+            rollback[n].last = statelists[i].head.slhead + (uint64_t)len * (j + 1) / slices;
+            rollback[n].in = statelists[i].nt ^ statelists[i].uid;
+        }
+    }
+
+    int started = 0;
+    for (; started < n; started++) {
+        if (pthread_create(&thread_id[started], NULL, nested_rollback_thread, &rollback[started]) != 0)
+            break;
+    }
+    // anything which didn't get a thread is done here
+    for (int i = started; i < n; i++)
+        nested_rollback_thread(&rollback[i]);
+    for (int i = 0; i < started; i++)
+        pthread_join(thread_id[i], NULL);
+}
+
+// the candidate keys of both statelists. Recovers the statelists, intersects them on the
+// first 16 bits of the cryptostate, rolls back the survivors and intersects the rolled back
+// states, on num_threads threads. Returns the number of candidates in statelists[0].head.keyhead,
+// -1 if out of memory.
+static int32_t nested_intersect(StateList_t *statelists, int num_threads) {
+    uint32_t *buckets[2] = {
+        calloc(0x10001, sizeof(uint32_t)),
+        calloc(0x10001, sizeof(uint32_t))
+    };
+    nested_worker_t worker[2];
+    pthread_t thread_id[2];
+    int32_t keycnt = -1;
+
+    statelists[0].head.slhead = statelists[1].head.slhead = NULL;
+    if (buckets[0] == NULL || buckets[1] == NULL)
+        goto out;
+
+    for (int i = 0; i < 2; i++) {
+        worker[i].statelist = &statelists[i];
+        worker[i].buckets = buckets[i];
+        worker[i].num_threads = (num_threads + 1) / 2;
+        pthread_create(thread_id + i, NULL, nested_worker_thread, &worker[i]);
+    }
+    for (int i = 0; i < 2; i++)
+        pthread_join(thread_id[i], NULL);
+
+    if (statelists[0].head.slhead == NULL || statelists[1].head.slhead == NULL)
+        goto out;
+
+    // the first 16 Bits of the cryptostate already contain part of our key.
+    // Keep the buckets which are in both lists.
+    struct Crypto1State *p3 = statelists[0].head.slhead;
+    struct Crypto1State *p4 = statelists[1].head.slhead;
+    for (uint32_t i = 0; i < 0x10000; i++) {
+        uint32_t len0 = buckets[0][i + 1] - buckets[0][i];
+        uint32_t len1 = buckets[1][i + 1] - buckets[1][i];
+        if (len0 == 0 || len1 == 0)
+            continue;
+        memmove(p3, statelists[0].head.slhead + buckets[0][i], len0 * sizeof(struct Crypto1State));
+        memmove(p4, statelists[1].head.slhead + buckets[1][i], len1 * sizeof(struct Crypto1State));
+        p3 += len0;
+        p4 += len1;
+    }
+    statelists[0].len = p3 - statelists[0].head.slhead;
+    statelists[1].len = p4 - statelists[1].head.slhead;
+
+    nested_rollback(statelists, num_threads);
+
+    *(uint64_t *)p3 = -1;
+    *(uint64_t *)p4 = -1;
+
+    // no states in common, no candidates. radixSort() returns NULL for an empty list too,
+    // after this NULL means out of memory
+    if (statelists[0].len == 0 || statelists[1].len == 0) {
+        keycnt = 0;
+        goto out;
+    }
+
+    // the statelists now contain possible keys. The key we are searching for must be in the
+    // intersection of both lists
+    if (radixSort(statelists[0].head.keyhead, statelists[0].len) == NULL
+            || radixSort(statelists[1].head.keyhead, statelists[1].len) == NULL)
+        goto out;
+
+    keycnt = intersection(statelists[0].head.keyhead, statelists[1].head.keyhead);
+
+out:
+    free(buckets[0]);
+    free(buckets[1]);
+    return keycnt;
+}
+
+static bool nested_has_key(StateList_t *statelist, uint32_t keycnt, uint64_t key) {
+    for (uint32_t i = 0; i < keycnt; i++) {
+        uint64_t key64;
+        crypto1_get_lfsr(statelist->head.slhead + i, &key64);
+        if (key64 == key)
+            return true;
+    }
+    return false;
+}
+
+// candidates checked by mfnested() and the time from the nonces to the end of the key check
+static struct {
+    uint64_t candidates;
+    uint64_t ms;
+} nested_stats;
+
+void mfnested_reset_stats(void) {
+    memset(&nested_stats, 0, sizeof(nested_stats));
+}
+
+void mfnested_print_stats(void) {
+    if (nested_stats.ms == 0)
+        return;
+    PrintAndLogEx(SUCCESS, "checked %" PRIu64 " candidate keys in %.1f seconds, %.0f candidates/s",
+                  nested_stats.candidates, nested_stats.ms / 1000.0, nested_stats.candidates * 1000.0 / nested_stats.ms);
+}
+
+// host side of mfnested() with simulated nonces, the qsort merge against nested_intersect()
+int mfnested_benchmark(uint32_t iterations) {
+    uint64_t ms_qsort = 0, ms_radix = 0, candidates = 0;
+    uint32_t errors = 0;
+
+    PrintAndLogEx(INFO, "Benchmarking the host side of the nested attack, %u random keys, %d CPUs", iterations, num_CPUs());
+
+    srand(msclock());
+    for (uint32_t n = 0; n < iterations; n++) {
+        uint64_t key = ((uint64_t)rand() << 32 ^ (uint64_t)rand() << 16 ^ rand()) & 0xffffffffffff;
+        StateList_t statelists[2][2];
+        uint32_t uid = rand() << 16 ^ rand();
+        for (int i = 0; i < 2; i++) {
+            struct Crypto1State *pcs = crypto1_create(key);
+            uint32_t nt = rand() << 16 ^ rand();
+            statelists[0][i].uid = statelists[1][i].uid = uid;
+            statelists[0][i].nt = statelists[1][i].nt = nt;
+            statelists[0][i].ks1 = statelists[1][i].ks1 = crypto1_word(pcs, nt ^ uid, 0);
+            crypto1_destroy(pcs);
+        }
+
+        uint64_t t1 = msclock();
+        uint32_t keycnt_qsort = nested_intersect_qsort(statelists[0]);
+        ms_qsort += msclock() - t1;
+
+        t1 = msclock();
+        int32_t keycnt = nested_intersect(statelists[1], num_CPUs());
+        ms_radix += msclock() - t1;
+
+        if (keycnt < 0) {
+            PrintAndLogEx(ERR, "Out of memory");
+            free(statelists[0][0].head.slhead);
+            free(statelists[0][1].head.slhead);
+            return PM3_EMALLOC;
+        }
+
+        if ((uint32_t)keycnt != keycnt_qsort || !nested_has_key(&statelists[0][0], keycnt_qsort, key) || !nested_has_key(&statelists[1][0], keycnt, key)) {
+            PrintAndLogEx(FAILED, "key [%012" PRIx64 "] - qsort %u, radix %d candidates", key, keycnt_qsort, keycnt);
+            errors++;
+        }
+        candidates += keycnt;
+
+        for (int i = 0; i < 2; i++) {
+            free(statelists[0][i].head.slhead);
+            free(statelists[1][i].head.slhead);
+        }
+    }
+
+    if (iterations == 0)
+        return PM3_SUCCESS;
+
+    PrintAndLogEx(NORMAL, "");
+    PrintAndLogEx(NORMAL, "  intersection   ms/key   speedup");
+    PrintAndLogEx(NORMAL, "  -------------+--------+--------");
+    PrintAndLogEx(NORMAL, "  qsort        | %6.1f |", (double)ms_qsort / iterations);
+    PrintAndLogEx(NORMAL, "  radix        | %6.1f | %5.2fx", (double)ms_radix / iterations, ms_radix ? (double)ms_qsort / ms_radix : 0.0);
+    PrintAndLogEx(NORMAL, "");
+    PrintAndLogEx(INFO, "%.1f candidate keys per nested key on average", (double)candidates / iterations);
+    if (errors) {
+        PrintAndLogEx(FAILED, "%u of %u keys failed", errors, iterations);
+        return PM3_ESOFT;
+    }
+    return PM3_SUCCESS;
+}
+
+// The nested attack in three steps: the nonces of the target block from the device,
+// the candidate keys on the host and the candidates checked on the device.
+// mfnested() runs them in a row, autopwn overlaps the steps of several targets.
+
+// nonces of the target block, statelists[2] are ready for mfnested_recover()
+int mfnested_acquire(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBlockNo, uint8_t trgKeyType, bool calibrate, StateList_t *statelists) {
     struct {
         uint8_t block;
         uint8_t keytype;
@@ -381,12 +880,14 @@ int mfnested(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBlockNo,
     // error during nested
     if (package->isOK) return package->isOK;
 
+    uint32_t uid;
     memcpy(&uid, package->cuid, sizeof(package->cuid));
 
-    for (i = 0; i < 2; i++) {
+    for (int i = 0; i < 2; i++) {
         statelists[i].blockNo = package->block;
         statelists[i].keyType = package->keytype;
         statelists[i].uid = uid;
+        statelists[i].head.slhead = NULL;
     }
 
     memcpy(&statelists[0].nt,  package->nt_a, sizeof(package->nt_a));
@@ -394,108 +895,99 @@ int mfnested(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBlockNo,
 
     memcpy(&statelists[1].nt,  package->nt_b, sizeof(package->nt_b));
     memcpy(&statelists[1].ks1, package->ks_b, sizeof(package->ks_b));
+    return PM3_SUCCESS;
+}
 
+// candidate keys of the nonces on num_threads threads, host only and safe to run in threads.
+// Returns their number, -1 if out of memory. Free with mfnested_free().
+int32_t mfnested_recover(StateList_t *statelists, int num_threads) {
+    return nested_intersect(statelists, num_threads);
+}
 
-    // calc keys
-    pthread_t thread_id[2];
-
-    // create and run worker threads
-    for (i = 0; i < 2; i++)
-        pthread_create(thread_id + i, NULL, nested_worker_thread, &statelists[i]);
-
-    // wait for threads to terminate:
-    for (i = 0; i < 2; i++)
-        pthread_join(thread_id[i], (void *)&statelists[i].head.slhead);
-
-    // the first 16 Bits of the cryptostate already contain part of our key.
-    // Create the intersection of the two lists based on these 16 Bits and
-    // roll back the cryptostate
-    p1 = p3 = statelists[0].head.slhead;
-    p2 = p4 = statelists[1].head.slhead;
-
-    while (p1 <= statelists[0].tail.sltail && p2 <= statelists[1].tail.sltail) {
-        if (Compare16Bits(p1, p2) == 0) {
-
-            struct Crypto1State savestate;
-            savestate = *p1;
-            while (Compare16Bits(p1, &savestate) == 0 && p1 <= statelists[0].tail.sltail) {
-                *p3 = *p1;
-                lfsr_rollback_word(p3, statelists[0].nt ^ statelists[0].uid, 0);
-                p3++;
-                p1++;
-            }
-            savestate = *p2;
-            while (Compare16Bits(p2, &savestate) == 0 && p2 <= statelists[1].tail.sltail) {
-                *p4 = *p2;
-                lfsr_rollback_word(p4, statelists[1].nt ^ statelists[1].uid, 0);
-                p4++;
-                p2++;
-            }
-        } else {
-            while (Compare16Bits(p1, p2) == -1) p1++;
-            while (Compare16Bits(p1, p2) == 1) p2++;
-        }
-    }
-
-    *(uint64_t *)p3 = -1;
-    *(uint64_t *)p4 = -1;
-    statelists[0].len = p3 - statelists[0].head.slhead;
-    statelists[1].len = p4 - statelists[1].head.slhead;
-    statelists[0].tail.sltail = --p3;
-    statelists[1].tail.sltail = --p4;
-
-    // the statelists now contain possible keys. The key we are searching for must be in the
-    // intersection of both lists
-    qsort(statelists[0].head.keyhead, statelists[0].len, sizeof(uint64_t), compare_uint64);
-    qsort(statelists[1].head.keyhead, statelists[1].len, sizeof(uint64_t), compare_uint64);
-    // Create the intersection
-    statelists[0].len = intersection(statelists[0].head.keyhead, statelists[1].head.keyhead);
-
-    //statelists[0].tail.keytail = --p7;
-    uint32_t keycnt = statelists[0].len;
-    if (keycnt == 0) goto out;
+void mfnested_free(StateList_t *statelists) {
+    free(statelists[0].head.slhead);
+    free(statelists[1].head.slhead);
+    statelists[0].head.slhead = statelists[1].head.slhead = NULL;
+}
 
+// streams the candidates to a started key check, -5 with the key in resultKey, -4 if none fits
+static int nested_check(chkkeys_stream_t *stream, StateList_t *statelists, uint32_t keycnt, uint8_t *resultKey) {
     memset(resultKey, 0, 6);
     uint64_t key64 = -1;
 
-    // The list may still contain several key candidates. Test each of them with mfCheckKeys
-    uint32_t max_keys = keycnt > KEYS_IN_BLOCK ? KEYS_IN_BLOCK : keycnt;
+    // The list may still contain several key candidates. Stream them to the device
     uint8_t keyBlock[PM3_CMD_DATA_SIZE] = {0x00};
 
-    for (i = 0; i < keycnt; i += max_keys) {
+    for (uint32_t i = 0; i < keycnt && !stream->found; i += KEYS_IN_BLOCK) {
 
-        int size = keycnt - i > max_keys ? max_keys : keycnt - i;
+        int size = keycnt - i > KEYS_IN_BLOCK ? KEYS_IN_BLOCK : keycnt - i;
 
         for (int j = 0; j < size; j++) {
-            crypto1_get_lfsr(statelists[0].head.slhead + i, &key64);
-            num_to_bytes(key64, 6, keyBlock + i * 6);
+            crypto1_get_lfsr(statelists[0].head.slhead + i + j, &key64);
+            num_to_bytes(key64, 6, keyBlock + j * 6);
         }
 
-        if (mfCheckKeys(statelists[0].blockNo, statelists[0].keyType, false, size, keyBlock, &key64) == PM3_SUCCESS) {
-            free(statelists[0].head.slhead);
-            free(statelists[1].head.slhead);
-            num_to_bytes(key64, 6, resultKey);
-
-            PrintAndLogEx(SUCCESS, "target block:%3u key type: %c  -- found valid key [%012" PRIx64 "]",
-                          (uint16_t)resp.oldarg[2] & 0xff,
-                          (resp.oldarg[2] >> 8) ? 'B' : 'A',
-                          key64
-                         );
-            return -5;
-        }
+        if (mfCheckKeys_stream_add(stream, size, keyBlock) != PM3_SUCCESS)
+            break;
+    }
+
+    int found = mfCheckKeys_stream_end(stream);
+    nested_stats.candidates += stream->checked;
+    PrintAndLogEx(DEBUG, "%u candidates, %u checked", keycnt, stream->checked);
+
+    if (found == PM3_SUCCESS) {
+        num_to_bytes(stream->key, 6, resultKey);
+        PrintAndLogEx(SUCCESS, "target block:%3u key type: %c  -- found valid key [%012" PRIx64 "]",
+                      statelists[0].blockNo,
+                      statelists[0].keyType ? 'B' : 'A',
+                      stream->key
+                     );
+        return -5;
     }
 
-out:
     PrintAndLogEx(SUCCESS, "target block:%3u key type: %c",
-                  (uint16_t)resp.oldarg[2] & 0xff,
-                  (resp.oldarg[2] >> 8) ? 'B' : 'A'
+                  statelists[0].blockNo,
+                  statelists[0].keyType ? 'B' : 'A'
                  );
-
-    free(statelists[0].head.slhead);
-    free(statelists[1].head.slhead);
     return -4;
 }
 
+// candidates of mfnested_recover() checked on the device
+int mfnested_check(StateList_t *statelists, uint32_t keycnt, uint8_t *resultKey) {
+    uint64_t t1 = msclock();
+    chkkeys_stream_t stream;
+    mfCheckKeys_stream_start(&stream, statelists[0].blockNo, statelists[0].keyType, false);
+    int res = nested_check(&stream, statelists, keycnt, resultKey);
+    nested_stats.ms += msclock() - t1;
+    return res;
+}
+
+int mfnested(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBlockNo, uint8_t trgKeyType, uint8_t *resultKey, bool calibrate) {
+    StateList_t statelists[2];
+
+    int res = mfnested_acquire(blockNo, keyType, key, trgBlockNo, trgKeyType, calibrate, statelists);
+    if (res != PM3_SUCCESS)
+        return res;
+
+    // the device switches on the field and selects the card while the host recovers the keys
+    uint64_t t1 = msclock();
+    chkkeys_stream_t stream;
+    mfCheckKeys_stream_start(&stream, statelists[0].blockNo, statelists[0].keyType, false);
+
+    // calc keys
+    int32_t keycnt = nested_intersect(statelists, num_CPUs());
+    if (keycnt < 0) {
+        mfCheckKeys_stream_end(&stream);
+        mfnested_free(statelists);
+        return PM3_EMALLOC;
+    }
+
+    res = nested_check(&stream, statelists, keycnt, resultKey);
+    nested_stats.ms += msclock() - t1;
+    mfnested_free(statelists);
+    return res;
+}
+
 // MIFARE
 int mfReadSector(uint8_t sectorNo, uint8_t keyType, uint8_t *key, uint8_t *data) {
 
@@ -54,6 +54,34 @@ typedef struct {
     //uint8_t foundKey[2];
 } icesector_t;
 
+// host side of CMD_HF_MIFARE_CHKKEYS_STREAM
+typedef struct {
+    uint8_t blockNo;
+    uint8_t keyType;
+    uint32_t in_flight;     // packets sent and not answered yet
+    uint32_t checked;       // keys checked on the device
+    bool found;
+    uint64_t key;
+    int status;
+    bool fallback;          // the device can't stream, one CMD_HF_MIFARE_CHKKEYS per packet
+    bool clear_trace;       // for the first of them
+} chkkeys_stream_t;
+
+// host side of the CMD_HF_MIFARE_CHKKEYS_FAST chunk pipeline
+#define CHKKEYS_FAST_WINDOW     2
+typedef struct {
+    uint8_t sectorsCnt;
+    uint8_t strategy;
+    sector_t *e_sector;
+    bool first;
+    uint8_t head;           // oldest chunk in flight
+    uint8_t in_flight;      // chunks sent and not answered yet
+    uint64_t sent_at[CHKKEYS_FAST_WINDOW];
+    uint64_t last_reply;
+    uint32_t sizes[CHKKEYS_FAST_WINDOW];
+    int status;
+} chkkeys_fast_stream_t;
+
 extern char logHexFileName[FILE_PATH_SIZE];
 #define KEYS_IN_BLOCK   ((PM3_CMD_DATA_SIZE - 4) / 6)
 #define KEYBLOCK_SIZE   (KEYS_IN_BLOCK * 6)
@@ -61,9 +89,23 @@ extern char logHexFileName[FILE_PATH_SIZE];
 
 int mfDarkside(uint8_t blockno, uint8_t key_type, uint64_t *key);
 int mfnested(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBlockNo, uint8_t trgKeyType, uint8_t *resultKey, bool calibrate);
+int mfnested_acquire(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBlockNo, uint8_t trgKeyType, bool calibrate, StateList_t *statelists);
+int32_t mfnested_recover(StateList_t *statelists, int num_threads);
+int mfnested_check(StateList_t *statelists, uint32_t keycnt, uint8_t *resultKey);
+void mfnested_free(StateList_t *statelists);
+int mfnested_benchmark(uint32_t iterations);
+void mfnested_reset_stats(void);
+void mfnested_print_stats(void);
 int mfCheckKeys(uint8_t blockNo, uint8_t keyType, bool clear_trace, uint8_t keycnt, uint8_t *keyBlock, uint64_t *key);
+int mfCheckKeys_stream_start(chkkeys_stream_t *stream, uint8_t blockNo, uint8_t keyType, bool clear_trace);
+int mfCheckKeys_stream_add(chkkeys_stream_t *stream, uint8_t keycnt, uint8_t *keyBlock);
+int mfCheckKeys_stream_end(chkkeys_stream_t *stream);
 int mfCheckKeys_fast(uint8_t sectorsCnt, uint8_t firstChunk, uint8_t lastChunk,
                      uint8_t strategy, uint32_t size, uint8_t *keyBlock, sector_t *e_sector, bool use_flashmemory);
+void mfCheckKeys_fast_stream_start(chkkeys_fast_stream_t *stream, uint8_t sectorsCnt, uint8_t strategy, sector_t *e_sector);
+int mfCheckKeys_fast_stream_add(chkkeys_fast_stream_t *stream, bool lastChunk, uint32_t size, uint8_t *keyBlock);
+int mfCheckKeys_fast_stream_end(chkkeys_fast_stream_t *stream);
+int mfCheckKeys_fast_stream_abort(chkkeys_fast_stream_t *stream);
 int mfKeyBrute(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint64_t *resultkey);
 
 int mfReadSector(uint8_t sectorNo, uint8_t keyType, uint8_t *key, uint8_t *data);
@@ -207,7 +207,7 @@ check_script:
                 } else {
                     rl_event_hook = check_comm;
                     if (session.pm3_present) {
-                        if (conn.send_via_fpc_usart == false)
+                        if (GetCommunicationArg()->send_via_fpc_usart == false)
                             prompt = PROXPROMPT_USB;
                         else
                             prompt = PROXPROMPT_FPC;
@@ -418,7 +418,7 @@ static int flash_pm3(char *serial_port_name, uint8_t num_files, char *filenames[
         PrintAndLogEx(SUCCESS, "    %s", filepaths[i]);
     }
 
-    if (OpenProxmark(serial_port_name, true, 60, true, FLASHMODE_SPEED)) {
+    if (OpenProxmark(serial_port_name, true, 60, FLASHMODE_SPEED)) {
         PrintAndLogEx(NORMAL, _GREEN_("Found"));
     } else {
         PrintAndLogEx(ERR, "Could not find Proxmark3 on " _RED_("%s") ".\n", serial_port_name);
@@ -795,7 +795,7 @@ int main(int argc, char *argv[]) {
 
     // try to open USB connection to Proxmark
     if (port != NULL) {
-        OpenProxmark(port, waitCOMPort, 20, false, speed);
+        OpenProxmark(port, waitCOMPort, 20, speed);
     }
 
     if (session.pm3_present && (TestProxmark() != PM3_SUCCESS)) {
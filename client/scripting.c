@@ -33,6 +33,7 @@
 #include "protocols.h"
 #include "fileutils.h"    // searchfile
 #include "cmdlf.h"        // lf_config
+#include "usart_defs.h"   // USART_BAUD_RATE
 
 static int returnToLuaWithError(lua_State *L, const char *fmt, ...) {
     char buffer[200];
@@ -51,36 +52,6 @@ static int l_clearCommandBuffer(lua_State *L) {
     return 0;
 }
 
-/**
- * Enable / Disable fast push mode for lua scripts like mfckeys
- * The following params expected:
- *
- *@brief l_fast_push_mode
- * @param L
- * @return
- */
-static int l_fast_push_mode(lua_State *L) {
-
-    luaL_checktype(L, 1, LUA_TBOOLEAN);
-
-    bool enable = lua_toboolean(L, 1);
-
-    conn.block_after_ACK = enable;
-
-    // Disable fast mode and send a dummy command to make it effective
-    if (enable == false) {
-        SendCommandNG(CMD_PING, NULL, 0);
-        if (!WaitForResponseTimeout(CMD_PING, NULL, 1000)) {
-            PrintAndLogEx(WARNING, "command execution time out");
-            return returnToLuaWithError(L, "command execution time out");
-        }
-    }
-
-    //Push the retval on the stack
-    lua_pushboolean(L, enable);
-    return 1;
-}
-
 /**
  * The following params expected:
  * @brief l_SendCommandOLD
@@ -826,7 +797,7 @@ static int l_hardnested(lua_State *L) {
     }
 
     uint64_t foundkey = 0;
-    int retval = mfnestedhard(blockNo, keyType, key, trgBlockNo, trgKeyType, haveTarget ? trgkey : NULL, nonce_file_read,  nonce_file_write,  slow,  tests, &foundkey, filename);
+    int retval = mfnestedhard(blockNo, keyType, key, trgBlockNo, trgKeyType, haveTarget ? trgkey : NULL, nonce_file_read,  nonce_file_write,  slow, false, NULL, tests, &foundkey, filename);
     DropField();
 
     //Push the key onto the stack
@@ -1098,6 +1069,91 @@ static int l_searchfile(lua_State *L) {
     return 1;
 }
 
+// Additional Proxmark3s opened by scripts, the id of a device is its index + 1, 0 is the main device
+#define MAX_LUA_DEVICES 16
+static struct {
+    pm3_device_t *dev;
+    lua_State *owner;
+} lua_devices[MAX_LUA_DEVICES];
+
+static pm3_device_t *lua_device_by_id(lua_State *L, int arg) {
+    lua_Integer id = luaL_checkinteger(L, arg);
+    if (id == 0)
+        return NULL;
+    if (id < 0 || id > MAX_LUA_DEVICES || lua_devices[id - 1].dev == NULL) {
+        luaL_error(L, "no device with id %d", (int)id);
+        return NULL;
+    }
+    return lua_devices[id - 1].dev;
+}
+
+static int lua_device_id(pm3_device_t *dev) {
+    for (int i = 0; i < MAX_LUA_DEVICES; i++)
+        if (lua_devices[i].dev == dev)
+            return i + 1;
+    return 0;
+}
+
+/**
+ * @brief l_open_device opens another Proxmark3, which gets its own communication threads
+ * @param port   serial port name, e.g. "/dev/ttyACM1" or "tcp:localhost:4321"
+ * @param speed  (optional) baudrate, defaults to USART_BAUD_RATE
+ * @return device id to pass to select_device, or nil and error message
+ */
+static int l_open_device(lua_State *L) {
+    size_t size;
+    const char *port = luaL_checklstring(L, 1, &size);
+    uint32_t speed = luaL_optinteger(L, 2, USART_BAUD_RATE);
+
+    int slot = lua_device_id(NULL) - 1;
+    if (slot < 0)
+        return returnToLuaWithError(L, "Too many devices, max %d", MAX_LUA_DEVICES);
+
+    pm3_device_t *dev = OpenProxmarkDevice(port, speed);
+    if (dev == NULL)
+        return returnToLuaWithError(L, "Can't open Proxmark3 on %s", port);
+
+    lua_devices[slot].dev = dev;
+    lua_devices[slot].owner = L;
+    lua_pushinteger(L, slot + 1);
+    return 1;
+}
+
+/**
+ * @brief l_select_device makes the script talk to another device, all core functions and
+ * console commands use it until the next select_device. 0 selects the main device again
+ * @return id of the previously selected device
+ */
+static int l_select_device(lua_State *L) {
+    pm3_device_t *dev = lua_device_by_id(L, 1);
+    pm3_device_t *prev = SetCurrentDevice(dev);
+    lua_pushinteger(L, lua_device_id(prev));
+    return 1;
+}
+
+static int l_close_device(lua_State *L) {
+    pm3_device_t *dev = lua_device_by_id(L, 1);
+    if (dev == NULL)
+        return returnToLuaWithError(L, "The main device can't be closed");
+
+    int id = lua_device_id(dev);
+    CloseProxmarkDevice(dev);
+    lua_devices[id - 1].dev = NULL;
+    lua_devices[id - 1].owner = NULL;
+    return 0;
+}
+
+// closes the devices a script left open, they don't outlive its lua_State
+void close_pm3_devices(lua_State *L) {
+    for (int i = 0; i < MAX_LUA_DEVICES; i++) {
+        if (lua_devices[i].dev == NULL || lua_devices[i].owner != L)
+            continue;
+        CloseProxmarkDevice(lua_devices[i].dev);
+        lua_devices[i].dev = NULL;
+        lua_devices[i].owner = NULL;
+    }
+}
+
 /**
  * @brief Sets the lua path to include "./lualibs/?.lua", in order for a script to be
  * able to do "require('foobar')" if foobar.lua is within lualibs folder.
@@ -1156,9 +1212,11 @@ int set_pm3_libraries(lua_State *L) {
         {"t55xx_readblock",             l_T55xx_readblock},
         {"t55xx_detect",                l_T55xx_detect},
         {"ndefparse",                   l_ndefparse},
-        {"fast_push_mode",              l_fast_push_mode},
         {"search_file",                 l_searchfile},
         {"rem",                         l_remark},
+        {"open_device",                 l_open_device},
+        {"select_device",               l_select_device},
+        {"close_device",                l_close_device},
         {NULL, NULL}
     };
 
@@ -24,4 +24,11 @@
 
 int set_pm3_libraries(lua_State *L);
 
+/**
+ * @brief close_pm3_devices closes the devices opened with core.open_device
+ *  from the given lua_State
+ * @param L
+ */
+void close_pm3_devices(lua_State *L);
+
 #endif
@@ -60,7 +60,8 @@ serial_port uart_open(const char *pcPortName, uint32_t speed);
  */
 void uart_close(const serial_port sp);
 
-/* Reads from the given serial port for up to 30ms.
+/* Reads from the given serial port for up to 30ms. The posix version reads as much as
+ * is available into a buffer and hands it out over the next calls.
  *   pbtRx: A pointer to a buffer for the returned data to be written to.
  *   pszMaxRxLen: The maximum data size we want to be sent.
  *   pszRxLen: The number of bytes that we were actually sent.
@@ -73,6 +74,10 @@ void uart_close(const serial_port sp);
  */
 int uart_receive(const serial_port sp, uint8_t *pbtRx, uint32_t pszMaxRxLen, uint32_t *pszRxLen);
 
+/* Number of read system calls and bytes read since the port was opened.
+ */
+void uart_get_stats(const serial_port sp, uint64_t *reads, uint64_t *bytes);
+
 /* Sends a buffer to a given serial port.
  *   pbtTx: A pointer to a buffer containing the data to send.
  *   len: The amount of data to be sent.
@@ -46,6 +46,7 @@
 #include <sys/ioctl.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
 #include <netinet/tcp.h>
 #include <netdb.h>
 
@@ -57,10 +58,18 @@
 #endif
 
 typedef struct termios term_info;
+// large reads, a BigBuf download comes in a few system calls instead of three per frame
+#define UART_RX_BUFFER_SIZE (64 * 1024)
+
 typedef struct {
     int fd;           // Serial port file descriptor
     term_info tiOld;  // Terminal info before using the port
     term_info tiNew;  // Terminal info during the transaction
+    uint8_t rxbuf[UART_RX_BUFFER_SIZE];   // bytes read from fd, not yet handed out
+    uint32_t rxpos;   // first byte not handed out
+    uint32_t rxend;   // end of the bytes read
+    uint64_t reads;   // read() calls
+    uint64_t bytes;   // bytes read
 } serial_port_unix;
 
 // see pm3_cmd.h
@@ -216,7 +225,7 @@ serial_port uart_open(const char *pcPortName, uint32_t speed) {
             return INVALID_SERIAL_PORT;
         }
     }
-    conn.uart_speed = uart_get_speed(sp);
+    GetCommunicationArg()->uart_speed = uart_get_speed(sp);
     return sp;
 }
 
@@ -242,7 +251,7 @@ void uart_close(const serial_port sp) {
 }
 
 int uart_receive(const serial_port sp, uint8_t *pbtRx, uint32_t pszMaxRxLen, uint32_t *pszRxLen) {
-    uint32_t byteCount;  // FIONREAD returns size on 32b
+    serial_port_unix *spu = (serial_port_unix *)sp;
     fd_set rfds;
     struct timeval tv;
 
@@ -252,12 +261,26 @@ int uart_receive(const serial_port sp, uint8_t *pbtRx, uint32_t pszMaxRxLen, uin
     }
     // Reset the output count
     *pszRxLen = 0;
-    do {
+    while (true) {
+        // Hand out what is buffered
+        uint32_t n = MIN(spu->rxend - spu->rxpos, pszMaxRxLen - *pszRxLen);
+        memcpy(pbtRx + *pszRxLen, spu->rxbuf + spu->rxpos, n);
+        spu->rxpos += n;
+        *pszRxLen += n;
+
+        if (*pszRxLen == pszMaxRxLen) {
+            // We have all the data we wanted.
+            return PM3_SUCCESS;
+        }
+
+        // The buffer is empty, wait for more
+        spu->rxpos = spu->rxend = 0;
+
         // Reset file descriptor
         FD_ZERO(&rfds);
-        FD_SET(((serial_port_unix *)sp)->fd, &rfds);
+        FD_SET(spu->fd, &rfds);
         tv = timeout;
-        int res = select(((serial_port_unix *)sp)->fd + 1, &rfds, NULL, NULL, &tv);
+        int res = select(spu->fd + 1, &rfds, NULL, NULL, &tv);
 
         // Read error
         if (res < 0) {
@@ -275,34 +298,27 @@ int uart_receive(const serial_port sp, uint8_t *pbtRx, uint32_t pszMaxRxLen, uin
             }
         }
 
-        // Retrieve the count of the incoming bytes
-        res = ioctl(((serial_port_unix *)sp)->fd, FIONREAD, &byteCount);
-//        printf("UART:: RX ioctl res %d byteCount %u\n", res, byteCount);
-        if (res < 0) return PM3_ENOTTY;
-
-        // Cap the number of bytes, so we don't overrun the buffer
-        if (pszMaxRxLen - (*pszRxLen) < byteCount) {
-//            printf("UART:: RX prevent overrun (have %u, need %u)\n", pszMaxRxLen - (*pszRxLen), byteCount);
-            byteCount = pszMaxRxLen - (*pszRxLen);
-        }
-
-        // There is something available, read the data
-        res = read(((serial_port_unix *)sp)->fd, pbtRx + (*pszRxLen), byteCount);
+        // There is something available, read as much as the buffer takes
+        res = read(spu->fd, spu->rxbuf, sizeof(spu->rxbuf));
 
         // Stop if the OS has some troubles reading the data
+        if (res < 0 && (errno == EINTR || errno == EAGAIN))
+            return (*pszRxLen == 0) ? PM3_ENODATA : PM3_SUCCESS;
+
+        // readable but nothing to read or an error, the device is gone
         if (res <= 0) {
-            return PM3_EIO;
+            return PM3_ENOTTY;
         }
 
-        *pszRxLen += res;
-
-        if (*pszRxLen == pszMaxRxLen) {
-            // We have all the data we wanted.
-            return PM3_SUCCESS;
-        }
-    } while (byteCount);
+        spu->rxend = res;
+        spu->reads++;
+        spu->bytes += res;
+    }
+}
 
-    return PM3_SUCCESS;
+void uart_get_stats(const serial_port sp, uint64_t *reads, uint64_t *bytes) {
+    *reads = ((serial_port_unix *)sp)->reads;
+    *bytes = ((serial_port_unix *)sp)->bytes;
 }
 
 int uart_send(const serial_port sp, const uint8_t *pbtTx, const uint32_t len) {
@@ -434,7 +450,7 @@ bool uart_set_speed(serial_port sp, const uint32_t uiPortSpeed) {
     cfsetospeed(&ti, stPortSpeed);
     bool result = tcsetattr(spu->fd, TCSANOW, &ti) != -1;
     if (result)
-        conn.uart_speed = uiPortSpeed;
+        GetCommunicationArg()->uart_speed = uiPortSpeed;
     return result;
 }
 
@@ -52,6 +52,10 @@ typedef struct {
     HANDLE hPort;     // Serial port handle
     DCB dcb;          // Device control settings
     COMMTIMEOUTS ct;  // Serial port time-out configuration
+    OVERLAPPED rx;    // the port is opened overlapped, so the sender thread can write
+    OVERLAPPED tx;    // while the receiver thread waits in ReadFile()
+    uint64_t reads;   // ReadFile() calls
+    uint64_t bytes;   // bytes read
 } serial_port_windows;
 
 uint32_t newtimeout_value = 0;
@@ -98,13 +102,22 @@ serial_port uart_open(const char *pcPortName, uint32_t speed) {
     _strupr(acPortName);
 
     // Try to open the serial port
-    // r/w,  none-share comport, no security, existing, no overlapping, no templates
-    sp->hPort = CreateFileA(acPortName, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+    // r/w,  none-share comport, no security, existing, overlapping, no templates
+    sp->hPort = CreateFileA(acPortName, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_FLAG_OVERLAPPED, NULL);
     if (sp->hPort == INVALID_HANDLE_VALUE) {
         uart_close(sp);
         return INVALID_SERIAL_PORT;
     }
 
+    // manual reset events, one per direction
+    sp->rx.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    sp->tx.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (sp->rx.hEvent == NULL || sp->tx.hEvent == NULL) {
+        uart_close(sp);
+        printf("[!] UART error while creating events\n");
+        return INVALID_SERIAL_PORT;
+    }
+
     // Prepare the device control
     // doesn't matter since PM3 device ignors this CDC command:  set_line_coding in usb_cdc.c
     memset(&sp->dcb, 0, sizeof(DCB));
@@ -134,16 +147,28 @@ serial_port uart_open(const char *pcPortName, uint32_t speed) {
             return INVALID_SERIAL_PORT;
         }
     }
-    conn.uart_speed = uart_get_speed(sp);
+    GetCommunicationArg()->uart_speed = uart_get_speed(sp);
     return sp;
 }
 
 void uart_close(const serial_port sp) {
-    if (((serial_port_windows *)sp)->hPort != INVALID_HANDLE_VALUE)
-        CloseHandle(((serial_port_windows *)sp)->hPort);
+    serial_port_windows *spw = (serial_port_windows *)sp;
+    if (spw->hPort != INVALID_HANDLE_VALUE)
+        CloseHandle(spw->hPort);
+    if (spw->rx.hEvent != NULL)
+        CloseHandle(spw->rx.hEvent);
+    if (spw->tx.hEvent != NULL)
+        CloseHandle(spw->tx.hEvent);
     free(sp);
 }
 
+// waits for the overlapped ReadFile()/WriteFile() just started, the COMMTIMEOUTS still apply
+static bool uart_overlapped_result(HANDLE hPort, OVERLAPPED *ov, BOOL res, DWORD *len) {
+    if (res == 0 && GetLastError() != ERROR_IO_PENDING)
+        return false;
+    return GetOverlappedResult(hPort, ov, len, TRUE);
+}
+
 bool uart_set_speed(serial_port sp, const uint32_t uiPortSpeed) {
     serial_port_windows *spw;
 
@@ -168,7 +193,7 @@ bool uart_set_speed(serial_port sp, const uint32_t uiPortSpeed) {
     bool result = SetCommState(spw->hPort, &spw->dcb);
     PurgeComm(spw->hPort, PURGE_RXABORT | PURGE_RXCLEAR);
     if (result)
-        conn.uart_speed = uiPortSpeed;
+        GetCommunicationArg()->uart_speed = uiPortSpeed;
 
     return result;
 }
@@ -182,10 +207,18 @@ uint32_t uart_get_speed(const serial_port sp) {
 }
 
 int uart_receive(const serial_port sp, uint8_t *pbtRx, uint32_t pszMaxRxLen, uint32_t *pszRxLen) {
+    serial_port_windows *spw = (serial_port_windows *)sp;
     uart_reconfigure_timeouts_polling(sp);
-    int res = ReadFile(((serial_port_windows *)sp)->hPort, pbtRx, pszMaxRxLen, (LPDWORD)pszRxLen, NULL);
-    if (res)
+    DWORD rxlen = 0;
+    ResetEvent(spw->rx.hEvent);
+    BOOL res = ReadFile(spw->hPort, pbtRx, pszMaxRxLen, NULL, &spw->rx);
+    res = uart_overlapped_result(spw->hPort, &spw->rx, res, &rxlen);
+    *pszRxLen = rxlen;
+    spw->reads++;
+    if (res) {
+        spw->bytes += rxlen;
         return PM3_SUCCESS;
+    }
 
     int errorcode = GetLastError();
 
@@ -196,9 +229,17 @@ int uart_receive(const serial_port sp, uint8_t *pbtRx, uint32_t pszMaxRxLen, uin
     return PM3_ENOTTY;
 }
 
+void uart_get_stats(const serial_port sp, uint64_t *reads, uint64_t *bytes) {
+    *reads = ((serial_port_windows *)sp)->reads;
+    *bytes = ((serial_port_windows *)sp)->bytes;
+}
+
 int uart_send(const serial_port sp, const uint8_t *p_tx, const uint32_t len) {
+    serial_port_windows *spw = (serial_port_windows *)sp;
     DWORD txlen = 0;
-    int res = WriteFile(((serial_port_windows *)sp)->hPort, p_tx, len, &txlen, NULL);
+    ResetEvent(spw->tx.hEvent);
+    BOOL res = WriteFile(spw->hPort, p_tx, len, NULL, &spw->tx);
+    res = uart_overlapped_result(spw->hPort, &spw->tx, res, &txlen);
     if (res)
         return PM3_SUCCESS;
 
@@ -820,22 +820,6 @@ uint64_t HornerScheme(uint64_t num, uint64_t divider, uint64_t factor) {
     return result;
 }
 
-// determine number of logical CPU cores (use for multithreaded functions)
-int num_CPUs(void) {
-#if defined(_WIN32)
-#include <sysinfoapi.h>
-    SYSTEM_INFO sysinfo;
-    GetSystemInfo(&sysinfo);
-    return sysinfo.dwNumberOfProcessors;
-#else
-#include <unistd.h>
-    int count = sysconf(_SC_NPROCESSORS_ONLN);
-    if (count <= 0)
-        count = 1;
-    return count;
-#endif
-}
-
 void str_lower(char *s) {
     for (size_t i = 0; i < strlen(s); i++)
         s[i] = tolower(s[i]);
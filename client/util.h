@@ -90,7 +90,6 @@ int32_t le24toh(uint8_t data[3]);
 uint32_t PackBits(uint8_t start, uint8_t len, uint8_t *bits);
 uint64_t HornerScheme(uint64_t num, uint64_t divider, uint64_t factor);
 
-int num_CPUs(void); // number of logical CPUs
 
 void str_lower(char *s); // converts string to lower case
 bool str_startswith(const char *s,  const char *pre);  // check for prefix in string
@@ -22,8 +22,13 @@
 #include "bucketsort.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include "parity.h"
 
+#if !defined(__arm__) || defined(__linux__) || defined(_WIN32) || defined(__APPLE__) // bare metal ARM Proxmark lacks threads
+#include <pthread.h>
+#endif
+
 #if !defined LOWMEM && defined __GNUC__
 static uint8_t filterlut[1 << 20];
 static void __attribute__((constructor)) fill_lut() {
@@ -127,6 +132,103 @@ recover(uint32_t *o_head, uint32_t *o_tail, uint32_t oks,
 
 
 #if !defined(__arm__) || defined(__linux__) || defined(_WIN32) || defined(__APPLE__) // bare metal ARM Proxmark lacks malloc()/free()
+struct crapto1_tables {
+    uint32_t *odd;                  // 1 << 21 entries each
+    uint32_t *even;
+    bucket_array_t bucket;          // for the out of place bucket_sort
+    struct Crypto1State *statelist; // 1 << 18 states
+};
+
+/** crapto1_tables_create
+ * allocate the tables lfsr_recovery32() works on, to be reused for many recoveries
+ */
+crapto1_tables_t *crapto1_tables_create(void) {
+    crapto1_tables_t *t = calloc(1, sizeof(crapto1_tables_t));
+    if (!t)
+        return 0;
+
+    bool ok = true;
+    t->odd = malloc(sizeof(uint32_t) << 21);
+    t->even = malloc(sizeof(uint32_t) << 21);
+    t->statelist = malloc(sizeof(struct Crypto1State) << 18);
+    for (int i = 0; i < 2; i++) {
+        for (uint32_t j = 0; j <= 0xff; j++) {
+            t->bucket[i][j].head = malloc(sizeof(uint32_t) << 14);
+            ok = ok && t->bucket[i][j].head;
+        }
+    }
+    if (!ok || !t->odd || !t->even || !t->statelist) {
+        crapto1_tables_destroy(t);
+        return 0;
+    }
+    return t;
+}
+
+void crapto1_tables_destroy(crapto1_tables_t *t) {
+    if (!t)
+        return;
+    for (int i = 0; i < 2; i++)
+        for (uint32_t j = 0; j <= 0xff; j++)
+            free(t->bucket[i][j].head);
+    free(t->odd);
+    free(t->even);
+    free(t->statelist);
+    free(t);
+}
+
+/** init_tables
+ * split the keystream into an odd and even part and fill the tables with all states
+ * which could have generated the last 10 bits of the keystream.
+ */
+static void init_tables(uint32_t ks2, uint32_t *oks, uint32_t *eks,
+                        uint32_t *odd_head, uint32_t **odd_tail,
+                        uint32_t *even_head, uint32_t **even_tail) {
+    int i;
+
+    *oks = *eks = 0;
+    for (i = 31; i >= 0; i -= 2)
+        *oks = *oks << 1 | BEBIT(ks2, i);
+    for (i = 30; i >= 0; i -= 2)
+        *eks = *eks << 1 | BEBIT(ks2, i);
+
+    *odd_tail = odd_head - 1;
+    *even_tail = even_head - 1;
+
+    // initialize statelists: add all possible states which would result into the rightmost 2 bits of the keystream
+    for (i = 1 << 20; i >= 0; --i) {
+        if (filter(i) == (*oks & 1))
+            *++*odd_tail = i;
+        if (filter(i) == (*eks & 1))
+            *++*even_tail = i;
+    }
+
+    // extend the statelists. Look at the next 8 Bits of the keystream (4 Bit each odd and even):
+    for (i = 0; i < 4; i++) {
+        extend_table_simple(odd_head,  odd_tail, (*oks >>= 1) & 1);
+        extend_table_simple(even_head, even_tail, (*eks >>= 1) & 1);
+    }
+}
+
+/** lfsr_recovery32_tables
+ * lfsr_recovery32() working on preallocated tables. The returned statelist
+ * belongs to the tables and is valid until their next use, don't free it.
+ */
+struct Crypto1State *lfsr_recovery32_tables(uint32_t ks2, uint32_t in, crapto1_tables_t *t) {
+    uint32_t *odd_tail, oks;
+    uint32_t *even_tail, eks;
+
+    t->statelist->odd = t->statelist->even = 0;
+
+    init_tables(ks2, &oks, &eks, t->odd, &odd_tail, t->even, &even_tail);
+
+    // the statelists now contain all states which could have generated the last 10 Bits of the keystream.
+    // 22 bits to go to recover 32 bits in total. From now on, we need to take the "in"
+    // parameter into account.
+    in = (in >> 16 & 0xff) | (in << 16) | (in & 0xff00); // Byte swapping
+    recover(t->odd, odd_tail, oks, t->even, even_tail, eks, 11, t->statelist, in << 1, t->bucket);
+    return t->statelist;
+}
+
 /** lfsr_recovery
  * recover the state of the lfsr given 32 bits of the keystream
  * additionally you can use the in parameter to specify the value
@@ -134,65 +236,155 @@ recover(uint32_t *o_head, uint32_t *o_tail, uint32_t oks,
  */
 struct Crypto1State *lfsr_recovery32(uint32_t ks2, uint32_t in) {
     struct Crypto1State *statelist;
-    uint32_t *odd_head = 0, *odd_tail = 0, oks = 0;
-    uint32_t *even_head = 0, *even_tail = 0, eks = 0;
+    crapto1_tables_t *t = crapto1_tables_create();
+    if (!t)
+        return 0;
+
+    statelist = lfsr_recovery32_tables(ks2, in, t);
+    t->statelist = 0; // the caller frees it
+    crapto1_tables_destroy(t);
+    return statelist;
+}
+
+#define RECOVERY32_MAX_THREADS 64
+
+// the top level buckets of the recursion in recover(), shared by all threads
+typedef struct {
+    bucket_info_t buckets;
+    uint32_t next_bucket;           // atomic, the next bucket to be taken by a thread
+    uint32_t oks, eks, in;
+    int rem;
+    struct {
+        uint32_t thread;
+        uint32_t first;             // the bucket's states in the thread's statelist
+        uint32_t count;
+    } result[0x100];
+    crapto1_tables_t *tables[RECOVERY32_MAX_THREADS];
+    bool failed;
+} recovery32_job_t;
+
+typedef struct {
+    recovery32_job_t *job;
+    uint32_t thread;
+} recovery32_thread_t;
+
+// every subtree of recover() grows its tables in place, each thread works on a private copy of its bucket
+static void *recover_thread(void *arg) {
+    recovery32_thread_t *thread = arg;
+    recovery32_job_t *job = thread->job;
+    crapto1_tables_t *t = crapto1_tables_create();
+
+    job->tables[thread->thread] = t;
+    if (!t) {
+        job->failed = true;
+        return NULL;
+    }
+
+    struct Crypto1State *sl = t->statelist;
+    uint32_t i;
+    while ((i = __atomic_fetch_add(&job->next_bucket, 1, __ATOMIC_RELAXED)) < job->buckets.numbuckets) {
+        size_t odd_len = job->buckets.bucket_info[1][i].tail - job->buckets.bucket_info[1][i].head + 1;
+        size_t even_len = job->buckets.bucket_info[0][i].tail - job->buckets.bucket_info[0][i].head + 1;
+        memcpy(t->odd, job->buckets.bucket_info[1][i].head, odd_len * sizeof(uint32_t));
+        memcpy(t->even, job->buckets.bucket_info[0][i].head, even_len * sizeof(uint32_t));
+        struct Crypto1State *end = recover(t->odd, t->odd + odd_len - 1, job->oks,
+                                           t->even, t->even + even_len - 1, job->eks,
+                                           job->rem, sl, job->in, t->bucket);
+        job->result[i].thread = thread->thread;
+        job->result[i].first = sl - t->statelist;
+        job->result[i].count = end - sl;
+        sl = end;
+    }
+    return NULL;
+}
+
+/** lfsr_recovery32_mt
+ * multi threaded lfsr_recovery32(). The first level of the recursion is done here,
+ * its buckets are independent subtrees and are handed out to the threads.
+ * Returns the same states in the same order as lfsr_recovery32().
+ */
+struct Crypto1State *lfsr_recovery32_mt(uint32_t ks2, uint32_t in, int num_threads) {
+    struct Crypto1State *statelist = 0;
+    uint32_t *odd_tail, oks;
+    uint32_t *even_tail, eks;
     int i;
 
-    // split the keystream into an odd and even part
-    for (i = 31; i >= 0; i -= 2)
-        oks = oks << 1 | BEBIT(ks2, i);
-    for (i = 30; i >= 0; i -= 2)
-        eks = eks << 1 | BEBIT(ks2, i);
+    if (num_threads <= 1)
+        return lfsr_recovery32(ks2, in);
+    if (num_threads > RECOVERY32_MAX_THREADS)
+        num_threads = RECOVERY32_MAX_THREADS;
 
-    odd_head = odd_tail = malloc(sizeof(uint32_t) << 21);
-    even_head = even_tail = malloc(sizeof(uint32_t) << 21);
-    statelist =  malloc(sizeof(struct Crypto1State) << 18);
-    if (!odd_tail-- || !even_tail-- || !statelist) {
-        free(statelist);
-        statelist = 0;
+    recovery32_job_t *job = calloc(1, sizeof(recovery32_job_t));
+    crapto1_tables_t *t = crapto1_tables_create();
+    if (!job || !t)
         goto out;
-    }
 
-    statelist->odd = statelist->even = 0;
+    init_tables(ks2, &oks, &eks, t->odd, &odd_tail, t->even, &even_tail);
 
-    // allocate memory for out of place bucket_sort
-    bucket_array_t bucket;
+    in = (in >> 16 & 0xff) | (in << 16) | (in & 0xff00); // Byte swapping
+    in <<= 1;
 
-    for (i = 0; i < 2; i++) {
-        for (uint32_t j = 0; j <= 0xff; j++) {
-            bucket[i][j].head = malloc(sizeof(uint32_t) << 14);
-            if (!bucket[i][j].head) {
-                goto out;
+    // first level of recover()
+    int rem = 11;
+    for (i = 0; i < 4 && rem--; i++) {
+        oks >>= 1;
+        eks >>= 1;
+        in >>= 2;
+        extend_table(t->odd, &odd_tail, oks & 1, LF_POLY_EVEN << 1 | 1, LF_POLY_ODD << 1, 0);
+        extend_table(t->even, &even_tail, eks & 1, LF_POLY_ODD, LF_POLY_EVEN << 1 | 1, in & 3);
+        if (t->odd > odd_tail || t->even > even_tail)
+            break;
+    }
+
+    if (t->odd <= odd_tail && t->even <= even_tail) {
+        bucket_sort_intersect(t->even, even_tail, t->odd, odd_tail, &job->buckets, t->bucket);
+
+        job->oks = oks;
+        job->eks = eks;
+        job->in = in;
+        job->rem = rem;
+
+        pthread_t thread_id[RECOVERY32_MAX_THREADS];
+        recovery32_thread_t thread[RECOVERY32_MAX_THREADS];
+        int started = 0;
+        for (i = 0; i < num_threads; i++) {
+            thread[i].job = job;
+            thread[i].thread = i;
+            if (pthread_create(&thread_id[i], NULL, recover_thread, &thread[i]) != 0) {
+                // the calling thread takes over the remaining buckets
+                recover_thread(&thread[i]);
+                break;
             }
+            started++;
         }
+        for (i = 0; i < started; i++)
+            pthread_join(thread_id[i], NULL);
+        if (job->failed)
+            goto out;
     }
 
-    // initialize statelists: add all possible states which would result into the rightmost 2 bits of the keystream
-    for (i = 1 << 20; i >= 0; --i) {
-        if (filter(i) == (oks & 1))
-            *++odd_tail = i;
-        if (filter(i) == (eks & 1))
-            *++even_tail = i;
-    }
+    // collect the states in the order lfsr_recovery32() would have found them
+    size_t count = 0;
+    for (uint32_t b = 0; b < job->buckets.numbuckets; b++)
+        count += job->result[b].count;
 
-    // extend the statelists. Look at the next 8 Bits of the keystream (4 Bit each odd and even):
-    for (i = 0; i < 4; i++) {
-        extend_table_simple(odd_head,  &odd_tail, (oks >>= 1) & 1);
-        extend_table_simple(even_head, &even_tail, (eks >>= 1) & 1);
-    }
+    statelist = malloc(sizeof(struct Crypto1State) * (count + 1));
+    if (!statelist)
+        goto out;
 
-    // the statelists now contain all states which could have generated the last 10 Bits of the keystream.
-    // 22 bits to go to recover 32 bits in total. From now on, we need to take the "in"
-    // parameter into account.
-    in = (in >> 16 & 0xff) | (in << 16) | (in & 0xff00); // Byte swapping
-    recover(odd_head, odd_tail, oks, even_head, even_tail, eks, 11, statelist, in << 1, bucket);
+    struct Crypto1State *sl = statelist;
+    for (int b = job->buckets.numbuckets - 1; b >= 0; b--) {
+        memcpy(sl, job->tables[job->result[b].thread]->statelist + job->result[b].first, sizeof(struct Crypto1State) * job->result[b].count);
+        sl += job->result[b].count;
+    }
+    sl->odd = sl->even = 0;
 
 out:
-    for (i = 0; i < 2; i++)
-        for (uint32_t j = 0; j <= 0xff; j++)
-            free(bucket[i][j].head);
-    free(odd_head);
-    free(even_head);
+    if (job)
+        for (i = 0; i < RECOVERY32_MAX_THREADS; i++)
+            crapto1_tables_destroy(job->tables[i]);
+    free(job);
+    crapto1_tables_destroy(t);
     return statelist;
 }
 
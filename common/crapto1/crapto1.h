@@ -38,7 +38,12 @@ uint32_t crypto1_word(struct Crypto1State *, uint32_t, int);
 uint32_t prng_successor(uint32_t x, uint32_t n);
 
 #if !defined(__arm__) || defined(__linux__) || defined(_WIN32) || defined(__APPLE__) // bare metal ARM Proxmark lacks malloc()/free()
+typedef struct crapto1_tables crapto1_tables_t;
+crapto1_tables_t *crapto1_tables_create(void);
+void crapto1_tables_destroy(crapto1_tables_t *t);
 struct Crypto1State *lfsr_recovery32(uint32_t ks2, uint32_t in);
+struct Crypto1State *lfsr_recovery32_tables(uint32_t ks2, uint32_t in, crapto1_tables_t *t);
+struct Crypto1State *lfsr_recovery32_mt(uint32_t ks2, uint32_t in, int num_threads);
 struct Crypto1State *lfsr_recovery64(uint32_t ks2, uint32_t ks3);
 struct Crypto1State *
 lfsr_common_prefix(uint32_t pfx, uint32_t rr, uint8_t ks[8], uint8_t par[8][8], uint32_t no_par);
@@ -0,0 +1,143 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Run length / delta codec for compressed downloads from the device
+//-----------------------------------------------------------------------------
+
+#include "rledelta.h"
+#include "string.h"
+
+#define RLED_RUN            0x80
+#define RLED_DELTA          0xC0
+
+#define RLED_MAX_LITERAL    128
+#define RLED_MIN_RUN        4
+#define RLED_MAX_RUN        (0x3FFF + RLED_MIN_RUN)
+#define RLED_MIN_DELTA      4                   // samples, shorter stretches go as literals
+#define RLED_MAX_DELTA      128
+// a delta stretch stops where a run this long starts
+#define RLED_DELTA_RUN      8
+
+static void flush_literal(const uint8_t *in, uint32_t *lit, uint8_t *out, uint32_t *o) {
+    if (*lit == 0)
+        return;
+    out[(*o)++] = *lit - 1;
+    memcpy(out + *o, in - *lit, *lit);
+    *o += *lit;
+    *lit = 0;
+}
+
+uint32_t rledelta_encode(const uint8_t *in, uint32_t inlen, uint8_t *out, uint32_t outsize, uint32_t *consumed) {
+    uint32_t i = 0, o = 0;
+    uint32_t lit = 0;       // literals pending, they end at in[i]
+    uint8_t prev = 0;
+
+    while (i < inlen) {
+        uint32_t pending = lit ? lit + 1 : 0;
+
+        uint32_t run = 1;
+        while (i + run < inlen && in[i + run] == in[i] && run < RLED_MAX_RUN)
+            run++;
+
+        if (run >= RLED_MIN_RUN) {
+            if (o + pending + 3 > outsize)
+                break;
+            flush_literal(in + i, &lit, out, &o);
+            out[o++] = RLED_RUN | ((run - RLED_MIN_RUN) >> 8);
+            out[o++] = (run - RLED_MIN_RUN) & 0xFF;
+            out[o++] = in[i];
+            prev = in[i];
+            i += run;
+            continue;
+        }
+
+        uint32_t n = 0, same = 0;
+        uint8_t p = prev;
+        while (i + n < inlen && n < RLED_MAX_DELTA) {
+            int d = in[i + n] - p;
+            if (d < -8 || d > 7)
+                break;
+            same = (d == 0) ? same + 1 : 0;
+            if (same == RLED_DELTA_RUN) {
+                n -= RLED_DELTA_RUN - 1;
+                break;
+            }
+            p = in[i + n];
+            n++;
+        }
+        if (o + pending + 1 + n / 2 > outsize) {
+            n = (o + pending + 1 < outsize) ? (outsize - o - pending - 1) * 2 : 0;
+        }
+        n &= ~1;
+
+        if (n >= RLED_MIN_DELTA) {
+            flush_literal(in + i, &lit, out, &o);
+            out[o++] = RLED_DELTA | (n / 2 - 1);
+            for (uint32_t j = 0; j < n; j += 2) {
+                uint8_t hi = (in[i + j] - prev) & 0x0F;
+                uint8_t lo = (in[i + j + 1] - in[i + j]) & 0x0F;
+                out[o++] = (hi << 4) | lo;
+                prev = in[i + j + 1];
+            }
+            i += n;
+            continue;
+        }
+
+        if (lit == RLED_MAX_LITERAL) {
+            flush_literal(in + i, &lit, out, &o);
+            pending = 0;
+        }
+        if (o + pending + (lit ? 1 : 2) > outsize)
+            break;
+        prev = in[i];
+        lit++;
+        i++;
+    }
+    flush_literal(in + i, &lit, out, &o);
+    *consumed = i;
+    return o;
+}
+
+int rledelta_decode(const uint8_t *in, uint32_t inlen, uint8_t *out, uint32_t outsize) {
+    uint32_t i = 0, o = 0;
+    uint8_t prev = 0;
+
+    while (i < inlen) {
+        uint8_t t = in[i++];
+        uint32_t n;
+        if ((t & 0x80) == 0) {
+            n = t + 1;
+            if (i + n > inlen || o + n > outsize)
+                return -1;
+            memcpy(out + o, in + i, n);
+            i += n;
+            o += n;
+            prev = out[o - 1];
+        } else if ((t & 0xC0) == RLED_RUN) {
+            if (i + 2 > inlen)
+                return -1;
+            n = (((t & 0x3F) << 8) | in[i]) + RLED_MIN_RUN;
+            if (o + n > outsize)
+                return -1;
+            prev = in[i + 1];
+            memset(out + o, prev, n);
+            i += 2;
+            o += n;
+        } else {
+            n = (t & 0x3F) + 1;
+            if (i + n > inlen || o + n * 2 > outsize)
+                return -1;
+            for (uint32_t j = 0; j < n; j++) {
+                int hi = in[i + j] >> 4, lo = in[i + j] & 0x0F;
+                prev += (hi > 7) ? hi - 16 : hi;
+                out[o++] = prev;
+                prev += (lo > 7) ? lo - 16 : lo;
+                out[o++] = prev;
+            }
+            i += n;
+        }
+    }
+    return o;
+}
@@ -0,0 +1,29 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Run length / delta codec for compressed downloads from the device
+//
+// Cheap enough for the ARM, suited to 8 bit ADC samples (slowly changing
+// values) and mostly empty buffers (long runs). Tokens:
+//   0nnnnnnn                    n+1 literal bytes follow
+//   10nnnnnn nnnnnnnn vvvvvvvv  n+4 times the value v
+//   11nnnnnn                    n+1 bytes follow, each two signed 4 bit deltas,
+//                               high nibble first, to the previous byte
+// The previous byte is 0 at the start of a block, blocks decode on their own.
+//-----------------------------------------------------------------------------
+
+#ifndef RLEDELTA_H__
+#define RLEDELTA_H__
+
+#include "common.h"
+
+// encodes as much of in as fits in outsize bytes, returns the encoded length
+// and the number of input bytes it covers in consumed
+uint32_t rledelta_encode(const uint8_t *in, uint32_t inlen, uint8_t *out, uint32_t outsize, uint32_t *consumed);
+
+// returns the decoded length, -1 if the block is corrupt or doesn't fit in outsize
+int rledelta_decode(const uint8_t *in, uint32_t inlen, uint8_t *out, uint32_t outsize);
+
+#endif
@@ -19,6 +19,9 @@
 #include "util_posix.h"
 #include <stdint.h>
 #include <time.h>
+#if !defined(_WIN32)
+#include <unistd.h>     // sysconf
+#endif
 
 
 // Timer functions
@@ -135,3 +138,30 @@ uint64_t msclock(void) {
 #endif
 }
 
+// a microseconds timer for latency measurement
+uint64_t usclock(void) {
+#if defined(_WIN32)
+    LARGE_INTEGER freq, count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (uint64_t)(count.QuadPart / freq.QuadPart) * 1000000 + (uint64_t)(count.QuadPart % freq.QuadPart) * 1000000 / freq.QuadPart;
+#else
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (1000000 * (uint64_t)t.tv_sec + t.tv_nsec / 1000);
+#endif
+}
+
+// determine number of logical CPU cores (use for multithreaded functions)
+int num_CPUs(void) {
+#if defined(_WIN32)
+    SYSTEM_INFO sysinfo;
+    GetSystemInfo(&sysinfo);
+    return sysinfo.dwNumberOfProcessors;
+#else
+    int count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (count <= 0)
+        count = 1;
+    return count;
+#endif
+}
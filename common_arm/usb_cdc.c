@@ -654,6 +654,12 @@ static uint8_t usb_read_ng_buffer[64];
 static size_t usb_read_ng_bufoff = 0;
 static size_t usb_read_ng_buflen = 0;
 
+// the rest of the last USB packet, not consumed by usb_read_ng yet. With pipelined
+// commands it can hold a whole frame while the endpoint is already empty
+bool usb_read_ng_has_buffered_data(void) {
+    return usb_read_ng_buflen > 0;
+}
+
 uint32_t usb_read_ng(uint8_t *data, size_t len) {
 
     if (len == 0) return 0;
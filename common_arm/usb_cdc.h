@@ -46,6 +46,7 @@ bool usb_poll_validate_length(void);
 uint32_t usb_read(uint8_t *data, size_t len);
 int usb_write(const uint8_t *data, const size_t len);
 uint32_t usb_read_ng(uint8_t *data, size_t len);
+bool usb_read_ng_has_buffered_data(void);
 
 void SetUSBreconnect(int value);
 int GetUSBreconnect(void);
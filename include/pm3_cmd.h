@@ -40,6 +40,11 @@ typedef struct {
 #define COMMANDNG_PREAMBLE_MAGIC  0x61334d50 // PM3a
 #define COMMANDNG_POSTAMBLE_MAGIC 0x3361     // a3
 
+// Sequenced frames: a NG frame with a sequence number between the preamble and the payload,
+// covered by the CRC. The replies to such a command are sequenced frames with the same number,
+// so several commands can be in flight. Only sent if the device reports capabilities.sequenced_frames
+#define COMMANDNG_SEQ_PREAMBLE_MAGIC  0x63334d50 // PM3c
+
 typedef struct {
     uint16_t crc;
 } PACKED PacketCommandNGPostamble;
@@ -56,6 +61,8 @@ typedef struct {
         uint32_t asDwords[PM3_CMD_DATA_SIZE / 4];
     } data;
     bool ng;             // does it store NG data or OLD data?
+    bool has_seq;        // sequenced frame?
+    uint16_t seq;        // sequence number of a sequenced frame
 } PacketCommandNG;
 
 // For reception and CRC check
@@ -65,6 +72,14 @@ typedef struct {
     PacketCommandNGPostamble foopost; // Probably not at that offset!
 } PACKED PacketCommandNGRaw;
 
+// For sequenced frames, without sequence number the payload starts at seq
+typedef struct {
+    PacketCommandNGPreamble pre;
+    uint16_t seq;
+    uint8_t data[PM3_CMD_DATA_SIZE];
+    PacketCommandNGPostamble foopost; // Probably not at that offset!
+} PACKED PacketCommandNGSeqRaw;
+
 typedef struct {
     uint64_t cmd;
     uint64_t arg[3];
@@ -84,6 +99,7 @@ typedef struct {
 
 #define RESPONSENG_PREAMBLE_MAGIC  0x62334d50 // PM3b
 #define RESPONSENG_POSTAMBLE_MAGIC 0x3362     // b3
+#define RESPONSENG_SEQ_PREAMBLE_MAGIC  0x64334d50 // PM3d
 
 typedef struct {
     uint16_t crc;
@@ -102,6 +118,8 @@ typedef struct {
         uint32_t asDwords[PM3_CMD_DATA_SIZE / 4];
     } data;
     bool ng;             // does it store NG data or OLD data?
+    bool has_seq;        // sequenced frame?
+    uint16_t seq;        // sequence number of the command it answers
 } PacketResponseNG;
 
 // For reception and CRC check
@@ -111,6 +129,14 @@ typedef struct {
     PacketResponseNGPostamble foopost; // Probably not at that offset!
 } PACKED PacketResponseNGRaw;
 
+// For sequenced frames, without sequence number the payload starts at seq
+typedef struct {
+    PacketResponseNGPreamble pre;
+    uint16_t seq;
+    uint8_t data[PM3_CMD_DATA_SIZE];
+    PacketResponseNGPostamble foopost; // Probably not at that offset!
+} PACKED PacketResponseNGSeqRaw;
+
 // A struct used to send sample-configs over USB
 typedef struct {
     uint8_t decimation;
@@ -187,9 +213,21 @@ typedef struct {
     // rdv4
     bool hw_available_flash            : 1;
     bool hw_available_smartcard        : 1;
+    // comms
+    bool sequenced_frames              : 1;
+    bool compressed_download           : 1;
+    // hf
+    bool mifare_chkkeys_stream         : 1;
 } PACKED capabilities_t;
-#define CAPABILITIES_VERSION 3
-extern capabilities_t pm3_capabilities;
+#define CAPABILITIES_VERSION 6
+// oldest firmware the client talks to. Versions since only added flags in the spare bits,
+// the client clears the ones the firmware doesn't know
+#define CAPABILITIES_VERSION_MIN 3
+
+// Downloads (CMD_DOWNLOAD_BIGBUF, CMD_DOWNLOAD_EML_BIGBUF, CMD_SPIFFS_DOWNLOAD, CMD_FLASHMEM_DOWNLOAD):
+// the client asks for a compressed download with this flag in arg2 if the device has
+// compressed_download, the device then sends MIX replies of rledelta blocks with it in arg1
+#define DOWNLOAD_COMPRESSED 0x80000000
 
 // For CMD_LF_T55XX_WRITEBL
 typedef struct {
@@ -250,6 +288,25 @@ typedef struct {
     uint8_t keytype;
 } PACKED mfc_eload_t;
 
+// For CMD_HF_MIFARE_CHKKEYS_STREAM, a key check spread over several packets.
+// The field stays on and the card selected between the packets.
+#define MF_CHKKEYS_STREAM_FIRST         0x01    // switch on the field
+#define MF_CHKKEYS_STREAM_LAST          0x02    // switch off the field when done
+#define MF_CHKKEYS_STREAM_CLEARTRACE    0x04
+typedef struct {
+    uint8_t keytype;
+    uint8_t blockno;
+    uint8_t flags;
+    uint8_t keycnt;
+    uint8_t keys[];
+} PACKED mf_chkkeys_stream_t;
+
+typedef struct {
+    uint8_t key[6];
+    bool found;
+    uint8_t checked;                        // number of keys tested from this packet
+} PACKED mf_chkkeys_stream_result_t;
+
 typedef struct {
     uint8_t status;
     uint8_t CSN[8];
@@ -488,6 +545,7 @@ typedef struct {
 #define CMD_HF_MIFARE_CHKKEYS                                             0x0623
 #define CMD_HF_MIFARE_SETMOD                                              0x0624
 #define CMD_HF_MIFARE_CHKKEYS_FAST                                        0x0625
+#define CMD_HF_MIFARE_CHKKEYS_STREAM                                      0x0626
 
 #define CMD_HF_MIFARE_SNIFF                                               0x0630
 #define CMD_HF_MIFARE_MFKEY                                               0x0631
@@ -0,0 +1,131 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Benchmark of lfsr_recovery32() against the multi threaded lfsr_recovery32_mt()
+//-----------------------------------------------------------------------------
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "crapto1/crapto1.h"
+#include "util_posix.h"     // num_CPUs
+#include "mfkey_batch.h"
+
+static uint64_t rand48(void) {
+    return ((uint64_t)(rand() & 0xffffff) << 24 | (rand() & 0xffffff)) & 0xffffffffffff;
+}
+
+static size_t count_states(struct Crypto1State *s) {
+    size_t n = 0;
+    while (s[n].odd | s[n].even)
+        n++;
+    return n;
+}
+
+// roll back the candidates and look for the key
+static bool find_key(struct Crypto1State *s, uint32_t in, uint64_t key) {
+    for (struct Crypto1State *t = s; t->odd | t->even; ++t) {
+        struct Crypto1State r = *t;
+        uint64_t k;
+        lfsr_rollback_word(&r, in, 0);
+        crypto1_get_lfsr(&r, &k);
+        if (k == key)
+            return true;
+    }
+    return false;
+}
+
+int main(int argc, char *argv[]) {
+    int iterations = 20;
+    int threads = num_CPUs();
+
+    printf("lfsr_recovery32 benchmark\n\n");
+
+    if (argc > 1 && (argv[1][0] == '-' || (iterations = atoi(argv[1])) <= 0)) {
+        printf("syntax: %s [<iterations> [<threads>]]\n\n", argv[0]);
+        printf("  recovers the lfsr state from <iterations> random keystreams with lfsr_recovery32()\n");
+        printf("  and lfsr_recovery32_mt(), checks that both return the same states and reports keys/s.\n");
+        printf("  <threads> defaults to the number of CPUs (%d)\n\n", num_CPUs());
+        return 1;
+    }
+    if (argc > 2 && (threads = atoi(argv[2])) <= 0)
+        threads = 1;
+
+    uint64_t *keys = calloc(iterations, sizeof(uint64_t));
+    uint32_t *ins = calloc(iterations, sizeof(uint32_t));
+    uint32_t *ks2 = calloc(iterations, sizeof(uint32_t));
+    struct Crypto1State **ref = calloc(iterations, sizeof(struct Crypto1State *));
+    if (!keys || !ins || !ks2 || !ref) {
+        printf("out of memory\n");
+        return 2;
+    }
+
+    srand(0x1337);
+    for (int i = 0; i < iterations; i++) {
+        keys[i] = rand48();
+        ins[i] = (uint32_t)rand48();
+        struct Crypto1State *s = crypto1_create(keys[i]);
+        ks2[i] = crypto1_word(s, ins[i], 0);
+        crypto1_destroy(s);
+    }
+
+    uint64_t states = 0;
+    uint64_t t1 = msclock();
+    for (int i = 0; i < iterations; i++) {
+        ref[i] = lfsr_recovery32(ks2[i], ins[i]);
+        if (ref[i] == NULL) {
+            printf("out of memory\n");
+            return 2;
+        }
+        states += count_states(ref[i]);
+    }
+    uint64_t single_ms = msclock() - t1;
+    if (single_ms == 0)
+        single_ms = 1;
+
+    int errors = 0;
+    t1 = msclock();
+    for (int i = 0; i < iterations; i++) {
+        struct Crypto1State *s = lfsr_recovery32_mt(ks2[i], ins[i], threads);
+        if (s == NULL) {
+            printf("out of memory\n");
+            return 2;
+        }
+        size_t n = count_states(s);
+        if (n != count_states(ref[i]) || memcmp(s, ref[i], n * sizeof(struct Crypto1State)) != 0) {
+            printf("mismatch: ks2 %08x in %08x\n", ks2[i], ins[i]);
+            errors++;
+        }
+        free(s);
+    }
+    uint64_t multi_ms = msclock() - t1;
+    if (multi_ms == 0)
+        multi_ms = 1;
+
+    for (int i = 0; i < iterations; i++) {
+        if (!find_key(ref[i], ins[i], keys[i])) {
+            printf("key %012" PRIx64 " not found\n", keys[i]);
+            errors++;
+        }
+        free(ref[i]);
+    }
+
+    printf("iterations %d, %" PRIu64 " candidate states (%" PRIu64 " per recovery)\n\n", iterations, states, states / iterations);
+    printf("                          time    recoveries/s         keys/s\n");
+    printf("lfsr_recovery32      %7.3fs %15.2f %14.0f\n",
+           single_ms / 1000.0, iterations * 1000.0 / single_ms, states * 1000.0 / single_ms);
+    printf("lfsr_recovery32_mt   %7.3fs %15.2f %14.0f   %d threads, speedup %.2fx\n",
+           multi_ms / 1000.0, iterations * 1000.0 / multi_ms, states * 1000.0 / multi_ms,
+           threads, (double)single_ms / multi_ms);
+    printf("\n%s\n", errors ? "FAILED" : "OK");
+
+    free(keys);
+    free(ins);
+    free(ks2);
+    free(ref);
+    return errors ? 1 : 0;
+}
@@ -5,6 +5,29 @@
 #include <stdlib.h>
 #include "crapto1/crapto1.h"
 #include "util_posix.h"
+#include "mfkey_batch.h"
+
+// batch mode, the fields are uid, nt0, nr0_enc, ar0_enc, nt1, nr1_enc, ar1_enc
+static bool crack(const mfkey_auth_t *auth, crapto1_tables_t *tables, uint64_t *key) {
+    uint32_t uid = auth->field[0], nt0 = auth->field[1], nr0_enc = auth->field[2], ar0_enc = auth->field[3];
+    uint32_t nt1 = auth->field[4], nr1_enc = auth->field[5], ar1_enc = auth->field[6];
+    uint32_t p64 = prng_successor(nt0, 64);
+    uint32_t p64b = prng_successor(nt1, 64);
+
+    struct Crypto1State *s = lfsr_recovery32_tables(ar0_enc ^ p64, 0, tables);
+    for (struct Crypto1State *t = s; t->odd | t->even; ++t) {
+        lfsr_rollback_word(t, 0, 0);
+        lfsr_rollback_word(t, nr0_enc, 1);
+        lfsr_rollback_word(t, uid ^ nt0, 0);
+        crypto1_get_lfsr(t, key);
+
+        crypto1_word(t, uid ^ nt1, 0);
+        crypto1_word(t, nr1_enc, 1);
+        if (ar1_enc == (crypto1_word(t, 0, 0) ^ p64b))
+            return true;
+    }
+    return false;
+}
 
 int main(int argc, char *argv[]) {
     struct Crypto1State *s, *t;
@@ -22,8 +45,12 @@ int main(int argc, char *argv[]) {
     printf("Recover key from two 32-bit reader authentication answers only\n");
     printf("This version implements Moebius two different nonce solution (like the supercard)\n\n");
 
+    if (argc > 1 && argv[1][0] == '-')
+        return mfkey_batch(argc, argv, 7, true, crack);
+
     if (argc < 8) {
-        printf("syntax: %s <uid> <nt> <nr_0> <ar_0> <nt1> <nr_1> <ar_1>\n\n", argv[0]);
+        printf("syntax: %s <uid> <nt> <nr_0> <ar_0> <nt1> <nr_1> <ar_1>\n", argv[0]);
+        mfkey_batch_usage(argv[0], "<uid> <nt> <nr_0> <ar_0> <nt1> <nr_1> <ar_1>");
         return 1;
     }
 
@@ -6,6 +6,31 @@
 #include <stdlib.h>
 #include "crapto1/crapto1.h"
 #include "util_posix.h"
+#include "mfkey_batch.h"
+
+// batch mode, the fields are uid, nt, nr_enc, ar_enc, at_enc
+static bool crack(const mfkey_auth_t *auth, crapto1_tables_t *tables, uint64_t *key) {
+    uint32_t uid = auth->field[0], nt = auth->field[1], nr_enc = auth->field[2];
+    uint32_t ar_enc = auth->field[3], at_enc = auth->field[4];
+    uint32_t p64 = prng_successor(nt, 64);
+    uint32_t ks2 = ar_enc ^ p64;
+    uint32_t ks3 = at_enc ^ prng_successor(p64, 32);
+
+    struct Crypto1State *revstate = lfsr_recovery64(ks2, ks3);
+    if (revstate == NULL)
+        return false;
+
+    bool found = (revstate->odd | revstate->even) != 0;
+    if (found) {
+        lfsr_rollback_word(revstate, 0, 0);
+        lfsr_rollback_word(revstate, 0, 0);
+        lfsr_rollback_word(revstate, nr_enc, 1);
+        lfsr_rollback_word(revstate, uid ^ nt, 0);
+        crypto1_get_lfsr(revstate, key);
+    }
+    crypto1_destroy(revstate);
+    return found;
+}
 
 int main(int argc, char *argv[]) {
     struct Crypto1State *revstate;
@@ -21,8 +46,12 @@ int main(int argc, char *argv[]) {
     printf("MIFARE Classic key recovery - based 64 bits of keystream\n");
     printf("Recover key from only one complete authentication!\n\n");
 
+    if (argc > 1 && argv[1][0] == '-')
+        return mfkey_batch(argc, argv, 5, false, crack);
+
     if (argc < 6) {
-        printf(" syntax: %s <uid> <nt> <{nr}> <{ar}> <{at}> [enc...]\n\n", argv[0]);
+        printf(" syntax: %s <uid> <nt> <{nr}> <{ar}> <{at}> [enc...]\n", argv[0]);
+        mfkey_batch_usage(argv[0], "<uid> <nt> <{nr}> <{ar}> <{at}>");
         return 1;
     }
 
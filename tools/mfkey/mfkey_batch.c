@@ -0,0 +1,306 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Batch mode of mfkey32v2 and mfkey64: crack a file of sniffed authentications
+//
+// Authentications of the same (uid, block, key type) share the key, only the
+// first one of each group is cracked, the others are tried if that one fails.
+// The groups are handed out to a pool of threads, each thread reuses its
+// lfsr_recovery32 tables for all its authentications.
+//-----------------------------------------------------------------------------
+#define __STDC_FORMAT_MACROS
+#include "mfkey_batch.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "util_posix.h"
+
+#define MAX_THREADS 256
+
+typedef struct {
+    mfkey_auth_t *auths;        // sorted by group
+    uint32_t *group_first;      // [num_groups + 1], index of the first auth of each group
+    uint32_t num_groups;
+    uint32_t next_group;        // atomic, the next group to be taken by a thread
+    uint32_t cracked;           // atomic, number of authentications cracked
+    bool use_tables;
+    bool out_of_memory;
+    mfkey_crack_t crack;
+    uint64_t *keys;             // [num_groups]
+    bool *found;                // [num_groups]
+} batch_t;
+
+void mfkey_batch_usage(const char *prog, const char *fields) {
+    printf(" batch:  %s -f <file|-> [-o <dictionary>] [-t <threads>]\n\n", prog);
+    printf("   -f   read authentications from <file>, - for stdin. One per line:\n");
+    printf("          %s [<block> <A|B>]\n", fields);
+    printf("        authentications with the same uid, block and key type are cracked once\n");
+    printf("   -o   write the recovered keys to a dictionary file\n");
+    printf("   -t   number of threads, defaults to the number of CPUs\n\n");
+}
+
+// authentications without block and key type are only grouped with identical ones
+static int num_fields_cmp = 0;
+static int compare_auth(const void *a, const void *b) {
+    const mfkey_auth_t *x = a, *y = b;
+    if (x->field[0] != y->field[0])
+        return x->field[0] < y->field[0] ? -1 : 1;
+    if (x->block != y->block)
+        return x->block < y->block ? -1 : 1;
+    if (x->keytype != y->keytype)
+        return x->keytype < y->keytype ? -1 : 1;
+    if (x->block < 0) {
+        for (int i = 1; i < num_fields_cmp; i++)
+            if (x->field[i] != y->field[i])
+                return x->field[i] < y->field[i] ? -1 : 1;
+    }
+    return x->line < y->line ? -1 : (x->line > y->line);
+}
+
+static bool same_group(const mfkey_auth_t *x, const mfkey_auth_t *y) {
+    if (x->field[0] != y->field[0] || x->block != y->block || x->keytype != y->keytype)
+        return false;
+    if (x->block >= 0)
+        return true;
+    return memcmp(x->field, y->field, sizeof(x->field)) == 0;
+}
+
+static bool parse_auth(char *line, int num_fields, mfkey_auth_t *auth) {
+    char *p = line;
+    int n;
+
+    memset(auth, 0, sizeof(mfkey_auth_t));
+    for (int i = 0; i < num_fields; i++) {
+        if (sscanf(p, "%x%n", &auth->field[i], &n) != 1)
+            return false;
+        p += n;
+    }
+
+    auth->block = -1;
+    char keytype;
+    if (sscanf(p, "%d %c%n", &auth->block, &keytype, &n) == 2) {
+        p += n;
+        auth->keytype = (keytype == 'a' || keytype == 'A') ? 'A' : (keytype == 'b' || keytype == 'B') ? 'B' : 0;
+        if (auth->block < 0 || auth->block > 255 || auth->keytype == 0)
+            return false;
+    } else {
+        auth->block = -1;
+    }
+
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+        p++;
+    return *p == '\0' || *p == '#';
+}
+
+static mfkey_auth_t *read_auths(FILE *f, int num_fields, uint32_t *num_auths) {
+    char line[512];
+    uint32_t size = 0, lineno = 0;
+    mfkey_auth_t *auths = NULL;
+
+    *num_auths = 0;
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        char *p = line;
+        while (*p == ' ' || *p == '\t')
+            p++;
+        if (*p == '#' || *p == '\r' || *p == '\n' || *p == '\0')
+            continue;
+
+        if (*num_auths == size) {
+            size = size ? size * 2 : 1024;
+            mfkey_auth_t *tmp = realloc(auths, size * sizeof(mfkey_auth_t));
+            if (tmp == NULL) {
+                free(auths);
+                return NULL;
+            }
+            auths = tmp;
+        }
+        if (!parse_auth(p, num_fields, &auths[*num_auths])) {
+            fprintf(stderr, "line %u: can't parse, skipped\n", lineno);
+            continue;
+        }
+        auths[*num_auths].line = lineno;
+        (*num_auths)++;
+    }
+    if (auths == NULL)
+        auths = malloc(sizeof(mfkey_auth_t));
+    return auths;
+}
+
+static void *batch_thread(void *arg) {
+    batch_t *batch = arg;
+    crapto1_tables_t *tables = NULL;
+
+    if (batch->use_tables) {
+        tables = crapto1_tables_create();
+        if (tables == NULL) {
+            batch->out_of_memory = true;
+            return NULL;
+        }
+    }
+
+    uint32_t g;
+    while ((g = __atomic_fetch_add(&batch->next_group, 1, __ATOMIC_RELAXED)) < batch->num_groups) {
+        for (uint32_t i = batch->group_first[g]; i < batch->group_first[g + 1]; i++) {
+            __atomic_fetch_add(&batch->cracked, 1, __ATOMIC_RELAXED);
+            if (batch->crack(&batch->auths[i], tables, &batch->keys[g])) {
+                batch->found[g] = true;
+                break;
+            }
+        }
+    }
+
+    crapto1_tables_destroy(tables);
+    return NULL;
+}
+
+static int compare_uint64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : (x > y);
+}
+
+static bool write_dictionary(const char *filename, uint64_t *keys, bool *found, uint32_t num_groups, uint32_t *num_keys) {
+    uint64_t *unique = calloc(num_groups + 1, sizeof(uint64_t));
+    if (unique == NULL)
+        return false;
+
+    uint32_t n = 0;
+    for (uint32_t g = 0; g < num_groups; g++)
+        if (found[g])
+            unique[n++] = keys[g];
+    qsort(unique, n, sizeof(uint64_t), compare_uint64);
+
+    FILE *f = fopen(filename, "w");
+    if (f == NULL) {
+        free(unique);
+        return false;
+    }
+    *num_keys = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        if (i > 0 && unique[i] == unique[i - 1])
+            continue;
+        fprintf(f, "%012" PRIx64 "\n", unique[i]);
+        (*num_keys)++;
+    }
+    free(unique);
+    return fclose(f) == 0;
+}
+
+int mfkey_batch(int argc, char *argv[], int num_fields, bool use_tables, mfkey_crack_t crack) {
+    const char *infile = NULL, *dictfile = NULL;
+    int num_threads = num_CPUs();
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            infile = argv[++i];
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            dictfile = argv[++i];
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            num_threads = atoi(argv[++i]);
+        } else {
+            printf("unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (infile == NULL) {
+        printf("no input file, use -f <file|->\n");
+        return 1;
+    }
+    if (num_threads < 1)
+        num_threads = 1;
+    if (num_threads > MAX_THREADS)
+        num_threads = MAX_THREADS;
+
+    FILE *f = strcmp(infile, "-") == 0 ? stdin : fopen(infile, "r");
+    if (f == NULL) {
+        printf("can't open %s\n", infile);
+        return 1;
+    }
+    batch_t batch;
+    memset(&batch, 0, sizeof(batch));
+    uint32_t num_auths;
+    batch.auths = read_auths(f, num_fields, &num_auths);
+    if (f != stdin)
+        fclose(f);
+    if (batch.auths == NULL) {
+        printf("out of memory\n");
+        return 2;
+    }
+
+    num_fields_cmp = num_fields;
+    qsort(batch.auths, num_auths, sizeof(mfkey_auth_t), compare_auth);
+
+    batch.group_first = calloc(num_auths + 1, sizeof(uint32_t));
+    batch.keys = calloc(num_auths + 1, sizeof(uint64_t));
+    batch.found = calloc(num_auths + 1, sizeof(bool));
+    if (batch.group_first == NULL || batch.keys == NULL || batch.found == NULL) {
+        printf("out of memory\n");
+        return 2;
+    }
+    for (uint32_t i = 0; i < num_auths; i++)
+        if (i == 0 || !same_group(&batch.auths[i - 1], &batch.auths[i]))
+            batch.group_first[batch.num_groups++] = i;
+    batch.group_first[batch.num_groups] = num_auths;
+    batch.use_tables = use_tables;
+    batch.crack = crack;
+
+    printf("%u authentications, %u unique (uid, block, key type), %d threads\n\n", num_auths, batch.num_groups, num_threads);
+
+    uint64_t t1 = msclock();
+    pthread_t thread_id[MAX_THREADS];
+    int started = 0;
+    for (; started < num_threads; started++)
+        if (pthread_create(&thread_id[started], NULL, batch_thread, &batch) != 0)
+            break;
+    if (started == 0)
+        batch_thread(&batch);
+    for (int i = 0; i < started; i++)
+        pthread_join(thread_id[i], NULL);
+    uint64_t ms = msclock() - t1;
+
+    // no thread got its tables
+    if (batch.out_of_memory && batch.next_group < batch.num_groups) {
+        printf("out of memory\n");
+        return 2;
+    }
+
+    uint32_t found = 0;
+    for (uint32_t g = 0; g < batch.num_groups; g++) {
+        mfkey_auth_t *auth = &batch.auths[batch.group_first[g]];
+        if (auth->block >= 0)
+            printf("uid %08x block %3d key %c  ", auth->field[0], auth->block, auth->keytype);
+        else
+            printf("uid %08x line %-5u       ", auth->field[0], auth->line);
+        if (batch.found[g]) {
+            printf("[%012" PRIx64 "]\n", batch.keys[g]);
+            found++;
+        } else {
+            printf("not found\n");
+        }
+    }
+
+    printf("\nfound %u of %u keys in %.1fs, %u authentications (%u cracked), %.2f auths/s\n",
+           found, batch.num_groups, ms / 1000.0, num_auths, batch.cracked, ms ? num_auths * 1000.0 / ms : 0.0);
+
+    int res = 0;
+    if (dictfile != NULL) {
+        uint32_t num_keys = 0;
+        if (write_dictionary(dictfile, batch.keys, batch.found, batch.num_groups, &num_keys)) {
+            printf("saved %u keys to %s\n", num_keys, dictfile);
+        } else {
+            printf("can't write %s\n", dictfile);
+            res = 1;
+        }
+    }
+
+    free(batch.auths);
+    free(batch.group_first);
+    free(batch.keys);
+    free(batch.found);
+    return res;
+}
@@ -0,0 +1,32 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Batch mode of mfkey32v2 and mfkey64: crack a file of sniffed authentications
+//-----------------------------------------------------------------------------
+
+#ifndef MFKEY_BATCH_H__
+#define MFKEY_BATCH_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "crapto1/crapto1.h"
+
+#define MFKEY_BATCH_MAX_FIELDS  7
+
+// one authentication, the hex fields in the order of the tool's command line
+typedef struct {
+    uint32_t field[MFKEY_BATCH_MAX_FIELDS];
+    int block;          // -1 if not given
+    char keytype;       // 'A', 'B' or 0 if not given
+    uint32_t line;
+} mfkey_auth_t;
+
+// recover the key of one authentication, tables are this thread's lfsr_recovery32 tables
+typedef bool (*mfkey_crack_t)(const mfkey_auth_t *auth, crapto1_tables_t *tables, uint64_t *key);
+
+void mfkey_batch_usage(const char *prog, const char *fields);
+int mfkey_batch(int argc, char *argv[], int num_fields, bool use_tables, mfkey_crack_t crack);
+
+#endif
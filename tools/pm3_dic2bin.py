@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+
+'''
+# pm3_dic2bin.py
+# Compiles .dic text dictionaries to the binary .bdic format the client maps
+# instead of parsing. Keys are deduplicated and sorted, or ordered by how many
+# times they appear in the input files, most frequent first.
+#
+# Usage: pm3_dic2bin.py [-k <keylen>] [-f] -o <output.bdic> <input.dic> [<input.dic> ...]
+#   -k  key length in bytes, 4 (t55xx), 6 (mifare) or 8 (iclass). Default 6
+#   -f  order by frequency instead of sorting
+'''
+
+import argparse
+import collections
+import struct
+import sys
+import zlib
+
+DICTIONARY_MAGIC = b'PM3DICT\0'
+DICTIONARY_VERSION = 1
+DICTIONARY_SORTED = 0x01
+DICTIONARY_BY_FREQUENCY = 0x02
+
+# dictionary_header_t in client/fileutils.h
+HEADER = struct.Struct('<8sIBBHQII')
+
+HEXDIGITS = set('0123456789abcdefABCDEF')
+
+
+def read_keys(filename, keylen, counts):
+    '''same rules as the client: comments, short lines and non hex lines are skipped'''
+    hexlen = keylen * 2
+    with open(filename, 'r', errors='replace') as f:
+        for line in f:
+            line = line[:hexlen]
+            if len(line) < hexlen or line[0] == '#':
+                continue
+            if line[0] not in HEXDIGITS:
+                print('%s: must include %d HEX symbols, skipping %s' % (filename, hexlen, line.rstrip()), file=sys.stderr)
+                continue
+            # like strtoull, up to the first non hex character
+            end = 0
+            while end < hexlen and line[end] in HEXDIGITS:
+                end += 1
+            counts[int(line[:end], 16)] += 1
+
+
+def crc32(data):
+    # common/crc32.c, without the final xor
+    return zlib.crc32(data) ^ 0xFFFFFFFF
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Compile .dic dictionaries for the Proxmark3 client')
+    parser.add_argument('-k', dest='keylen', type=int, default=6, choices=[4, 6, 8], help='key length in bytes')
+    parser.add_argument('-f', dest='by_frequency', action='store_true', help='most frequent keys first')
+    parser.add_argument('-o', dest='output', required=True, help='output .bdic file')
+    parser.add_argument('inputs', nargs='+', help='input .dic files')
+    args = parser.parse_args()
+
+    counts = collections.Counter()
+    for filename in args.inputs:
+        read_keys(filename, args.keylen, counts)
+
+    if args.by_frequency:
+        keys = sorted(counts, key=lambda k: (-counts[k], k))
+        flags = DICTIONARY_BY_FREQUENCY
+    else:
+        keys = sorted(counts)
+        flags = DICTIONARY_SORTED
+
+    header = HEADER.pack(DICTIONARY_MAGIC, DICTIONARY_VERSION, args.keylen, flags, HEADER.size, len(keys), 0, 0)
+    header = HEADER.pack(DICTIONARY_MAGIC, DICTIONARY_VERSION, args.keylen, flags, HEADER.size, len(keys), crc32(header), 0)
+
+    with open(args.output, 'wb') as f:
+        f.write(header)
+        for i in range(0, len(keys), 65536):
+            f.write(b''.join(k.to_bytes(args.keylen, 'big') for k in keys[i:i + 65536]))
+
+    print('%d keys (%d unique) written to %s' % (sum(counts.values()), len(keys), args.output))
+
+
+if __name__ == '__main__':
+    main()
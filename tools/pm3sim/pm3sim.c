@@ -0,0 +1,810 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Virtual Proxmark3 on a pseudo terminal
+//
+// Speaks the OLD, MIX and NG frame formats like the firmware over USB, so the
+// client and its communication stack can be tested and benchmarked without
+// hardware:  ./pm3sim &  then  ../../client/proxmark3 /dev/pts/N
+//
+// Answers ping, capabilities, status and the BigBuf, emulator and flash memory
+// downloads (raw or compressed), other commands from a file of canned replies.
+// The emulator memory is a MIFARE Classic card: 14a selects answer with the
+// UID, SAK and ATQA of block 0, hf mf chk, fchk, rdbl and nested run against
+// its sector trailers. The card has a weak PRNG, nested nonces are exact.
+//-----------------------------------------------------------------------------
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 600
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include "pm3_cmd.h"
+#include "mifare.h"
+#include "pmflash.h"
+#include "crc16.h"
+#include "commonutil.h"
+#include "rledelta.h"
+#include "util_posix.h"
+#include "crapto1/crapto1.h"
+
+#define BIGBUF_SIZE             40000
+#define EML_SIZE                4096
+#define FLASH_SIZE              FLASH_MEM_MAX_SIZE
+#define MAX_CANNED              256
+#define CONN_SPEED_TEST_MS      500
+
+typedef struct {
+    uint16_t cmd;
+    int16_t status;
+    uint16_t len;
+    uint8_t data[PM3_CMD_DATA_SIZE];
+} canned_reply_t;
+
+static int master = -1;
+static uint8_t bigbuf[BIGBUF_SIZE];
+static uint8_t emlbuf[EML_SIZE];
+static uint8_t *flashmem;
+static canned_reply_t canned[MAX_CANNED];
+static int num_canned = 0;
+
+// options
+static uint32_t reply_delay_us = 0;     // before answering a command
+static uint32_t link_rate = 0;          // bytes/s, 0 = as fast as the pty goes
+static uint32_t auth_us = 0;            // per MIFARE authentication attempt
+static uint32_t nested_us = 0;          // to collect the nonces of a nested attack
+static bool with_compression = true;
+static bool with_seq = true;
+static bool with_chkkeys_stream = true;
+static bool verbose = false;
+
+// the reply to a sequenced command carries its number
+static bool reply_with_seq = false;
+static uint16_t reply_seq = 0;
+
+// link throttling, the time the last byte sent is on the other side
+static uint64_t link_busy_until_us = 0;
+
+static uint64_t stat_commands = 0, stat_frames = 0, stat_bytes = 0;
+
+static bool write_all(const uint8_t *buf, size_t len) {
+    while (len > 0) {
+        ssize_t res = write(master, buf, len);
+        if (res < 0) {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            return false;
+        }
+        buf += res;
+        len -= res;
+    }
+    return true;
+}
+
+static bool read_all(uint8_t *buf, size_t len) {
+    while (len > 0) {
+        ssize_t res = read(master, buf, len);
+        if (res < 0 && (errno == EINTR || errno == EAGAIN))
+            continue;
+        if (res < 0 && errno == EIO) {
+            // no client on the slave side, wait for one
+            msleep(10);
+            continue;
+        }
+        if (res <= 0)
+            return false;
+        buf += res;
+        len -= res;
+    }
+    return true;
+}
+
+static void send_frame(const uint8_t *frame, size_t len) {
+    if (link_rate) {
+        uint64_t now = usclock();
+        if (link_busy_until_us < now)
+            link_busy_until_us = now;
+        link_busy_until_us += len * 1000000ULL / link_rate;
+        if (link_busy_until_us > now + 1000)
+            usleep(link_busy_until_us - now);
+    }
+    write_all(frame, len);
+    stat_frames++;
+    stat_bytes += len;
+}
+
+static void reply_ng_internal(uint16_t cmd, int16_t status, const uint8_t *data, size_t len, bool ng) {
+    PacketResponseNGSeqRaw frame;
+    size_t header_len = sizeof(PacketResponseNGPreamble);
+
+    frame.pre.magic = RESPONSENG_PREAMBLE_MAGIC;
+    if (reply_with_seq) {
+        frame.pre.magic = RESPONSENG_SEQ_PREAMBLE_MAGIC;
+        frame.seq = reply_seq;
+        header_len += sizeof(frame.seq);
+    }
+    uint8_t *payload = (uint8_t *)&frame + header_len;
+    frame.pre.length = len;
+    frame.pre.ng = ng;
+    frame.pre.status = status;
+    frame.pre.cmd = cmd;
+    memcpy(payload, data, len);
+    // like the firmware over USB, no CRC
+    PacketResponseNGPostamble post = { .crc = RESPONSENG_POSTAMBLE_MAGIC };
+    memcpy(payload + len, &post, sizeof(post));
+    send_frame((uint8_t *)&frame, header_len + len + sizeof(post));
+}
+
+static void reply_ng(uint16_t cmd, int16_t status, const uint8_t *data, size_t len) {
+    reply_ng_internal(cmd, status, data, len, true);
+}
+
+static void reply_mix(uint16_t cmd, uint64_t arg0, uint64_t arg1, uint64_t arg2, const uint8_t *data, size_t len) {
+    uint8_t payload[PM3_CMD_DATA_SIZE];
+    uint64_t arg[3] = {arg0, arg1, arg2};
+    len = len > PM3_CMD_DATA_SIZE_MIX ? PM3_CMD_DATA_SIZE_MIX : len;
+    memcpy(payload, arg, sizeof(arg));
+    memcpy(payload + sizeof(arg), data, len);
+    reply_ng_internal(cmd, PM3_SUCCESS, payload, sizeof(arg) + len, false);
+}
+
+static void reply_old(uint64_t cmd, uint64_t arg0, uint64_t arg1, uint64_t arg2, const void *data, size_t len) {
+    PacketResponseOLD frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.cmd = cmd;
+    frame.arg[0] = arg0;
+    frame.arg[1] = arg1;
+    frame.arg[2] = arg2;
+    if (data)
+        memcpy(frame.d.asBytes, data, len > PM3_CMD_DATA_SIZE ? PM3_CMD_DATA_SIZE : len);
+    send_frame((uint8_t *)&frame, sizeof(frame));
+}
+
+static void dbprint(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+static void dbprint(const char *fmt, ...) {
+    struct {
+        uint16_t flag;
+        char buf[PM3_CMD_DATA_SIZE - sizeof(uint16_t)];
+    } PACKED data;
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(data.buf, sizeof(data.buf), fmt, ap);
+    va_end(ap);
+    data.flag = FLAG_LOG;
+    reply_ng(CMD_DEBUG_PRINT_STRING, PM3_SUCCESS, (uint8_t *)&data, sizeof(data.flag) + strlen(data.buf));
+}
+
+// same as SendDownload() in armsrc/appmain.c
+static void send_download(uint16_t cmd, uint32_t base, const uint8_t *mem, uint32_t numofbytes, uint64_t arg2, bool compressed) {
+    for (uint32_t i = 0; i < numofbytes;) {
+        uint32_t len;
+        if (compressed) {
+            uint8_t block[PM3_CMD_DATA_SIZE_MIX];
+            uint32_t blocklen = rledelta_encode(mem + i, numofbytes - i, block, sizeof(block), &len);
+            reply_mix(cmd, base + i, len | DOWNLOAD_COMPRESSED, arg2, block, blocklen);
+        } else {
+            len = numofbytes - i > PM3_CMD_DATA_SIZE ? PM3_CMD_DATA_SIZE : numofbytes - i;
+            reply_old(cmd, base + i, len, arg2, mem + i, len);
+        }
+        i += len;
+    }
+}
+
+// clamps a download request to the simulated memory
+static uint32_t dl_len(uint64_t start, uint64_t len, uint32_t size) {
+    if (start >= size)
+        return 0;
+    return len > size - start ? size - start : len;
+}
+
+static void send_capabilities(void) {
+    capabilities_t caps;
+    memset(&caps, 0, sizeof(caps));
+    caps.version = CAPABILITIES_VERSION;
+    caps.via_usb = true;
+    caps.compiled_with_flash = true;
+    caps.compiled_with_lf = true;
+    caps.compiled_with_hitag = true;
+    caps.compiled_with_hfsniff = true;
+    caps.compiled_with_iso14443a = true;
+    caps.compiled_with_iso14443b = true;
+    caps.compiled_with_iso15693 = true;
+    caps.compiled_with_felica = true;
+    caps.compiled_with_legicrf = true;
+    caps.compiled_with_iclass = true;
+    caps.hw_available_flash = true;
+    caps.sequenced_frames = with_seq;
+    caps.compressed_download = with_compression;
+    caps.mifare_chkkeys_stream = with_chkkeys_stream;
+    // firmware from before the stream command, its spare bits are garbage
+    if (with_chkkeys_stream == false) {
+        caps.version = 5;
+        caps.mifare_chkkeys_stream = true;
+    }
+    reply_ng(CMD_CAPABILITIES, PM3_SUCCESS, (uint8_t *)&caps, sizeof(caps));
+}
+
+static void send_status(void) {
+    dbprint("[ pm3sim ]");
+    dbprint("  commands................%" PRIu64, stat_commands);
+    dbprint("  frames sent.............%" PRIu64, stat_frames);
+    dbprint("  bytes sent..............%" PRIu64, stat_bytes);
+    dbprint("  link rate...............%s", link_rate ? "throttled" : "unlimited");
+
+    dbprint("Transfer Speed");
+    dbprint("  Sending packets to client...");
+    uint64_t start = msclock();
+    uint64_t delta = 0;
+    uint32_t bytes = 0;
+    while (delta < CONN_SPEED_TEST_MS) {
+        reply_ng(CMD_DOWNLOADED_BIGBUF, PM3_SUCCESS, bigbuf, PM3_CMD_DATA_SIZE);
+        bytes += PM3_CMD_DATA_SIZE;
+        delta = msclock() - start;
+    }
+    dbprint("  Time elapsed............%" PRIu64 "ms", delta);
+    dbprint("  Bytes transferred.......%u", bytes);
+    dbprint("  Transfer Speed PM3 -> Client = %" PRIu64 "bytes/s", (uint64_t)1000 * bytes / delta);
+    reply_ng(CMD_STATUS, PM3_SUCCESS, NULL, 0);
+}
+
+// MIFARE card of the emulator memory, key A and B of sector s from its trailer
+static bool mf_auth(uint8_t s, uint8_t keytype, const uint8_t *key) {
+    uint32_t blockno = (s < 32) ? s * 4 + 3 : 128 + (s - 32) * 16 + 15;
+    if (auth_us)
+        usleep(auth_us);
+    return memcmp(emlbuf + blockno * 16 + (keytype ? 10 : 0), key, 6) == 0;
+}
+
+static uint8_t mf_sector(uint8_t blockno) {
+    return (blockno < 128) ? blockno / 4 : 32 + (blockno - 128) / 16;
+}
+
+// weak PRNG, 16 bit LFSR
+static uint32_t mf_nonce(void) {
+    return prng_successor(0x01200145, rand() % 0xFFFF);
+}
+
+static uint32_t mf_cuid(void) {
+    uint32_t cuid;
+    memcpy(&cuid, emlbuf, 4);
+    return cuid;
+}
+
+// CMD_HF_MIFARE_CHKKEYS
+static void chkkeys(PacketCommandNG *packet) {
+    uint8_t keytype = packet->data.asBytes[0];
+    uint8_t blockno = packet->data.asBytes[1];
+    uint8_t keycnt = MIN(packet->data.asBytes[3], (packet->length - 4) / 6);
+    struct {
+        uint8_t key[6];
+        bool found;
+    } PACKED keyresult = {0};
+
+    for (uint8_t i = 0; i < keycnt && !keyresult.found; i++) {
+        if (mf_auth(mf_sector(blockno), keytype, packet->data.asBytes + 4 + i * 6)) {
+            memcpy(keyresult.key, packet->data.asBytes + 4 + i * 6, 6);
+            keyresult.found = true;
+        }
+    }
+    reply_ng(CMD_HF_MIFARE_CHKKEYS, PM3_SUCCESS, (uint8_t *)&keyresult, sizeof(keyresult));
+}
+
+// CMD_HF_MIFARE_CHKKEYS_STREAM, packets after the key was found are aborted
+static void chkkeys_stream(PacketCommandNG *packet) {
+    static bool active = false;
+    mf_chkkeys_stream_t *payload = (mf_chkkeys_stream_t *)packet->data.asBytes;
+    mf_chkkeys_stream_result_t keyresult = {0};
+
+    if (payload->flags & MF_CHKKEYS_STREAM_FIRST)
+        active = true;
+
+    if (!active) {
+        reply_ng(CMD_HF_MIFARE_CHKKEYS_STREAM, PM3_EOPABORTED, (uint8_t *)&keyresult, sizeof(keyresult));
+        return;
+    }
+
+    for (uint8_t i = 0; i < payload->keycnt; i++) {
+        keyresult.checked++;
+        if (mf_auth(mf_sector(payload->blockno), payload->keytype, payload->keys + i * 6)) {
+            memcpy(keyresult.key, payload->keys + i * 6, 6);
+            keyresult.found = true;
+            break;
+        }
+    }
+    reply_ng(CMD_HF_MIFARE_CHKKEYS_STREAM, PM3_SUCCESS, (uint8_t *)&keyresult, sizeof(keyresult));
+    if (keyresult.found || (payload->flags & MF_CHKKEYS_STREAM_LAST))
+        active = false;
+}
+
+// CMD_HF_MIFARE_READBL, key B of a trailer reads as zeros like on most cards
+static void readblock(PacketCommandNG *packet) {
+    mf_readblock_t *payload = (mf_readblock_t *)packet->data.asBytes;
+    uint8_t data[16] = {0};
+    if (!mf_auth(mf_sector(payload->blockno), payload->keytype, payload->key)) {
+        reply_ng(CMD_HF_MIFARE_READBL, PM3_ESOFT, data, sizeof(data));
+        return;
+    }
+    memcpy(data, emlbuf + payload->blockno * 16, 16);
+    if (payload->blockno == ((payload->blockno < 128) ? (payload->blockno | 3) : (payload->blockno | 15)))
+        memset(data, 0, 6);
+    reply_ng(CMD_HF_MIFARE_READBL, PM3_SUCCESS, data, sizeof(data));
+}
+
+// CMD_HF_MIFARE_NESTED, two nonces of the target key and their keystream
+static void nested(PacketCommandNG *packet) {
+    struct {
+        uint8_t block;
+        uint8_t keytype;
+        uint8_t target_block;
+        uint8_t target_keytype;
+        bool calibrate;
+        uint8_t key[6];
+    } PACKED *payload = (void *)packet->data.asBytes;
+    struct {
+        int16_t isOK;
+        uint8_t block;
+        uint8_t keytype;
+        uint8_t cuid[4];
+        struct {
+            uint32_t nt;
+            uint32_t ks;
+        } PACKED nonce[2];
+    } PACKED result = {0};
+
+    if (nested_us)
+        usleep(nested_us);
+
+    result.block = payload->target_block;
+    result.keytype = payload->target_keytype;
+    uint32_t cuid = mf_cuid();
+    memcpy(result.cuid, &cuid, 4);
+    if (!mf_auth(mf_sector(payload->block), payload->keytype, payload->key)) {
+        result.isOK = -4;
+        reply_ng(CMD_HF_MIFARE_NESTED, PM3_SUCCESS, (uint8_t *)&result, sizeof(result));
+        return;
+    }
+
+    uint8_t s = mf_sector(payload->target_block);
+    uint32_t blockno = (s < 32) ? s * 4 + 3 : 128 + (s - 32) * 16 + 15;
+    uint64_t key = bytes_to_num(emlbuf + blockno * 16 + (payload->target_keytype ? 10 : 0), 6);
+    for (int i = 0; i < 2; i++) {
+        result.nonce[i].nt = mf_nonce();
+        struct Crypto1State *pcs = crypto1_create(key);
+        result.nonce[i].ks = crypto1_word(pcs, result.nonce[i].nt ^ cuid, 0);
+        crypto1_destroy(pcs);
+    }
+    reply_ng(CMD_HF_MIFARE_NESTED, PM3_SUCCESS, (uint8_t *)&result, sizeof(result));
+}
+
+// a found key is tried on the other open sectors as well
+static void chkkeys_fast_found(const uint8_t *key, uint8_t k, uint8_t allkeys, uint8_t *found, uint8_t keys[][6], uint8_t *foundkeys) {
+    for (uint8_t o = 0; o < allkeys; o++) {
+        if (found[o] == 0 && (o == k || mf_auth(o / 2, o & 1, key))) {
+            memcpy(keys[o], key, 6);
+            found[o] = 1;
+            (*foundkeys)++;
+        }
+    }
+}
+
+// CMD_HF_MIFARE_CHKKEYS_FAST, strategy 1 depth first from the first open sector,
+// 2 width first. The state lives from the first to the last chunk like on the
+// device, every chunk is answered with the keys found so far.
+static void chkkeys_fast(PacketCommandNG *packet) {
+    static bool active = false;
+    static uint8_t foundkeys = 0;
+    static uint8_t found[80];
+    static uint8_t keys[80][6];
+
+    uint8_t sectorcnt = MIN(packet->oldarg[0] & 0xFF, 40);
+    bool firstchunk = (packet->oldarg[0] >> 8) & 0xF;
+    bool lastchunk = (packet->oldarg[0] >> 12) & 0xF;
+    uint8_t strategy = packet->oldarg[1] & 0xFF;
+    uint16_t keycnt = MIN(packet->oldarg[2] & 0xFF, packet->length / 6);
+    uint8_t allkeys = sectorcnt * 2;
+
+    if (firstchunk) {
+        memset(found, 0, sizeof(found));
+        memset(keys, 0, sizeof(keys));
+        foundkeys = 0;
+        active = true;
+    }
+
+    if (active && strategy == 1) {
+        for (uint8_t s = 0; s < sectorcnt && foundkeys < allkeys; s++) {
+            if (found[s * 2] && found[s * 2 + 1])
+                continue;
+            uint8_t before = foundkeys;
+            for (uint16_t i = 0; i < keycnt && (found[s * 2] & found[s * 2 + 1]) == 0; i++) {
+                for (uint8_t t = 0; t < 2; t++)
+                    if (found[s * 2 + t] == 0 && mf_auth(s, t, packet->data.asBytes + i * 6))
+                        chkkeys_fast_found(packet->data.asBytes + i * 6, s * 2 + t, allkeys, found, keys, &foundkeys);
+            }
+            // nothing in the first open sector, next chunk
+            if (foundkeys == before)
+                break;
+        }
+    }
+
+    if (active && strategy == 2) {
+        for (uint16_t i = 0; i < keycnt && foundkeys < allkeys; i++) {
+            for (uint8_t o = 0; o < allkeys; o++)
+                if (found[o] == 0 && mf_auth(o / 2, o & 1, packet->data.asBytes + i * 6))
+                    chkkeys_fast_found(packet->data.asBytes + i * 6, o, allkeys, found, keys, &foundkeys);
+        }
+    }
+
+    uint8_t result[480 + 10] = {0};
+    uint64_t bitmap = 0;
+    for (uint8_t o = 0; o < allkeys; o++) {
+        memcpy(result + (o / 2) * 12 + (o & 1) * 6, keys[o], 6);
+        if (found[o] && o < 64)
+            bitmap |= (uint64_t)1 << o;
+        if (found[o] && o >= 64)
+            result[488 + (o - 64) / 8] |= 1 << ((o - 64) % 8);
+    }
+    for (int b = 0; b < 8; b++)
+        result[480 + b] = bitmap >> (56 - 8 * b);
+
+    reply_old(CMD_ACK, foundkeys, 0, 0, result, sizeof(result));
+    if (foundkeys == allkeys || lastchunk)
+        active = false;
+}
+
+static void handle_command(PacketCommandNG *packet) {
+    stat_commands++;
+    if (verbose)
+        printf("cmd 0x%04x %s len %u%s\n", packet->cmd, packet->ng ? "NG" : "MIX/OLD", packet->length, packet->has_seq ? " seq" : "");
+    if (reply_delay_us)
+        usleep(reply_delay_us);
+
+    reply_with_seq = packet->has_seq;
+    reply_seq = packet->seq;
+
+    for (int i = 0; i < num_canned; i++) {
+        if (canned[i].cmd == packet->cmd) {
+            reply_ng(canned[i].cmd, canned[i].status, canned[i].data, canned[i].len);
+            reply_with_seq = false;
+            return;
+        }
+    }
+
+    switch (packet->cmd) {
+        case CMD_PING:
+            reply_ng(CMD_PING, PM3_SUCCESS, packet->data.asBytes, packet->length);
+            break;
+        case CMD_CAPABILITIES:
+            send_capabilities();
+            break;
+        case CMD_QUIT_SESSION:
+            break;
+        case CMD_STATUS:
+            send_status();
+            break;
+        case CMD_DOWNLOAD_BIGBUF: {
+            sample_config config = { .decimation = 1, .bits_per_sample = 8, .averaging = 1 };
+            uint32_t len = dl_len(packet->oldarg[0], packet->oldarg[1], BIGBUF_SIZE);
+            bool compressed = with_compression && (packet->oldarg[2] & DOWNLOAD_COMPRESSED);
+            send_download(CMD_DOWNLOADED_BIGBUF, 0, bigbuf + packet->oldarg[0], len, BIGBUF_SIZE, compressed);
+            reply_old(CMD_ACK, 1, 0, BIGBUF_SIZE, &config, sizeof(config));
+            break;
+        }
+        case CMD_DOWNLOAD_EML_BIGBUF: {
+            uint32_t len = dl_len(packet->oldarg[0], packet->oldarg[1], EML_SIZE);
+            bool compressed = with_compression && (packet->oldarg[2] & DOWNLOAD_COMPRESSED);
+            send_download(CMD_DOWNLOADED_EML_BIGBUF, 0, emlbuf + packet->oldarg[0], len, 0, compressed);
+            reply_old(CMD_ACK, 1, 0, 0, NULL, 0);
+            break;
+        }
+        case CMD_FLASHMEM_DOWNLOAD: {
+            uint32_t len = dl_len(packet->oldarg[0], packet->oldarg[1], FLASH_SIZE);
+            bool compressed = with_compression && (packet->oldarg[2] & DOWNLOAD_COMPRESSED);
+            send_download(CMD_FLASHMEM_DOWNLOADED, 0, flashmem + packet->oldarg[0], len, 0, compressed);
+            reply_old(CMD_ACK, 1, 0, 0, NULL, 0);
+            break;
+        }
+        case CMD_HF_ISO14443A_READER: {
+            iso14a_card_select_t card = {0};
+            card.uidlen = 4;
+            memcpy(card.uid, emlbuf, 4);
+            card.sak = emlbuf[5];
+            card.atqa[0] = emlbuf[6];
+            card.atqa[1] = emlbuf[7];
+            bool connect = packet->oldarg[0] & ISO14A_CONNECT;
+            reply_mix(CMD_ACK, connect ? 1 : 0, connect ? card.uidlen : 0, 0, (uint8_t *)&card, sizeof(card));
+            // an authentication answers with the nonce of a weak PRNG
+            if (connect && (packet->oldarg[0] & ISO14A_RAW) && packet->length && (packet->data.asBytes[0] & 0xFE) == 0x60) {
+                uint8_t nt[4];
+                num_to_bytes(mf_nonce(), 4, nt);
+                reply_mix(CMD_ACK, sizeof(nt), 0, 0, nt, sizeof(nt));
+            }
+            break;
+        }
+        case CMD_HF_MIFARE_CHKKEYS_FAST:
+            chkkeys_fast(packet);
+            break;
+        case CMD_HF_MIFARE_CHKKEYS:
+            chkkeys(packet);
+            break;
+        case CMD_HF_MIFARE_CHKKEYS_STREAM:
+            // unknown to firmwares without it, no reply
+            if (with_chkkeys_stream)
+                chkkeys_stream(packet);
+            break;
+        case CMD_HF_MIFARE_READBL:
+            readblock(packet);
+            break;
+        case CMD_HF_MIFARE_NESTED:
+            nested(packet);
+            break;
+        case CMD_HF_MIFARE_EML_MEMGET: {
+            uint8_t blockno = packet->data.asBytes[0];
+            uint8_t blockcnt = packet->data.asBytes[1];
+            if (blockno * 16 + blockcnt * 16 > EML_SIZE || blockcnt * 16 > PM3_CMD_DATA_SIZE) {
+                reply_ng(CMD_HF_MIFARE_EML_MEMGET, PM3_EOUTOFBOUND, NULL, 0);
+                break;
+            }
+            reply_ng(CMD_HF_MIFARE_EML_MEMGET, PM3_SUCCESS, emlbuf + blockno * 16, blockcnt * 16);
+            break;
+        }
+        case CMD_HF_MIFARE_EML_MEMSET:
+            // the emulator memory is the card, keep it
+            break;
+        case CMD_HF_MIFARE_EML_LOAD:
+            reply_ng(CMD_HF_MIFARE_EML_LOAD, PM3_SUCCESS, NULL, 0);
+            break;
+        default:
+            dbprint("%s: 0x%04x", "unknown command:", packet->cmd);
+            break;
+    }
+    reply_with_seq = false;
+}
+
+// reads one command frame, false if the pty is gone
+static bool receive_command(PacketCommandNG *packet) {
+    PacketCommandNGSeqRaw raw;
+
+    memset(packet, 0, sizeof(PacketCommandNG));
+    if (!read_all((uint8_t *)&raw.pre, sizeof(raw.pre)))
+        return false;
+
+    if (raw.pre.magic != COMMANDNG_PREAMBLE_MAGIC && raw.pre.magic != COMMANDNG_SEQ_PREAMBLE_MAGIC) {
+        PacketCommandOLD old;
+        memcpy(&old, &raw.pre, sizeof(raw.pre));
+        if (!read_all((uint8_t *)&old + sizeof(raw.pre), sizeof(old) - sizeof(raw.pre)))
+            return false;
+        packet->magic = 0;
+        packet->ng = false;
+        packet->cmd = old.cmd;
+        packet->oldarg[0] = old.arg[0];
+        packet->oldarg[1] = old.arg[1];
+        packet->oldarg[2] = old.arg[2];
+        packet->length = PM3_CMD_DATA_SIZE;
+        memcpy(packet->data.asBytes, old.d.asBytes, PM3_CMD_DATA_SIZE);
+        return true;
+    }
+
+    size_t header_len = sizeof(raw.pre);
+    uint8_t *payload = (uint8_t *)&raw.seq;
+    if (raw.pre.magic == COMMANDNG_SEQ_PREAMBLE_MAGIC) {
+        if (!read_all((uint8_t *)&raw.seq, sizeof(raw.seq)))
+            return false;
+        packet->has_seq = true;
+        packet->seq = raw.seq;
+        header_len += sizeof(raw.seq);
+        payload = raw.data;
+    }
+    uint16_t length = raw.pre.length;
+    PacketCommandNGPostamble post;
+    if (length > PM3_CMD_DATA_SIZE)
+        return false;
+    if (!read_all(payload, length) || !read_all((uint8_t *)&post, sizeof(post)))
+        return false;
+
+    if (post.crc != COMMANDNG_POSTAMBLE_MAGIC) {
+        uint8_t first, second;
+        compute_crc(CRC_14443_A, (uint8_t *)&raw, header_len + length, &first, &second);
+        if ((first << 8) + second != post.crc) {
+            printf("frame 0x%04x with invalid CRC, dropped\n", raw.pre.cmd);
+            packet->cmd = 0;
+            return true;
+        }
+    }
+
+    packet->magic = raw.pre.magic;
+    packet->ng = raw.pre.ng;
+    packet->cmd = raw.pre.cmd;
+    packet->crc = post.crc;
+    if (packet->ng) {
+        packet->length = length;
+        memcpy(packet->data.asBytes, payload, length);
+    } else {
+        uint64_t arg[3] = {0};
+        if (length < sizeof(arg))
+            return true;
+        memcpy(arg, payload, sizeof(arg));
+        packet->oldarg[0] = arg[0];
+        packet->oldarg[1] = arg[1];
+        packet->oldarg[2] = arg[2];
+        packet->length = length - sizeof(arg);
+        memcpy(packet->data.asBytes, payload + sizeof(arg), packet->length);
+    }
+    return true;
+}
+
+// an LF read: noisy envelope of a manchester modulated tag, then the unused BigBuf
+static void fill_bigbuf(void) {
+    double v = 128;
+    srand(0x1337);
+    for (uint32_t i = 0; i < 30000; i++) {
+        double target = ((i / 32) ^ (i / 96)) & 1 ? 200 : 60;
+        v += (target - v) * 0.3;
+        bigbuf[i] = (uint8_t)(v + rand() % 5 - 2);
+    }
+    for (uint32_t i = 0; i < EML_SIZE; i++)
+        emlbuf[i] = (i % 64 >= 48) ? 0xFF : 0x00;     // MIFARE 1k, empty sectors with default keys
+    memcpy(emlbuf, "\x01\x02\x03\x04\x04\x08\x04\x00", 8);    // UID, BCC, SAK, ATQA
+    // flash is erased but the beginning
+    memset(flashmem, 0xFF, FLASH_SIZE);
+    for (uint32_t i = 0; i < 0x2000; i++)
+        flashmem[i] = rand();
+}
+
+static bool load_file(const char *filename, uint8_t *dest, size_t size) {
+    FILE *f = fopen(filename, "rb");
+    if (f == NULL)
+        return false;
+    memset(dest, 0, size);
+    size_t n = fread(dest, 1, size, f);
+    fclose(f);
+    printf("loaded %zu bytes from %s\n", n, filename);
+    return true;
+}
+
+// lines of "<cmd> <status> [<hex payload>]", cmd in hex, status in decimal
+static bool load_canned(const char *filename) {
+    FILE *f = fopen(filename, "r");
+    if (f == NULL)
+        return false;
+    char line[2 * PM3_CMD_DATA_SIZE + 64];
+    while (fgets(line, sizeof(line), f) && num_canned < MAX_CANNED) {
+        unsigned int cmd;
+        int status, n;
+        char *p = line;
+        if (*p == '#' || sscanf(p, "%x %d%n", &cmd, &status, &n) != 2)
+            continue;
+        p += n;
+        canned_reply_t *c = &canned[num_canned++];
+        c->cmd = cmd;
+        c->status = status;
+        c->len = 0;
+        unsigned int b;
+        while (c->len < PM3_CMD_DATA_SIZE && sscanf(p, " %2x%n", &b, &n) == 1) {
+            c->data[c->len++] = b;
+            p += n;
+        }
+    }
+    fclose(f);
+    printf("loaded %d canned replies from %s\n", num_canned, filename);
+    return true;
+}
+
+static void usage(const char *prog) {
+    printf("Virtual Proxmark3 on a pseudo terminal\n\n");
+    printf("syntax: %s [options]\n\n", prog);
+    printf("  -b <file>     BigBuf contents, e.g. raw samples\n");
+    printf("  -e <file>     emulator memory contents\n");
+    printf("  -r <file>     canned replies, lines of \"<cmd hex> <status> [<payload hex>]\"\n");
+    printf("  -d <us>       delay before answering each command\n");
+    printf("  -s <bytes/s>  throttle the link, e.g. 11520 for a 115200 baud FPC link\n");
+    printf("  -a <us>       time of a MIFARE authentication attempt, e.g. 2000\n");
+    printf("  -n <us>       time to collect the nonces of a nested attack, e.g. 500000\n");
+    printf("  -R            no compressed downloads\n");
+    printf("  -S            no sequenced frames\n");
+    printf("  -K            no streamed MIFARE key checks (CMD_HF_MIFARE_CHKKEYS_STREAM), capabilities version 5\n");
+    printf("  -p <file>     write the pty name to <file> once it is ready\n");
+    printf("  -v            print the commands received\n\n");
+    printf("  the client connects with: proxmark3 <pty>\n\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *ptyfile = NULL;
+
+    flashmem = malloc(FLASH_SIZE);
+    if (flashmem == NULL) {
+        printf("out of memory\n");
+        return 2;
+    }
+    fill_bigbuf();
+
+    for (int i = 1; i < argc; i++) {
+        bool has_arg = i + 1 < argc;
+        if (strcmp(argv[i], "-b") == 0 && has_arg) {
+            if (!load_file(argv[++i], bigbuf, sizeof(bigbuf))) {
+                printf("can't read %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-e") == 0 && has_arg) {
+            if (!load_file(argv[++i], emlbuf, sizeof(emlbuf))) {
+                printf("can't read %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-r") == 0 && has_arg) {
+            if (!load_canned(argv[++i])) {
+                printf("can't read %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-d") == 0 && has_arg) {
+            reply_delay_us = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "-a") == 0 && has_arg) {
+            auth_us = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "-n") == 0 && has_arg) {
+            nested_us = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "-s") == 0 && has_arg) {
+            link_rate = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "-p") == 0 && has_arg) {
+            ptyfile = argv[++i];
+        } else if (strcmp(argv[i], "-R") == 0) {
+            with_compression = false;
+        } else if (strcmp(argv[i], "-S") == 0) {
+            with_seq = false;
+        } else if (strcmp(argv[i], "-K") == 0) {
+            with_chkkeys_stream = false;
+        } else if (strcmp(argv[i], "-v") == 0) {
+            verbose = true;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+        printf("can't open a pseudo terminal: %s\n", strerror(errno));
+        return 1;
+    }
+    const char *name = ptsname(master);
+
+    // keep the slave side open and raw, so the pty survives the client
+    // reconnecting and nothing is echoed before the client configures it
+    int slave = open(name, O_RDWR | O_NOCTTY);
+    struct termios ti;
+    if (slave < 0 || tcgetattr(slave, &ti) != 0) {
+        printf("can't open %s: %s\n", name, strerror(errno));
+        return 1;
+    }
+    cfmakeraw(&ti);
+    tcsetattr(slave, TCSANOW, &ti);
+
+    printf("pm3sim on %s\n", name);
+    fflush(stdout);
+    if (ptyfile) {
+        FILE *f = fopen(ptyfile, "w");
+        if (f == NULL) {
+            printf("can't write %s\n", ptyfile);
+            return 1;
+        }
+        fprintf(f, "%s\n", name);
+        fclose(f);
+    }
+
+    PacketCommandNG packet;
+    while (receive_command(&packet)) {
+        if (packet.cmd != 0)
+            handle_command(&packet);
+        fflush(stdout);
+    }
+
+    close(slave);
+    close(master);
+    free(flashmem);
+    return 0;
+}
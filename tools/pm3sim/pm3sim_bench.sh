@@ -0,0 +1,66 @@
+#!/usr/bin/env bash
+
+# Benchmarks the client communication stack against pm3sim, no hardware needed.
+# Reports commands/s and round trip percentiles (hw latency), and the download
+# speed of BigBuf (data samples) and flash memory (mem dump) for a few links.
+#
+#   ./pm3sim_bench.sh [<pings>]
+#
+# CLIENT can point to another client binary. Exits with 1 if a step fails.
+
+PINGS=${1:-1000}
+cd "$(dirname "$0")" || exit 1
+CLIENT=${CLIENT:-../../client/proxmark3}
+SIM=./pm3sim
+
+if [ ! -x "$SIM" ] || [ ! -x "$CLIENT" ]; then
+    echo "build the client and pm3sim first (make client, make -C tools/pm3sim)"
+    exit 1
+fi
+
+TMP=$(mktemp -d)
+trap 'kill $SIMPID 2>/dev/null; rm -rf "$TMP"' EXIT
+
+# name, link rate in bytes/s (0 = pty speed), extra pm3sim options
+SCENARIOS=(
+    "usb|0|"
+    "usb-raw|0|-R"
+    "fpc-115200|11520|"
+    "fpc-115200-raw|11520|-R"
+)
+
+FAILED=0
+printf "%-16s %10s %9s %9s %9s %14s %14s\n" "link" "cmds/s" "p50 ms" "p90 ms" "p99 ms" "samples kB/s" "flash kB/s"
+for s in "${SCENARIOS[@]}"; do
+    IFS='|' read -r NAME RATE OPTS <<< "$s"
+    rm -f "$TMP/pty"
+    # shellcheck disable=SC2086
+    $SIM -p "$TMP/pty" -s "$RATE" $OPTS > "$TMP/sim.log" 2>&1 &
+    SIMPID=$!
+    for _ in $(seq 50); do [ -s "$TMP/pty" ] && break; sleep 0.1; done
+    PTY=$(cat "$TMP/pty" 2>/dev/null)
+
+    PINGS_RUN=$PINGS
+    FLASH=262144
+    if [ "$RATE" != "0" ]; then
+        PINGS_RUN=$((PINGS / 10))
+        FLASH=32768
+    fi
+    HOME="$TMP" timeout 300 "$CLIENT" "$PTY" -d 1 -c "hw latency n $PINGS_RUN; data samples 39999; mem dump o 0 l $FLASH f $TMP/dump" > "$TMP/out.log" 2>&1
+    kill $SIMPID 2>/dev/null
+    wait $SIMPID 2>/dev/null
+
+    CMDS=$(sed -n 's/.*pings, .* \([0-9.]*\) commands\/s.*/\1/p' "$TMP/out.log")
+    PCT=$(sed -n 's/.*percentiles p50 \([0-9.]*\) ms, p90 \([0-9.]*\) ms, p99 \([0-9.]*\) ms.*/\1 \2 \3/p' "$TMP/out.log")
+    DL=$(sed -n 's/.*Downloaded .* \([0-9.]*\) kB\/s.*/\1/p' "$TMP/out.log" | tr '\n' ' ')
+    read -r P50 P90 P99 <<< "$PCT"
+    read -r DL_SAMPLES DL_FLASH <<< "$DL"
+    if [ -z "$CMDS" ] || [ -z "$P99" ] || [ -z "$DL_FLASH" ]; then
+        echo "$NAME: FAILED, client output:"
+        cat "$TMP/out.log"
+        FAILED=1
+        continue
+    fi
+    printf "%-16s %10s %9s %9s %9s %14s %14s\n" "$NAME" "$CMDS" "$P50" "$P90" "$P99" "$DL_SAMPLES" "$DL_FLASH"
+done
+exit $FAILED